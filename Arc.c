@@ -142,6 +142,22 @@ Arc Arc__new(String from) {
     return arc;
 }
 
+/// @brief Returns the *Tag* at the other end of *arc* from *tag*.
+/// @param arc is the *Arc* to use.
+/// @param tag is one end of *arc*.
+/// @returns the other end of *arc*.
+///
+/// *Arc__other_tag*() will return *to_tag* of *arc* if *tag* is the
+/// *from_tag* and *from_tag* otherwise.
+
+Tag Arc__other_tag(Arc arc, Tag tag) {
+    Tag other_tag = arc->from_tag;
+    if (other_tag == tag) {
+	other_tag = arc->to_tag;
+    }
+    return other_tag;
+}
+
 /// @brief Read in an XML <Arc.../> tag from *in_file*.
 /// @param in_file is the file to read from.
 /// @param map is contains the Tag associations.
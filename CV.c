@@ -1,6 +1,7 @@
 // Copyright (c) 2010, 2013 by Wayne C. Gramlich.  All rights reserved.
 
 #include <assert.h>
+#include <math.h>
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 #include <string.h>
@@ -13,14 +14,10 @@
 #include "Logical.h"
 #include "String.h"
 
-static CvSlice whole_sequence;		// CV_WHOLE_SEQ (see below)
+// CV_WHOLE_SEQ is a function call, so it can not initialize a static:
+static CvSlice whole_sequence = {0, CV_WHOLE_SEQ_END_INDEX};
 CV_Slice CV__whole_seq = &whole_sequence;
 
-void CV_Slice__Initialize(void)
-{
-    whole_sequence = CV_WHOLE_SEQ;
-}
-
 // Depth constants:
 Integer CV__depth_1u = IPL_DEPTH_1U;
 Integer CV__depth_8u = IPL_DEPTH_8U;
@@ -291,22 +288,18 @@ void CV__set_zero(CV_Matrix matrix) {
     cvSetZero(matrix);
 }
 
-Integer CV__round(Double value) {
-    return cvRound(value);
-}
-
-// Read the calibration file and generate the undistortion maps
-// in:
-//   calibrate_file_name   -  camera calibration file
-//   w h                   -  width and height of images to undistort
-// out:
-//   mapx, mapy,           - undistortion maps
+/// @brief Read the lens calibration in *calibrate_file_name* into *lens*.
+/// @param calibrate_file_name is the camera calibration file to read.
+/// @param lens is where the 8 (*CV_LENS_SIZE*) lens parameters are stored.
+/// @returns 0 on success and -1 on failure.
+///
+/// *CV__lens_calibrate_read*() will read the focal lengths (fc), principal
+/// point (cc) and distortion coefficients (kc) from *calibrate_file_name*
+/// and store them into *lens* in the order fcx, fcy, ccx, ccy, k1, k2, p1,
+/// p2.  The file format is "fc %f %f cc %f %f kc %f %f %f %f".
 
-Integer CV__undistortion_setup(String_Const calibrate_file_name,
- Integer width, Integer height, CV_Image *mapx, CV_Image *mapy) {
-    Double fcx, fcy, ccx, ccy;
-    Double kc[4];
-  
+Integer CV__lens_calibrate_read(
+  String_Const calibrate_file_name, Double *lens) {
     // Open *calibrate_file_name*:
     File file = File__open(calibrate_file_name, "r");
     if (file == (File)0) {
@@ -317,12 +310,153 @@ Integer CV__undistortion_setup(String_Const calibrate_file_name,
     // Scan in the calibration values:
     //  format is fc - focal length, cc, principal point, kc distortion vector
     int x = fscanf(file, "fc %lf %lf cc %lf %lf kc %lf %lf %lf %lf", 
-       &fcx, &fcy, &ccx, &ccy, &kc[0], &kc[1], &kc[2], &kc[3]);
+       &lens[0], &lens[1], &lens[2], &lens[3],
+       &lens[4], &lens[5], &lens[6], &lens[7]);
+    File__close(file);
     if (x != 8) {
         File__format(stderr, "Expected 8 parameters got %d\n", x);
         return -1;
     }
-    File__close(file);
+    return 0;
+}
+
+/// @brief Apply the lens distortion in *lens* to the point (*x*, *y*).
+/// @param lens is the 8 lens parameters from *CV__lens_calibrate_read*().
+/// @param x is the undistorted X coordinate, replaced by the distorted one.
+/// @param y is the undistorted Y coordinate, replaced by the distorted one.
+///
+/// *CV__lens_distort*() will map the undistorted image point (*x*, *y*) to
+/// where it lands in the distorted camera image.  This is the same mapping
+/// that *CV__undistortion_setup*() stores into its maps, so sampling the
+/// distorted image at the returned point is the same as sampling the
+/// undistorted image at the original point.
+
+void CV__lens_distort(Double *lens, Double *x, Double *y) {
+    Double fcx = lens[0];
+    Double fcy = lens[1];
+    Double ccx = lens[2];
+    Double ccy = lens[3];
+    Double k1 = lens[4];
+    Double k2 = lens[5];
+    Double p1 = lens[6];
+    Double p2 = lens[7];
+
+    // Convert to normalized camera coordinates, distort, and convert back:
+    Double nx = (*x - ccx) / fcx;
+    Double ny = (*y - ccy) / fcy;
+    Double r2 = nx * nx + ny * ny;
+    Double radial = 1.0 + (k1 + k2 * r2) * r2;
+    Double dx = nx * radial + 2.0 * p1 * nx * ny + p2 * (r2 + 2.0 * nx * nx);
+    Double dy = ny * radial + p1 * (r2 + 2.0 * ny * ny) + 2.0 * p2 * nx * ny;
+    *x = fcx * dx + ccx;
+    *y = fcy * dy + ccy;
+}
+
+/// @brief Remove the lens distortion in *lens* from the point (*x*, *y*).
+/// @param lens is the 8 lens parameters from *CV__lens_calibrate_read*().
+/// @param x is the distorted X coordinate, replaced by the undistorted one.
+/// @param y is the distorted Y coordinate, replaced by the undistorted one.
+///
+/// *CV__lens_undistort*() is the inverse of *CV__lens_distort*().  There
+/// is no closed form, so it uses the same fixed point iteration as
+/// OpenCV's *cvUndistortPoints*(), which converges quickly for the amount
+/// of distortion in our lenses.
+
+void CV__lens_undistort(Double *lens, Double *x, Double *y) {
+    Double fcx = lens[0];
+    Double fcy = lens[1];
+    Double ccx = lens[2];
+    Double ccy = lens[3];
+    Double k1 = lens[4];
+    Double k2 = lens[5];
+    Double p1 = lens[6];
+    Double p2 = lens[7];
+
+    // Iterate starting from the distorted normalized coordinates:
+    Double x0 = (*x - ccx) / fcx;
+    Double y0 = (*y - ccy) / fcy;
+    Double nx = x0;
+    Double ny = y0;
+    for (Unsigned iteration = 0; iteration < 20; iteration++) {
+	Double r2 = nx * nx + ny * ny;
+	Double radial = 1.0 + (k1 + k2 * r2) * r2;
+	Double delta_x = 2.0 * p1 * nx * ny + p2 * (r2 + 2.0 * nx * nx);
+	Double delta_y = p1 * (r2 + 2.0 * ny * ny) + 2.0 * p2 * nx * ny;
+	nx = (x0 - delta_x) / radial;
+	ny = (y0 - delta_y) / radial;
+    }
+    *x = fcx * nx + ccx;
+    *y = fcy * ny + ccy;
+}
+
+/// @brief Return a nearest neighbor remap table for *map_x* and *map_y*.
+/// @param map_x is the 32-bit float source X map (or null for none).
+/// @param map_y is the 32-bit float source Y map (or null for none).
+/// @param width is the image width.
+/// @param height is the image height.
+/// @returns a new *width* by *height* remap table.
+///
+/// *CV__remap_table_create*() will return a table with one entry per
+/// destination pixel, in row major order.  Each entry is the source pixel
+/// that *CV_Image__remap*() with *CV_INTER_NN* would fetch, packed as
+/// (y << 16) | x, or *CV_REMAP_OUTSIDE* if it falls outside of the source
+/// image.  If *map_x* is null, the identity table is returned.  The
+/// returned table is released with *Memory__free*().
+
+Unsigned *CV__remap_table_create(
+  CV_Image map_x, CV_Image map_y, Integer width, Integer height) {
+    assert (width > 0 && width <= 0xffff && height > 0 && height <= 0xffff);
+    Unsigned *remap_table = (Unsigned *)Memory__allocate(
+      (Unsigned)(width * height) * sizeof(Unsigned), "CV__remap_table_create");
+    Unsigned *remap_entry = remap_table;
+    for (Integer y = 0; y < height; y++) {
+	float *x_row = (float *)0;
+	float *y_row = (float *)0;
+	if (map_x != (CV_Image)0) {
+	    x_row = (float *)(map_x->imageData + map_x->widthStep * y);
+	    y_row = (float *)(map_y->imageData + map_y->widthStep * y);
+	}
+	for (Integer x = 0; x < width; x++) {
+	    // Round the same way that the OpenCV nearest neighbor remap does:
+	    Integer source_x = x;
+	    Integer source_y = y;
+	    if (x_row != (float *)0) {
+		source_x = CV__round((Double)x_row[x]);
+		source_y = CV__round((Double)y_row[x]);
+	    }
+	    Unsigned entry = CV_REMAP_OUTSIDE;
+	    if (0 <= source_x && source_x < width &&
+	      0 <= source_y && source_y < height) {
+		entry = ((Unsigned)source_y << 16) | (Unsigned)source_x;
+	    }
+	    *remap_entry++ = entry;
+	}
+    }
+    return remap_table;
+}
+
+Integer CV__round(Double value) {
+    return cvRound(value);
+}
+
+// Read the calibration file and generate the undistortion maps
+// in:
+//   calibrate_file_name   -  camera calibration file
+//   w h                   -  width and height of images to undistort
+// out:
+//   mapx, mapy,           - undistortion maps
+
+Integer CV__undistortion_setup(String_Const calibrate_file_name,
+ Integer width, Integer height, CV_Image *mapx, CV_Image *mapy) {
+    Double lens[CV_LENS_SIZE];
+    if (CV__lens_calibrate_read(calibrate_file_name, lens) != 0) {
+	return -1;
+    }
+    Double fcx = lens[0];
+    Double fcy = lens[1];
+    Double ccx = lens[2];
+    Double ccy = lens[3];
+    Double *kc = lens + 4;
     
     // Create *intrisic* matrix:
     double intrinsic_vector[9] = {
@@ -355,6 +489,125 @@ void CV_Image__adaptive_threshold(CV_Image source_image,
       adaptive_method, threshold_type, block_size, parameter1);
 }
 
+/// @brief Threshold *source_image* against the mean of a box around each
+///        pixel.
+/// @param source_image is the 8-bit gray scale image to threshold.
+/// @param destination_image is the 8-bit image to store the results into.
+/// @param maximum_value is the value stored for pixels above threshold.
+/// @param block_size is the odd width and height of the box.
+/// @param parameter1 is subtracted from the box mean to get the threshold.
+/// @param band_count is the number of row bands to process in parallel.
+///
+/// *CV_Image__box_threshold*() is a faster replacement for
+/// *CV_Image__adaptive_threshold*() with *CV__adaptive_thresh_mean_c* and
+/// *CV__thresh_binary*.  Each pixel of *destination_image* is set to
+/// *maximum_value* if the matching pixel in *source_image* is greater than
+/// the rounded mean of the *block_size* by *block_size* box around it minus
+/// *parameter1*, and 0 otherwise.  As with OpenCV, pixels past the image
+/// edge replicate the nearest edge pixel.  The box sums are kept as
+/// running column sums, so the cost per pixel does not depend upon
+/// *block_size*.  The rows are split into *band_count* bands which are
+/// processed by separate threads; the results do not depend upon
+/// *band_count*.
+
+void CV_Image__box_threshold(CV_Image source_image,
+  CV_Image destination_image, Integer maximum_value, Integer block_size,
+  Double parameter1, Unsigned band_count) {
+    assert (source_image->nChannels == 1 && source_image->depth == 8);
+    assert (destination_image->nChannels == 1 &&
+      destination_image->depth == 8);
+    assert (source_image->width == destination_image->width &&
+      source_image->height == destination_image->height);
+    assert (block_size > 1 && (block_size & 1) == 1);
+
+    // Clamp *band_count* so that every band has at least one row:
+    Integer height = source_image->height;
+    if (band_count < 1) {
+	band_count = 1;
+    }
+    if (band_count > CV_THRESHOLD_BANDS_MAXIMUM) {
+	band_count = CV_THRESHOLD_BANDS_MAXIMUM;
+    }
+    if ((Integer)band_count > height) {
+	band_count = (Unsigned)height;
+    }
+
+    // Split the rows into *band_count* bands:
+    Double delta = ceil(parameter1);
+    struct CV_Threshold_Band__Struct bands[CV_THRESHOLD_BANDS_MAXIMUM];
+    for (Unsigned index = 0; index < band_count; index++) {
+	CV_Threshold_Band band = &bands[index];
+	band->block_size = block_size;
+	band->delta = (Integer)delta;
+	band->destination_image = destination_image;
+	band->end_column = source_image->width;
+	band->end_row = height * (Integer)(index + 1) / (Integer)band_count;
+	band->maximum_value = maximum_value;
+	band->source_image = source_image;
+	band->start_column = 0;
+	band->start_row = height * (Integer)index / (Integer)band_count;
+    }
+
+    // Process the first band on this thread and the rest in parallel:
+    for (Unsigned index = 1; index < band_count; index++) {
+	CV_Threshold_Band band = &bands[index];
+	Integer result = pthread_create(&band->thread,
+	  (pthread_attr_t *)0, CV_Threshold_Band__process, (void *)band);
+	assert (result == 0);
+    }
+    CV_Threshold_Band__process((void *)&bands[0]);
+    for (Unsigned index = 1; index < band_count; index++) {
+	Integer result = pthread_join(bands[index].thread, (void **)0);
+	assert (result == 0);
+    }
+}
+
+/// @brief Threshold a rectangle of *source_image* against the mean of a
+///        box around each pixel.
+/// @param source_image is the 8-bit gray scale image to threshold.
+/// @param destination_image is the 8-bit image to store the results into.
+/// @param maximum_value is the value stored for pixels above threshold.
+/// @param block_size is the odd width and height of the box.
+/// @param parameter1 is subtracted from the box mean to get the threshold.
+/// @param x is the left column of the rectangle.
+/// @param y is the top row of the rectangle.
+/// @param width is the width of the rectangle.
+/// @param height is the height of the rectangle.
+///
+/// *CV_Image__box_threshold_rectangle*() will threshold just the *width*
+/// by *height* rectangle at (*x*, *y*) of *source_image* into the same
+/// rectangle of *destination_image*; the rest of *destination_image* is
+/// left alone.  The boxes still reach outside of the rectangle, so the
+/// results are identical to the same pixels from
+/// *CV_Image__box_threshold*().  The rectangle is processed on this thread.
+
+void CV_Image__box_threshold_rectangle(CV_Image source_image,
+  CV_Image destination_image, Integer maximum_value, Integer block_size,
+  Double parameter1, Integer x, Integer y, Integer width, Integer height) {
+    assert (source_image->nChannels == 1 && source_image->depth == 8);
+    assert (destination_image->nChannels == 1 &&
+      destination_image->depth == 8);
+    assert (source_image->width == destination_image->width &&
+      source_image->height == destination_image->height);
+    assert (block_size > 1 && (block_size & 1) == 1);
+    assert (x >= 0 && y >= 0 && width > 0 && height > 0);
+    assert (x + width <= source_image->width &&
+      y + height <= source_image->height);
+
+    Double delta = ceil(parameter1);
+    struct CV_Threshold_Band__Struct band;
+    band.block_size = block_size;
+    band.delta = (Integer)delta;
+    band.destination_image = destination_image;
+    band.end_column = x + width;
+    band.end_row = y + height;
+    band.maximum_value = maximum_value;
+    band.source_image = source_image;
+    band.start_column = x;
+    band.start_row = y;
+    CV_Threshold_Band__process((void *)&band);
+}
+
 void CV_Image__blob_draw(
   CV_Image image, Integer x, Integer y, CV_Scalar color) {
     // Draw a small cross at the indicated point.
@@ -476,6 +729,68 @@ Unsigned CV_Image__fetch3(
     return pointer[channel];
 }
 
+/// @brief Shrink *source_image* by *scale* averaging *scale* x *scale* blocks.
+/// @param source_image is the 8-bit gray scale image to shrink.
+/// @param destination_image is the 8-bit gray scale result image.
+/// @param scale is the decimation factor.
+///
+/// *CV_Image__gray_decimate*() will set each pixel of *destination_image*
+/// to the rounded average of the *scale* x *scale* block of *source_image*
+/// pixels that it covers.  *destination_image* must be *scale* times
+/// smaller than *source_image* (rounded down); any leftover columns and
+/// rows on the right and bottom of *source_image* are ignored.  Pixel
+/// (*x*, *y*) of *destination_image* is centered on the *source_image*
+/// point (*scale* * *x* + (*scale* - 1) / 2, *scale* * *y* +
+/// (*scale* - 1) / 2).
+
+void CV_Image__gray_decimate(
+  CV_Image source_image, CV_Image destination_image, Unsigned scale) {
+    Integer width = destination_image->width;
+    Integer height = destination_image->height;
+    Integer factor = (Integer)scale;
+    assert (factor >= 1);
+    assert (source_image->nChannels == 1 && source_image->depth == 8);
+    assert (destination_image->nChannels == 1 &&
+      destination_image->depth == 8);
+    assert (source_image->width / factor == width &&
+      source_image->height / factor == height);
+    uchar *source_data = (uchar *)source_image->imageData;
+    Integer source_step = source_image->widthStep;
+    uchar *destination_data = (uchar *)destination_image->imageData;
+    Integer destination_step = destination_image->widthStep;
+    Unsigned area = scale * scale;
+    Unsigned half_area = area >> 1;
+
+    // *sums* accumulates the column sums of *factor* source rows:
+    Unsigned *sums = (Unsigned *)Memory__allocate(
+      (Unsigned)width * scale * sizeof(Unsigned), "CV_Image__gray_decimate");
+    Integer source_width = width * factor;
+    for (Integer y = 0; y < height; y++) {
+	uchar *source_row = source_data + source_step * y * factor;
+	for (Integer x = 0; x < source_width; x++) {
+	    sums[x] = (Unsigned)source_row[x];
+	}
+	for (Integer row = 1; row < factor; row++) {
+	    source_row += source_step;
+	    for (Integer x = 0; x < source_width; x++) {
+		sums[x] += (Unsigned)source_row[x];
+	    }
+	}
+
+	// Add up each group of *factor* column sums:
+	uchar *destination_row = destination_data + destination_step * y;
+	for (Integer x = 0; x < width; x++) {
+	    Unsigned *block = sums + x * factor;
+	    Unsigned sum = 0;
+	    for (Integer column = 0; column < factor; column++) {
+		sum += block[column];
+	    }
+	    destination_row[x] = (uchar)((sum + half_area) / area);
+	}
+    }
+    Memory__free((Memory)sums);
+}
+
 Integer CV_Image__gray_fetch(CV_Image image, Integer x, Integer y) {
     Integer result = -1;
     if (0 <= x && x < image->width && 0 <= y && y < image->height) {
@@ -485,6 +800,519 @@ Integer CV_Image__gray_fetch(CV_Image image, Integer x, Integer y) {
     return result;
 }
 
+/// @brief Return the bilinearly interpolated gray value at (*x*, *y*).
+/// @param image is the 8-bit gray scale image to sample.
+/// @param x is the X coordinate to sample at.
+/// @param y is the Y coordinate to sample at.
+/// @returns the interpolated gray value.
+///
+/// *CV_Image__gray_interpolate*() will return the gray value of *image*
+/// at (*x*, *y*) interpolated from the 4 surrounding pixel centers.
+/// There is no bounds checking; (*x*, *y*) must be in the range
+/// [0, width - 1) x [0, height - 1).
+
+Double CV_Image__gray_interpolate(CV_Image image, Double x, Double y) {
+    Integer x0 = (Integer)x;
+    Integer y0 = (Integer)y;
+    Double dx = x - (Double)x0;
+    Double dy = y - (Double)y0;
+    Integer width_step = image->widthStep;
+    uchar *top = (uchar *)image->imageData + width_step * y0 + x0;
+    uchar *bottom = top + width_step;
+    Double upper = (Double)top[0] + dx * (Double)(top[1] - top[0]);
+    Double lower = (Double)bottom[0] + dx * (Double)(bottom[1] - bottom[0]);
+    return upper + dy * (lower - upper);
+}
+
+/// @brief Refine the corners of a dark quadrilateral by fitting its edges.
+/// @param image is the 8-bit gray scale image containing the quadrilateral.
+/// @param corners are the 4 rough corners to refine.
+/// @param search_distance is how far (in pixels) the true edges can be
+/// from the rough edges.
+/// @returns (*Logical*)1 if *corners* was refined and (*Logical*)0 otherwise.
+///
+/// *CV_Image__corners_line_fit*() will refine the 4 *corners* of a dark
+/// quadrilateral on a light background (i.e. a tag) to sub-pixel accuracy.
+/// Each side is sampled at up to *CV_LINE_FIT_SAMPLES_MAXIMUM* points
+/// away from its ends.  At each sample point the gray levels are scanned
+/// along the side normal for *search_distance* pixels both ways, and the
+/// steepest dark to light step going outward is located to sub-pixel
+/// accuracy with a parabola fit.  A straight line is fit through these
+/// edge points (weighted by their step sizes) and the refined corners
+/// are the intersections of adjacent side lines.  This is one pass per
+/// side rather than an iterative solve per corner.  If a side does not
+/// have enough edge points, two adjacent sides are nearly parallel, or a
+/// corner would move by more than 2 * *search_distance*, *corners* is
+/// left unchanged and (*Logical*)0 is returned.
+
+Logical CV_Image__corners_line_fit(
+  CV_Image image, CV_Point2D32F_Vector corners, Double search_distance) {
+    // Grab the rough corners and their center:
+    Double xs[4];
+    Double ys[4];
+    Double center_x = 0.0;
+    Double center_y = 0.0;
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	xs[index] = CV_Point2D32F__x_get(corner);
+	ys[index] = CV_Point2D32F__y_get(corner);
+	center_x += xs[index] / 4.0;
+	center_y += ys[index] / 4.0;
+    }
+
+    // The scan along each normal goes both ways in half pixel *steps* out
+    // to *search_distance* (but no further than 16 pixels):
+    Integer steps = (Integer)(2.0 * search_distance + 0.5);
+    if (steps < 2) {
+	steps = 2;
+    } else if (steps > 32) {
+	steps = 32;
+    }
+    Integer scan_size = 2 * steps + 1;
+    Double scan[2 * 32 + 1];
+    Double x_limit = (Double)(image->width - 1);
+    Double y_limit = (Double)(image->height - 1);
+
+    // Fit a line (*a* * x + *b* * y = *c*) to each side:
+    Double as[4];
+    Double bs[4];
+    Double cs[4];
+    for (Unsigned side = 0; side < 4; side++) {
+	Unsigned next = (side + 1) & 3;
+	Double x0 = xs[side];
+	Double y0 = ys[side];
+	Double dx = xs[next] - x0;
+	Double dy = ys[next] - y0;
+	Double length = sqrt(dx * dx + dy * dy);
+	if (length < 4.0) {
+	    return (Logical)0;
+	}
+	Double tangent_x = dx / length;
+	Double tangent_y = dy / length;
+
+	// Point the normal away from the center:
+	Double normal_x = -tangent_y;
+	Double normal_y = tangent_x;
+	if (normal_x * (x0 + dx / 2.0 - center_x) +
+	  normal_y * (y0 + dy / 2.0 - center_y) < 0.0) {
+	    normal_x = -normal_x;
+	    normal_y = -normal_y;
+	}
+
+	// Stay away from the corners, where the two edges blur together:
+	Unsigned samples = (Unsigned)(length / 2.0);
+	if (samples > CV_LINE_FIT_SAMPLES_MAXIMUM) {
+	    samples = CV_LINE_FIT_SAMPLES_MAXIMUM;
+	} else if (samples < 4) {
+	    samples = 4;
+	}
+	Double start = 0.15 * length;
+	Double spacing = 0.7 * length / (Double)(samples - 1);
+
+	// Accumulate the weighted edge points:
+	Double sum_w = 0.0;
+	Double sum_x = 0.0;
+	Double sum_y = 0.0;
+	Double sum_xx = 0.0;
+	Double sum_xy = 0.0;
+	Double sum_yy = 0.0;
+	Unsigned points = 0;
+	for (Unsigned sample = 0; sample < samples; sample++) {
+	    Double distance = start + spacing * (Double)sample;
+	    Double sample_x = x0 + distance * tangent_x;
+	    Double sample_y = y0 + distance * tangent_y;
+
+	    // Make sure that the whole scan is inside of *image*:
+	    Double reach = (Double)steps / 2.0;
+	    Double low_x = sample_x - reach * fabs(normal_x);
+	    Double high_x = sample_x + reach * fabs(normal_x);
+	    Double low_y = sample_y - reach * fabs(normal_y);
+	    Double high_y = sample_y + reach * fabs(normal_y);
+	    if (low_x < 0.0 || high_x >= x_limit ||
+	      low_y < 0.0 || high_y >= y_limit) {
+		continue;
+	    }
+
+	    // Scan inside to outside along the normal:
+	    for (Integer step = 0; step < scan_size; step++) {
+		Double offset = (Double)(step - steps) / 2.0;
+		scan[step] = CV_Image__gray_interpolate(image,
+		  sample_x + offset * normal_x, sample_y + offset * normal_y);
+	    }
+
+	    // Find the steepest dark to light step (over 1 pixel) leaving
+	    // room on both sides for the parabola fit:
+	    Integer best_step = 0;
+	    Double best_gradient = (Double)CV_LINE_FIT_STEP_MINIMUM;
+	    for (Integer step = 2; step + 2 < scan_size; step++) {
+		Double gradient = scan[step + 1] - scan[step - 1];
+		if (gradient > best_gradient) {
+		    best_gradient = gradient;
+		    best_step = step;
+		}
+	    }
+	    if (best_step == 0) {
+		continue;
+	    }
+
+	    // Fit a parabola through the gradients around the peak:
+	    Double before = scan[best_step] - scan[best_step - 2];
+	    Double after = scan[best_step + 2] - scan[best_step];
+	    Double curvature = before - 2.0 * best_gradient + after;
+	    Double peak = 0.0;
+	    if (curvature < 0.0) {
+		peak = 0.5 * (before - after) / curvature;
+	    }
+	    Double offset = ((Double)(best_step - steps) + peak) / 2.0;
+	    Double edge_x = sample_x + offset * normal_x;
+	    Double edge_y = sample_y + offset * normal_y;
+	    sum_w += best_gradient;
+	    sum_x += best_gradient * edge_x;
+	    sum_y += best_gradient * edge_y;
+	    sum_xx += best_gradient * edge_x * edge_x;
+	    sum_xy += best_gradient * edge_x * edge_y;
+	    sum_yy += best_gradient * edge_y * edge_y;
+	    points += 1;
+	}
+	if (points < 3) {
+	    return (Logical)0;
+	}
+
+	// The line goes through the mean edge point along the principal
+	// axis of the edge point covariance:
+	Double mean_x = sum_x / sum_w;
+	Double mean_y = sum_y / sum_w;
+	Double covariance_xx = sum_xx / sum_w - mean_x * mean_x;
+	Double covariance_xy = sum_xy / sum_w - mean_x * mean_y;
+	Double covariance_yy = sum_yy / sum_w - mean_y * mean_y;
+	Double angle = 0.5 *
+	  atan2(2.0 * covariance_xy, covariance_xx - covariance_yy);
+	as[side] = -sin(angle);
+	bs[side] = cos(angle);
+	cs[side] = as[side] * mean_x + bs[side] * mean_y;
+    }
+
+    // Each corner is the intersection of the sides on either side of it:
+    Double new_xs[4];
+    Double new_ys[4];
+    Double move_maximum = 2.0 * search_distance;
+    for (Unsigned index = 0; index < 4; index++) {
+	Unsigned previous = (index + 3) & 3;
+	Double determinant =
+	  as[previous] * bs[index] - bs[previous] * as[index];
+	if (fabs(determinant) < 0.1) {
+	    return (Logical)0;
+	}
+	Double x = (cs[previous] * bs[index] - bs[previous] * cs[index]) /
+	  determinant;
+	Double y = (as[previous] * cs[index] - cs[previous] * as[index]) /
+	  determinant;
+	if (fabs(x - xs[index]) > move_maximum ||
+	  fabs(y - ys[index]) > move_maximum) {
+	    return (Logical)0;
+	}
+	new_xs[index] = x;
+	new_ys[index] = y;
+    }
+
+    // Everything worked, so update *corners*:
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	CV_Point2D32F__x_set(corner, new_xs[index]);
+	CV_Point2D32F__y_set(corner, new_ys[index]);
+    }
+    return (Logical)1;
+}
+
+/// @brief Return a 3 by 3 weighted sum of the pixels around (*x*, *y*).
+/// @param image is the 8-bit gray scale image to read pixels from.
+/// @param x is the column of the middle pixel.
+/// @param y is the row of the middle pixel.
+/// @param weights is the 9 weights in row major order (top row first.)
+/// @returns the weighted sum of the 9 pixels.
+///
+/// *CV_Image__gray_weighted_sum*() will multiply each of the 9 pixels
+/// centered on (*x*, *y*) in *image* by the matching entry of *weights*
+/// and return the sum.  There is no bounds checking, so (*x*, *y*) must
+/// be at least one pixel in from each edge of *image*.
+
+Integer CV_Image__gray_weighted_sum(
+  CV_Image image, Integer x, Integer y, const Integer *weights) {
+    // No bounds checking; (*x*, *y*) must be at least one pixel inside:
+    Integer width_step = image->widthStep;
+    uchar *middle = (uchar *)image->imageData + width_step * y + x;
+    uchar *above = middle - width_step;
+    uchar *below = middle + width_step;
+    return
+      above[-1] * weights[0] + above[0] * weights[1] + above[1] * weights[2] +
+      middle[-1] * weights[3] + middle[0] * weights[4] +
+      middle[1] * weights[5] + below[-1] * weights[6] +
+      below[0] * weights[7] + below[1] * weights[8];
+}
+
+/// @brief Fetch one remapped row of *source_image* as gray scale.
+/// @param source_image is the 8-bit gray scale or BGR image to fetch from.
+/// @param remap_row is the *width* remap table entries for the row.
+/// @param width is the number of pixels in the row.
+/// @param gray_row is where the *width* gray scale pixels are stored.
+///
+/// *CV_Image__gray_remap_row*() will fetch the source pixel for each entry
+/// in *remap_row* (see *CV__remap_table_create*()), convert it to gray
+/// scale and store it into *gray_row*.  Entries that are
+/// *CV_REMAP_OUTSIDE* are stored as 0 (black).  The gray scale conversion
+/// is the same fixed point conversion that *CV_Image__convert_color*()
+/// does for *CV__rgb_to_gray*.
+
+void CV_Image__gray_remap_row(CV_Image source_image,
+  Unsigned *remap_row, Integer width, unsigned char *gray_row) {
+    uchar *source_data = (uchar *)source_image->imageData;
+    Unsigned source_step = (Unsigned)source_image->widthStep;
+    if (source_image->nChannels == 3) {
+	for (Integer x = 0; x < width; x++) {
+	    Unsigned entry = remap_row[x];
+	    uchar gray = 0;
+	    if (entry != CV_REMAP_OUTSIDE) {
+		uchar *pixel = source_data +
+		  (entry >> 16) * source_step + (entry & 0xffff) * 3;
+		gray = (uchar)((pixel[0] * 4899 + pixel[1] * 9617 +
+		  pixel[2] * 1868 + 8192) >> 14);
+	    }
+	    gray_row[x] = gray;
+	}
+    } else {
+	assert (source_image->nChannels == 1);
+	for (Integer x = 0; x < width; x++) {
+	    Unsigned entry = remap_row[x];
+	    uchar gray = 0;
+	    if (entry != CV_REMAP_OUTSIDE) {
+		gray =
+		  source_data[(entry >> 16) * source_step + (entry & 0xffff)];
+	    }
+	    gray_row[x] = gray;
+	}
+    }
+}
+
+/// @brief Convert *source_image* to gray scale, undistort it and blur it
+///        in one pass.
+/// @param source_image is the 8-bit gray scale or BGR image to convert.
+/// @param destination_image is the 8-bit gray scale image to store into.
+/// @param remap_table is the remap table from *CV__remap_table_create*().
+/// @param blur is (*Logical*)1 to apply a 3x3 Gaussian blur.
+/// @param band_count is the number of row bands to process in parallel.
+///
+/// *CV_Image__gray_undistort_smooth*() computes the same image as
+/// *CV_Image__convert_color*() with *CV__rgb_to_gray*, followed by
+/// *CV_Image__remap*() with *CV_INTER_NN* | *CV_WARP_FILL_OUTLIERS* and
+/// a black fill, followed (if *blur* is set) by *CV_Image__smooth*() with
+/// a 3x3 *CV__gaussian*.  Rather than making three passes over full size
+/// images, each gray scale undistorted row is computed once into a
+/// rolling window of 3 rows that stays in cache, and the blurred row is
+/// written straight into *destination_image*.  Only the source pixels
+/// that are actually used are converted to gray scale.  As with OpenCV,
+/// the blur reflects about the edge pixels (i.e. *BORDER_REFLECT_101*)
+/// and rounds the weighted sum of 16 to nearest.  When *band_count* is
+/// more than 1, the rows are split into *band_count* bands that are
+/// converted by separate threads with
+/// *CV_Image__gray_undistort_smooth_rectangle*(), which reaches one row
+/// past each end of its band for the blur; the results do not depend
+/// upon *band_count*.
+
+void CV_Image__gray_undistort_smooth(CV_Image source_image,
+  CV_Image destination_image, Unsigned *remap_table, Logical blur,
+  Unsigned band_count) {
+    Integer width = destination_image->width;
+    Integer height = destination_image->height;
+    assert (destination_image->nChannels == 1 &&
+      destination_image->depth == 8);
+    assert (source_image->width == width && source_image->height == height);
+
+    // Clamp *band_count* so that every band has at least one row:
+    if (band_count > CV_THRESHOLD_BANDS_MAXIMUM) {
+	band_count = CV_THRESHOLD_BANDS_MAXIMUM;
+    }
+    if ((Integer)band_count > height) {
+	band_count = (Unsigned)height;
+    }
+
+    // Split the rows into *band_count* bands and process the first band
+    // on this thread and the rest in parallel:
+    if (band_count > 1) {
+	struct CV_Gray_Band__Struct bands[CV_THRESHOLD_BANDS_MAXIMUM];
+	for (Unsigned index = 0; index < band_count; index++) {
+	    CV_Gray_Band band = &bands[index];
+	    band->blur = blur;
+	    band->destination_image = destination_image;
+	    band->end_row = height * (Integer)(index + 1) / (Integer)band_count;
+	    band->remap_table = remap_table;
+	    band->source_image = source_image;
+	    band->start_row = height * (Integer)index / (Integer)band_count;
+	}
+	for (Unsigned index = 1; index < band_count; index++) {
+	    CV_Gray_Band band = &bands[index];
+	    Integer result = pthread_create(&band->thread,
+	      (pthread_attr_t *)0, CV_Gray_Band__process, (void *)band);
+	    assert (result == 0);
+	}
+	CV_Gray_Band__process((void *)&bands[0]);
+	for (Unsigned index = 1; index < band_count; index++) {
+	    Integer result = pthread_join(bands[index].thread, (void **)0);
+	    assert (result == 0);
+	}
+	return;
+    }
+    uchar *destination_data = (uchar *)destination_image->imageData;
+    Integer destination_step = destination_image->widthStep;
+
+    // Without a blur, the rows go straight into *destination_image*:
+    if (!blur) {
+	for (Integer y = 0; y < height; y++) {
+	    CV_Image__gray_remap_row(source_image, remap_table + width * y,
+	      width, destination_data + destination_step * y);
+	}
+	return;
+    }
+    assert (width >= 2 && height >= 2);
+
+    // *rows* is a rolling window where row y lives at *rows*[y % 3]
+    // and *sums* holds the vertical 1-2-1 sums of the current row:
+    uchar *rows = (uchar *)Memory__allocate(
+      3 * (Unsigned)width, "CV_Image__gray_undistort_smooth");
+    Unsigned *sums = (Unsigned *)Memory__allocate(
+      (Unsigned)(width + 2) * sizeof(Unsigned),
+      "CV_Image__gray_undistort_smooth");
+
+    // Prime the window with rows 0 and 1:
+    CV_Image__gray_remap_row(source_image, remap_table, width, rows);
+    CV_Image__gray_remap_row(
+      source_image, remap_table + width, width, rows + width);
+
+    for (Integer y = 0; y < height; y++) {
+	// Fetch row y + 1 into the window, if it exists:
+	if (y + 1 < height && y >= 1) {
+	    CV_Image__gray_remap_row(source_image,
+	      remap_table + width * (y + 1), width,
+	      rows + width * ((y + 1) % 3));
+	}
+
+	// Select the rows above and below reflecting about the edges:
+	Integer above_y = (y == 0) ? 1 : y - 1;
+	Integer below_y = (y == height - 1) ? height - 2 : y + 1;
+	uchar *above = rows + width * (above_y % 3);
+	uchar *middle = rows + width * (y % 3);
+	uchar *below = rows + width * (below_y % 3);
+
+	// Vertical sums with one reflected column on each side:
+	for (Integer x = 0; x < width; x++) {
+	    sums[x + 1] = (Unsigned)above[x] +
+	      2 * (Unsigned)middle[x] + (Unsigned)below[x];
+	}
+	sums[0] = sums[2];
+	sums[width + 1] = sums[width - 1];
+
+	// Horizontal sums:
+	uchar *destination_row = destination_data + destination_step * y;
+	for (Integer x = 0; x < width; x++) {
+	    destination_row[x] =
+	      (uchar)((sums[x] + 2 * sums[x + 1] + sums[x + 2] + 8) >> 4);
+	}
+    }
+
+    Memory__free((Memory)rows);
+    Memory__free((Memory)sums);
+}
+
+/// @brief Convert a rectangle of *source_image* to gray scale, undistort
+///        it and blur it.
+/// @param source_image is the 8-bit gray scale or BGR image to convert.
+/// @param destination_image is the 8-bit gray scale image to store into.
+/// @param remap_table is the remap table from *CV__remap_table_create*().
+/// @param blur is (*Logical*)1 to apply a 3x3 Gaussian blur.
+/// @param left is the left column of the rectangle.
+/// @param top is the top row of the rectangle.
+/// @param width is the width of the rectangle.
+/// @param height is the height of the rectangle.
+///
+/// *CV_Image__gray_undistort_smooth_rectangle*() will compute just the
+/// *width* by *height* rectangle at (*left*, *top*) of the image that
+/// *CV_Image__gray_undistort_smooth*() computes; the rest of
+/// *destination_image* is left alone.  The rectangle (plus a one pixel
+/// border for the blur, reflected about the image edges) is undistorted
+/// into a scratch buffer and then blurred into *destination_image*, so
+/// the results are identical to the same pixels of the whole image.
+
+void CV_Image__gray_undistort_smooth_rectangle(CV_Image source_image,
+  CV_Image destination_image, Unsigned *remap_table, Logical blur,
+  Integer left, Integer top, Integer width, Integer height) {
+    Integer image_width = destination_image->width;
+    Integer image_height = destination_image->height;
+    assert (destination_image->nChannels == 1 &&
+      destination_image->depth == 8);
+    assert (source_image->width == image_width &&
+      source_image->height == image_height);
+    assert (left >= 0 && top >= 0 && width > 0 && height > 0);
+    assert (left + width <= image_width && top + height <= image_height);
+    uchar *destination_data = (uchar *)destination_image->imageData;
+    Integer destination_step = destination_image->widthStep;
+
+    // Without a blur, the rows go straight into *destination_image*:
+    if (!blur) {
+	for (Integer y = top; y < top + height; y++) {
+	    CV_Image__gray_remap_row(source_image,
+	      remap_table + image_width * y + left, width,
+	      destination_data + destination_step * y + left);
+	}
+	return;
+    }
+    assert (image_width >= 2 && image_height >= 2);
+
+    // *rows* holds the undistorted rows from *top* - 1 to *top* + *height*
+    // for the columns from *left* - 1 to *left* + *width*, where the rows
+    // and columns past the image edges are reflected back in:
+    Integer rows_width = width + 2;
+    Integer rows_height = height + 2;
+    uchar *rows = (uchar *)Memory__allocate(
+      (Unsigned)(rows_width * rows_height),
+      "CV_Image__gray_undistort_smooth_rectangle");
+    Integer low_x = (left > 0) ? left - 1 : 0;
+    Integer high_x =
+      (left + width < image_width) ? left + width + 1 : image_width;
+    for (Integer row = 0; row < rows_height; row++) {
+	Integer y = top - 1 + row;
+	y = (y < 0) ? 1 : ((y >= image_height) ? image_height - 2 : y);
+	uchar *rows_row = rows + rows_width * row;
+	CV_Image__gray_remap_row(source_image,
+	  remap_table + image_width * y + low_x, high_x - low_x,
+	  rows_row + (low_x - left + 1));
+	if (left == 0) {
+	    rows_row[0] = rows_row[2];
+	}
+	if (left + width == image_width) {
+	    rows_row[width + 1] = rows_row[width - 1];
+	}
+    }
+
+    // Blur *rows* into *destination_image*:
+    for (Integer row = 0; row < height; row++) {
+	uchar *above = rows + rows_width * row;
+	uchar *middle = above + rows_width;
+	uchar *below = middle + rows_width;
+	uchar *destination_row =
+	  destination_data + destination_step * (top + row) + left;
+	for (Integer x = 0; x < width; x++) {
+	    Unsigned sum0 = (Unsigned)above[x] +
+	      2 * (Unsigned)middle[x] + (Unsigned)below[x];
+	    Unsigned sum1 = (Unsigned)above[x + 1] +
+	      2 * (Unsigned)middle[x + 1] + (Unsigned)below[x + 1];
+	    Unsigned sum2 = (Unsigned)above[x + 2] +
+	      2 * (Unsigned)middle[x + 2] + (Unsigned)below[x + 2];
+	    destination_row[x] = (uchar)((sum0 + 2 * sum1 + sum2 + 8) >> 4);
+	}
+    }
+
+    Memory__free((Memory)rows);
+}
+
 void CV_Image__find_corner_sub_pix(CV_Image image, CV_Point2D32F_Vector corners,
   Integer count, CV_Size window, CV_Size zero_zone, CV_Term_Criteria criteria) {
     cvFindCornerSubPix(image, corners, count, *window, *zero_zone, *criteria);
@@ -503,6 +1331,34 @@ Integer CV_Image__height_get(CV_Image image) {
     return image->height;
 }
 
+/// @brief Track points from *previous_image* to *current_image* with
+///        pyramidal Lucas-Kanade optical flow.
+/// @param previous_image is the 8-bit gray scale image the points are in.
+/// @param current_image is the 8-bit gray scale image to track them into.
+/// @param previous_points are the points in *previous_image*.
+/// @param current_points is where the tracked points are stored.
+/// @param count is the number of points to track.
+/// @param window is the size of the search window at each pyramid level.
+/// @param levels is the number of pyramid levels above the image.
+/// @param status is set to 1 for each point that was tracked and 0
+/// otherwise.
+/// @param errors is set to the tracking error of each point.
+/// @param criteria is when to stop iterating at each pyramid level.
+///
+/// *CV_Image__optical_flow_pyramid_lk*() will track the *count* points
+/// in *previous_points* from *previous_image* into *current_image* and
+/// store the results into *current_points*, *status* and *errors*.  The
+/// pyramids are built internally.
+
+void CV_Image__optical_flow_pyramid_lk(CV_Image previous_image,
+  CV_Image current_image, CV_Point2D32F_Vector previous_points,
+  CV_Point2D32F_Vector current_points, Integer count, CV_Size window,
+  Integer levels, char *status, float *errors, CV_Term_Criteria criteria) {
+    cvCalcOpticalFlowPyrLK(previous_image, current_image,
+      (CvArr *)0, (CvArr *)0, previous_points, current_points, count,
+      *window, levels, status, errors, *criteria, 0);
+}
+
 /// @brief Reads in a *CV_Image* in from the .pnm file named *file_name*.
 /// @param file_name is the base name (excluding suffix) to write out to.
 /// @returns the *CV_Image* corresponding to the file read in.
@@ -540,6 +1396,10 @@ void CV_Image__remap(CV_Image source_image, CV_Image destination_image,
       destination_image, map_x, map_y, flags, *fill_value);
 }
 
+void CV_Image__repeat(CV_Image source_image, CV_Image destination_image) {
+    cvRepeat(source_image, destination_image);
+}
+
 void CV_Image__smooth(CV_Image source_image, CV_Image destination_image,
   Integer smooth_type, Integer parameter1, Integer parameter2,
   Double parameter3, Double parameter4) {
@@ -904,6 +1764,10 @@ Logical CV_Sequence__check_contour_convexity(CV_Sequence contour) {
     return (Logical)(cvCheckContourConvexity(contour) ? 1 : 0);
 }
 
+CV_Sequence CV_Sequence__child_get(CV_Sequence sequence) {
+    return sequence->v_next;
+}
+
 Double CV_Sequence__contour_area(
   CV_Sequence contour, CV_Slice slice, Integer oriented) {
     return cvContourArea(contour, *slice, oriented);
@@ -962,3 +1826,130 @@ CV_Term_Criteria CV_Term_Criteria__create(
     return term_criteria;
 }
 
+// *CV_Gray_Band* routines:
+
+/// @brief Convert the rows of *band* to gray scale, undistort and blur them.
+/// @param band_pointer is the *CV_Gray_Band* to process.
+/// @returns (void *)0.
+///
+/// *CV_Gray_Band__process*() will compute the rows from *start_row* up to
+/// (but not including) *end_row* of *band_pointer* as described in
+/// *CV_Image__gray_undistort_smooth*().  It is used directly as a thread
+/// body.
+
+void *CV_Gray_Band__process(void *band_pointer) {
+    CV_Gray_Band band = (CV_Gray_Band)band_pointer;
+    CV_Image__gray_undistort_smooth_rectangle(band->source_image,
+      band->destination_image, band->remap_table, band->blur,
+      0, band->start_row, band->destination_image->width,
+      band->end_row - band->start_row);
+    return (void *)0;
+}
+
+// *CV_Threshold_Band* routines:
+
+/// @brief Threshold the rows of *band*.
+/// @param band_pointer is the *CV_Threshold_Band* to process.
+/// @returns (void *)0.
+///
+/// *CV_Threshold_Band__process*() will threshold the rows from
+/// *start_row* up to (but not including) *end_row* of *band_pointer* as
+/// described in *CV_Image__box_threshold*().  Only the columns from
+/// *start_column* up to (but not including) *end_column* are written.
+/// It is used directly as a thread body.  For each row, the column sums
+/// over the box height are updated incrementally (only for the columns
+/// that the boxes touch) and prefix summed across the (edge replicated)
+/// row, so each box sum is the difference of two prefix sums.  The final
+/// comparison is done in integer arithmetic without a divide, so the
+/// inner loops are straight line code that the compiler can vectorize.
+
+void *CV_Threshold_Band__process(void *band_pointer) {
+    CV_Threshold_Band band = (CV_Threshold_Band)band_pointer;
+    CV_Image source_image = band->source_image;
+    CV_Image destination_image = band->destination_image;
+    Integer block_size = band->block_size;
+    Integer radius = block_size / 2;
+    Integer area = block_size * block_size;
+    Integer width = source_image->width;
+    Integer height = source_image->height;
+    Integer source_step = source_image->widthStep;
+    Integer destination_step = destination_image->widthStep;
+    uchar *source_data = (uchar *)source_image->imageData;
+    uchar *destination_data = (uchar *)destination_image->imageData;
+    uchar maximum_value = (uchar)band->maximum_value;
+
+    // A pixel is above threshold when it is greater than mean - delta,
+    // i.e. when the rounded mean is less than *limit* = pixel + delta.
+    // Since *area* is odd there are no rounding ties, so that is exactly
+    // when 2 * box_sum + area < 2 * area * limit:
+    Integer area2 = 2 * area;
+    Integer delta = band->delta;
+
+    // The boxes for the columns from *start_column* to *end_column* need
+    // the column sums from *low_column* up to *high_column*:
+    Integer start_column = band->start_column;
+    Integer end_column = band->end_column;
+    Integer low_column = (start_column > radius) ? start_column - radius : 0;
+    Integer high_column =
+      (end_column + radius < width) ? end_column + radius : width;
+
+    // *column_sums*[x] is the sum of the *block_size* rows centered on
+    // the current row in column x, and *prefix_sums*[p] is the sum of the
+    // first p column sums of the row (starting at *start_column*) padded
+    // by *radius* replicated columns on each side:
+    Unsigned padded_width = (Unsigned)(end_column - start_column + 2 * radius);
+    Unsigned *column_sums = (Unsigned *)Memory__allocate(
+      (Unsigned)width * sizeof(Unsigned), "CV_Threshold_Band__process");
+    Unsigned *prefix_sums = (Unsigned *)Memory__allocate(
+      (padded_width + 1) * sizeof(Unsigned), "CV_Threshold_Band__process");
+
+    // Load up *column_sums* for the row before *start_row*:
+    for (Integer x = low_column; x < high_column; x++) {
+	column_sums[x] = 0;
+    }
+    for (Integer y = band->start_row - radius - 1;
+      y < band->start_row + radius; y++) {
+	Integer row = (y < 0) ? 0 : ((y >= height) ? height - 1 : y);
+	uchar *source_row = source_data + source_step * row;
+	for (Integer x = low_column; x < high_column; x++) {
+	    column_sums[x] += source_row[x];
+	}
+    }
+
+    for (Integer y = band->start_row; y < band->end_row; y++) {
+	// Slide *column_sums* down by one row:
+	Integer add_row = (y + radius >= height) ? height - 1 : y + radius;
+	Integer remove_row = (y <= radius) ? 0 : y - radius - 1;
+	uchar *add_data = source_data + source_step * add_row;
+	uchar *remove_data = source_data + source_step * remove_row;
+	for (Integer x = low_column; x < high_column; x++) {
+	    column_sums[x] += (Unsigned)add_data[x] - (Unsigned)remove_data[x];
+	}
+
+	// Prefix sum *column_sums* across the edge replicated row:
+	Unsigned sum = 0;
+	Unsigned index = 0;
+	prefix_sums[index++] = 0;
+	for (Integer x = start_column - radius; x < end_column + radius; x++) {
+	    Integer column = (x < 0) ? 0 : ((x >= width) ? width - 1 : x);
+	    sum += column_sums[column];
+	    prefix_sums[index++] = sum;
+	}
+
+	// Threshold the row:
+	uchar *source_row = source_data + source_step * y;
+	uchar *destination_row = destination_data + destination_step * y;
+	for (Integer x = start_column; x < end_column; x++) {
+	    Integer offset = x - start_column;
+	    Integer box_sum = (Integer)
+	      (prefix_sums[offset + block_size] - prefix_sums[offset]);
+	    Integer limit = (Integer)source_row[x] + delta;
+	    destination_row[x] =
+	      (2 * box_sum + area < area2 * limit) ? maximum_value : 0;
+	}
+    }
+
+    Memory__free((Memory)column_sums);
+    Memory__free((Memory)prefix_sums);
+    return (void *)0;
+}
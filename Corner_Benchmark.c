@@ -0,0 +1,373 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "CV.h"
+#include "Double.h"
+#include "File.h"
+#include "Integer.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Unsigned.h"
+
+/// @brief *Corner_Benchmark* is a pointer to a *Corner_Benchmark__Struct*
+/// object.
+typedef struct Corner_Benchmark__Struct *Corner_Benchmark;
+
+/// @brief A *Corner_Benchmark* is a set of synthetic tag images along with
+/// the true and rough corners of the tag in each image.
+struct Corner_Benchmark__Struct {
+    /// @brief One rendered tag image per trial.
+    CV_Image *images;
+
+    /// @brief 8 *Double*'s (x0, y0, ..., x3, y3) of rough corners per trial.
+    Double *roughs;
+
+    /// @brief 8 *Double*'s (x0, y0, ..., x3, y3) of true corners per trial.
+    Double *truths;
+
+    /// @brief Number of trials.
+    Unsigned trials_size;
+};
+
+extern Corner_Benchmark Corner_Benchmark__create(
+  Unsigned trials_size, Double rough_offset, Unsigned *random);
+extern void Corner_Benchmark__free(Corner_Benchmark corner_benchmark);
+extern Double Corner_Benchmark__random(Unsigned *random);
+extern void Corner_Benchmark__render(CV_Image image,
+  Double *homography, uint64_t bits, Unsigned *random);
+extern void Corner_Benchmark__run(Corner_Benchmark corner_benchmark,
+  String_Const label, Logical line_fit, Double search_distance);
+
+/// @brief Compare the corner refinement methods on synthetic tags.
+/// @param arguments_size is the number of arguments
+/// @param arguments is the vector of command line arguments.
+/// @returns 0 for success.
+///
+/// *main*() will render synthetic tags with random sizes, rotations and
+/// perspective, start each tag with rough corners that are off by up to
+/// 1 pixel (contours found at full resolution) or 2 pixels (contours
+/// found on a decimated image), and refine them with both
+/// *CV_Image__find_corner_sub_pix*() and *CV_Image__corners_line_fit*().
+/// For each method it reports the RMS and maximum corner error against
+/// the true corners, the RMS error in the average diagonal length (which
+/// *Camera_Tag__initialize*() uses for the distance to the tag), the
+/// number of tags the method could not refine, and the time per
+/// candidate.
+
+int main(int arguments_size, char *arguments[]) {
+    Unsigned trials_size = 2000;
+    Unsigned random = 24680;
+    File__format(stdout, "%d synthetic tags\n", trials_size);
+    File__format(stdout, "method                   corner rms  max  "
+      "diagonal rms  failed  time(us)\n");
+    for (Unsigned scale = 1; scale <= 2; scale++) {
+	Corner_Benchmark corner_benchmark =
+	  Corner_Benchmark__create(trials_size, (Double)scale, &random);
+	Double search_distance = (Double)scale + 2.0;
+	if (scale == 1) {
+	    Corner_Benchmark__run(corner_benchmark,
+	      "sub pix, rough 1px", (Logical)0, search_distance);
+	    Corner_Benchmark__run(corner_benchmark,
+	      "line fit, rough 1px", (Logical)1, search_distance);
+	} else {
+	    Corner_Benchmark__run(corner_benchmark,
+	      "sub pix, rough 2px", (Logical)0, search_distance);
+	    Corner_Benchmark__run(corner_benchmark,
+	      "line fit, rough 2px", (Logical)1, search_distance);
+	}
+	Corner_Benchmark__free(corner_benchmark);
+    }
+    return 0;
+}
+
+/// @brief Create a set of synthetic tag images.
+/// @param trials_size is the number of tag images to create.
+/// @param rough_offset is the most the rough corners are off in X and Y.
+/// @param random is the random number generator state.
+/// @returns a new *Corner_Benchmark* object.
+///
+/// *Corner_Benchmark__create*() will render *trials_size* tags with random
+/// data bits, sizes (6 to 60 pixels from the center to a side),
+/// rotations and perspective into their own images.  The rough corners
+/// of each tag are the true corners rounded to the nearest pixel and then
+/// moved by up to *rough_offset* in both X and Y.
+
+Corner_Benchmark Corner_Benchmark__create(
+  Unsigned trials_size, Double rough_offset, Unsigned *random) {
+    Corner_Benchmark corner_benchmark =
+      Memory__new(Corner_Benchmark, "Corner_Benchmark__create");
+    corner_benchmark->images = (CV_Image *)Memory__allocate(
+      trials_size * sizeof(CV_Image), "Corner_Benchmark__create:images");
+    corner_benchmark->roughs = (Double *)Memory__allocate(
+      8 * trials_size * sizeof(Double), "Corner_Benchmark__create:roughs");
+    corner_benchmark->truths = (Double *)Memory__allocate(
+      8 * trials_size * sizeof(Double), "Corner_Benchmark__create:truths");
+    corner_benchmark->trials_size = trials_size;
+
+    Double pi = (Double)3.14159265358979323846264;
+    CV_Size size = CV_Size__create(256, 256);
+    for (Unsigned trial = 0; trial < trials_size; trial++) {
+	// Pick the homography from tag (u, v) coordinates in [-1, 1]
+	// to image coordinates.  The tag is scaled, rotated and tilted
+	// about its center before being moved to the image center:
+	Double half_side = 6.0 + 54.0 * Corner_Benchmark__random(random);
+	Double angle = 2.0 * pi * Corner_Benchmark__random(random);
+	Double center_x = 127.0 + Corner_Benchmark__random(random);
+	Double center_y = 127.0 + Corner_Benchmark__random(random);
+	Double tilt_u = 0.2 * Corner_Benchmark__random(random) - 0.1;
+	Double tilt_v = 0.2 * Corner_Benchmark__random(random) - 0.1;
+	Double homography[9];
+	homography[0] = half_side * cos(angle) + center_x * tilt_u;
+	homography[1] = -half_side * sin(angle) + center_x * tilt_v;
+	homography[2] = center_x;
+	homography[3] = half_side * sin(angle) + center_y * tilt_u;
+	homography[4] = half_side * cos(angle) + center_y * tilt_v;
+	homography[5] = center_y;
+	homography[6] = tilt_u;
+	homography[7] = tilt_v;
+	homography[8] = 1.0;
+
+	// Record the true and rough corners:
+	static Double us[4] = {-1.0, 1.0, 1.0, -1.0};
+	static Double vs[4] = {-1.0, -1.0, 1.0, 1.0};
+	Double *truth = corner_benchmark->truths + 8 * trial;
+	Double *rough = corner_benchmark->roughs + 8 * trial;
+	for (Unsigned index = 0; index < 4; index++) {
+	    Double u = us[index];
+	    Double v = vs[index];
+	    Double w = homography[6] * u + homography[7] * v + 1.0;
+	    Double x = (homography[0] * u + homography[1] * v +
+	      homography[2]) / w;
+	    Double y = (homography[3] * u + homography[4] * v +
+	      homography[5]) / w;
+	    Double offset_x =
+	      rough_offset * (2.0 * Corner_Benchmark__random(random) - 1.0);
+	    Double offset_y =
+	      rough_offset * (2.0 * Corner_Benchmark__random(random) - 1.0);
+	    truth[2 * index] = x;
+	    truth[2 * index + 1] = y;
+	    rough[2 * index] = floor(x + 0.5) + floor(offset_x + 0.5);
+	    rough[2 * index + 1] = floor(y + 0.5) + floor(offset_y + 0.5);
+	}
+
+	// Render the tag with random data bits:
+	uint64_t bits = ((uint64_t)(*random) << 32) ^
+	  (uint64_t)(Corner_Benchmark__random(random) * 4294967295.0);
+	CV_Image image = CV_Image__create(size, CV__depth_8u, 1);
+	Corner_Benchmark__render(image, homography, bits, random);
+	corner_benchmark->images[trial] = image;
+    }
+    CV_Size__free(size);
+    return corner_benchmark;
+}
+
+/// @brief Release the storage of *corner_benchmark*.
+/// @param corner_benchmark is the *Corner_Benchmark* to release.
+///
+/// *Corner_Benchmark__free*() will release the images and storage of
+/// *corner_benchmark*.
+
+void Corner_Benchmark__free(Corner_Benchmark corner_benchmark) {
+    for (Unsigned trial = 0; trial < corner_benchmark->trials_size; trial++) {
+	CV__release_image(corner_benchmark->images[trial]);
+    }
+    Memory__free((Memory)corner_benchmark->images);
+    Memory__free((Memory)corner_benchmark->roughs);
+    Memory__free((Memory)corner_benchmark->truths);
+    Memory__free((Memory)corner_benchmark);
+}
+
+/// @brief Return a random number in [0, 1).
+/// @param random is the random number generator state.
+/// @returns a random number in [0, 1).
+///
+/// *Corner_Benchmark__random*() will step the linear congruential random
+/// number generator *random* and return its next value scaled to [0, 1).
+
+Double Corner_Benchmark__random(Unsigned *random) {
+    *random = *random * 1103515245 + 12345;
+    return (Double)(*random >> 8) / 16777216.0;
+}
+
+/// @brief Render a tag into *image*.
+/// @param image is the 8-bit gray scale image to render into.
+/// @param homography maps tag (u, v) coordinates to image coordinates.
+/// @param bits are the 64 data bits of the tag.
+/// @param random is the random number generator state.
+///
+/// *Corner_Benchmark__render*() will render a tag with a black border
+/// (one tenth of the tag wide) around an 8 x 8 grid of *bits* onto a
+/// white background.  Each pixel is averaged over 4 x 4 sub-pixel
+/// samples, the result is blurred with a 3 x 3 binomial filter to act
+/// like a camera lens, and up to +/-8 levels of noise are added.
+
+void Corner_Benchmark__render(CV_Image image,
+  Double *homography, uint64_t bits, Unsigned *random) {
+    // Invert *homography* so that pixels map back to tag coordinates:
+    Double *h = homography;
+    Double inverse[9];
+    inverse[0] = h[4] * h[8] - h[5] * h[7];
+    inverse[1] = h[2] * h[7] - h[1] * h[8];
+    inverse[2] = h[1] * h[5] - h[2] * h[4];
+    inverse[3] = h[5] * h[6] - h[3] * h[8];
+    inverse[4] = h[0] * h[8] - h[2] * h[6];
+    inverse[5] = h[2] * h[3] - h[0] * h[5];
+    inverse[6] = h[3] * h[7] - h[4] * h[6];
+    inverse[7] = h[1] * h[6] - h[0] * h[7];
+    inverse[8] = h[0] * h[4] - h[1] * h[3];
+
+    // Render the sharp image with 4 x 4 samples per pixel:
+    Integer width = CV_Image__width_get(image);
+    Integer height = CV_Image__height_get(image);
+    Double *sharp = (Double *)Memory__allocate(
+      (Unsigned)(width * height) * sizeof(Double), "Corner_Benchmark__render");
+    for (Integer y = 0; y < height; y++) {
+	for (Integer x = 0; x < width; x++) {
+	    Double sum = 0.0;
+	    for (Integer sample = 0; sample < 16; sample++) {
+		Double sample_x =
+		  (Double)x + ((Double)(sample & 3) - 1.5) / 4.0;
+		Double sample_y =
+		  (Double)y + ((Double)(sample >> 2) - 1.5) / 4.0;
+		Double w = inverse[6] * sample_x + inverse[7] * sample_y +
+		  inverse[8];
+		Double u = (inverse[0] * sample_x + inverse[1] * sample_y +
+		  inverse[2]) / w;
+		Double v = (inverse[3] * sample_x + inverse[4] * sample_y +
+		  inverse[5]) / w;
+		Double gray = 220.0;
+		if (fabs(u) < 1.0 && fabs(v) < 1.0) {
+		    gray = 30.0;
+		    if (fabs(u) < 0.8 && fabs(v) < 0.8) {
+			Unsigned column = (Unsigned)((u + 0.8) * 5.0);
+			Unsigned row = (Unsigned)((v + 0.8) * 5.0);
+			if ((bits >> (row * 8 + column)) & 1) {
+			    gray = 220.0;
+			}
+		    }
+		}
+		sum += gray;
+	    }
+	    sharp[y * width + x] = sum / 16.0;
+	}
+    }
+
+    // Blur, add noise and store into *image*:
+    for (Integer y = 0; y < height; y++) {
+	for (Integer x = 0; x < width; x++) {
+	    Double gray = 220.0;
+	    if (0 < x && x < width - 1 && 0 < y && y < height - 1) {
+		Double *center = sharp + y * width + x;
+		Double *above = center - width;
+		Double *below = center + width;
+		gray = (above[-1] + 2.0 * above[0] + above[1] +
+		  2.0 * center[-1] + 4.0 * center[0] + 2.0 * center[1] +
+		  below[-1] + 2.0 * below[0] + below[1]) / 16.0;
+	    }
+	    gray += 16.0 * Corner_Benchmark__random(random) - 8.0;
+	    if (gray < 0.0) {
+		gray = 0.0;
+	    } else if (gray > 255.0) {
+		gray = 255.0;
+	    }
+	    CV_Image__store3(image,
+	      (Unsigned)x, (Unsigned)y, 0, (Unsigned)(gray + 0.5));
+	}
+    }
+    Memory__free((Memory)sharp);
+}
+
+/// @brief Refine the corners of every trial and print the results.
+/// @param corner_benchmark contains the trials to refine.
+/// @param label is the name of the method.
+/// @param line_fit is (*Logical*)1 for *CV_Image__corners_line_fit*() and
+/// (*Logical*)0 for *CV_Image__find_corner_sub_pix*().
+/// @param search_distance is passed to *CV_Image__corners_line_fit*().
+///
+/// *Corner_Benchmark__run*() will refine the rough corners of each trial
+/// in *corner_benchmark* with the method selected by *line_fit* using the
+/// same parameters as *Fiducials__process*(), and print one row of
+/// results labeled with *label*.  A failed line fit leaves the rough
+/// corners in place (*Fiducials__process*() falls back to
+/// *CV_Image__find_corner_sub_pix*() instead) and is counted.
+
+void Corner_Benchmark__run(Corner_Benchmark corner_benchmark,
+  String_Const label, Logical line_fit, Double search_distance) {
+    CV_Point2D32F_Vector corners = CV_Point2D32F_Vector__create(4);
+    CV_Size size_5x5 = CV_Size__create(5, 5);
+    CV_Size size_m1xm1 = CV_Size__create(-1, -1);
+    CV_Term_Criteria term_criteria = CV_Term_Criteria__create(
+      CV__term_criteria_iterations | CV__term_criteria_eps, 5, 0.2);
+    Unsigned trials_size = corner_benchmark->trials_size;
+    Double *refined = (Double *)Memory__allocate(
+      8 * trials_size * sizeof(Double), "Corner_Benchmark__run");
+
+    // Time just the refinement:
+    Unsigned failed = 0;
+    clock_t start_clock = clock();
+    for (Unsigned trial = 0; trial < trials_size; trial++) {
+	CV_Image image = corner_benchmark->images[trial];
+	Double *rough = corner_benchmark->roughs + 8 * trial;
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, index);
+	    CV_Point2D32F__x_set(corner, rough[2 * index]);
+	    CV_Point2D32F__y_set(corner, rough[2 * index + 1]);
+	}
+	if (line_fit) {
+	    if (!CV_Image__corners_line_fit(image, corners, search_distance)) {
+		failed += 1;
+	    }
+	} else {
+	    CV_Image__find_corner_sub_pix(image, corners, 4,
+	      size_5x5, size_m1xm1, term_criteria);
+	}
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, index);
+	    refined[8 * trial + 2 * index] = CV_Point2D32F__x_get(corner);
+	    refined[8 * trial + 2 * index + 1] = CV_Point2D32F__y_get(corner);
+	}
+    }
+    Double seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+
+    // Measure the corner and diagonal errors:
+    Double corner_sum = 0.0;
+    Double corner_maximum = 0.0;
+    Double diagonal_sum = 0.0;
+    for (Unsigned trial = 0; trial < trials_size; trial++) {
+	Double *truth = corner_benchmark->truths + 8 * trial;
+	Double *result = refined + 8 * trial;
+	for (Unsigned index = 0; index < 4; index++) {
+	    Double dx = result[2 * index] - truth[2 * index];
+	    Double dy = result[2 * index + 1] - truth[2 * index + 1];
+	    Double error = sqrt(dx * dx + dy * dy);
+	    corner_sum += error * error;
+	    if (error > corner_maximum) {
+		corner_maximum = error;
+	    }
+	}
+	Double truth_diagonal =
+	  (hypot(truth[4] - truth[0], truth[5] - truth[1]) +
+	  hypot(truth[6] - truth[2], truth[7] - truth[3])) / 2.0;
+	Double result_diagonal =
+	  (hypot(result[4] - result[0], result[5] - result[1]) +
+	  hypot(result[6] - result[2], result[7] - result[3])) / 2.0;
+	Double error = result_diagonal - truth_diagonal;
+	diagonal_sum += error * error;
+    }
+    File__format(stdout, "%-24s %10.3f %5.2f %13.3f %7d %9.2f\n", label,
+      sqrt(corner_sum / (Double)(4 * trials_size)), corner_maximum,
+      sqrt(diagonal_sum / (Double)trials_size), failed,
+      seconds * 1000000.0 / (Double)trials_size);
+
+    Memory__free((Memory)refined);
+    CV_Size__free(size_5x5);
+    CV_Size__free(size_m1xm1);
+    free((void *)corners);
+}
@@ -0,0 +1,186 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+
+#include "Corner_Tracker.h"
+#include "CV.h"
+#include "Double.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Unsigned.h"
+
+/// @brief Append a tag to track to *corner_tracker*.
+/// @param corner_tracker is the *Corner_Tracker* to append to.
+/// @param tag_id is the id of the tag.
+/// @param direction is the decode direction of the tag.
+/// @param corners is the 8 corner coordinates (x0, y0, ..., x3, y3) of the
+/// tag in the current gray scale image.
+///
+/// *Corner_Tracker__append*() will append the tag with *tag_id*,
+/// *direction* and *corners* to the tags tracked by *corner_tracker*.
+/// Once *CORNER_TRACKER_TAGS_MAXIMUM* tags have been appended, any more
+/// are ignored.
+
+void Corner_Tracker__append(Corner_Tracker corner_tracker,
+  Unsigned tag_id, Unsigned direction, Double *corners) {
+    Unsigned size = corner_tracker->size;
+    if (size < CORNER_TRACKER_TAGS_MAXIMUM) {
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(
+	      corner_tracker->previous_points, 4 * size + index);
+	    CV_Point2D32F__x_set(point, corners[2 * index]);
+	    CV_Point2D32F__y_set(point, corners[2 * index + 1]);
+	}
+	corner_tracker->directions[size] = direction;
+	corner_tracker->tag_ids[size] = tag_id;
+	corner_tracker->tracked[size] = (Logical)0;
+	corner_tracker->size = size + 1;
+    }
+}
+
+/// @brief Forget all of the tags in *corner_tracker*.
+/// @param corner_tracker is the *Corner_Tracker* to clear.
+///
+/// *Corner_Tracker__clear*() will remove all of the tags from
+/// *corner_tracker*.  The tracked corners from the last
+/// *Corner_Tracker__track*() are still available from
+/// *Corner_Tracker__corners_get*() until *Corner_Tracker__track*() is
+/// called again.
+
+void Corner_Tracker__clear(Corner_Tracker corner_tracker) {
+    corner_tracker->size = 0;
+}
+
+/// @brief Return the tracked corners of one tag.
+/// @param corner_tracker is the *Corner_Tracker* to fetch from.
+/// @param index is the index of the tag.
+/// @param corners is where the 8 tracked corner coordinates are stored.
+///
+/// *Corner_Tracker__corners_get*() will store the corners of the tag at
+/// *index* as tracked by the last *Corner_Tracker__track*() into
+/// *corners*.
+
+void Corner_Tracker__corners_get(
+  Corner_Tracker corner_tracker, Unsigned index, Double *corners) {
+    assert (index < CORNER_TRACKER_TAGS_MAXIMUM);
+    for (Unsigned corner_index = 0; corner_index < 4; corner_index++) {
+	CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(
+	  corner_tracker->current_points, 4 * index + corner_index);
+	corners[2 * corner_index] = CV_Point2D32F__x_get(point);
+	corners[2 * corner_index + 1] = CV_Point2D32F__y_get(point);
+    }
+}
+
+/// @brief Return a new empty *Corner_Tracker* object.
+/// @returns a new empty *Corner_Tracker* object.
+///
+/// *Corner_Tracker__create*() will create and return a new empty
+/// *Corner_Tracker* object.
+
+Corner_Tracker Corner_Tracker__create(void) {
+    Corner_Tracker corner_tracker =
+      Memory__new(Corner_Tracker, "Corner_Tracker__create");
+    corner_tracker->criteria = CV_Term_Criteria__create(
+      CV__term_criteria_iterations | CV__term_criteria_eps, 20, 0.03);
+    corner_tracker->current_points =
+      CV_Point2D32F_Vector__create(4 * CORNER_TRACKER_TAGS_MAXIMUM);
+    corner_tracker->previous_image = (CV_Image)0;
+    corner_tracker->previous_points =
+      CV_Point2D32F_Vector__create(4 * CORNER_TRACKER_TAGS_MAXIMUM);
+    corner_tracker->size = 0;
+    corner_tracker->window =
+      CV_Size__create(CORNER_TRACKER_WINDOW, CORNER_TRACKER_WINDOW);
+    return corner_tracker;
+}
+
+/// @brief Release the storage associated with *corner_tracker*.
+/// @param corner_tracker is the *Corner_Tracker* object to release.
+///
+/// *Corner_Tracker__free*() will release the storage associated with
+/// *corner_tracker*.
+
+void Corner_Tracker__free(Corner_Tracker corner_tracker) {
+    if (corner_tracker->previous_image != (CV_Image)0) {
+	CV__release_image(corner_tracker->previous_image);
+    }
+    Memory__free((Memory)corner_tracker->criteria);
+    Memory__free((Memory)corner_tracker->current_points);
+    Memory__free((Memory)corner_tracker->previous_points);
+    CV_Size__free(corner_tracker->window);
+    Memory__free((Memory)corner_tracker);
+}
+
+/// @brief Remember the gray scale image that the tags were found in.
+/// @param corner_tracker is the *Corner_Tracker* to save into.
+/// @param image is the 8-bit gray scale image to save.
+///
+/// *Corner_Tracker__image_save*() will copy *image* into *corner_tracker*
+/// so that the corners can be tracked from it into the next frame.
+
+void Corner_Tracker__image_save(
+  Corner_Tracker corner_tracker, CV_Image image) {
+    // (Re)create *previous_image* if its size is not right:
+    Integer width = CV_Image__width_get(image);
+    Integer height = CV_Image__height_get(image);
+    CV_Image previous_image = corner_tracker->previous_image;
+    if (previous_image == (CV_Image)0 ||
+      CV_Image__width_get(previous_image) != width ||
+      CV_Image__height_get(previous_image) != height) {
+	if (previous_image != (CV_Image)0) {
+	    CV__release_image(previous_image);
+	}
+	CV_Size size = CV_Size__create(width, height);
+	previous_image = CV_Image__create(size, CV__depth_8u, 1);
+	CV_Size__free(size);
+	corner_tracker->previous_image = previous_image;
+    }
+    CV_Image__copy(image, previous_image, (CV_Image)0);
+}
+
+/// @brief Track the corners of each tag into *image*.
+/// @param corner_tracker is the *Corner_Tracker* to track with.
+/// @param image is the 8-bit gray scale image of the current frame.
+/// @returns the number of tags whose 4 corners were all tracked.
+///
+/// *Corner_Tracker__track*() will track the corners of each tag in
+/// *corner_tracker* from the saved image into *image* with pyramidal
+/// Lucas-Kanade optical flow.  A tag is marked as *tracked* when all 4
+/// of its corners were found with an error of no more than
+/// *CORNER_TRACKER_ERROR_MAXIMUM*.  The tracked corners can be fetched
+/// with *Corner_Tracker__corners_get*().
+
+Unsigned Corner_Tracker__track(Corner_Tracker corner_tracker, CV_Image image) {
+    Unsigned size = corner_tracker->size;
+    CV_Image previous_image = corner_tracker->previous_image;
+    if (size == 0 || previous_image == (CV_Image)0) {
+	return 0;
+    }
+    assert (CV_Image__width_get(previous_image) == CV_Image__width_get(image)
+      && CV_Image__height_get(previous_image) == CV_Image__height_get(image));
+
+    // Track all of the corners at once:
+    CV_Image__optical_flow_pyramid_lk(previous_image, image,
+      corner_tracker->previous_points, corner_tracker->current_points,
+      (Integer)(4 * size), corner_tracker->window, CORNER_TRACKER_LEVELS,
+      corner_tracker->status, corner_tracker->errors,
+      corner_tracker->criteria);
+
+    // A tag is only tracked if all 4 of its corners are:
+    Unsigned tracked_size = 0;
+    for (Unsigned index = 0; index < size; index++) {
+	Logical tracked = (Logical)1;
+	for (Unsigned corner_index = 4 * index;
+	  corner_index < 4 * index + 4; corner_index++) {
+	    if (corner_tracker->status[corner_index] == 0 ||
+	      (Double)corner_tracker->errors[corner_index] >
+	      CORNER_TRACKER_ERROR_MAXIMUM) {
+		tracked = (Logical)0;
+	    }
+	}
+	corner_tracker->tracked[index] = tracked;
+	if (tracked) {
+	    tracked_size += 1;
+	}
+    }
+    return tracked_size;
+}
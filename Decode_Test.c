@@ -0,0 +1,400 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Double.h"
+#include "FEC.h"
+#include "File.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Tag_Dictionary.h"
+#include "Unsigned.h"
+
+extern void Decode_Test__benchmark(
+  Tag_Dictionary tag_dictionary, Unsigned words_size);
+extern void Decode_Test__codewords_test(Tag_Dictionary tag_dictionary);
+extern Logical Decode_Test__fec_compare(FEC fec, Unsigned *tag_bytes);
+extern void Decode_Test__fec_test(Tag_Dictionary tag_dictionary);
+extern void Decode_Test__noisy_test(
+  Tag_Dictionary tag_dictionary, Unsigned words_size);
+extern void Decode_Test__orient_test(Unsigned words_size);
+extern uint64_t Decode_Test__random_word(Unsigned *random);
+
+int main(int arguments_size, char *arguments[]) {
+    FEC fec = FEC__create(8, 4, 4);
+    clock_t start_clock = clock();
+    Tag_Dictionary tag_dictionary = Tag_Dictionary__create(fec);
+    Double create_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+    File__format(stdout, "Tag dictionary: create=%.4fs\n", create_seconds);
+
+    Decode_Test__orient_test(100000);
+    Decode_Test__fec_test(tag_dictionary);
+    Decode_Test__codewords_test(tag_dictionary);
+    Decode_Test__noisy_test(tag_dictionary, 200000);
+    Decode_Test__benchmark(tag_dictionary, 200000);
+
+    Tag_Dictionary__free(tag_dictionary);
+    return 0;
+}
+
+/// @brief Times dictionary decoding against Reed-Solomon decoding.
+/// @param tag_dictionary to use for decoding.
+/// @param words_size is the number of bit patterns to decode.
+///
+/// *Decode_Test__benchmark*() will time decoding *words_size* exact tag
+/// bit patterns (the dictionary hit path), *words_size* tag bit patterns
+/// with 2 bits flipped (a dictionary miss that FEC corrects) and
+/// *words_size* random bit patterns (i.e. candidates that are not tags,
+/// a dictionary miss that FEC rejects) with both
+/// *Tag_Dictionary__decode*() and *Tag_Dictionary__fec_decode*().  It
+/// also reports how many of the misses the filter turned away.
+
+void Decode_Test__benchmark(
+  Tag_Dictionary tag_dictionary, Unsigned words_size) {
+    Unsigned random = 13579;
+    uint64_t *tag_words =
+      (uint64_t *)Memory__allocate(words_size * sizeof(uint64_t),
+      "Decode_Test__benchmark:tag_words");
+    uint64_t *noisy_words =
+      (uint64_t *)Memory__allocate(words_size * sizeof(uint64_t),
+      "Decode_Test__benchmark:noisy_words");
+    uint64_t *random_words =
+      (uint64_t *)Memory__allocate(words_size * sizeof(uint64_t),
+      "Decode_Test__benchmark:random_words");
+    Unsigned filtered = 0;
+    for (Unsigned index = 0; index < words_size; index++) {
+	random = random * 1103515245 + 12345;
+	Unsigned tag_id = (random >> 8) & 0xffff;
+	Unsigned direction = (random >> 24) & 3;
+	tag_words[index] =
+	  Tag_Dictionary__tag_bits(tag_dictionary, tag_id, direction);
+
+	// Flip 2 different bits (at most 2 bad bytes, so FEC corrects it):
+	random = random * 1103515245 + 12345;
+	Unsigned flip1 = (random >> 16) & 63;
+	Unsigned flip2 = (flip1 + 1 + ((random >> 8) % 63)) & 63;
+	noisy_words[index] = tag_words[index] ^
+	  ((uint64_t)1 << flip1) ^ ((uint64_t)1 << flip2);
+
+	random_words[index] = Decode_Test__random_word(&random);
+	Unsigned filter_bit =
+	  Tag_Dictionary__filter_bit(random_words[index]);
+	if (((tag_dictionary->filter[filter_bit >> 6] >>
+	  (filter_bit & 63)) & 1) == 0) {
+	    filtered++;
+	}
+    }
+
+    // Time each decoder on each set of words:
+    uint64_t *words_table[3];
+    words_table[0] = tag_words;
+    words_table[1] = noisy_words;
+    words_table[2] = random_words;
+    Double seconds[6];
+    Unsigned found[6];
+    for (Unsigned test = 0; test < 6; test++) {
+	uint64_t *words = words_table[test % 3];
+	Unsigned count = 0;
+	clock_t start_clock = clock();
+	for (Unsigned index = 0; index < words_size; index++) {
+	    Unsigned tag_id = 0;
+	    Unsigned direction = 0;
+	    if (test < 3) {
+		count += Tag_Dictionary__decode(tag_dictionary,
+		  words[index], &tag_id, &direction);
+	    } else {
+		count += Tag_Dictionary__fec_decode(tag_dictionary,
+		  words[index], &tag_id, &direction);
+	    }
+	}
+	seconds[test] = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+	found[test] = count;
+    }
+    assert (found[0] == words_size && found[3] == words_size);
+    assert (found[1] == words_size && found[4] == words_size);
+    assert (found[2] == found[5]);
+
+    Double scale = 1.0e9 / (Double)words_size;
+    File__format(stdout, "Tag decode: words=%d "
+      "hits: dictionary=%.1fns fec=%.1fns "
+      "noisy misses: dictionary=%.1fns fec=%.1fns "
+      "non-tag misses: dictionary=%.1fns fec=%.1fns filtered=%.1f%%\n",
+      words_size, seconds[0] * scale, seconds[3] * scale,
+      seconds[1] * scale, seconds[4] * scale,
+      seconds[2] * scale, seconds[5] * scale,
+      100.0 * (Double)filtered / (Double)words_size);
+
+    Memory__free((Memory)tag_words);
+    Memory__free((Memory)noisy_words);
+    Memory__free((Memory)random_words);
+}
+
+/// @brief Checks every tag bit pattern in every direction.
+/// @param tag_dictionary to check.
+///
+/// *Decode_Test__codewords_test*() will verify that the bit pattern of
+/// every tag id in every direction is found by *Tag_Dictionary__lookup*()
+/// and decodes back to itself.  It also counts how often the old
+/// Reed-Solomon decoder disagrees (i.e. it "corrects" an exact bit pattern
+/// into a different tag or direction.)
+
+void Decode_Test__codewords_test(Tag_Dictionary tag_dictionary) {
+    Unsigned duplicates = 0;
+    Unsigned fec_mismatches = 0;
+    for (Unsigned direction = 0; direction < 4; direction++) {
+	for (Unsigned tag_id = 0; tag_id < 65536; tag_id++) {
+	    uint64_t bits =
+	      Tag_Dictionary__tag_bits(tag_dictionary, tag_id, direction);
+	    Unsigned found_id = 0;
+	    Unsigned found_direction = 0;
+	    assert (Tag_Dictionary__lookup(tag_dictionary,
+	      bits, &found_id, &found_direction));
+	    if (found_id != tag_id || found_direction != direction) {
+		// A symmetric bit pattern; the entry must be an alias:
+		assert (Tag_Dictionary__tag_bits(tag_dictionary,
+		  found_id, found_direction) == bits);
+		duplicates++;
+	    }
+
+	    Unsigned fec_id = 0;
+	    Unsigned fec_direction = 0;
+	    assert (Tag_Dictionary__fec_decode(tag_dictionary,
+	      bits, &fec_id, &fec_direction));
+	    if (fec_id != found_id || fec_direction != found_direction) {
+		fec_mismatches++;
+	    }
+	}
+    }
+    File__format(stdout,
+      "Tag codewords: duplicates=%d fec_mismatches=%d\n",
+      duplicates, fec_mismatches);
+}
+
+/// @brief Checks that *FEC__correct*() matches the reference decoder.
+/// @param fec is the (8,4,4) Reed-Solomon decoder.
+/// @param tag_bytes is the 8 received tag bytes.
+/// @returns 1 if the received bytes were corrected and 0 otherwise.
+///
+/// *Decode_Test__fec_compare*() will run *FEC__correct*(),
+/// *FEC__word_correct*() and *FEC__reference_correct*() on copies of
+/// *tag_bytes* and assert that the results and the corrected bytes are
+/// all identical.
+
+Logical Decode_Test__fec_compare(FEC fec, Unsigned *tag_bytes) {
+    Unsigned fast_bytes[8];
+    Unsigned reference_bytes[8];
+    uint64_t word = 0;
+    for (Unsigned index = 0; index < 8; index++) {
+	fast_bytes[index] = tag_bytes[index];
+	reference_bytes[index] = tag_bytes[index];
+	word |= (uint64_t)tag_bytes[index] << (index << 3);
+    }
+    Logical fast = FEC__correct(fec, fast_bytes, 8);
+    Logical reference = FEC__reference_correct(fec, reference_bytes, 8);
+    Logical packed = FEC__word_correct(fec, &word);
+    assert (fast == reference && packed == reference);
+    for (Unsigned index = 0; index < 8; index++) {
+	assert (fast_bytes[index] == reference_bytes[index]);
+	assert (((word >> (index << 3)) & 0xff) == reference_bytes[index]);
+    }
+    return fast;
+}
+
+/// @brief Checks the tag code decoder against the reference decoder.
+/// @param tag_dictionary has the (8,4,4) Reed-Solomon decoder to check.
+///
+/// *Decode_Test__fec_test*() will exhaustively compare *FEC__correct*()
+/// with *FEC__reference_correct*().  Both decoders only look at the
+/// received bytes through the syndromes, which are linear, so the
+/// result for a corrupted tag depends only on the error pattern.  Every
+/// error pattern with up to 2 bad bytes (all correctable errors) is
+/// tried, as is every possible value of the last 3 parity bytes (which
+/// covers most uncorrectable ones.)  The two decoders are timed too.
+
+void Decode_Test__fec_test(Tag_Dictionary tag_dictionary) {
+    FEC fec = tag_dictionary->fec;
+    Unsigned tag_bytes[8];
+    uint64_t codeword = Tag_Dictionary__codeword(tag_dictionary, 0x1234);
+    for (Unsigned index = 0; index < 8; index++) {
+	tag_bytes[index] = (codeword >> (index << 3)) & 0xff;
+    }
+
+    // Try every error pattern with 1 or 2 bad bytes:
+    Unsigned corrected = 0;
+    Unsigned patterns = 1;
+    assert (Decode_Test__fec_compare(fec, tag_bytes));
+    for (Unsigned position1 = 0; position1 < 8; position1++) {
+	for (Unsigned error1 = 1; error1 < 256; error1++) {
+	    tag_bytes[position1] ^= error1;
+	    corrected += Decode_Test__fec_compare(fec, tag_bytes);
+	    patterns++;
+	    for (Unsigned position2 = position1 + 1;
+	      position2 < 8; position2++) {
+		for (Unsigned error2 = 1; error2 < 256; error2++) {
+		    tag_bytes[position2] ^= error2;
+		    corrected += Decode_Test__fec_compare(fec, tag_bytes);
+		    patterns++;
+		    tag_bytes[position2] ^= error2;
+		}
+	    }
+	    tag_bytes[position1] ^= error1;
+	}
+    }
+    assert (corrected == patterns - 1);
+
+    // Try every value of the last 3 parity bytes:
+    Unsigned parity_corrected = 0;
+    for (Unsigned parity = 0; parity < (1 << 24); parity++) {
+	tag_bytes[5] = parity & 0xff;
+	tag_bytes[6] = (parity >> 8) & 0xff;
+	tag_bytes[7] = (parity >> 16) & 0xff;
+	parity_corrected += Decode_Test__fec_compare(fec, tag_bytes);
+    }
+
+    // Time both decoders on random bytes:
+    Unsigned words_size = 200000;
+    Double seconds[2];
+    for (Unsigned test = 0; test < 2; test++) {
+	Unsigned random = 86420;
+	clock_t start_clock = clock();
+	for (Unsigned index = 0; index < words_size; index++) {
+	    uint64_t word = Decode_Test__random_word(&random);
+	    for (Unsigned byte_index = 0; byte_index < 8; byte_index++) {
+		tag_bytes[byte_index] = (word >> (byte_index << 3)) & 0xff;
+	    }
+	    if (test == 0) {
+		(void)FEC__correct(fec, tag_bytes, 8);
+	    } else {
+		(void)FEC__reference_correct(fec, tag_bytes, 8);
+	    }
+	}
+	seconds[test] = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+    }
+
+    Double scale = 1.0e9 / (Double)words_size;
+    File__format(stdout, "Tag FEC: patterns=%d corrected=%d "
+      "parity_corrected=%d fast=%.1fns reference=%.1fns\n",
+      patterns, corrected, parity_corrected,
+      seconds[0] * scale, seconds[1] * scale);
+}
+
+/// @brief Checks that noisy bit patterns decode the same as before.
+/// @param tag_dictionary to check.
+/// @param words_size is the number of bit patterns to try.
+///
+/// *Decode_Test__noisy_test*() will flip a few bits of random tag bit
+/// patterns and also generate purely random bit patterns, and verify
+/// that *Tag_Dictionary__decode*() agrees with the Reed-Solomon decoder
+/// whenever the bit pattern is not an exact tag.
+
+void Decode_Test__noisy_test(
+  Tag_Dictionary tag_dictionary, Unsigned words_size) {
+    Unsigned random = 97531;
+    Unsigned corrected = 0;
+    Unsigned rejected = 0;
+    for (Unsigned index = 0; index < words_size; index++) {
+	uint64_t bits = 0;
+	if ((index & 1) == 0) {
+	    // Flip 1 to 8 bits of a tag bit pattern:
+	    random = random * 1103515245 + 12345;
+	    Unsigned tag_id = (random >> 8) & 0xffff;
+	    Unsigned direction = (random >> 24) & 3;
+	    bits = Tag_Dictionary__tag_bits(tag_dictionary, tag_id, direction);
+	    random = random * 1103515245 + 12345;
+	    Unsigned flips = 1 + ((random >> 16) & 7);
+	    for (Unsigned flip = 0; flip < flips; flip++) {
+		random = random * 1103515245 + 12345;
+		bits ^= (uint64_t)1 << ((random >> 16) & 63);
+	    }
+	} else {
+	    bits = Decode_Test__random_word(&random);
+	}
+
+	Unsigned tag_id = 0;
+	Unsigned direction = 0;
+	if (Tag_Dictionary__lookup(tag_dictionary,
+	  bits, &tag_id, &direction)) {
+	    // The flips happened to cancel out:
+	    continue;
+	}
+	Unsigned fec_id = 0;
+	Unsigned fec_direction = 0;
+	Logical fec_found = Tag_Dictionary__fec_decode(tag_dictionary,
+	  bits, &fec_id, &fec_direction);
+	Logical found = Tag_Dictionary__decode(tag_dictionary,
+	  bits, &tag_id, &direction);
+	assert (found == fec_found);
+	if (found) {
+	    assert (tag_id == fec_id && direction == fec_direction);
+	    corrected++;
+	} else {
+	    rejected++;
+	}
+    }
+    File__format(stdout, "Tag noise: words=%d corrected=%d rejected=%d\n",
+      words_size, corrected, rejected);
+}
+
+/// @brief Checks the tag word rotations against the tag layout.
+/// @param words_size is the number of random bit patterns to try.
+///
+/// *Decode_Test__orient_test*() will verify bit by bit that
+/// *Tag_Dictionary__orient*() moves sample point 8*row* + *column* to
+/// the tag bit that is printed there in each direction, and that
+/// *Tag_Dictionary__unorient*() undoes it.
+
+void Decode_Test__orient_test(Unsigned words_size) {
+    Unsigned random = 11223;
+    for (Unsigned index = 0; index < words_size; index++) {
+	uint64_t bits = Decode_Test__random_word(&random);
+	for (Unsigned direction = 0; direction < 4; direction++) {
+	    uint64_t word = Tag_Dictionary__orient(bits, direction);
+	    assert (Tag_Dictionary__unorient(word, direction) == bits);
+	    for (Unsigned row = 0; row < 8; row++) {
+		for (Unsigned column = 0; column < 8; column++) {
+		    // Tag bit 8*k + j is bit 7 - j of tag byte k:
+		    Unsigned tag_bit = 0;
+		    switch (direction) {
+		      case 0:
+			tag_bit = 8 * row + 7 - column;
+			break;
+		      case 1:
+			tag_bit = 63 - 8 * column - row;
+			break;
+		      case 2:
+			tag_bit = 56 - 8 * row + column;
+			break;
+		      case 3:
+			tag_bit = 8 * column + row;
+			break;
+		      default:
+			assert (0);
+			break;
+		    }
+		    Unsigned word_bit = (tag_bit & ~7) + 7 - (tag_bit & 7);
+		    assert (((word >> word_bit) & 1) ==
+		      ((bits >> (8 * row + column)) & 1));
+		}
+	    }
+	}
+    }
+    File__format(stdout, "Tag orient: words=%d\n", words_size);
+}
+
+/// @brief Returns a pseudo random 64-bit word.
+/// @param random is the pseudo random number state.
+/// @returns a pseudo random 64-bit word.
+///
+/// *Decode_Test__random_word*() will advance *random* and return a
+/// pseudo random 64-bit word.
+
+uint64_t Decode_Test__random_word(Unsigned *random) {
+    uint64_t word = 0;
+    for (Unsigned index = 0; index < 4; index++) {
+	*random = *random * 1103515245 + 12345;
+	word = (word << 16) | ((*random >> 8) & 0xffff);
+    }
+    return word;
+}
@@ -36,6 +36,7 @@ int main(int arguments_size, char *arguments[]) {
     assert (gettimeofday(start_time_value, (struct timezone *)0) == 0);
 
     Logical image_log = (Logical)0;
+    Logical undistort_sparse = (Logical)0;
     List /* <String> */ image_file_names =
       List__new("Demo:main:List__new:image_file_names");
     String lens_calibrate_file_name = (String)0;
@@ -49,6 +50,8 @@ int main(int arguments_size, char *arguments[]) {
 	    Unsigned size = String__size(argument);
 	    if (String__equal(argument, "--image_log")) {
 		image_log = (Logical)1;
+	    } else if (String__equal(argument, "--undistort_sparse")) {
+		undistort_sparse = (Logical)1;
 	    } else if (size > 4 && String__equal(argument + size - 4, ".txt")) {
 		lens_calibrate_file_name = argument;
 	    } else if (size > 4 && String__equal(argument + size - 4, ".log")) {
@@ -72,9 +75,10 @@ int main(int arguments_size, char *arguments[]) {
 	assert (image != (CV_Image)0);
 
 	// Load up *fiducials_create*:
-	Fiducials_Create fiducials_create = Fiducials_Create__one_and_only();
+	Fiducials_Create fiducials_create = Fiducials_Create__create();
 	fiducials_create->fiducials_path = (String_Const)".";
 	fiducials_create->lens_calibrate_file_name = lens_calibrate_file_name;
+	fiducials_create->undistort_sparse = undistort_sparse;
 	fiducials_create->announce_object = (Memory)0;
 	fiducials_create->arc_announce_routine = Fiducials__arc_announce;
 	fiducials_create->location_announce_routine =
@@ -86,6 +90,7 @@ int main(int arguments_size, char *arguments[]) {
 	  (String_Const)"Tag_Heights.xml";
 	
 	Fiducials fiducials = Fiducials__create(image, fiducials_create);
+	Fiducials_Create__free(fiducials_create);
 	fiducials->map->image_log = image_log;
 
 	for (Unsigned index = 0; index < size; index++) {
@@ -56,6 +56,23 @@
 // Helper macro to find minimum value.
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 
+// The shortened tag code has 8 symbols of 8 bits: 4 data and 4 parity.
+#define TAG_NN            255
+#define TAG_BLOCK_SIZE    8
+#define TAG_DATA_SIZE     4
+#define TAG_PARITY_SIZE   4
+#define TAG_ZERO_SIZE     (TAG_NN - TAG_BLOCK_SIZE)
+#define TAG_ALPHA_ZERO    ((uintGF) TAG_NN)
+
+// The largest exponent rvFec_TagCorrect() looks up in alphaToLong[] is
+// 254 + (TAG_PARITY_SIZE - 1) * 255, so this is plenty:
+#define TAG_ALPHA_LONG_SIZE  (TAG_PARITY_SIZE * TAG_NN)
+
+// Index of the syndrome table entry for syndrome i (1..4), block
+// position p (0..7) and received byte value v:
+#define TAG_SYNDROME(i, p, v) \
+  ((((i) - 1) * TAG_BLOCK_SIZE + (p)) * 256 + (v))
+
 // Primitive polynomial tables.  See Lin & Costello, Error Control Coding
 // Appendix A  and  Lee & Messerschmitt, Digital Communication p. 453.
 
@@ -195,6 +212,42 @@ rvFec_InitPolynomial(
 }
 
 
+static void
+rvFec_InitTagTables(
+  rvFec* self)
+{
+    // Initialize the tables used by rvFec_TagCorrect().
+    rvInt16 i;
+    rvInt16 p;
+    rvInt16 v;
+
+    // Local references so code is easier on the eyes.
+    uintGF *alphaTo = self->alphaTo;
+    uintGF *indexOf = self->indexOf;
+    uintGF *alphaToLong = self->alphaToLong;
+    uintGF *tagSyndromes = self->tagSyndromes;
+
+    // alphaToLong[x] is alphaTo[x % nn] (note alphaTo[nn] is 0, not 1.)
+    for (i = 0; i < TAG_ALPHA_LONG_SIZE; i++) {
+	alphaToLong[i] = alphaTo[i % TAG_NN];
+    }
+
+    // Block position p is received symbol j = TAG_ZERO_SIZE + p, which
+    // adds v * alpha**((ALPHA_ROOT + i - 1) * j) to syndrome i:
+    for (i = 1; i <= TAG_PARITY_SIZE; i++) {
+	for (p = 0; p < TAG_BLOCK_SIZE; p++) {
+	    rvInt16 power =
+	      ((ALPHA_ROOT + i - 1) * (TAG_ZERO_SIZE + p)) % TAG_NN;
+	    tagSyndromes[TAG_SYNDROME(i, p, 0)] = 0;
+	    for (v = 1; v < 256; v++) {
+		tagSyndromes[TAG_SYNDROME(i, p, v)] =
+		  alphaTo[(indexOf[v] + power) % TAG_NN];
+	    }
+	}
+    }
+}
+
+
 rvFec* rvFec_New(rvInt16 symbolSize, rvInt16 dataSize, rvInt16 paritySize)
 // Initialize the encoder object.
 {
@@ -263,6 +316,25 @@ rvFec* rvFec_New(rvInt16 symbolSize, rvInt16 dataSize, rvInt16 paritySize)
 
         // Initialize generator polynomial.
         rvFec_InitPolynomial(self);
+
+        // Initialize the tag code tables if this is the tag code.
+        self->alphaToLong = NULL;
+        self->tagSyndromes = NULL;
+        if ((mm == 8) && (dataSize == TAG_DATA_SIZE) &&
+	  (paritySize == TAG_PARITY_SIZE)) {
+            self->alphaToLong =
+	      (uintGF*) malloc(sizeof(uintGF) * TAG_ALPHA_LONG_SIZE);
+            self->tagSyndromes = (uintGF*) malloc(sizeof(uintGF) *
+	      TAG_PARITY_SIZE * TAG_BLOCK_SIZE * 256);
+            if ((self->alphaToLong != NULL) && (self->tagSyndromes != NULL)) {
+                rvFec_InitTagTables(self);
+            } else {
+                if (self->alphaToLong) free(self->alphaToLong);
+                if (self->tagSyndromes) free(self->tagSyndromes);
+                self->alphaToLong = NULL;
+                self->tagSyndromes = NULL;
+            }
+        }
     } else {
         // Clean up.
         if (self) free(self);
@@ -602,6 +674,312 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
     return 1;
 }
 
+static rvInt16
+rvFec_TagCommonFactor(
+  rvFec* self,
+  uintGF *lambda,
+  rvInt16 deg_lambda,
+  uintGF *omega,
+  rvInt16 deg_omega)
+// Returns 1 if lambda(x) and omega(x) (both in index form) have a common
+// factor and 0 otherwise.  This is Euclid's algorithm on polynomials.
+{
+    rvInt16 i;
+    rvInt16 da;
+    rvInt16 db;
+    uintGF a[TAG_PARITY_SIZE + 1];
+    uintGF b[TAG_PARITY_SIZE + 1];
+    uintGF *alphaTo = self->alphaToLong;
+    uintGF *indexOf = self->indexOf;
+
+    // Convert both polynomials to polynomial form.
+    for (i = 0; i <= TAG_PARITY_SIZE; i++) {
+	a[i] = (i > deg_lambda || lambda[i] == TAG_ALPHA_ZERO) ?
+	  0 : alphaTo[lambda[i]];
+	b[i] = (i > deg_omega || omega[i] == TAG_ALPHA_ZERO) ?
+	  0 : alphaTo[omega[i]];
+    }
+    da = deg_lambda;
+    db = deg_omega;
+    while ((db >= 0) && (b[db] == 0)) db--;
+
+    // A zero omega(x) shares all of lambda(x).
+    while (db >= 0) {
+	// a(x) <-- a(x) mod b(x)
+	while (da >= db) {
+	    if (a[da] != 0) {
+		rvInt16 factor = indexOf[a[da]] + TAG_NN - indexOf[b[db]];
+		for (i = 0; i <= db; i++) {
+		    if (b[i] != 0) {
+			a[i + da - db] ^= alphaTo[factor + indexOf[b[i]]];
+		    }
+		}
+	    }
+	    da--;
+	}
+	while ((da >= 0) && (a[da] == 0)) da--;
+
+	// Swap a(x) and b(x).
+	for (i = 0; i <= TAG_PARITY_SIZE; i++) {
+	    uintGF tmp = a[i];
+	    a[i] = b[i];
+	    b[i] = tmp;
+	}
+	i = da;
+	da = db;
+	db = i;
+    }
+
+    // a(x) is now the greatest common divisor.
+    return (da > 0);
+}
+
+
+rvInt16 rvFec_TagCorrect(rvFec* self, rvUint8* blockBuffer)
+// Correct the block buffer of the (8,4,4) tag code.  Returns 1 if success
+// or 0 if unable to correct.  This is rvFec_Correct() specialized for the
+// tag code, and it must give exactly the same results (including
+// the corrected bytes):
+//
+//   - Only the 8 live symbols contribute to the syndromes; the 247 zero
+//     padding symbols never do.  Each byte's contribution comes straight
+//     out of the tagSyndromes[] table.
+//   - All zero syndromes (the usual case for a good tag) return at once.
+//   - Working buffers are fixed size locals rather than alloca()'s.
+//   - alphaToLong[] replaces alphaTo[modnn()] so there are no divides.
+//   - The Chien search only visits the 8 live positions.  Only if it
+//     comes up short are the padding positions searched, since
+//     rvFec_Correct() treats roots there specially.
+{
+    rvInt16 i;
+    rvInt16 j;
+    rvInt16 r;
+    rvInt16 el;
+    rvInt16 count;
+    rvInt16 deg_omega;
+    rvInt16 deg_lambda;
+    rvInt16 loc[TAG_PARITY_SIZE];
+    uintGF b[TAG_PARITY_SIZE + 1];
+    uintGF t[TAG_PARITY_SIZE + 1];
+    uintGF root[TAG_PARITY_SIZE];
+    uintGF omega[TAG_PARITY_SIZE + 1];
+    uintGF lambda[TAG_PARITY_SIZE + 1];
+    uintGF syndromes[TAG_PARITY_SIZE + 1];
+    uintGF syn_error;
+
+    // Local references so code is easier on the eyes.
+    uintGF *alphaTo = self->alphaToLong;
+    uintGF *indexOf = self->indexOf;
+    uintGF *tagSyndromes = self->tagSyndromes;
+
+    // Form each syndrome from the 8 live symbols:
+    syn_error = 0;
+    for (i = 1; i <= TAG_PARITY_SIZE; i++) {
+        uintGF syndrome =
+	  tagSyndromes[TAG_SYNDROME(i, 0, blockBuffer[0])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 1, blockBuffer[1])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 2, blockBuffer[2])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 3, blockBuffer[3])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 4, blockBuffer[4])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 5, blockBuffer[5])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 6, blockBuffer[6])] ^
+	  tagSyndromes[TAG_SYNDROME(i, 7, blockBuffer[7])];
+        syn_error |= syndrome;
+        syndromes[i] = indexOf[syndrome];
+    }
+
+    if (!syn_error) {
+        // If all syndromes are zero there are no errors to correct.
+        return 1;
+    }
+
+    // Berlekamp-Massey algorithm to determine error locator polynomial.
+    lambda[0] = 1;
+    b[0] = 0;
+    for (i = 1; i < TAG_PARITY_SIZE + 1; ++i) {
+	lambda[i] = 0;
+	b[i] = TAG_ALPHA_ZERO;
+    }
+    el = 0;
+
+    for (r = 1; r <= TAG_PARITY_SIZE; ++r) {
+        uintGF discrepancy = 0;
+
+        // Compute discrepancy at the r-th step in poly-form.
+        for (i = 0; i < r; i++) {
+            if ((lambda[i] != 0) && (syndromes[r - i] != TAG_ALPHA_ZERO)) {
+                discrepancy ^= alphaTo[indexOf[lambda[i]] + syndromes[r - i]];
+            }
+        }
+        discrepancy = indexOf[discrepancy];
+
+        if (discrepancy == TAG_ALPHA_ZERO) {
+	    for (i = TAG_PARITY_SIZE - 1; i >= 0; --i) {
+		b[i + 1] = b[i];
+	    }
+            b[0] = TAG_ALPHA_ZERO;
+        } else {
+            // T(x) <-- lambda(x) - discrepancy*x*b(x)
+            t[0] = lambda[0];
+            for (i = 0 ; i < TAG_PARITY_SIZE; i++) {
+		if (b[i] != TAG_ALPHA_ZERO) {
+                    t[i + 1] = lambda[i + 1] ^ alphaTo[discrepancy + b[i]];
+                } else {
+                    t[i + 1] = lambda[i + 1];
+		}
+            }
+
+            if ((2 * el) < r) {
+                el = r - el;
+
+                // B(x) <-- inv(discrepancy) * lambda(x)
+                for (i = 0; i <= TAG_PARITY_SIZE; i++) {
+                    b[i] = (lambda[i] == 0) ? TAG_ALPHA_ZERO :
+		      (uintGF) ((indexOf[lambda[i]] - discrepancy + TAG_NN) %
+		      TAG_NN);
+                }
+            } else {
+		for (i = TAG_PARITY_SIZE - 1; i >= 0; --i) {
+		    b[i + 1] = b[i];
+		}
+                b[0] = TAG_ALPHA_ZERO;
+            }
+
+            for (i = 0; i < TAG_PARITY_SIZE + 1; ++i) lambda[i] = t[i];
+        }
+    }
+
+    // Convert lambda to index form and compute deg(lambda(x)).
+    deg_lambda = 0;
+    for (i = 0; i < TAG_PARITY_SIZE + 1; ++i) {
+        lambda[i] = indexOf[lambda[i]];
+        if (lambda[i] != TAG_ALPHA_ZERO) {
+	    deg_lambda = i;
+	}
+    }
+
+    // Compute error evaluator poly omega(x) =
+    // s(x) * lambda(x) (modulo x**(NN-KK))
+    // in index form. Also find deg(omega).
+    deg_omega = 0;
+    for (i = 0; i < TAG_PARITY_SIZE; ++i) {
+        uintGF tmp = 0;
+        for (j = (deg_lambda < i) ? deg_lambda : i; j >= 0; --j) {
+            if ((syndromes[i + 1 - j] != TAG_ALPHA_ZERO) &&
+	      (lambda[j] != TAG_ALPHA_ZERO)) {
+                tmp ^= alphaTo[syndromes[i + 1 - j] + lambda[j]];
+	    }
+        }
+        if (tmp != 0) {
+	    deg_omega = i;
+	}
+        omega[i] = indexOf[tmp];
+    }
+    omega[TAG_PARITY_SIZE] = TAG_ALPHA_ZERO;
+
+    // Chien search of the live positions; root i is error location
+    // nn - i, so the live positions are i = 1 ... TAG_BLOCK_SIZE:
+    count = 0;
+    for (i = 1; i <= TAG_BLOCK_SIZE; i++) {
+        uintGF q = 1;
+        for (j = deg_lambda; j > 0; j--) {
+            if (lambda[j] != TAG_ALPHA_ZERO) {
+                q ^= alphaTo[lambda[j] + i * j];
+            }
+        }
+        if (!q) {
+            root[count] = (uintGF) i;
+            loc[count] = TAG_NN - i;
+            count++;
+        }
+    }
+
+    // The remaining roots (if any) are in the zero padding.  A padding
+    // root is only acceptable if its error value is zero, which means it
+    // must be a root of omega(x) too.  So unless lambda(x) and omega(x)
+    // have a common factor, rvFec_Correct() would give up.  Otherwise,
+    // search the rest of the positions just like rvFec_Correct() does:
+    if (deg_lambda != count) {
+	rvInt16 reg[TAG_PARITY_SIZE + 1];
+	if (!rvFec_TagCommonFactor(self,
+	  lambda, deg_lambda, omega, deg_omega)) {
+	    return 0;
+	}
+	for (j = 1; j <= deg_lambda; j++) {
+	    reg[j] = (lambda[j] == TAG_ALPHA_ZERO) ? TAG_ALPHA_ZERO :
+	      (lambda[j] + TAG_BLOCK_SIZE * j) % TAG_NN;
+	}
+	for (i = TAG_BLOCK_SIZE + 1; i <= TAG_NN; i++) {
+	    uintGF q = 1;
+	    for (j = deg_lambda; j > 0; j--) {
+		if (reg[j] != TAG_ALPHA_ZERO) {
+		    reg[j] += j;
+		    if (reg[j] >= TAG_NN) {
+			reg[j] -= TAG_NN;
+		    }
+		    q ^= alphaTo[reg[j]];
+		}
+	    }
+	    if (!q) {
+		// More roots than deg(lambda) is uncorrectable anyway:
+		if (count == deg_lambda) {
+		    return 0;
+		}
+		root[count] = (uintGF) i;
+		loc[count] = TAG_NN - i;
+		count++;
+	    }
+	}
+    }
+
+    // If deg(lambda) unequal to number of roots then uncorrectable error
+    // detected:
+    if (deg_lambda != count) {
+        return 0;
+    }
+
+    // Compute error values in poly-form.  With ALPHA_ROOT == 1, num2 is
+    // always 1 (i.e. 0 in index form):
+    for (j = count - 1; j >= 0; j--) {
+        uintGF den;
+        uintGF num1;
+
+        num1 = 0;
+        for (i = deg_omega; i >= 0; i--) {
+	    if (omega[i] != TAG_ALPHA_ZERO) {
+		num1 ^= alphaTo[omega[i] + i * root[j]];
+	    }
+        }
+
+        den = 0;
+        for (i = MIN(deg_lambda, TAG_PARITY_SIZE - 1) & ~1; i >= 0; i -=2) {
+	    if (lambda[i + 1] != TAG_ALPHA_ZERO) {
+		den ^= alphaTo[lambda[i + 1] + i * root[j]];
+	    }
+        }
+
+        if (den == 0) {
+            return 0;
+        }
+
+        // Apply error to data.
+        if (num1 != 0) {
+            // We should never need to correct in the zero padding.
+            if (loc[j] < TAG_ZERO_SIZE) {
+                return 0;
+            }
+
+            // Only the data portion gets corrected.
+            if (loc[j] < TAG_ZERO_SIZE + TAG_DATA_SIZE) {
+                blockBuffer[loc[j] - TAG_ZERO_SIZE] ^=
+		  alphaTo[indexOf[num1] + TAG_NN - indexOf[den]];
+            }
+        }
+    }
+
+    return 1;
+}
+
 Logical
 FEC__correct(
     FEC fec,
@@ -617,8 +995,12 @@ FEC__correct(
 	data_bytes[index] = data[index] & 0xff;
     }    
 
-    /* Correct any errors: */
-    result = rvFec_Correct(fec, data_bytes);
+    /* Correct any errors (use the faster tag code decoder if we can): */
+    if (fec->tagSyndromes != NULL && size == TAG_BLOCK_SIZE) {
+	result = rvFec_TagCorrect(fec, data_bytes);
+    } else {
+	result = rvFec_Correct(fec, data_bytes);
+    }
 
     /* Load {data_bytes} into {data}: */
     for (index = 0; index < size; index++) {
@@ -628,6 +1010,64 @@ FEC__correct(
     return result;
 }
 
+Logical
+FEC__reference_correct(
+    FEC fec,
+    Unsigned *data,
+    Unsigned size)
+{
+    unsigned char data_bytes[8];
+    Unsigned index;
+    Logical result;
+
+    /* Load {data} into {data_bytes}: */
+    for (index = 0; index < size; index++) {
+	data_bytes[index] = data[index] & 0xff;
+    }
+
+    /* Correct any errors with the general purpose decoder: */
+    result = rvFec_Correct(fec, data_bytes);
+
+    /* Load {data_bytes} into {data}: */
+    for (index = 0; index < size; index++) {
+	data[index] = data_bytes[index];
+    }
+
+    return result;
+}
+
+Logical
+FEC__word_correct(
+    FEC fec,
+    uint64_t *word)
+{
+    rvUint8 data_bytes[8];
+    Unsigned index;
+    Logical result;
+    uint64_t data = *word;
+
+    /* Unpack {word} (least significant byte first) into {data_bytes}: */
+    for (index = 0; index < 8; index++) {
+	data_bytes[index] = (rvUint8) (data >> (index << 3));
+    }
+
+    /* Correct any errors (use the faster tag code decoder if we can): */
+    if (fec->tagSyndromes != NULL) {
+	result = rvFec_TagCorrect(fec, data_bytes);
+    } else {
+	result = rvFec_Correct(fec, data_bytes);
+    }
+
+    /* Pack {data_bytes} back into {word}: */
+    data = 0;
+    for (index = 0; index < 8; index++) {
+	data |= (uint64_t) data_bytes[index] << (index << 3);
+    }
+    *word = data;
+
+    return result;
+}
+
 void
 FEC__parity(
   FEC fec,
@@ -660,6 +1100,23 @@ FEC__create(
     return rvFec_New(symbol_size, data_size, parity_size);
 }
 
+void
+FEC__free(
+  FEC fec)
+{
+    /* Release the tables and then {fec} itself: */
+    if (fec->alphaToLong != NULL) {
+	free(fec->alphaToLong);
+    }
+    if (fec->tagSyndromes != NULL) {
+	free(fec->tagSyndromes);
+    }
+    free(fec->gg);
+    free(fec->alphaTo);
+    free(fec->indexOf);
+    free(fec);
+}
+
 /*
 
 		  GNU LESSER GENERAL PUBLIC LICENSE
@@ -19,6 +19,7 @@
 #include "Map.h"
 #include "String.h"
 #include "Tag.h"
+#include "Tag_Dictionary.h"
 #include "Unsigned.h"
 
 // Introduction:
@@ -600,13 +601,260 @@ void Fiducials__image_show(Fiducials fiducials, Logical show) {
     }
 }
 
+/// @brief Quickly check that *corners* have a dark border around them.
+/// @param fiducials is the *Fiducials* object that contains the image.
+/// @param corners is the 4 rough (e.g. integer) corners of a candidate.
+/// @returns (*Logical*)1 unless the candidate is clearly not a tag.
+///
+/// *Fiducials__border_probe*() will map the 8 reference points that
+/// *Fiducials__tag_points_compute*() uses (4 just outside of the black
+/// border and 4 on it) through the homography for *corners* and sample
+/// *gray_image* at each of them.  Since *corners* can be a pixel or two
+/// off, the probe only requires the black references to be darker than
+/// the white references on average; the real border test is done after
+/// the sub pixel corner refinement.  Candidates with a reference point
+/// outside of the image are let through.
+
+Logical Fiducials__border_probe(
+  Fiducials fiducials, CV_Point2D32F_Vector corners) {
+    // The reference points in 1/20ths of the quadralateral; the first 4
+    // are white and the last 4 are black:
+    static const Integer u20s[8] = {5,  5, 15, 15, 5,  5, 15, 15};
+    static const Integer v20s[8] = {-1, 21, -1, 21, 1, 19,  1, 19};
+
+    Double homography[8];
+    Fiducials__homography_compute(corners, homography);
+
+    // Add up the white and black samples:
+    CV_Image gray_image = fiducials->gray_image;
+    Integer white_sum = 0;
+    Integer black_sum = 0;
+    for (Unsigned index = 0; index < 8; index++) {
+	Double u = (Double)u20s[index] / 20.0;
+	Double v = (Double)v20s[index] / 20.0;
+	Double w = homography[6] * u + homography[7] * v + 1.0;
+	Integer x = CV__round(
+	  (homography[0] * u + homography[1] * v + homography[2]) / w);
+	Integer y = CV__round(
+	  (homography[3] * u + homography[4] * v + homography[5]) / w);
+	Integer value = CV_Image__gray_fetch(gray_image, x, y);
+	if (value < 0) {
+	    return (Logical)1;
+	}
+	if (index < 4) {
+	    white_sum += value;
+	} else {
+	    black_sum += value;
+	}
+    }
+    return (Logical)(black_sum < white_sum);
+}
+
+/// @brief Add the *Camera_Tag* for a found tag to *fiducials*.
+/// @param fiducials is the *Fiducials* object to add to.
+/// @param tag_id is the id of the tag.
+/// @param direction_index is the direction (0-3) that the tag matched.
+/// @param corners is the 4 (undistorted) corners of the tag.
+/// @returns the new *Camera_Tag*.
+///
+/// *Fiducials__camera_tag_add*() will initialize a *Camera_Tag* (from
+/// the *camera_tags_pool* if possible) for the tag with *tag_id* seen at
+/// *corners*, announce it, mark its *Tag* as currently visible and append
+/// it to the *camera_tags* of *fiducials*.  This is used both for decoded
+/// tags and for tags whose corners were tracked from the previous frame.
+
+Camera_Tag Fiducials__camera_tag_add(Fiducials fiducials,
+  Unsigned tag_id, Unsigned direction_index, CV_Point2D32F_Vector corners) {
+    List /* <Camera_Tag> */ camera_tags = fiducials->camera_tags;
+    List /* <Tag> */ current_visibles = fiducials->current_visibles;
+    CV_Image debug_image = fiducials->debug_image;
+    Unsigned debug_index = fiducials->debug_index;
+    File log_file = fiducials->log_file;
+    Map map = fiducials->map;
+
+    // Allocate a *camera_tag*:
+    List /* <Camera_Tag> */ camera_tags_pool =
+      fiducials->camera_tags_pool;
+    Camera_Tag camera_tag = (Camera_Tag)0;
+    if (List__size(camera_tags_pool) == 0) {
+	 // *camera_tags_pool* is empty;
+	// allocate a new one:
+	camera_tag = Camera_Tag__new();
+    } else {
+	camera_tag =
+	  (Camera_Tag)List__pop(camera_tags_pool);
+    }
+
+    // Load up *camera_tag* to get center, twist, etc.:
+    Tag tag = Map__tag_lookup(map, tag_id);
+
+    double vertices[4][2];
+    for (Unsigned index = 0; index < 4; index++) {
+      CV_Point2D32F pt = CV_Point2D32F_Vector__fetch1(corners, index);
+      vertices[index][0] = pt->x;
+      vertices[index][1] = pt->y;
+    }
+    fiducials->fiducial_announce_routine(
+	fiducials->announce_object, tag_id,
+	direction_index, tag->world_diagonal,
+	vertices[0][0], vertices[0][1],
+	vertices[1][0], vertices[1][1],
+	vertices[2][0], vertices[2][1],
+	vertices[3][0], vertices[3][1]);
+
+    if (debug_index == 11) {
+	Camera_Tag__initialize(camera_tag, tag,
+	  direction_index, corners, debug_image);
+    } else {
+	Camera_Tag__initialize(camera_tag, tag,
+	  direction_index, corners, (CV_Image)0);
+    }
+    List__append(current_visibles, (Memory)tag,
+      "Fiduicals__create:List_append:current_visibles");
+    File__format(log_file, "Tag: %d x=%f y=%f\n",
+      tag->id, tag->x, tag->y);
+
+    // Record the maximum *camera_diagonal*:
+    Double camera_diagonal = camera_tag->diagonal;
+    Double diagonal =
+      camera_diagonal;
+    if (diagonal  > tag->diagonal) {
+	tag->diagonal = diagonal;
+	tag->updated = (Logical)1;
+    }
+
+    // Append *camera_tag* to *camera_tags*:
+    List__append(camera_tags, (Memory)camera_tag,
+      "Fiducials__Create:List__append:camera_tags");
+    return camera_tag;
+}
+
+/// @brief Return the *Camera_Tag* for *tag_id* in *camera_tags*.
+/// @param camera_tags is the list of *Camera_Tag*'s to search.
+/// @param tag_id is the tag id to search for.
+/// @returns the matching *Camera_Tag* or (*Camera_Tag*)0 if none.
+///
+/// *Fiducials__camera_tag_find*() will return the *Camera_Tag* in
+/// *camera_tags* whose tag has an id of *tag_id*, or (*Camera_Tag*)0
+/// if there is none.
+
+Camera_Tag Fiducials__camera_tag_find(
+  List /* <Camera_Tag> */ camera_tags, Unsigned tag_id) {
+    Unsigned camera_tags_size = List__size(camera_tags);
+    for (Unsigned index = 0; index < camera_tags_size; index++) {
+	Camera_Tag camera_tag = (Camera_Tag)List__fetch(camera_tags, index);
+	if (camera_tag->tag->id == tag_id) {
+	    return camera_tag;
+	}
+    }
+    return (Camera_Tag)0;
+}
+
+/// @brief Decode the candidate quadrilaterals in the *quad_finder* of
+/// *fiducials*.
+/// @param fiducials is the *Fiducials* object to decode for.
+/// @param debug_index is the debug index that the frame is processed with.
+/// @param scale is the decimation that the candidates were found at.
+/// @param sequence_number is the number of the frame.
+///
+/// *Fiducials__candidates_decode*() will run each candidate quadrilateral
+/// through *Fiducials_Decoder__candidate_decode*() and leave the outcomes
+/// in the *candidates* of *fiducials* in candidate order.  The candidates
+/// are spread over *decode_threads* threads (the calling thread is one of
+/// them), each with its own *Fiducials_Decoder*.  Since each outcome only
+/// depends on its own candidate, the outcomes do not depend on the number
+/// of threads.  The debug images 8 through 11 are drawn candidate by
+/// candidate, so they are always decoded on the calling thread.
+
+void Fiducials__candidates_decode(Fiducials fiducials,
+  Unsigned debug_index, Integer scale, Unsigned sequence_number) {
+    // Make sure that there is a *Fiducials_Candidate* for each candidate:
+    Unsigned quads_size = fiducials->quad_finder->quads_size;
+    if (quads_size > fiducials->candidates_allocated) {
+	while (quads_size > fiducials->candidates_allocated) {
+	    fiducials->candidates_allocated *= 2;
+	}
+	fiducials->candidates = (Fiducials_Candidate)Memory__reallocate(
+	  (Memory)fiducials->candidates, fiducials->candidates_allocated *
+	  sizeof(struct Fiducials_Candidate__Struct),
+	  "Fiducials__candidates_decode");
+    }
+
+    // Clamp the number of threads so that each one gets a candidate:
+    Unsigned decoders_size = fiducials->decode_threads;
+    if (decoders_size > FIDUCIALS_DECODERS_MAXIMUM) {
+	decoders_size = FIDUCIALS_DECODERS_MAXIMUM;
+    }
+    if (decoders_size > quads_size) {
+	decoders_size = quads_size;
+    }
+    if (decoders_size < 1 || debug_index >= 8) {
+	decoders_size = 1;
+    }
+
+    // Decode on this thread and the rest in parallel.  The decoders past
+    // the first are only created once *decode_threads* asks for them:
+    fiducials->candidates_next = 0;
+    for (Unsigned index = 0; index < decoders_size; index++) {
+	Fiducials_Decoder decoder = fiducials->decoders[index];
+	if (decoder == (Fiducials_Decoder)0) {
+	    decoder = Fiducials_Decoder__create(fiducials);
+	    fiducials->decoders[index] = decoder;
+	}
+	decoder->debug_index = debug_index;
+	decoder->scale = scale;
+	decoder->sequence_number = sequence_number;
+    }
+    for (Unsigned index = 1; index < decoders_size; index++) {
+	Fiducials_Decoder decoder = fiducials->decoders[index];
+	Integer result = pthread_create(&decoder->thread,
+	  (pthread_attr_t *)0, Fiducials_Decoder__process, (void *)decoder);
+	assert (result == 0);
+    }
+    Fiducials_Decoder__process((void *)fiducials->decoders[0]);
+    for (Unsigned index = 1; index < decoders_size; index++) {
+	Integer result =
+	  pthread_join(fiducials->decoders[index]->thread, (void **)0);
+	assert (result == 0);
+    }
+}
+
+/// @brief Reset the candidate counters of *fiducials*.
+/// @param fiducials is the *Fiducials* object to reset the counters of.
+///
+/// *Fiducials__counters_reset*() will set all of the *Fiducials_Counters*
+/// of *fiducials* back to zero.
+
+void Fiducials__counters_reset(Fiducials fiducials) {
+    Fiducials_Counters counters = fiducials->counters;
+    counters->cache_hits = 0;
+    counters->cache_misses = 0;
+    counters->candidates = 0;
+    counters->frames_full = 0;
+    counters->frames_predicted = 0;
+    counters->frames_roi = 0;
+    counters->frames_tracked = 0;
+    counters->rejected_border = 0;
+    counters->rejected_decode = 0;
+    counters->rejected_duplicate = 0;
+    counters->rejected_probe = 0;
+    counters->rejected_shape = 0;
+    counters->tags = 0;
+    counters->tags_tracked = 0;
+}
+
 /// @brief Create and return a *Fiducials* object.
 /// @param original_image is the image to start with.
 /// @param fiducials_create is a *Fiducials_Create* object that
 ///        specifies the various features to enable or disable.
 ///
 /// *Fiducials__create*() creates and returns a *Fiducials* object
-/// using the values in *fiduicials_create*.
+/// using the values in *fiduicials_create*.  Building a *Tag_Dictionary*
+/// takes a lot of time and memory, so when the *tag_dictionary* of
+/// *fiducials_create* is not null, it is shared (it is only read while
+/// decoding) and must outlive the *Fiducials* object.  Otherwise a
+/// *Tag_Dictionary* (and its *FEC*) are built and owned by the
+/// *Fiducials* object.
 
 //FIXME: Change this code so that the image size is determined from
 // the first image that is processed.  This allows the image size
@@ -638,6 +886,8 @@ Fiducials Fiducials__create(
     String_Const map_base_name = fiducials_create->map_base_name;
     String_Const tag_heights_file_name =
       fiducials_create->tag_heights_file_name;
+    Logical undistort_sparse = fiducials_create->undistort_sparse;
+    Tag_Dictionary tag_dictionary = fiducials_create->tag_dictionary;
 
     // Get *log_file* open if *log_file_name* is not null:
     File log_file = stderr;
@@ -652,134 +902,45 @@ Fiducials Fiducials__create(
     Integer term_criteria_type =
       CV__term_criteria_iterations | CV__term_criteria_eps;
 
-    // The north/west/south/east mappings must reside in static
-    // memory rather than on the stack:
-
-    static Logical north_mapping[64] = {
-	//corner1	      corner0
-	 0,  1,  2,  3,  4,  5,  6,  7,
-	 8,  9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	//corner2	      corner3
-    };
-
-    static Logical west_mapping[64] = {
-	//corner1	      corner0
-	 7, 15, 23, 31, 39, 47, 55, 63,
-	 6, 14, 22, 30, 38, 46, 54, 62,
-	 5, 13, 21, 29, 37, 45, 53, 61,
-	 4, 12, 20, 28, 36, 44, 52, 60,
-	 3, 11, 19, 27, 35, 43, 51, 59,
-	 2, 10, 18, 26, 34, 42, 50, 58,
-	 1,  9, 17, 25, 33, 41, 49, 57,
-	 0,  8, 16, 24, 32, 40, 48, 56,
-	//corner2	      corner3
-    };
-
-    static Logical south_mapping[64] = {
-	//corner1	      corner0
-	63, 62, 61, 60, 59, 58, 57, 56,
-	55, 54, 53, 52, 51, 50, 49, 48,
-	47, 46, 45, 44, 43, 42, 41, 40,
-	39, 38, 37, 36, 35, 34, 33, 32,
-	31, 30, 29, 28, 27, 26, 25, 24,
-	23, 22, 21, 20, 19, 18, 17, 16,
-	15, 14, 13, 12, 11, 10,  9,  8,
-	 7,  6,  5,  4,  3,  2,  1,  0,
-	//corner2	      corner3
-    };
-
-    static Logical east_mapping[64] = {
-	//corner1	      corner0
-	56, 48, 40, 32, 24, 16,  8,  0,
-	57, 49, 41, 33, 25, 17,  9,  1,
-	58, 50, 42, 34, 26, 18, 10,  2,
-	59, 51, 43, 35, 27, 19, 11,  3,
-	60, 52, 44, 36, 28, 20, 12,  4,
-	61, 53, 45, 37, 29, 21, 13,  5,
-	62, 54, 46, 38, 30, 22, 14,  6,
-	63, 55, 47, 39, 31, 23, 15,  7,
-	//corner2	      corner3
-    };
-
-    static Logical north_mapping_flipped[64] = {
-	//corner1	      corner0
-	 7,  6,  5,  4,  3,  2,  1,  0,
-	15, 14, 13, 12, 11, 10,  9,  8,
-	23, 22, 21, 20, 19, 18, 17, 16,
-	31, 30, 29, 28, 27, 26, 25, 24,
-	39, 38, 37, 36, 35, 34, 33, 32,
-	47, 46, 45, 44, 43, 42, 41, 40,
-	55, 54, 53, 52, 51, 50, 49, 48,
-	63, 62, 61, 60, 59, 58, 57, 56,
-	 //corner2	      corner3
-    };
-
-    static Logical west_mapping_flipped[64] = {
-	//corner1	      corner0
-	63, 55, 47, 39, 31, 23, 15, 7,
-	62, 54, 46, 38, 30, 22, 14, 6,
-	61, 53, 45, 37, 29, 21, 13, 5,
-	60, 52, 44, 36, 28, 20, 12, 4,
-	59, 51, 43, 35, 27, 19, 11, 3,
-	58, 50, 42, 34, 26, 18, 10, 2,
-	57, 49, 41, 33, 25, 17,  9, 1,
-	56, 48, 40, 32, 24, 16,  8, 0,
-	//corner2	      corner3
-    };
-
-    static Logical south_mapping_flipped[64] = {
-	//corner1	      corner0
-	56, 57, 58, 59, 60, 61, 62, 63, 
-	48, 49, 50, 51, 52, 53, 54, 55,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	 8,  9, 10, 11, 12, 13, 14, 15, 
-	 0,  1,  2,  3,  4,  5,  6,  7,
-	//corner2	      corner3
-    };
-
-    static Logical east_mapping_flipped[64] = {
-	//corner1	      corner0
-	 0,  8, 16, 24, 32, 40, 48, 56,
-	 1,  9, 17, 25, 33, 41, 49, 57,
-	 2, 10, 18, 26, 34, 42, 50, 58,
-	 3, 11, 19, 27, 35, 43, 51, 59,
-	 4, 13, 20, 28, 36, 44, 52, 60,
-	 5, 13, 21, 29, 37, 45, 53, 61,
-	 6, 14, 22, 30, 38, 46, 54, 62,
-	 7, 15, 23, 31, 39, 47, 55, 63,
-	 //corner2	      corner3
-    };
-
-    // The north/west/south/east mappings must reside in static
-    // memory rather than on the stack:
-
-    static Logical *mappings[4] = {
-	&north_mapping_flipped[0],
-	&west_mapping_flipped[0],
-	&south_mapping_flipped[0],
-	&east_mapping_flipped[0],
-    };
-
-    //for (Unsigned index = 0; index < 4; index++) {
-    //	File__format(log_file, "mappings[%d]=0x%x\n", index, mappings[index]);
-    //}
+    // Create the *tag_dictionary* used to decode tag bits unless it is
+    // shared:
+    Logical tag_dictionary_owned =
+      (Logical)(tag_dictionary == (Tag_Dictionary)0);
+    if (tag_dictionary_owned) {
+	tag_dictionary = Tag_Dictionary__create(FEC__create(8, 4, 4));
+    }
 
+    // Read in the lens parameters (the focal lengths are also used to
+    // size the tags).  Either undistort just the tag corners and sample
+    // points (*undistort_sparse*), or build the maps to undistort every
+    // frame.  A lens calibration file that can not be read is reported
+    // and then treated as if there was none:
     CV_Image map_x = (CV_Image)0;
     CV_Image map_y = (CV_Image)0;
-    if (lens_calibrate_file_name != (String)0) {
+    Double lens[CV_LENS_SIZE];
+    for (Unsigned index = 0; index < CV_LENS_SIZE; index++) {
+	lens[index] = 0.0;
+    }
+    if (lens_calibrate_file_name == (String)0) {
+	undistort_sparse = (Logical)0;
+    } else {
 	String full_lens_calibrate_file_name =
 	  String__format("%s/%s", fiducials_path, lens_calibrate_file_name);
-	assert (CV__undistortion_setup(
-	  full_lens_calibrate_file_name, width, height, &map_x, &map_y) == 0);
+	Integer result =
+	  CV__lens_calibrate_read(full_lens_calibrate_file_name, lens);
+	if (result == 0 && !undistort_sparse) {
+	    result = CV__undistortion_setup(full_lens_calibrate_file_name,
+	      width, height, &map_x, &map_y);
+	}
+	if (result != 0) {
+	    File__format(stderr,
+	      "Could not read lens calibration '%s'; not undistorting\n",
+	      full_lens_calibrate_file_name);
+	    for (Unsigned index = 0; index < CV_LENS_SIZE; index++) {
+		lens[index] = 0.0;
+	    }
+	    undistort_sparse = (Logical)0;
+	}
 	String__free(full_lens_calibrate_file_name);
     }
 
@@ -788,10 +949,24 @@ Fiducials Fiducials__create(
       arc_announce_routine, tag_announce_routine,
       tag_heights_file_name, "Fiducials__new:Map__create");
 
+    // Size the smallest tag worth looking at.  A square tag with a
+    // diagonal of D pixels has an area of D*D/2 square pixels; never look
+    // at anything smaller than 500 square pixels:
+    Double tag_diagonal_minimum = Fiducials__tag_diagonal_minimum(map, lens);
+    Double tag_area_minimum =
+      tag_diagonal_minimum * tag_diagonal_minimum / 2.0;
+    if (tag_area_minimum < 500.0) {
+	tag_area_minimum = 500.0;
+    }
+
     Fiducials_Results results =
       Memory__new(Fiducials_Results, "Fiducials__create");
     results->map_changed = (Logical)0;
 
+    // The *frame* that *Fiducials__process*() uses owns the gray scale
+    // and edge images:
+    Fiducials_Frame frame = Fiducials_Frame__create(image_size);
+
     // Create and load *fiducials*:
     Fiducials fiducials = Memory__new(Fiducials, "Fiducials__create");
     fiducials->arc_announce_routine = arc_announce_routine;
@@ -806,18 +981,43 @@ Fiducials Fiducials__create(
       List__new("Fiducials__create:List__new:camera_tags"); // <Camera_Tag>
     fiducials->camera_tags_pool =
       List__new("Fiducials__create:List__new:camera_tags_pool"); // <Camera_Tag>
+    fiducials->candidate_cascade = (Logical)1;
+    fiducials->candidates_allocated = 16;
+    fiducials->candidates = (Fiducials_Candidate)Memory__allocate(
+      fiducials->candidates_allocated *
+      sizeof(struct Fiducials_Candidate__Struct), "Fiducials__create");
+    Integer result = pthread_mutex_init(&fiducials->candidates_mutex,
+      (pthread_mutexattr_t *)0);
+    assert (result == 0);
+    fiducials->candidates_next = 0;
+    fiducials->contours_reference = (Logical)0;
+    fiducials->corner_tracker = Corner_Tracker__create();
     fiducials->corners = CV_Point2D32F_Vector__create(4);
+    fiducials->corners_line_fit = (Logical)0;
+    fiducials->corners_tracking = (Logical)0;
+    fiducials->counters =
+      Memory__new(Fiducials_Counters, "Fiducials__create");
     fiducials->current_visibles =
       List__new("Fiducials__create:List_new:current_visibles"); // Tag
     fiducials->cyan = CV_Scalar__rgb(0.0, 1.0, 1.0);
     fiducials->debug_image = CV_Image__create(image_size, CV__depth_8u, 3);
     fiducials->debug_index = 0;
-    fiducials->edge_image = CV_Image__create(image_size, CV__depth_8u, 1);
-    fiducials->fec = FEC__create(8, 4, 4);
-    fiducials->gray_image = CV_Image__create(image_size, CV__depth_8u, 1);
+    fiducials->decode_threads = 1;
+    fiducials->decoders[0] = Fiducials_Decoder__create(fiducials);
+    for (Unsigned index = 1; index < FIDUCIALS_DECODERS_MAXIMUM; index++) {
+	fiducials->decoders[index] = (Fiducials_Decoder)0;
+    }
+    fiducials->edge_image = frame->edge_image;
+    fiducials->fec = tag_dictionary->fec;
+    fiducials->frame = frame;
+    frame->debug_image = fiducials->debug_image;
+    fiducials->gray_image = frame->gray_image;
     fiducials->green = CV_Scalar__rgb(0.0, 255.0, 0.0);
     fiducials->image_size = image_size;
     fiducials->last_x = 0.0;
+    for (Unsigned index = 0; index < CV_LENS_SIZE; index++) {
+	fiducials->lens[index] = lens[index];
+    }
     fiducials->last_y = 0.0;
     fiducials->location_announce_routine = location_announce_routine;
     fiducials->locations =
@@ -826,28 +1026,62 @@ Fiducials Fiducials__create(
     fiducials->map = map;
     fiducials->map_x = map_x;
     fiducials->map_y = map_y;
-    fiducials->mappings = &mappings[0];
+    fiducials->odometry_anchored = (Logical)0;
+    fiducials->odometry_anchor_etw = 0.0;
+    fiducials->odometry_anchor_ex = 0.0;
+    fiducials->odometry_anchor_ey = 0.0;
+    fiducials->odometry_anchor_rtw = 0.0;
+    fiducials->odometry_anchor_rx = 0.0;
+    fiducials->odometry_anchor_ry = 0.0;
+    fiducials->odometry_etw = 0.0;
+    fiducials->odometry_ex = 0.0;
+    fiducials->odometry_ey = 0.0;
+    fiducials->odometry_valid = (Logical)0;
     fiducials->origin = CV_Point__create(0, 0);
     fiducials->original_image = original_image;
     fiducials->path = fiducials_path;
+    fiducials->pipelined = (Logical)0;
+    fiducials->preprocess_reference = (Logical)0;
     fiducials->previous_visibles =
       List__new("Fiducials__create:List__new:previous_visibles"); // Tag
     fiducials->purple = CV_Scalar__rgb(255.0, 0.0, 255.0);
+    fiducials->pyramid_scale = 1;
+    fiducials->quad_cache = Quad_Cache__create();
+    fiducials->quad_caching = (Logical)1;
+    fiducials->quad_finder = Quad_Finder__create();
     fiducials->red = CV_Scalar__rgb(255.0, 0.0, 0.0);
-    fiducials->references = CV_Point2D32F_Vector__create(8);
+    fiducials->remap_table =
+      CV__remap_table_create(map_x, map_y, (Integer)width, (Integer)height);
     fiducials->results = results;
-    fiducials->sample_points = CV_Point2D32F_Vector__create(64);
+    fiducials->roi_countdown = 0;
+    fiducials->roi_full_interval = FIDUCIALS_ROI_FULL_INTERVAL;
+    fiducials->roi_tracking = (Logical)0;
+    fiducials->rois_allocated = 16;
+    fiducials->rois = (Integer *)Memory__allocate(
+      fiducials->rois_allocated * 4 * sizeof(Integer), "Fiducials__create");
+    fiducials->rois_size = 0;
     fiducials->size_5x5 = CV_Size__create(5, 5);
     fiducials->size_m1xm1 = CV_Size__create(-1, -1);
     fiducials->sequence_number = 0;
     fiducials->storage = storage;
+    fiducials->tag_area_minimum = tag_area_minimum;
+    fiducials->tag_diagonal_minimum = tag_diagonal_minimum;
+    fiducials->tag_dictionary = tag_dictionary;
+    fiducials->tag_dictionary_owned = tag_dictionary_owned;
     fiducials->temporary_gray_image =
       CV_Image__create(image_size, CV__depth_8u, 1);
+    fiducials->threshold_bands = 1;
+    fiducials->threshold_gaussian = (Logical)0;
+    fiducials->track_countdown = 0;
+    fiducials->track_full_interval = FIDUCIALS_TRACK_FULL_INTERVAL;
+    fiducials->undistort_sparse = undistort_sparse;
+    fiducials->update_sequence_number = 0;
     fiducials->weights_index = 0;
     fiducials->term_criteria = 
       CV_Term_Criteria__create(term_criteria_type, 5, 0.2);
     fiducials->y_flip = (Logical)0;
     fiducials->black = CV_Scalar__rgb(0, 0, 0);
+    Fiducials__counters_reset(fiducials);
 
     return fiducials;
 }
@@ -902,6 +1136,35 @@ void Fiducials__free(Fiducials fiducials) {
     // Relaase the *Map*:
     Map__free(fiducials->map);
 
+    // Release the *Tag_Dictionary* (and its *FEC*) unless it is shared,
+    // and the *Corner_Tracker*, *Quad_Cache* and *Quad_Finder*:
+    if (fiducials->tag_dictionary_owned) {
+	Tag_Dictionary__free(fiducials->tag_dictionary);
+	FEC__free(fiducials->fec);
+    }
+    Corner_Tracker__free(fiducials->corner_tracker);
+    Quad_Cache__free(fiducials->quad_cache);
+    Quad_Finder__free(fiducials->quad_finder);
+
+    // Release the undistortion remap table, the counters and the regions
+    // of interest:
+    Memory__free((Memory)fiducials->remap_table);
+    Memory__free((Memory)fiducials->counters);
+    Memory__free((Memory)fiducials->rois);
+
+    // Release the candidates and their decoders:
+    Memory__free((Memory)fiducials->candidates);
+    pthread_mutex_destroy(&fiducials->candidates_mutex);
+    for (Unsigned index = 0; index < FIDUCIALS_DECODERS_MAXIMUM; index++) {
+	Fiducials_Decoder decoder = fiducials->decoders[index];
+	if (decoder != (Fiducials_Decoder)0) {
+	    Fiducials_Decoder__free(decoder);
+	}
+    }
+
+    // Release the *frame* (and its images):
+    Fiducials_Frame__free(fiducials->frame);
+
     // Finally release *fiducials*:
     Memory__free((Memory)fiducials);
 }
@@ -916,37 +1179,75 @@ void Fiducials__map_save(Fiducials fiducials) {
     Map__save(fiducials->map);
 }
 
+/// @brief Set the dead reckoning position for the next image.
+/// @param fiducials is the *Fiducials* object to set the position of.
+/// @param ex is the robot X coordinate from the wheel encoders.
+/// @param ey is the robot Y coordinate from the wheel encoders.
+/// @param etw is the robot twist from the wheel encoders in radians.
+///
+/// *Fiducials__odometry_set*() will remember the dead reckoning position
+/// (ex, ey, etw) (see "Fusing with Dead Reckoning" above) for the next
+/// call to *Fiducials__process*().  Once an image has been located, the
+/// change in (ex, ey, etw) from that image predicts where the robot is,
+/// and the map tags near it are only searched for in the windows that
+/// *Fiducials__tags_predict*() projects them into.  It needs to be called
+/// before each *Fiducials__process*() to keep the prediction going.  It
+/// is not used with a *Fiducials_Pipeline*, which processes the next
+/// frame before the current one is located.
+
+void Fiducials__odometry_set(
+  Fiducials fiducials, Double ex, Double ey, Double etw) {
+    fiducials->odometry_etw = etw;
+    fiducials->odometry_ex = ex;
+    fiducials->odometry_ey = ey;
+    fiducials->odometry_valid = (Logical)1;
+}
+
 /// @brief Process the current image associated with *fiducials*.
 /// @param fiducials is the *Fiducials* object to use.
 /// @returns a *Fiducials_Results* that contains information about
 ///          how the processing worked.
 ///
 /// *Fiducials__process*() will process *fiducials* to determine
-/// the robot location.
+/// the robot location.  The image is run through the three stages
+/// (*Fiducials__frame_preprocess*(), *Fiducials__frame_detect*() and
+/// *Fiducials__frame_update*()) one after the other in the *frame* of
+/// *fiducials*; a *Fiducials_Pipeline* runs them on separate threads.
 
 Fiducials_Results Fiducials__process(Fiducials fiducials) {
-    // Clear *storage*:
-    CV_Memory_Storage storage = fiducials->storage;
-    CV_Memory_Storage__clear(storage);
+    Fiducials_Frame frame = fiducials->frame;
+    frame->debug_index = fiducials->debug_index;
+    frame->original_image = fiducials->original_image;
+    Fiducials__frame_preprocess(fiducials, frame);
+    Fiducials__frame_detect(fiducials, frame);
+    return Fiducials__frame_update(fiducials, frame);
+}
 
-    // Grab some values from *fiducials*:
-    List /*<Tag>*/ current_visibles = fiducials->current_visibles;
-    CV_Image debug_image = fiducials->debug_image;
-    Unsigned debug_index = fiducials->debug_index;
-    CV_Image edge_image = fiducials->edge_image;
-    CV_Image gray_image = fiducials->gray_image;
-    List /*<Location>*/ locations = fiducials->locations;
-    File log_file = fiducials->log_file;
-    CV_Image original_image = fiducials->original_image;
-    List /*<Tag>*/ previous_visibles = fiducials->previous_visibles;
-    Fiducials_Results results = fiducials->results;
+/// @brief Preprocess the original image of *frame*.
+/// @param fiducials is the *Fiducials* object to use.
+/// @param frame is the *Fiducials_Frame* to preprocess.
+///
+/// *Fiducials__frame_preprocess*() is the first stage of
+/// *Fiducials__process*().  It will give *frame* the next sequence
+/// number, decide whether *frame* is searched in full, in regions of
+/// interest or only tracked, convert the original image of *frame* to
+/// the undistorted and blurred *gray_image* of *frame*, and then
+/// (possibly decimated) threshold that into the *edge_image* of *frame*.
+/// Only the images of *frame* are written, so this can run on the next
+/// frame while *Fiducials__frame_detect*() runs on this one.
+
+void Fiducials__frame_preprocess(Fiducials fiducials, Fiducials_Frame frame) {
+    // Grab some values from *fiducials* and *frame*:
+    CV_Image debug_image = frame->debug_image;
+    Unsigned debug_index = frame->debug_index;
+    CV_Image edge_image = frame->edge_image;
+    CV_Image gray_image = frame->gray_image;
+    CV_Image original_image = frame->original_image;
     CV_Image temporary_gray_image = fiducials->temporary_gray_image;
-    Fiducials_Location_Announce_Routine location_announce_routine =
-      fiducials->location_announce_routine;
-    Unsigned sequence_number = fiducials->sequence_number++;
+    frame->sequence_number = fiducials->sequence_number++;
 
     // For *debug_level* 0, we show the original image in color:
-    if (debug_index == 0) {
+    if (debug_index == 0 && debug_image != (CV_Image)0) {
 	CV_Image__copy(original_image, debug_image, (CV_Image)0);
     }
 
@@ -954,7 +1255,7 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
     Integer channels = CV_Image__channels_get(original_image);
 
     // Deal with *debug_index* 0:
-    if (debug_index == 0) {
+    if (debug_index == 0 && debug_image != (CV_Image)0) {
 	if (channels == 3) {
 	    // Original image is color, so a simple copy will work:
 	    CV_Image__copy(original_image, debug_image, (CV_Image)0);
@@ -965,38 +1266,118 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
 	}
     }
 
-    // Convert *original_image* to gray scale:
-    if (channels == 3) {
-	// Original image is color, so we need to convert to gray scale:
-	CV_Image__convert_color(original_image, gray_image, CV__rgb_to_gray);
-    } else if (channels == 1) {
-	// Original image is gray, so a simple copy will work:
-	CV_Image__copy(original_image, gray_image, (CV_Image)0);
-    } else {
-	assert(0);
-    }
-
-    // Show results of gray scale converion for *debug_index* 1:
-    if (debug_index == 1) {
-	CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
+    // With *corners_tracking*, most frames do not search for tags at
+    // all.  Instead, the corners of the tags found in the previous frame
+    // are tracked into this one by *corner_tracker*.  The tags are
+    // searched for every *track_full_interval* frames, in the frame after
+    // a tracked tag is lost, and whenever the reference code or a debug
+    // image needs the search:
+    Unsigned track_tracked_size = (fiducials->corners_tracking) ?
+      fiducials->corner_tracker->size : 0;
+    Logical track_pass = (Logical)(fiducials->corners_tracking &&
+      fiducials->track_countdown > 0 && track_tracked_size > 0 &&
+      !fiducials->contours_reference && debug_index < 4);
+
+    // With *roi_tracking*, most frames only preprocess, threshold and
+    // search the regions of interest around the tags found in the
+    // previous frame.  The whole frame is searched every
+    // *roi_full_interval* frames, in the frame after a tracked tag is
+    // lost, and whenever the reference code or a debug image needs the
+    // whole frame.  With odometry, the windows that the map tags are
+    // predicted to be in are searched as regions of interest as well,
+    // which also finds the tags that are just coming into view:
+    Unsigned roi_tracked_size =
+      (fiducials->roi_tracking) ? fiducials->rois_size : 0;
+    Unsigned roi_predicted_size = 0;
+    if (!track_pass && fiducials->odometry_valid &&
+      fiducials->odometry_anchored) {
+	fiducials->rois_size = roi_tracked_size;
+	roi_predicted_size = Fiducials__tags_predict(fiducials);
     }
-    
-    // Preform undistort if available:
-    if (fiducials->map_x != (CV_Image)0) {
-	Integer flags = CV_INTER_NN | CV_WARP_FILL_OUTLIERS;
-	CV_Image__copy(gray_image, temporary_gray_image, (CV_Image)0);
-	CV_Image__remap(temporary_gray_image, gray_image,
-	  fiducials->map_x, fiducials->map_y, flags, fiducials->black);
+    Logical roi_pass = (Logical)(!track_pass &&
+      (roi_tracked_size > 0 || roi_predicted_size > 0) &&
+      fiducials->roi_countdown > 0 &&
+      !fiducials->threshold_gaussian && !fiducials->contours_reference &&
+      !(4 <= debug_index && debug_index <= 8));
+    if (roi_pass) {
+	Fiducials__rois_merge(fiducials);
     }
 
-    // Show results of undistort:
-    if (debug_index == 2) {
-	CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
-    }
+    // The odometry belongs to this frame from now on:
+    frame->odometry_etw = fiducials->odometry_etw;
+    frame->odometry_ex = fiducials->odometry_ex;
+    frame->odometry_ey = fiducials->odometry_ey;
+    frame->odometry_valid = fiducials->odometry_valid;
+    fiducials->odometry_valid = (Logical)0;
+
+    // Convert *original_image* to gray scale, undistort it and blur it.
+    // The fused version does this in a single pass.  The original chain
+    // of full image passes is kept as a reference (and to display the
+    // intermediate images for *debug_index* 1 and 2):
+    if (fiducials->preprocess_reference ||
+      debug_index == 1 || debug_index == 2) {
+	// Convert *original_image* to gray scale:
+	if (channels == 3) {
+	    // Original image is color, so we need to convert to gray scale:
+	    CV_Image__convert_color(
+	      original_image, gray_image, CV__rgb_to_gray);
+	} else if (channels == 1) {
+	    // Original image is gray, so a simple copy will work:
+	    CV_Image__copy(original_image, gray_image, (CV_Image)0);
+	} else {
+	    assert(0);
+	}
+
+	// Show results of gray scale converion for *debug_index* 1:
+	if (debug_index == 1) {
+	    CV_Image__convert_color(
+	      gray_image, debug_image, CV__gray_to_rgb);
+	}
+
+	// Preform undistort if available:
+	if (fiducials->map_x != (CV_Image)0) {
+	    Integer flags = CV_INTER_NN | CV_WARP_FILL_OUTLIERS;
+	    CV_Image__copy(gray_image, temporary_gray_image, (CV_Image)0);
+	    CV_Image__remap(temporary_gray_image, gray_image,
+	      fiducials->map_x, fiducials->map_y, flags, fiducials->black);
+	}
+
+	// Show results of undistort:
+	if (debug_index == 2) {
+	    CV_Image__convert_color(
+	      gray_image, debug_image, CV__gray_to_rgb);
+	}
 
-    // Perform Gaussian blur if requested:
-    if (fiducials->blur) {
-	CV_Image__smooth(gray_image, gray_image, CV__gaussian, 3, 0, 0.0, 0.0);
+	// Perform Gaussian blur if requested:
+	if (fiducials->blur) {
+	    CV_Image__smooth(
+	      gray_image, gray_image, CV__gaussian, 3, 0, 0.0, 0.0);
+	}
+    } else if (roi_pass && !fiducials->map->image_log) {
+	// Only the regions of interest (plus what the threshold box
+	// reaches around them) are needed.  The rest of *gray_image* is
+	// left over from an earlier frame:
+	Integer width = CV_Image__width_get(gray_image);
+	Integer height = CV_Image__height_get(gray_image);
+	Integer margin = FIDUCIALS_ROI_MARGIN;
+	Unsigned rois_size = fiducials->rois_size;
+	for (Unsigned roi_index = 0; roi_index < rois_size; roi_index++) {
+	    Integer *roi = fiducials->rois + 4 * roi_index;
+	    Integer left = (roi[0] > margin) ? roi[0] - margin : 0;
+	    Integer top = (roi[1] > margin) ? roi[1] - margin : 0;
+	    Integer right =
+	      (roi[2] + margin < width) ? roi[2] + margin : width;
+	    Integer bottom =
+	      (roi[3] + margin < height) ? roi[3] + margin : height;
+	    if (left < right && top < bottom) {
+		CV_Image__gray_undistort_smooth_rectangle(original_image,
+		  gray_image, fiducials->remap_table, fiducials->blur,
+		  left, top, right - left, bottom - top);
+	    }
+	}
+    } else {
+	CV_Image__gray_undistort_smooth(original_image, gray_image,
+	  fiducials->remap_table, fiducials->blur, fiducials->threshold_bands);
     }
 
     // Show results of Gaussian blur for *debug_index* 2:
@@ -1004,362 +1385,425 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
 	CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
     }
 
-    // Perform adpative threshold:
-    CV_Image__adaptive_threshold(gray_image, edge_image, 255.0,
-      CV__adaptive_thresh_gaussian_c, CV__thresh_binary, 45, 5.0);
+    // The tag contours are found on *gray_image* decimated by
+    // *pyramid_scale* (coarse) and then the corners are refined on
+    // *gray_image* (fine).  Both the threshold and the contour finding get
+    // *pyramid_scale* squared times faster:
+    Unsigned pyramid_scale =
+      Fiducials__pyramid_scale_select(fiducials, debug_index);
+    Integer scale = (Integer)pyramid_scale;
+    CV_Image contour_gray_image = gray_image;
+    CV_Image contour_edge_image = edge_image;
+    if (pyramid_scale > 1 && !track_pass) {
+	// (Re)create the decimated images if their size is not right:
+	Integer pyramid_width = CV_Image__width_get(gray_image) / scale;
+	Integer pyramid_height = CV_Image__height_get(gray_image) / scale;
+	CV_Image pyramid_gray_image = frame->pyramid_gray_image;
+	if (pyramid_gray_image == (CV_Image)0 ||
+	  CV_Image__width_get(pyramid_gray_image) != pyramid_width ||
+	  CV_Image__height_get(pyramid_gray_image) != pyramid_height) {
+	    if (pyramid_gray_image != (CV_Image)0) {
+		CV__release_image(pyramid_gray_image);
+		CV__release_image(frame->pyramid_edge_image);
+	    }
+	    CV_Size pyramid_size =
+	      CV_Size__create(pyramid_width, pyramid_height);
+	    frame->pyramid_gray_image =
+	      CV_Image__create(pyramid_size, CV__depth_8u, 1);
+	    frame->pyramid_edge_image =
+	      CV_Image__create(pyramid_size, CV__depth_8u, 1);
+	    CV_Size__free(pyramid_size);
+	}
+	contour_gray_image = frame->pyramid_gray_image;
+	contour_edge_image = frame->pyramid_edge_image;
+	CV_Image__gray_decimate(gray_image, contour_gray_image, pyramid_scale);
+    }
+
+    // Perform adpative threshold.  The 25x25 box mean has about the same
+    // spread as the Gaussian weights that OpenCV uses for a 45x45 block
+    // (sigma of about 7.1 pixels), so the two agree on about 99% of the
+    // pixels; the box threshold is much faster.  The block sizes shrink
+    // with *pyramid_scale* (but stay odd):
+    if (fiducials->threshold_gaussian) {
+	CV_Image__adaptive_threshold(contour_gray_image, contour_edge_image,
+	  255.0, CV__adaptive_thresh_gaussian_c, CV__thresh_binary,
+	  (45 / scale) | 1, 5.0);
+    } else if (!roi_pass && !track_pass) {
+	CV_Image__box_threshold(contour_gray_image, contour_edge_image,
+	  255, (25 / scale) | 1, 5.0, fiducials->threshold_bands);
+    }
 
     // Show results of adaptive threshold for *debug_index* 3:
     if (debug_index == 4) {
 	CV_Image__convert_color(edge_image, debug_image, CV__gray_to_rgb);
     }
 
-    // Find the *edge_image* *contours*:
-    CV_Point origin = fiducials->origin;
-    Integer header_size = 128;
-    CV_Sequence contours = CV_Image__find_contours(edge_image, storage,
-      header_size, CV__retr_list, CV__chain_approx_simple, origin);
-    if (contours == (CV_Sequence)0) {
-	File__format(log_file, "no contours found\n");
-    }
+    // Pass everything that was decided on to *Fiducials__frame_detect*():
+    frame->contour_edge_image = contour_edge_image;
+    frame->contour_gray_image = contour_gray_image;
+    frame->pyramid_scale = pyramid_scale;
+    frame->roi_pass = roi_pass;
+    frame->roi_predicted_size = roi_predicted_size;
+    frame->roi_tracked_size = roi_tracked_size;
+    frame->track_pass = track_pass;
+    frame->track_tracked_size = track_tracked_size;
+}
 
-    // For *debug_index* 4, show the *edge_image* *contours*:
-    if (debug_index == 5) {
-	//File__format(log_file, "Draw red contours\n");
-	CV_Scalar red = fiducials->red;
-	CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
-	CV_Image__draw_contours(debug_image,
-	  contours, red, red, 2, 2, 8, origin);
-    }
+/// @brief Find and decode the tags in *frame*.
+/// @param fiducials is the *Fiducials* object to use.
+/// @param frame is the *Fiducials_Frame* from
+/// *Fiducials__frame_preprocess*().
+///
+/// *Fiducials__frame_detect*() is the second stage of
+/// *Fiducials__process*().  It will find the candidate quadrilaterals in
+/// the *edge_image* of *frame*, run them through the rejection cascade,
+/// refine their corners, decode them, and append the tags that decode
+/// (or that were tracked from the previous frame) to the tags of
+/// *frame*.  The *gray_image* of *fiducials* is pointed at the
+/// *gray_image* of *frame* for the sampling routines.  Nothing is
+/// announced and the map is not touched.
+
+void Fiducials__frame_detect(Fiducials fiducials, Fiducials_Frame frame) {
+    // Clear *storage*:
+    CV_Memory_Storage storage = fiducials->storage;
+    CV_Memory_Storage__clear(storage);
 
-    // For the remaining debug steps, we use the original *gray_image*:
-    if (debug_index >= 5) {
-	CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
-    }
+    // Grab some values from *fiducials* and *frame*:
+    fiducials->edge_image = frame->edge_image;
+    fiducials->gray_image = frame->gray_image;
+    CV_Image contour_edge_image = frame->contour_edge_image;
+    CV_Image contour_gray_image = frame->contour_gray_image;
+    Corner_Tracker corner_tracker = fiducials->corner_tracker;
+    CV_Image debug_image = frame->debug_image;
+    Unsigned debug_index = frame->debug_index;
+    CV_Image gray_image = frame->gray_image;
+    File log_file = fiducials->log_file;
+    Logical roi_pass = frame->roi_pass;
+    Unsigned roi_predicted_size = frame->roi_predicted_size;
+    Unsigned roi_tracked_size = frame->roi_tracked_size;
+    Integer scale = (Integer)frame->pyramid_scale;
+    Unsigned sequence_number = frame->sequence_number;
+    Logical track_pass = frame->track_pass;
+    Unsigned track_tracked_size = frame->track_tracked_size;
+    frame->tags_size = 0;
+
+    // Find the candidate tag quadrilaterals in *contour_edge_image*.  The
+    // run length encoded *quad_finder* is much faster than the OpenCV
+    // contours, which are kept as a reference (and to show the contours
+    // for *debug_index* 5 through 8):
+    CV_Point origin = fiducials->origin;
+    Integer header_size = 128;
+    Double area_minimum = fiducials->tag_area_minimum / (Double)(scale * scale);
+    Quad_Finder quad_finder = fiducials->quad_finder;
+    if (track_pass) {
+	// The tags come from *corner_tracker* below, so there are no
+	// candidates to look at:
+	quad_finder->quads_size = 0;
+    } else if (fiducials->contours_reference ||
+      (5 <= debug_index && debug_index <= 8)) {
+	// Find the *contour_edge_image* *contours*:
+	quad_finder->quads_size = 0;
+	CV_Sequence contours = CV_Image__find_contours(contour_edge_image,
+	  storage, header_size, CV__retr_ccomp, CV__chain_approx_simple,
+	  origin);
+	if (contours == (CV_Sequence)0) {
+	    File__format(log_file, "no contours found\n");
+	}
 
-    // Iterate over all of the *contours*:
-    List /* <Camera_Tag> */ camera_tags = fiducials->camera_tags;
-    Map map = fiducials->map;
-    Unsigned contours_count = 0;
-    for (CV_Sequence contour = contours; contour != (CV_Sequence)0;
-      contour = CV_Sequence__next_get(contour)) {
-	// Keep a count of total countours:
-	contours_count += 1;
-	//File__format(log_file, "contours_count=%d\n", contours_count);
-
-	static CvSlice whole_sequence;
-	CV_Slice CV__whole_seq = &whole_sequence;
-	whole_sequence = CV_WHOLE_SEQ;
-
-	// Perform a polygon approximation of {contour}:
-	Integer arc_length =
-	  (Integer)(CV_Sequence__arc_length(contour, CV__whole_seq, 1) * 0.02);
-	CV_Sequence polygon_contour =
-	  CV_Sequence__approximate_polygon(contour,
-	  header_size, storage, CV__poly_approx_dp, arc_length, 0.0);
-	if (debug_index == 6) {
-	    //File__format(log_file, "Draw green contours\n");
-	    CV_Scalar green = fiducials->green;
+	// For *debug_index* 4, show the *edge_image* *contours*:
+	if (debug_index == 5) {
+	    //File__format(log_file, "Draw red contours\n");
+	    CV_Scalar red = fiducials->red;
+	    CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
 	    CV_Image__draw_contours(debug_image,
-	      polygon_contour, green, green, 2, 2, 1, origin);
-	}
-
-	// If we have a 4-sided polygon with an area greater than 500 square
-	// pixels, we can explore to see if we have a tag:
-	if (CV_Sequence__total_get(polygon_contour) == 4 &&
-	  fabs(CV_Sequence__contour_area(polygon_contour,
-	  CV__whole_seq, 0)) > 500.0 &&
-	  CV_Sequence__check_contour_convexity(polygon_contour)) {
-	    // For debugging, display the polygons in red:
-	    //File__format(log_file, "Have 4 sides > 500i\n");
-
-	    // Just show the fiducial outlines for *debug_index* of 6:
-	    if (debug_index == 7) {
-		CV_Scalar red = fiducials->red;
-		CV_Image__draw_contours(debug_image,
-		  polygon_contour, red, red, 2, 2, 1, origin);
-	    }
+	      contours, red, red, 2, 2, 8, origin);
+	}
 
-	    // Copy the 4 corners from {poly_contour} to {corners}:
-	    CV_Point2D32F_Vector corners = fiducials->corners;
-	    for (Unsigned index = 0; index < 4; index++) {
-		CV_Point2D32F corner =
-		  CV_Point2D32F_Vector__fetch1(corners, index);
-		CV_Point point =
-		  CV_Sequence__point_fetch1(polygon_contour, index);
-		CV_Point2D32F__point_set(corner, point);
-
-		if (debug_index == 7) {
-		    //File__format(log_file,
-		    //  "point[%d] x:%f y:%f\n", index, point->x, point->y);
-		}
-	    }
+	// For the remaining debug steps, we use the original *gray_image*:
+	if (debug_index >= 5) {
+	    CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
+	}
 
-	    // Now find the sub pixel corners of {corners}:
-	    CV_Image__find_corner_sub_pix(gray_image, corners, 4,
-	      fiducials->size_5x5, fiducials->size_m1xm1,
-	      fiducials->term_criteria);
-
-	    // Ensure that the corners are in a counter_clockwise direction:
-	    CV_Point2D32F_Vector__corners_normalize(corners);
-
-	    // For debugging show the 4 corners of the possible tag where
-	    //corner0=red, corner1=green, corner2=blue, corner3=purple:
-	    if (debug_index == 8) {
-		for (Unsigned index = 0; index < 4; index++) {
-		    CV_Point point =
-		      CV_Sequence__point_fetch1(polygon_contour, index);
-		    Integer x = CV_Point__x_get(point);
-		    Integer y = CV_Point__y_get(point);
-		    CV_Scalar color = (CV_Scalar)0;
-		    String text = (String)0;
-		    switch (index) {
-		      case 0:
-			color = fiducials->red;
-			text = "red";
-			break;
-		      case 1:
-			color = fiducials->green;
-			text = "green";
-			break;
-		      case 2:
-			color = fiducials->blue;
-			text = "blue";
-			break;
-		      case 3:
-			color = fiducials->purple;
-			text = "purple";
-			break;
-		      default:
-			assert(0);
-		    }
-		    CV_Image__cross_draw(debug_image, x, y, color);
-		    File__format(log_file,
-		      "poly_point[%d]=(%d:%d) %s\n", index, x, y, text);
+	// The *contours* are in a two level hierarchy.  The top level holds
+	// the outer borders of the white regions and the second level holds
+	// the borders of the holes in them.  The outer border of a black tag
+	// is a hole in the white ceiling, while the inner border of the tag
+	// frame is the outer border of the white region inside of the tag.
+	// Only the holes are looked at, so that each tag is a candidate
+	// once rather than once for each of its borders:
+	Unsigned contours_count = 0;
+	for (CV_Sequence outer_contour = contours;
+	  outer_contour != (CV_Sequence)0;
+	  outer_contour = CV_Sequence__next_get(outer_contour)) {
+	    for (CV_Sequence contour = CV_Sequence__child_get(outer_contour);
+	      contour != (CV_Sequence)0;
+	      contour = CV_Sequence__next_get(contour)) {
+		// Keep a count of total countours:
+		contours_count += 1;
+		//File__format(log_file, "contours_count=%d\n", contours_count);
+
+		// Perform a polygon approximation of {contour}:
+		Integer arc_length = (Integer)(CV_Sequence__arc_length(
+		  contour, CV__whole_seq, 1) * 0.02);
+		if (arc_length < 1) {
+		    // Decimated tag contours can be short, so keep some
+		    // tolerance:
+		    arc_length = 1;
 		}
-	    }
-
-	    // Compute the 8 reference points for deciding whether the
-	    // polygon is "tag like" in its borders:
-	    CV_Point2D32F_Vector references =
-	      Fiducials__references_compute(fiducials, corners);
-
-	    // Now sample the periphery of the tag and looking for the
-	    // darkest white value (i.e. minimum) and the lightest black
-	    // value (i.e. maximum):
-	    //Integer white_darkest =
-	    //  CV_Image__points_minimum(gray_image, references, 0, 3);
-	    //Integer black_lightest =
-	    //  CV_Image__points_maximum(gray_image, references, 4, 7);
-	    Integer white_darkest =
-	      Fiducials__points_minimum(fiducials, references, 0, 3);
-	    Integer black_lightest =
-	      Fiducials__points_maximum(fiducials, references, 4, 7);
-
-	    // {threshold} should be smack between the two:
-	    Integer threshold = (white_darkest + black_lightest) / 2;
-	    
-	    // For debugging, show the 8 points that are sampled around the
-	    // the tag periphery to even decide whether to do further testing.
-	    // Show "black" as green crosses, and "white" as green crosses:
-	    if (debug_index == 9) {
-		CV_Scalar red = fiducials->red;
-		CV_Scalar green = fiducials->green;
-		for (Unsigned index = 0; index < 8; index++) {
-		    CV_Point2D32F reference =
-		      CV_Point2D32F_Vector__fetch1(references, index);
-		    Integer x = CV__round(CV_Point2D32F__x_get(reference));
-		    Integer y = CV__round(CV_Point2D32F__y_get(reference));
-		    //Integer value =
-		    //  CV_Image__point_sample(gray_image, reference);
-		    Integer value =
-		      Fiducials__point_sample(fiducials, reference);
-		    CV_Scalar color = red;
-		    if (value < threshold) {
-			color = green;
-		    }
-		    CV_Image__cross_draw(debug_image, x, y, color);
-		    File__format(log_file, "ref[%d:%d]:%d\n", x, y, value);
+		CV_Sequence polygon_contour =
+		  CV_Sequence__approximate_polygon(contour,
+		  header_size, storage, CV__poly_approx_dp, arc_length, 0.0);
+		if (debug_index == 6) {
+		    //File__format(log_file, "Draw green contours\n");
+		    CV_Scalar green = fiducials->green;
+		    CV_Image__draw_contours(debug_image,
+		      polygon_contour, green, green, 2, 2, 1, origin);
 		}
-	    }
 
-	    // If we have enough contrast keep on trying for a tag match:
-	    if (black_lightest < white_darkest) {
-		// We have a tag to try:
-
-		// Now it is time to read all the bits of the tag out:
-		CV_Point2D32F_Vector sample_points = fiducials->sample_points;
-
-		// Now compute the locations to sample for tag bits:
-		Fiducials__sample_points_compute(corners, sample_points);
-
-		// Extract all 64 tag bit values:
-		Logical *tag_bits = &fiducials->tag_bits[0];
-		for (Unsigned index = 0; index < 64; index++) {
-		    // Grab the pixel value and convert into a {bit}:
-		    CV_Point2D32F sample_point =
-		      CV_Point2D32F_Vector__fetch1(sample_points, index);
-		    //Integer value =
-		    //  CV_Image__point_sample(gray_image, sample_point);
-		    Integer value =
-		      Fiducials__point_sample(fiducials, sample_point);
-		    Logical bit = (value < threshold);
-		    tag_bits[index] = bit;
-
-		    // For debugging:
-		    if (debug_index == 10) {
+		// If we have a 4-sided polygon with an area greater than
+		// *area_minimum* (at least 500 square full resolution pixels),
+		// we can explore to see if we have a tag:
+		if (CV_Sequence__total_get(polygon_contour) == 4 &&
+		  fabs(CV_Sequence__contour_area(polygon_contour,
+		  CV__whole_seq, 0)) > area_minimum &&
+		  CV_Sequence__check_contour_convexity(polygon_contour)) {
+		    // Just show the fiducial outlines for *debug_index* of 6:
+		    if (debug_index == 7) {
 			CV_Scalar red = fiducials->red;
-			CV_Scalar green = fiducials->green;
-			CV_Scalar cyan = fiducials->cyan;
-			CV_Scalar blue = fiducials->blue;
-
-			// Show white bits as {red} and black bits as {green}:
-			CV_Scalar color = red;
-			if (bit) {
-			    color = green;
-			}
-
-			// Show where bit 0 and 7 are:
-			//if (index == 0) {
-			//    // Bit 0 is {cyan}:
-			//    color = cyan;
-			//}
-			//if (index == 7) {
-			//    // Bit 7 is {blue}:
-			//    color = blue;
-			//}
-
-			// Now splat a cross of {color} at ({x},{y}):
-			Integer x =
-			  CV__round(CV_Point2D32F__x_get(sample_point));
-			Integer y =
-			  CV__round(CV_Point2D32F__y_get(sample_point));
-			CV_Image__cross_draw(debug_image, x, y, color);
+			CV_Image__draw_contours(debug_image,
+			  polygon_contour, red, red, 2, 2, 1, origin);
 		    }
-		}
 
-		//tag_bits :@= extractor.tag_bits
-		//bit_field :@= extractor.bit_field
-		//tag_bytes :@= extractor.tag_bytes
-
-		// Now we iterate through the 4 different mapping
-		// orientations to see if any one of the 4 mappings match:
-		Logical **mappings = fiducials->mappings;
-		Unsigned mappings_size = 4;
-		for (Unsigned direction_index = 0;
-		  direction_index < mappings_size; direction_index++) {
-		    // Grab the mapping:
-		    Logical *mapping = mappings[direction_index];
-		    //File__format(log_file,
-		    //  "mappings[%d]:0x%x\n", direction_index, mapping);
-
-
-		    Logical mapped_bits[64];
-		    for (Unsigned i = 0; i < 64; i++) {
-			 mapped_bits[mapping[i]] = tag_bits[i];
+		    // Append the 4 corners of {polygon_contour} to
+		    // *quad_finder*:
+		    Double quad[8];
+		    for (Unsigned index = 0; index < 4; index++) {
+			CV_Point point =
+			  CV_Sequence__point_fetch1(polygon_contour, index);
+			Integer x = CV_Point__x_get(point);
+			Integer y = CV_Point__y_get(point);
+			quad[2 * index] = (Double)x;
+			quad[2 * index + 1] = (Double)y;
 		    }
+		    Quad_Finder__quad_append(quad_finder, quad);
+		}
+	    }
+	}
+    } else if (roi_pass) {
+	// Threshold and search each region of interest (scaled down to
+	// *contour_edge_image*) in turn:
+	Integer contour_width = CV_Image__width_get(contour_edge_image);
+	Integer contour_height = CV_Image__height_get(contour_edge_image);
+	quad_finder->quads_size = 0;
+	Unsigned rois_size = fiducials->rois_size;
+	for (Unsigned roi_index = 0; roi_index < rois_size; roi_index++) {
+	    Integer *roi = fiducials->rois + 4 * roi_index;
+	    Integer left = roi[0] / scale;
+	    Integer top = roi[1] / scale;
+	    Integer right = (roi[2] + scale - 1) / scale;
+	    Integer bottom = (roi[3] + scale - 1) / scale;
+	    right = (right > contour_width) ? contour_width : right;
+	    bottom = (bottom > contour_height) ? contour_height : bottom;
+	    if (left < right && top < bottom) {
+		CV_Image__box_threshold_rectangle(contour_gray_image,
+		  contour_edge_image, 255, (25 / scale) | 1, 5.0,
+		  left, top, right - left, bottom - top);
+		Quad_Finder__rectangle_find(quad_finder, contour_edge_image,
+		  area_minimum, left, top, right - left, bottom - top, 1);
+	    }
+	}
+	if (debug_index >= 5) {
+	    CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
+	}
+    } else {
+	Quad_Finder__find(quad_finder, contour_edge_image,
+	  area_minimum, fiducials->threshold_bands);
+	if (debug_index >= 5) {
+	    CV_Image__convert_color(gray_image, debug_image, CV__gray_to_rgb);
+	}
+    }
 
-		    // Fill in tag bytes;
-		    Unsigned tag_bytes[8];
-		    for (Unsigned i = 0; i < 8; i++) {
-			Unsigned byte = 0;
-			for (Unsigned j = 0; j < 8; j++) {
-			    if (mapped_bits[(i<<3) + j]) {
-				//byte |= 1 << j;
-				byte |= 1 << (7 - j);
-			    }
-			}
-			tag_bytes[i] = byte;
-		    }
-		    if (debug_index == 11) {
-			File__format(log_file,
-			  "dir=%d Tag[0]=0x%x Tag[1]=0x%x\n",
-			  direction_index, tag_bytes[0], tag_bytes[1]);
-		    }
+    // Only keep one of each set of nested candidate quadrilaterals (e.g.
+    // both borders of a tag frame) so that each tag is decoded once:
+    Fiducials_Counters counters = fiducials->counters;
+    if (track_pass) {
+	counters->frames_tracked += 1;
+    } else if (roi_pass) {
+	counters->frames_roi += 1;
+	if (roi_predicted_size > 0) {
+	    counters->frames_predicted += 1;
+	}
+    } else {
+	counters->frames_full += 1;
+    }
+    Unsigned duplicates_size = Quad_Finder__duplicates_remove(quad_finder);
+    counters->candidates += duplicates_size;
+    counters->rejected_duplicate += duplicates_size;
+
+    // Decode all of the candidate quadrilaterals (possibly in parallel):
+    Quad_Cache quad_cache = fiducials->quad_cache;
+    fiducials->rois_size = 0;
+    Fiducials__candidates_decode(fiducials,
+      debug_index, scale, sequence_number);
+
+    // Either pick up the tags that *corner_tracker* tracked into this
+    // frame, or forget them since they are about to be found again:
+    if (track_pass) {
+	Fiducials__tags_track(fiducials, frame);
+    } else {
+	Corner_Tracker__clear(corner_tracker);
+    }
 
-		    // Now we need to do some FEC (Forward Error Correction):
-		    FEC fec = fiducials->fec;
-		    if (FEC__correct(fec, tag_bytes, 8)) {
-			// We passed FEC:
-			if (debug_index == 11) {
-			    File__format(log_file, "FEC correct\n");
-			}
-
-			// Now see if the two CRC's match:
-			Unsigned computed_crc = CRC__compute(tag_bytes, 2);
-			Unsigned tag_crc = (tag_bytes[3] << 8) | tag_bytes[2];
-			if (computed_crc == tag_crc) {
-			    // Yippee!!! We have a tag:
-			    // Compute {tag_id} from the the first two bytes
-			    // of {tag_bytes}:
-			    Unsigned tag_id =
-			      (tag_bytes[1] << 8) | tag_bytes[0];
-
-			    if (debug_index == 11) {
-				File__format(log_file,
-				  "CRC correct, Tag=%d\n", tag_id);
-			    }
-
-			    // Allocate a *camera_tag*:
-			    List /* <Camera_Tag> */ camera_tags_pool =
-			      fiducials->camera_tags_pool;
-			    Camera_Tag camera_tag = (Camera_Tag)0;
-			    if (List__size(camera_tags_pool) == 0) {
-				 // *camera_tags_pool* is empty;
-				// allocate a new one:
-				camera_tag = Camera_Tag__new();
-			    } else {
-				camera_tag =
-				  (Camera_Tag)List__pop(camera_tags_pool);
-			    }
-
-			    // Load up *camera_tag* to get center, twist, etc.:
-			    Tag tag = Map__tag_lookup(map, tag_id);
-
-			    double vertices[4][2];
-			    for (Unsigned index = 0; index < 4; index++) {
-			      CV_Point2D32F pt = CV_Point2D32F_Vector__fetch1(corners, index);
-			      vertices[index][0] = pt->x;
-			      vertices[index][1] = pt->y;
-			    }			    
-                            fiducials->fiducial_announce_routine(
-                                fiducials->announce_object, tag_id,
-				direction_index, tag->world_diagonal,
-                                vertices[0][0], vertices[0][1],
-				vertices[1][0], vertices[1][1],
-                                vertices[2][0], vertices[2][1],
-                                vertices[3][0], vertices[3][1]);
-
-			    if (debug_index == 11) {
-				Camera_Tag__initialize(camera_tag, tag,
-				  direction_index, corners, debug_image);
-			    } else {
-				Camera_Tag__initialize(camera_tag, tag,
-				  direction_index, corners, (CV_Image)0);
-			    }
-			    List__append(current_visibles, (Memory)tag,
-			      "Fiduicals__create:List_append:current_visibles");
-			    File__format(log_file, "Tag: %d x=%f y=%f\n",
-			      tag->id, tag->x, tag->y);
-
-			    // Record the maximum *camera_diagonal*:
-			    Double camera_diagonal = camera_tag->diagonal;
-			    Double diagonal =
-			      camera_diagonal;
-			    if (diagonal  > tag->diagonal) {
-				tag->diagonal = diagonal;
-                                tag->updated = (Logical)1;
-			    }
-
-			    // Append *camera_tag* to *camera_tags*:
-			    List__append(camera_tags, (Memory)camera_tag,
-			      "Fiducials__Create:List__append:camera_tags");
-			    //File__format(log_file,
-			    //  "Found %d\n", camera_tag->tag->id);
-			}
-		    }
-		}
+    // Merge the decoded candidates in candidate order, so that the
+    // results are the same no matter how many threads decoded them:
+    CV_Point2D32F_Vector corners = fiducials->corners;
+    Unsigned quads_size = quad_finder->quads_size;
+    for (Unsigned quad_index = 0; quad_index < quads_size; quad_index++) {
+	Double *quad = quad_finder->quads + 8 * quad_index;
+	Fiducials_Candidate candidate = fiducials->candidates + quad_index;
+
+	// The candidates go through a cascade of tests that are ordered by
+	// cost.  Each rejection is counted in *counters*:
+	counters->candidates += 1;
+	Unsigned status = candidate->status;
+	if (status == FIDUCIALS_CANDIDATE_CACHED) {
+	    counters->cache_hits += 1;
+	    continue;
+	}
+	if (fiducials->quad_caching) {
+	    counters->cache_misses += 1;
+	}
+	switch (status) {
+	  case FIDUCIALS_CANDIDATE_SHAPE:
+	    counters->rejected_shape += 1;
+	    break;
+	  case FIDUCIALS_CANDIDATE_PROBE:
+	    counters->rejected_probe += 1;
+	    break;
+	  case FIDUCIALS_CANDIDATE_BORDER:
+	    counters->rejected_border += 1;
+	    break;
+	  case FIDUCIALS_CANDIDATE_DECODE:
+	    counters->rejected_decode += 1;
+	    break;
+	  case FIDUCIALS_CANDIDATE_TAG:
+	    break;
+	  default:
+	    assert(0);
+	}
+
+	// Remember the candidates that are not tags in *quad_cache*:
+	if (status == FIDUCIALS_CANDIDATE_BORDER ||
+	  status == FIDUCIALS_CANDIDATE_DECODE) {
+	    if (fiducials->quad_caching) {
+		Quad_Cache__insert(quad_cache, candidate->key, sequence_number);
 	    }
+	    continue;
+	}
+	if (status != FIDUCIALS_CANDIDATE_TAG) {
+	    continue;
+	}
+
+	// Each tag can only be used once per frame, since the arcs are
+	// between pairs of different tags.  Any other sighting (i.e. a
+	// duplicate candidate or a second copy of the tag) is dropped:
+	Unsigned tag_id = candidate->tag_id;
+	if (Fiducials_Frame__tag_find(frame, tag_id)) {
+	    File__format(log_file, "Duplicate tag: %d\n", tag_id);
+	    counters->rejected_duplicate += 1;
+	    continue;
+	}
+
+	// Hand the tag over to *Fiducials__frame_update*():
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, index);
+	    CV_Point2D32F__x_set(corner, candidate->corners[2 * index]);
+	    CV_Point2D32F__y_set(corner, candidate->corners[2 * index + 1]);
+	}
+	Fiducials_Frame__tag_append(
+	  frame, tag_id, candidate->direction_index, corners);
+	counters->tags += 1;
+	Fiducials__roi_append(fiducials, quad, scale);
+	if (fiducials->corners_tracking) {
+	    Corner_Tracker__append(corner_tracker, tag_id,
+	      candidate->direction_index, candidate->gray_corners);
+	}
+    }
+
+    // Schedule the next full frame pass for *roi_tracking* and the
+    // predicted windows:
+    if (!roi_pass && !track_pass) {
+	fiducials->roi_countdown = (fiducials->roi_full_interval > 0) ?
+	  fiducials->roi_full_interval - 1 : 0;
+    } else if (fiducials->rois_size < roi_tracked_size ||
+      fiducials->rois_size == 0) {
+	fiducials->roi_countdown = 0;
+    } else if (fiducials->roi_countdown > 0) {
+	fiducials->roi_countdown -= 1;
+    }
+
+    // Schedule the next search for *corners_tracking* and save
+    // *gray_image* to track the corners out of in the next frame:
+    if (!track_pass) {
+	fiducials->track_countdown = (fiducials->track_full_interval > 0) ?
+	  fiducials->track_full_interval - 1 : 0;
+    } else if (corner_tracker->size < track_tracked_size) {
+	fiducials->track_countdown = 0;
+    } else {
+	fiducials->track_countdown -= 1;
+    }
+    if (fiducials->corners_tracking && corner_tracker->size > 0) {
+	Corner_Tracker__image_save(corner_tracker, gray_image);
+    }
+}
+
+/// @brief Update the map and the location with the tags in *frame*.
+/// @param fiducials is the *Fiducials* object to use.
+/// @param frame is the *Fiducials_Frame* from *Fiducials__frame_detect*().
+/// @returns a *Fiducials_Results* that contains information about
+///          how the processing worked.
+///
+/// *Fiducials__frame_update*() is the last stage of *Fiducials__process*().
+/// It will add a *Camera_Tag* for each tag of *frame* (announcing it),
+/// update the *Arc*'s between each pair of them, compute and announce the
+/// location, announce the tags that came into or went out of view, and
+/// update the map.  The frames must be updated in sequence number order.
+/// The sequence number of *frame* is left in *update_sequence_number* so
+/// that the announce routines can tell which frame they are called for.
+
+Fiducials_Results Fiducials__frame_update(
+  Fiducials fiducials, Fiducials_Frame frame) {
+    // Grab some values from *fiducials* and *frame*:
+    List /* <Camera_Tag> */ camera_tags = fiducials->camera_tags;
+    List /*<Tag>*/ current_visibles = fiducials->current_visibles;
+    CV_Image debug_image = frame->debug_image;
+    CV_Image gray_image = frame->gray_image;
+    List /*<Location>*/ locations = fiducials->locations;
+    File log_file = fiducials->log_file;
+    Map map = fiducials->map;
+    CV_Image original_image = frame->original_image;
+    List /*<Tag>*/ previous_visibles = fiducials->previous_visibles;
+    Quad_Cache quad_cache = fiducials->quad_cache;
+    Fiducials_Results results = fiducials->results;
+    Fiducials_Location_Announce_Routine location_announce_routine =
+      fiducials->location_announce_routine;
+    Unsigned sequence_number = frame->sequence_number;
+    fiducials->update_sequence_number = sequence_number;
+
+    // Add a *Camera_Tag* for each tag in *frame* to *camera_tags*:
+    CV_Point2D32F_Vector corners = frame->corners;
+    Unsigned tags_size = frame->tags_size;
+    for (Unsigned tag_index = 0; tag_index < tags_size; tag_index++) {
+	Double *tag_corners = frame->tag_corners + 8 * tag_index;
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, index);
+	    CV_Point2D32F__x_set(corner, tag_corners[2 * index]);
+	    CV_Point2D32F__y_set(corner, tag_corners[2 * index + 1]);
 	}
+	Fiducials__camera_tag_add(fiducials, frame->tag_ids[tag_index],
+	  frame->tag_directions[tag_index], corners);
     }
 
     // Just for consistency sort *camera_tags*:
@@ -1389,6 +1833,11 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
 
     List__trim(locations, 0);
     results->image_interesting = (Logical)0;
+    Logical located = (Logical)0;
+    Double located_x = 0.0;
+    Double located_y = 0.0;
+    Double located_bearing = 0.0;
+    Double distance_per_pixel = 0.0;
     if (camera_tags_size > 0) {
 	Double pi = 3.14159265358979323846264;
 	Unsigned half_width = CV_Image__width_get(gray_image) >> 1;
@@ -1476,11 +1925,45 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
 	      closest_location->id, closest_location->x, closest_location->y,
 	      /* z */ 0.0, closest_location->bearing);
 
+	    // Remember the location and pixel size for *quad_cache*:
+	    Camera_Tag closest_camera_tag =
+	      Fiducials__camera_tag_find(camera_tags, closest_location->id);
+	    located = (Logical)1;
+	    located_x = closest_location->x;
+	    located_y = closest_location->y;
+	    located_bearing = closest_location->bearing;
+	    distance_per_pixel = closest_camera_tag->tag->world_diagonal /
+	      closest_camera_tag->diagonal;
+
 	    // Release *closest_location*:
 	    Location__free(closest_location);
 	}
     }
 
+    // The *quad_cache* entries are image positions, so they have to be
+    // forgotten when the camera moves:
+    if (fiducials->quad_caching) {
+	Integer image_width = CV_Image__width_get(gray_image);
+	Integer image_height = CV_Image__height_get(gray_image);
+	Double radius = sqrt((Double)(image_width * image_width +
+	  image_height * image_height)) / 2.0;
+	Quad_Cache__motion_update(quad_cache, located,
+	  located_x, located_y, located_bearing, distance_per_pixel, radius);
+    }
+
+    // Anchor the odometry to the location so that the next location can
+    // be predicted from the change in the odometry.  A pipeline already
+    // preprocesses the next frames, so it never predicts:
+    if (located && frame->odometry_valid && !fiducials->pipelined) {
+	fiducials->odometry_anchored = (Logical)1;
+	fiducials->odometry_anchor_etw = frame->odometry_etw;
+	fiducials->odometry_anchor_ex = frame->odometry_ex;
+	fiducials->odometry_anchor_ey = frame->odometry_ey;
+	fiducials->odometry_anchor_rtw = located_bearing;
+	fiducials->odometry_anchor_rx = located_x;
+	fiducials->odometry_anchor_ry = located_y;
+    }
+
     // Visit each *current_tag* in *current_visibles*:
     Unsigned current_visibles_size = List__size(current_visibles);
     for (Unsigned current_visibles_index = 0;
@@ -1544,7 +2027,7 @@ Fiducials_Results Fiducials__process(Fiducials fiducials) {
     List__trim(camera_tags, 0);
 
     // Flip the debug image:
-    if (fiducials->y_flip) {
+    if (fiducials->y_flip && debug_image != (CV_Image)0) {
 	CV_Image__flip(debug_image, debug_image, 0);
     }
 
@@ -1575,44 +2058,18 @@ Integer Fiducials__point_sample(Fiducials fiducials, CV_Point2D32F point) {
     Integer y = CV__round(CV_Point2D32F__y_get(point));
     CV_Image image = fiducials->gray_image;
 
-    static Integer weights0[9] = {
-      0,   0,  0,
-      0, 100,  0,
-      0,  0,   0};
-
-    static Integer weights1[9] = {
-       0,  15,  0,
-      15,  40,  15,
-       0,  15,  0};
-
-    static Integer weights2[9] = {
-       5,  10,  5,
-      10,  40, 10,
-       5,  10,  5};
-
     // Sample *image*:
-    static Integer x_offsets[9] = {
+    static const Integer x_offsets[9] = {
       -1,  0,  1,
       -1,  0,  1,
       -1,  0,  1};
-    static Integer y_offsets[9] = {
+    static const Integer y_offsets[9] = {
       -1, -1, -1,
        0,  0,  0,
        1,  1,  1};
 
     // Select sample *weights*:
-    Integer *weights = (Integer *)0;
-    switch (fiducials->weights_index) {
-      case 1:
-	weights = weights1;
-	break;
-      case 2:
-	weights = weights2;
-	break;
-      default:
-	weights = weights0;
-	break;
-    }
+    const Integer *weights = Fiducials__sample_weights(fiducials);
 
     // Interate across sample point;
     Integer numerator = 0;
@@ -1703,41 +2160,37 @@ Logical CV_Point2D32F_Vector__is_clockwise(CV_Point2D32F_Vector corners) {
     return z < 0.0;
  }
 
-/// @brief Return 8 sample locations to determine if a quadralateral is
-///        worth testing for quadralateral'ness.
-/// @param fiducials is the *Fiducals* object that contains the image.
-/// @param corners is the 4 potential fiducial corners.
-/// @returns a vector 8 places to test for ficial'ness.
+/// @brief Compute the homography that maps tag space onto *corners*.
+/// @param corners is the 4 fiducial corners.
+/// @param homography is where the 8 homography coefficients are stored.
 ///
-/// *Fiducials__references_compute*() 4 corner points in *corners* to
-/// compute 8 reference points that are returned.  The first 4 reference
-/// points will be just outside of the quadrateral formed by *corners*
-/// (i.e. the white bounding box) and the last 4 reference points are
-/// on the inside (i.e. the black bounding box).  The returned vector
-/// is perminately allocated in *fiducials*, so it does not need to have
-/// it storage released.
-
-CV_Point2D32F_Vector Fiducials__references_compute(
-  Fiducials fiducials, CV_Point2D32F_Vector corners) {
-
-    // Extract the 8 references from {references}:
-    CV_Point2D32F_Vector references = fiducials->references;
-    CV_Point2D32F reference0 = CV_Point2D32F_Vector__fetch1(references, 0);
-    CV_Point2D32F reference1 = CV_Point2D32F_Vector__fetch1(references, 1);
-    CV_Point2D32F reference2 = CV_Point2D32F_Vector__fetch1(references, 2);
-    CV_Point2D32F reference3 = CV_Point2D32F_Vector__fetch1(references, 3);
-    CV_Point2D32F reference4 = CV_Point2D32F_Vector__fetch1(references, 4);
-    CV_Point2D32F reference5 = CV_Point2D32F_Vector__fetch1(references, 5);
-    CV_Point2D32F reference6 = CV_Point2D32F_Vector__fetch1(references, 6);
-    CV_Point2D32F reference7 = CV_Point2D32F_Vector__fetch1(references, 7);
-
-    // Extract the 4 corners from {corners}:
-    CV_Point2D32F corner0 = CV_Point2D32F_Vector__fetch1(corners, 0);
-    CV_Point2D32F corner1 = CV_Point2D32F_Vector__fetch1(corners, 1);
-    CV_Point2D32F corner2 = CV_Point2D32F_Vector__fetch1(corners, 2);
-    CV_Point2D32F corner3 = CV_Point2D32F_Vector__fetch1(corners, 3);
-
-    // Extract the x and y references from {corner0} through {corner3}:
+/// *Fiducials__homography_compute*() will compute the perspective
+/// transform that maps the unit square in tag space onto the
+/// quadralateral in *corners* and store its 8 coefficients into
+/// *homography*.  Tag space (0, 0) maps to corners[1], (1, 0) to
+/// corners[2], (1, 1) to corners[3] and (0, 1) to corners[0].  Tag space
+/// (*u*, *v*) maps to image point (*x*, *y*) as follows:
+///
+///        w = h[6] * u + h[7] * v + 1
+///        x = (h[0] * u + h[1] * v + h[2]) / w
+///        y = (h[3] * u + h[4] * v + h[5]) / w
+///
+/// Unlike bilinear interpolation, this keeps the tag grid lines straight
+/// and correctly spaced when the tag is viewed at an oblique angle.  When
+/// *corners* is a parallelogram the result is the same affine transform
+/// that bilinear interpolation would give.  (See Heckbert, "Fundamentals
+/// of Texture Mapping and Image Warping", section 2.2.3.)
+
+void Fiducials__homography_compute(
+  CV_Point2D32F_Vector corners, Double *homography) {
+
+    // Extract the 4 corners from {corners} in tag space order:
+    CV_Point2D32F corner0 = CV_Point2D32F_Vector__fetch1(corners, 1);
+    CV_Point2D32F corner1 = CV_Point2D32F_Vector__fetch1(corners, 2);
+    CV_Point2D32F corner2 = CV_Point2D32F_Vector__fetch1(corners, 3);
+    CV_Point2D32F corner3 = CV_Point2D32F_Vector__fetch1(corners, 0);
+
+    // Extract the x and y values from {corner0} through {corner3}:
     Double x0 = CV_Point2D32F__x_get(corner0);
     Double y0 = CV_Point2D32F__y_get(corner0);
     Double x1 = CV_Point2D32F__x_get(corner1);
@@ -1747,232 +2200,283 @@ CV_Point2D32F_Vector Fiducials__references_compute(
     Double x3 = CV_Point2D32F__x_get(corner3);
     Double y3 = CV_Point2D32F__y_get(corner3);
 
-    Double dx21 = x2 - x1;
-    Double dy21 = y2 - y1;
-    Double dx30 = x3 - x0;
-    Double dy30 = y3 - y0;
-
-    // Determine the points ({xx0, yy0}) and ({xx1, yy1}) that determine
-    // a line parrallel to one side of the quadralatal:
-    Double xx0 = x1 + dx21 * 5.0 / 20.0;
-    Double yy0 = y1 + dy21 * 5.0 / 20.0;
-    Double xx1 = x0 + dx30 * 5.0 / 20.0;
-    Double yy1 = y0 + dy30 * 5.0 / 20.0;
-
-    // Set the outside and inside reference points along the line
-    // through points ({xx0, yy0}) and ({xx1, yy1}):
-    Double dxx10 = xx1 - xx0;
-    Double dyy10 = yy1 - yy0;
-    CV_Point2D32F__x_set(reference0, xx0 + dxx10 * -1.0 / 20.0);
-    CV_Point2D32F__y_set(reference0, yy0 + dyy10 * -1.0 / 20.0);
-    CV_Point2D32F__x_set(reference4, xx0 + dxx10 * 1.0 / 20.0);
-    CV_Point2D32F__y_set(reference4, yy0 + dyy10 * 1.0 / 20.0);
-    CV_Point2D32F__x_set(reference1, xx0 + dxx10 * 21.0 / 20.0);
-    CV_Point2D32F__y_set(reference1, yy0 + dyy10 * 21.0 / 20.0);
-    CV_Point2D32F__x_set(reference5, xx0 + dxx10 * 19.0 / 20.0);
-    CV_Point2D32F__y_set(reference5, yy0 + dyy10 * 19.0 / 20.0);
-
-    // Determine the points ({xx2, yy2}) and ({xx3, yy3}) that determine
-    // a line parrallel to the other side of the quadralatal:
-    Double xx2 = x1 + dx21 * 15.0 / 20.0;
-    Double yy2 = y1 + dy21 * 15.0 / 20.0;
-    Double xx3 = x0 + dx30 * 15.0 / 20.0;
-    Double yy3 = y0 + dy30 * 15.0 / 20.0;
-
-    // Set the outside and inside reference points along the line
-    // through points ({xx2, yy2}) and ({xx3, yy3}):
-    Double dxx32 = xx3 - xx2;
-    Double dyy32 = yy3 - yy2;
-    CV_Point2D32F__x_set(reference2, xx2 + dxx32 * -1.0 / 20.0);
-    CV_Point2D32F__y_set(reference2, yy2 + dyy32 * -1.0 / 20.0);
-    CV_Point2D32F__x_set(reference6, xx2 + dxx32 * 1.0 / 20.0);
-    CV_Point2D32F__y_set(reference6, yy2 + dyy32 * 1.0 / 20.0);
-    CV_Point2D32F__x_set(reference3, xx2 + dxx32 * 21.0 / 20.0);
-    CV_Point2D32F__y_set(reference3, yy2 + dyy32 * 21.0 / 20.0);
-    CV_Point2D32F__x_set(reference7, xx2 + dxx32 * 19.0 / 20.0);
-    CV_Point2D32F__y_set(reference7, yy2 + dyy32 * 19.0 / 20.0);
-
-    return references;
+    // {sx} and {sy} are zero when the quadralateral is a parallelogram,
+    // which makes the perspective terms {g} and {h} zero as well:
+    Double sx = x0 - x1 + x2 - x3;
+    Double sy = y0 - y1 + y2 - y3;
+    Double dx1 = x1 - x2;
+    Double dy1 = y1 - y2;
+    Double dx2 = x3 - x2;
+    Double dy2 = y3 - y2;
+    Double determinant = dx1 * dy2 - dx2 * dy1;
+
+    // Compute the perspective terms {g} and {h}:
+    Double g = 0.0;
+    Double h = 0.0;
+    if (Double__absolute(determinant) > 1.0e-9) {
+	g = (sx * dy2 - dx2 * sy) / determinant;
+	h = (dx1 * sy - sx * dy1) / determinant;
+
+	// A badly non-convex quadralateral can put the horizon (w = 0)
+	// inside of tag space.  Since w is linear in (u, v), checking the
+	// corners of tag space (including the references just outside of
+	// it) is sufficient.  Fall back to the affine transform when that
+	// happens; the candidate will be rejected anyway:
+	if (1.0 - 0.05 * h <= 0.0 || 1.0 + g - 0.05 * h <= 0.0 ||
+	  1.0 + 1.05 * h <= 0.0 || 1.0 + g + 1.05 * h <= 0.0) {
+	    g = 0.0;
+	    h = 0.0;
+	}
+    }
+
+    // Fill in *homography*:
+    homography[0] = x1 - x0 + g * x1;
+    homography[1] = x3 - x0 + h * x3;
+    homography[2] = x0;
+    homography[3] = y1 - y0 + g * y1;
+    homography[4] = y3 - y0 + h * y3;
+    homography[5] = y0;
+    homography[6] = g;
+    homography[7] = h;
 }
 
-/// @brief Return the maximum value of the points in *points*.
-/// @param fiducials is the *Fiducials* object that contains the image.
-/// @param points is the vector of points to sample.
-/// @param start_index is the first index to start with.
-/// @param end_index is the last index to end with.
-/// @returns the maximum sampled value.
-///
+/// @brief Return whether *corners* are shaped enough like a tag.
+/// @param corners is the 4 corners of a candidate tag.
+/// @returns (*Logical*)1 if *corners* could be a tag.
 ///
-/// *Fiducials__points_maximum*() will sweep from *start_index* to
-/// *end_index* through *points*.  Using each selected point in *points*},
-/// the corresponding value in *image* is sampled.  The minimum of the
-/// sampled point is returned.
+/// *Fiducials__quad_shape_check*() will return (*Logical*)0 if the width
+/// to height ratio of the bounding box of *corners*, the longest to the
+/// shortest side ratio, or the longer to the shorter diagonal ratio is
+/// more than *FIDUCIALS_ASPECT_MAXIMUM*.  Tags seen by an upward looking
+/// camera are close to square even when seen off to the side.
+
+Logical Fiducials__quad_shape_check(CV_Point2D32F_Vector corners) {
+    // Grab the corner coordinates and the bounding box:
+    Double xs[4];
+    Double ys[4];
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	xs[index] = CV_Point2D32F__x_get(corner);
+	ys[index] = CV_Point2D32F__y_get(corner);
+    }
+    Double x_minimum = xs[0];
+    Double x_maximum = xs[0];
+    Double y_minimum = ys[0];
+    Double y_maximum = ys[0];
+    for (Unsigned index = 1; index < 4; index++) {
+	x_minimum = Double__minimum(x_minimum, xs[index]);
+	x_maximum = Double__maximum(x_maximum, xs[index]);
+	y_minimum = Double__minimum(y_minimum, ys[index]);
+	y_maximum = Double__maximum(y_maximum, ys[index]);
+    }
 
-Integer Fiducials__points_maximum(Fiducials fiducials,
-  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index) {
+    // Check the bounding box:
+    Double aspect = FIDUCIALS_ASPECT_MAXIMUM;
+    Double width = x_maximum - x_minimum;
+    Double height = y_maximum - y_minimum;
+    if (width > aspect * height || height > aspect * width) {
+	return (Logical)0;
+    }
 
-    // Start with a big value move it down:
-    Integer result = 0;
-
-    // Iterate across the {points} from {start_index} to {end_index}:
-    for (Unsigned index = start_index; index <= end_index; index++) {
-	CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(points, index);
-	Integer value = Fiducials__point_sample(fiducials, point);
-	//call d@(form@("max[%f%:%f%]:%d%\n\") %
-	//  f@(point.x) % f@(point.y) / f@(value))
-	if (value > result) {
-	// New maximum value:
-	    result = value;
+    // Check the sides (the lengths are squared):
+    Double side_minimum = -1.0;
+    Double side_maximum = 0.0;
+    for (Unsigned index = 0; index < 4; index++) {
+	Unsigned next = (index + 1) & 3;
+	Double dx = xs[next] - xs[index];
+	Double dy = ys[next] - ys[index];
+	Double side = dx * dx + dy * dy;
+	if (side_minimum < 0.0 || side < side_minimum) {
+	    side_minimum = side;
 	}
+	side_maximum = Double__maximum(side_maximum, side);
     }
-    return result;
+    if (side_maximum > aspect * aspect * side_minimum) {
+	return (Logical)0;
+    }
+
+    // Check the diagonals (the lengths are squared):
+    Double diagonal02 = (xs[2] - xs[0]) * (xs[2] - xs[0]) +
+      (ys[2] - ys[0]) * (ys[2] - ys[0]);
+    Double diagonal13 = (xs[3] - xs[1]) * (xs[3] - xs[1]) +
+      (ys[3] - ys[1]) * (ys[3] - ys[1]);
+    if (diagonal02 > aspect * aspect * diagonal13 ||
+      diagonal13 > aspect * aspect * diagonal02) {
+	return (Logical)0;
+    }
+    return (Logical)1;
 }
 
-/// @brief Return the minimum value of the points in *points*.
-/// @param fiducials is the *Fiducials* object that contains the image.
-/// @param points is the vector of points to sample.
-/// @param start_index is the first index to start with.
-/// @param end_index is the last index to end with.
-/// @returns the minimum sampled value.
+/// @brief Return the decimation factor to find the tag contours at.
+/// @param fiducials is the *Fiducials* object to use.
+/// @param debug_index is the debug image that is being shown.
+/// @returns the decimation factor (1 for full resolution).
 ///
-/// *Fiducials__points_minimum*() will sweep from *start_index* to
-/// *end_index* through *points*.  Using each selected point in *points*},
-/// the corresponding value in *image* is sampled.  The minimum of the
-/// sampled point is returned.
+/// *Fiducials__pyramid_scale_select*() will return the *pyramid_scale*
+/// of *fiducials* halved until the smallest expected tag diagonal (i.e.
+/// *tag_diagonal_minimum*) is still *FIDUCIALS_PYRAMID_DIAGONAL_MINIMUM*
+/// pixels or more in the decimated image.  The debug images 4 through 8
+/// draw the contours over full size images, so they always get 1.
+
+Unsigned Fiducials__pyramid_scale_select(
+  Fiducials fiducials, Unsigned debug_index) {
+    Unsigned scale = fiducials->pyramid_scale;
+    assert (scale >= 1);
+    if (4 <= debug_index && debug_index <= 8) {
+	scale = 1;
+    }
+    Double tag_diagonal_minimum = fiducials->tag_diagonal_minimum;
+    while (scale > 1 && tag_diagonal_minimum / (Double)scale <
+      FIDUCIALS_PYRAMID_DIAGONAL_MINIMUM) {
+	scale /= 2;
+    }
+    return scale;
+}
 
-Integer Fiducials__points_minimum(Fiducials fiducials,
-  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index) {
+/// @brief Append the region of interest around a tag to *fiducials*.
+/// @param fiducials is the *Fiducials* object to append to.
+/// @param quad is the 8 rough corner coordinates of the tag.
+/// @param scale is the decimation factor that *quad* was found at.
+///
+/// *Fiducials__roi_append*() will append the full resolution bounding
+/// box of *quad* padded by *FIDUCIALS_ROI_PADDING* times its size on
+/// each side (and clipped to the image) to the *rois* array of
+/// *fiducials*.  Each region of interest is stored as 4 *Integer*'s:
+/// left, top, right and bottom, where right and bottom are one past the
+/// last column and row.
+
+void Fiducials__roi_append(Fiducials fiducials, Double *quad, Integer scale) {
+    // Find the bounding box of *quad*:
+    Double minimum_x = quad[0];
+    Double maximum_x = quad[0];
+    Double minimum_y = quad[1];
+    Double maximum_y = quad[1];
+    for (Unsigned index = 1; index < 4; index++) {
+	Double x = quad[2 * index];
+	Double y = quad[2 * index + 1];
+	minimum_x = (x < minimum_x) ? x : minimum_x;
+	maximum_x = (x > maximum_x) ? x : maximum_x;
+	minimum_y = (y < minimum_y) ? y : minimum_y;
+	maximum_y = (y > maximum_y) ? y : maximum_y;
+    }
 
-    // Start with a big value move it down:
-    Integer result = 0x7fffffff;
+    // Lift the bounding box to full resolution and pad it:
+    Double full_scale = (Double)scale;
+    Double size = full_scale * (((maximum_x - minimum_x >
+      maximum_y - minimum_y) ? maximum_x - minimum_x :
+      maximum_y - minimum_y) + 1.0);
+    Double padding = size * FIDUCIALS_ROI_PADDING + full_scale;
+    Double left = floor(full_scale * minimum_x - padding);
+    Double top = floor(full_scale * minimum_y - padding);
+    Double right = ceil(full_scale * (maximum_x + 1.0) + padding);
+    Double bottom = ceil(full_scale * (maximum_y + 1.0) + padding);
+
+    // Clip it to the image:
+    Integer width = CV_Image__width_get(fiducials->gray_image);
+    Integer height = CV_Image__height_get(fiducials->gray_image);
+    left = (left < 0.0) ? 0.0 : left;
+    top = (top < 0.0) ? 0.0 : top;
+    right = (right > (Double)width) ? (Double)width : right;
+    bottom = (bottom > (Double)height) ? (Double)height : bottom;
+
+    // Make sure there is room and append it:
+    if (fiducials->rois_size >= fiducials->rois_allocated) {
+	fiducials->rois_allocated *= 2;
+	fiducials->rois = (Integer *)Memory__reallocate(
+	  (Memory)fiducials->rois,
+	  fiducials->rois_allocated * 4 * sizeof(Integer),
+	  "Fiducials__roi_append");
+    }
+    Integer *roi = fiducials->rois + 4 * fiducials->rois_size;
+    roi[0] = (Integer)left;
+    roi[1] = (Integer)top;
+    roi[2] = (Integer)right;
+    roi[3] = (Integer)bottom;
+    fiducials->rois_size += 1;
+}
 
-    // Iterate across the {points} from {start_index} to {end_index}:
-    for (Unsigned index = start_index; index <= end_index; index++) {
-	CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(points, index);
-	Integer value = Fiducials__point_sample(fiducials, point);
-	if (value < result) {
-	    // New minimum value:
-	    result = value;
+/// @brief Merge the overlapping regions of interest in *fiducials*.
+/// @param fiducials is the *Fiducials* object that has the regions.
+///
+/// *Fiducials__rois_merge*() will replace each pair of overlapping
+/// regions of interest in the *rois* array of *fiducials* with their
+/// bounding box until no two of them overlap, so that no pixel is
+/// searched twice (and no tag is found twice.)
+
+void Fiducials__rois_merge(Fiducials fiducials) {
+    Integer *rois = fiducials->rois;
+    Unsigned rois_size = fiducials->rois_size;
+    Logical merged = (Logical)1;
+    while (merged) {
+	merged = (Logical)0;
+	for (Unsigned index1 = 0; index1 < rois_size; index1++) {
+	    Integer *roi1 = rois + 4 * index1;
+	    Unsigned index2 = index1 + 1;
+	    while (index2 < rois_size) {
+		Integer *roi2 = rois + 4 * index2;
+		if (roi1[0] < roi2[2] && roi2[0] < roi1[2] &&
+		  roi1[1] < roi2[3] && roi2[1] < roi1[3]) {
+		    // Grow *roi1* to cover *roi2* and move the last region
+		    // into the slot of *roi2*:
+		    roi1[0] = (roi2[0] < roi1[0]) ? roi2[0] : roi1[0];
+		    roi1[1] = (roi2[1] < roi1[1]) ? roi2[1] : roi1[1];
+		    roi1[2] = (roi2[2] > roi1[2]) ? roi2[2] : roi1[2];
+		    roi1[3] = (roi2[3] > roi1[3]) ? roi2[3] : roi1[3];
+		    rois_size -= 1;
+		    Integer *last = rois + 4 * rois_size;
+		    for (Unsigned index = 0; index < 4; index++) {
+			roi2[index] = last[index];
+		    }
+		    merged = (Logical)1;
+		} else {
+		    index2 += 1;
+		}
+	    }
 	}
     }
-    return result;
+    fiducials->rois_size = rois_size;
 }
 
-/// @brief Compute the fiducial locations to sample using *corners*
-/// @param corners is the the 4 of the fiducials.
-/// @param sample_points is the 64 vector of points that are computed.
+/// @brief Return the 3x3 sample weights selected for *fiducials*.
+/// @param fiducials is the *Fiducials* object that selects the weights.
+/// @returns the 9 sample weights in row major order.
 ///
-/// *Fiducials__sample_points_compute*() will use the 4 corners in 
-/// *corners* as a quadralateral to compute an 8 by 8 grid of tag
-/// bit sample points and store the results into the the 64
-/// preallocated *CV_Point2D32F* objects in *sample_points*.
-/// The quadralateral must be convex and in the counter-clockwise
-/// direction.  Bit 0 will be closest to corners[1], bit 7 will be
-/// closest to corners[0], bit 56 closest to corners[2] and bit 63
-/// closest to corners[3].
-
-//FIXME: sample points comes from *fiducials*, so shouldn't have
-// have *fiducials* as a argument instead of *sample_points*???!!!
-
-void Fiducials__sample_points_compute(
-  CV_Point2D32F_Vector corners, CV_Point2D32F_Vector sample_points) {
-
-    CV_Point2D32F corner0 = CV_Point2D32F_Vector__fetch1(corners, 0);
-    CV_Point2D32F corner1 = CV_Point2D32F_Vector__fetch1(corners, 1);
-    CV_Point2D32F corner2 = CV_Point2D32F_Vector__fetch1(corners, 2);
-    CV_Point2D32F corner3 = CV_Point2D32F_Vector__fetch1(corners, 3);
-
-    // Extract the x and y references from {corner0} through {corner3}:
-    Double x0 = CV_Point2D32F__x_get(corner0);
-    Double y0 = CV_Point2D32F__y_get(corner0);
-    Double x1 = CV_Point2D32F__x_get(corner1);
-    Double y1 = CV_Point2D32F__y_get(corner1);
-    Double x2 = CV_Point2D32F__x_get(corner2);
-    Double y2 = CV_Point2D32F__y_get(corner2);
-    Double x3 = CV_Point2D32F__x_get(corner3);
-    Double y3 = CV_Point2D32F__y_get(corner3);
-
-    // Figure out the vector directions {corner1} to {corner2}, as well as,
-    // the vector from {corner3} to {corner0}.  If {corners} specify a
-    // quadralateral, these vectors should be approximately parallel:
-    Double dx21 = x2 - x1;
-    Double dy21 = y2 - y1;
-    Double dx30 = x3 - x0;
-    Double dy30 = y3 - y0;
-
-    // {index} will cycle through the 64 sample points in {sample_points}:
-    Unsigned index = 0;
-
-    // There are ten rows (or columns) enclosed by the quadralateral.
-    // (The outermost "white" rows and columns are not enclosed by the
-    // quadralateral.)  Since we want to sample the middle 8 rows (or
-    // columns), We want a fraction that goes from 3/20, 5/20, ..., 17/20.
-    // The fractions 1/20 and 19/20 would correspond to a black border,
-    // which we do not care about:
-    Double i_fraction = 3.0 / 20.0;
-    Double i_increment = 2.0 / 20.0;
-
-    // Loop over the first axis of the grid:
-    Unsigned i = 0;
-    while (i < 8) {
-
-	// Compute ({xx1},{yy1}) which is a point that is {i_fraction} between
-	// ({x1},{y1}) and ({x2},{y2}), as well as, ({xx2},{yy2}) which is a
-	// point that is {i_fraction} between ({x0},{y0}) and ({x3},{y3}).
-	Double xx1 = x1 + dx21 * i_fraction;
-	Double yy1 = y1 + dy21 * i_fraction;
-	Double xx2 = x0 + dx30 * i_fraction;
-	Double yy2 = y0 + dy30 * i_fraction;
-
-	// Compute the vector from ({xx1},{yy1}) to ({xx2},{yy2}):
-	Double dxx21 = xx2 - xx1;
-	Double dyy21 = yy2 - yy1;
-
-	// As with {i_fraction}, {j_fraction} needs to sample the
-	// the data stripes through the quadralateral with values
-	// that range from 3/20 through 17/20:
-	Double j_fraction = 3.0 / 20.0;
-	Double j_increment = 2.0 / 20.0;
-
-	// Loop over the second axis of the grid:
-	Unsigned j = 0;
-	while (j < 8) {
-	    // Fetch next {sample_point}:
-	    CV_Point2D32F sample_point =
-	      CV_Point2D32F_Vector__fetch1(sample_points, index);
-	    index = index + 1;
+/// *Fiducials__sample_weights*() will return the 9 weights that are used
+/// to sample the 3x3 neighborhood around a point as selected by the
+/// *weights_index* field of *fiducials*.  The weights always sum to 100.
+/// The weight tables are read only, so every *Fiducials* object can share
+/// them.
+
+const Integer *Fiducials__sample_weights(Fiducials fiducials) {
+    static const Integer weights0[9] = {
+      0,   0,  0,
+      0, 100,  0,
+      0,  0,   0};
 
-	    // Write the rvGrid position into the rvGrid array:
-	    CV_Point2D32F__x_set(sample_point, xx1 + dxx21 * j_fraction);
-	    CV_Point2D32F__y_set(sample_point, yy1 + dyy21 * j_fraction);
+    static const Integer weights1[9] = {
+       0,  15,  0,
+      15,  40,  15,
+       0,  15,  0};
 
-	    // Increment {j_faction} to the sample point:
-	    j_fraction = j_fraction + j_increment;
-	    j = j + 1;
-	}
+    static const Integer weights2[9] = {
+       5,  10,  5,
+      10,  40, 10,
+       5,  10,  5};
 
-	// Increment {i_fraction} to the next sample striple:
-	i_fraction = i_fraction + i_increment;
-	i = i + 1;
+    // Select sample *weights*:
+    const Integer *weights = (const Integer *)0;
+    switch (fiducials->weights_index) {
+      case 1:
+	weights = weights1;
+	break;
+      case 2:
+	weights = weights2;
+	break;
+      default:
+	weights = weights0;
+	break;
     }
-
-    CV_Point2D32F sample_point0 =
-      CV_Point2D32F_Vector__fetch1(sample_points, 0);
-    CV_Point2D32F sample_point7 =
-      CV_Point2D32F_Vector__fetch1(sample_points, 7);
-    CV_Point2D32F sample_point56 =
-      CV_Point2D32F_Vector__fetch1(sample_points, 56);
-    CV_Point2D32F sample_point63 =
-      CV_Point2D32F_Vector__fetch1(sample_points, 63);
-
-    // clockwise direction.  Bit 0 will be closest to corners[1], bit 7
-    // will be closest to corners[0], bit 56 closest to corners[2] and
-    // bit 63 closest to corners[3].
-
-    //Fiducials__sample_points_helper("0:7", corner0, sample_point7);
-    //Fiducials__sample_points_helper("1:0", corner0, sample_point0);
-    //Fiducials__sample_points_helper("2:56", corner0, sample_point56);
-    //Fiducials__sample_points_helper("3:63", corner0, sample_point63);
+    return weights;
 }
 
 // Used in *Fiducials__sample_points*() for debugging:
@@ -2016,28 +2520,927 @@ void Fiducials__tag_announce(void *announce_object, Integer id,
       id, x, y, twist, visible_text);
 }
 
-static struct Fiducials_Create__Struct fiducials_create_struct =
-{
-    (String_Const)0,				// fiducials_path
-    (String_Const)0,				// lens_calibrate_file_name
-    (void *)0,					// announce_object
-    (Fiducials_Arc_Announce_Routine)0,		// arc_announce_routine
-    (Fiducials_Location_Announce_Routine)0,	// location_announce_routine
-    (Fiducials_Tag_Announce_Routine)0,		// tag_announce_routine
-    (Fiducials_Fiducial_Announce_Routine)0,    	// fiducial_announce_routine
-    (String_Const)0,				// log_file_name
-    (String_Const)0,				// map_base_name
-    (String_Const)0,				// tag_heights_file_name
-};
-
-/// @brief Returns the one and only *Fiducials_Create* object.
-/// @returns the one and only *Fiducials_Create* object.
+/// @brief Return the smallest tag diagonal in pixels to expect.
+/// @param map is the *Map* that contains the tag heights.
+/// @param lens is the 8 lens parameters (all 0.0 when unknown).
+/// @returns the smallest expected tag diagonal in pixels.
+///
+/// *Fiducials__tag_diagonal_minimum*() will return the smallest diagonal
+/// that any tag listed in the tag heights file read into *map* can have in
+/// the camera image.  An upward looking camera sees a tag with a diagonal
+/// of *world_diagonal* on a ceiling *z* above the floor as at least
+/// *world_diagonal* * F / *z* pixels across, where F is the smaller focal
+/// length in *lens*; the camera is never below the floor.  Without a lens
+/// calibration or tag heights, the diagonal of a 500 square pixel tag
+/// (about 31.6 pixels) is returned.
+
+Double Fiducials__tag_diagonal_minimum(Map map, Double *lens) {
+    Double focal_length = lens[0];
+    if (lens[1] < focal_length) {
+	focal_length = lens[1];
+    }
+    Double diagonal_minimum = 0.0;
+    if (focal_length > 0.0) {
+	List /* <Tag_Height> */ tag_heights = map->tag_heights;
+	Unsigned tag_heights_size = List__size(tag_heights);
+	for (Unsigned index = 0; index < tag_heights_size; index++) {
+	    Tag_Height tag_height =
+	      (Tag_Height)List__fetch(tag_heights, index);
+	    if (tag_height->z > 0.0) {
+		Double diagonal =
+		  tag_height->world_diagonal * focal_length / tag_height->z;
+		if (diagonal_minimum <= 0.0 || diagonal < diagonal_minimum) {
+		    diagonal_minimum = diagonal;
+		}
+	    }
+	}
+    }
+    if (diagonal_minimum <= 0.0) {
+	diagonal_minimum = sqrt(2.0 * 500.0);
+    }
+    return diagonal_minimum;
+}
+
+/// @brief Project a map tag into the image from a robot location.
+/// @param fiducials is the *Fiducials* object with the image.
+/// @param tag is the map *Tag* to project.
+/// @param rx is the robot X floor coordinate.
+/// @param ry is the robot Y floor coordinate.
+/// @param rtw is the robot bearing in radians.
+/// @param image_x is where the image X coordinate of the tag is stored.
+/// @param image_y is where the image Y coordinate of the tag is stored.
+/// @returns (*Logical*)1 if *tag* has a map position to project.
 ///
-/// *Fiducials_Create__one_and_only*() will return the one and only
-/// *Fiducials_Create* object.  This object needs to be initalized
-/// prior to calling *Fiduciasl__create*().
+/// *Fiducials__tag_project*() will compute where the center of *tag*
+/// shows up in the image taken from robot location (*rx*, *ry*, *rtw*)
+/// by running the location computation in *Fiducials__process*()
+/// backwards.  The scale comes from the largest *diagonal* (in pixels)
+/// that *tag* has been seen with, so only tags that have been seen and
+/// placed in the map (i.e. in its spanning tree) can be projected.  When
+/// *undistort_sparse* is set, the position is mapped back into the
+/// distorted image.
+
+Logical Fiducials__tag_project(Fiducials fiducials, Tag tag,
+  Double rx, Double ry, Double rtw, Double *image_x, Double *image_y) {
+    if (!(tag->diagonal > 0.0 && tag->world_diagonal > 0.0 &&
+      (tag->parent_arc != (Arc)0 || List__size(tag->arcs) > 0))) {
+	return (Logical)0;
+    }
 
-Fiducials_Create Fiducials_Create__one_and_only(void)
-{
-    return &fiducials_create_struct;
+    // Undo the bearing computation to get the twist of the tag in the
+    // image and then undo the floor distance and angle computation:
+    Double pi = 3.14159265358979323846264;
+    Double camera_twist = Double__angle_normalize(pi - rtw - tag->twist);
+    Double dx = rx - tag->x;
+    Double dy = ry - tag->y;
+    Double floor_distance = Double__square_root(dx * dx + dy * dy);
+    Double angle = Double__arc_tangent2(dy, dx);
+    Double polar_angle = Double__angle_normalize(angle - pi + camera_twist);
+    Double polar_distance =
+      floor_distance * tag->diagonal / tag->world_diagonal;
+
+    // Offset from the image center:
+    Integer half_width = CV_Image__width_get(fiducials->gray_image) / 2;
+    Integer half_height = CV_Image__height_get(fiducials->gray_image) / 2;
+    Double x =
+      (Double)half_width + polar_distance * Double__cosine(polar_angle);
+    Double y =
+      (Double)half_height + polar_distance * Double__sine(polar_angle);
+    if (fiducials->undistort_sparse) {
+	CV__lens_distort(fiducials->lens, &x, &y);
+    }
+    *image_x = x;
+    *image_y = y;
+    return (Logical)1;
+}
+
+/// @brief Append the predicted windows of the map tags in view.
+/// @param fiducials is the *Fiducials* object to predict for.
+/// @returns the number of windows that were appended.
+///
+/// *Fiducials__tags_predict*() will predict the robot location from the
+/// location and odometry of the last located image plus the change in
+/// odometry since then (see *Fiducials__odometry_set*()).  Each map tag
+/// that *Fiducials__tag_project*() puts in or near the image gets a
+/// window around it appended to the regions of interest of *fiducials*
+/// with *Fiducials__roi_append*().
+
+Unsigned Fiducials__tags_predict(Fiducials fiducials) {
+    // The odometry drifts away from the map, so the change since the
+    // anchor is rotated from odometry coordinates into map coordinates:
+    Double dex = fiducials->odometry_ex - fiducials->odometry_anchor_ex;
+    Double dey = fiducials->odometry_ey - fiducials->odometry_anchor_ey;
+    Double rotate =
+      fiducials->odometry_anchor_rtw - fiducials->odometry_anchor_etw;
+    Double cosine = Double__cosine(rotate);
+    Double sine = Double__sine(rotate);
+    Double rx = fiducials->odometry_anchor_rx + dex * cosine - dey * sine;
+    Double ry = fiducials->odometry_anchor_ry + dex * sine + dey * cosine;
+    Double rtw = Double__angle_normalize(fiducials->odometry_anchor_rtw +
+      fiducials->odometry_etw - fiducials->odometry_anchor_etw);
+
+    // Append a window for each tag that lands in or near the image:
+    Integer image_width = CV_Image__width_get(fiducials->gray_image);
+    Integer image_height = CV_Image__height_get(fiducials->gray_image);
+    Double width = (Double)image_width;
+    Double height = (Double)image_height;
+    List /* <Tag> */ all_tags = fiducials->map->all_tags;
+    Unsigned all_tags_size = List__size(all_tags);
+    Unsigned predicted_size = 0;
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	Tag tag = (Tag)List__fetch(all_tags, index);
+	Double x = 0.0;
+	Double y = 0.0;
+	if (Fiducials__tag_project(fiducials, tag, rx, ry, rtw, &x, &y)) {
+	    Double half = tag->diagonal * FIDUCIALS_PREDICT_SLACK;
+	    if (x + half > 0.0 && x - half < width &&
+	      y + half > 0.0 && y - half < height) {
+		// *Fiducials__roi_append*() pads the tag box:
+		Double box[8];
+		box[0] = x - half;
+		box[1] = y - half;
+		box[2] = x + half;
+		box[3] = y - half;
+		box[4] = x + half;
+		box[5] = y + half;
+		box[6] = x - half;
+		box[7] = y + half;
+		Fiducials__roi_append(fiducials, box, 1);
+		predicted_size += 1;
+	    }
+	}
+    }
+    return predicted_size;
+}
+
+/// @brief Add the tags that *corner_tracker* tracked into this frame.
+/// @param fiducials is the *Fiducials* object with the *corner_tracker*.
+/// @param frame is the *Fiducials_Frame* to add the tags to.
+/// @returns the number of tags that were added.
+///
+/// *Fiducials__tags_track*() will track the corners of the tags found in
+/// the previous frame into the current *gray_image* of *fiducials* with
+/// its *corner_tracker* and append each tag whose tracked corners still
+/// look like a tag (the right shape and a dark border with light around
+/// it) to the tags of *frame*.  No decode is done; the tag id and direction are
+/// carried over from the previous frame.  The added tags are appended
+/// back to *corner_tracker* (and to the regions of interest) so that they
+/// can be tracked into the next frame.
+
+Unsigned Fiducials__tags_track(Fiducials fiducials, Fiducials_Frame frame) {
+    Corner_Tracker corner_tracker = fiducials->corner_tracker;
+    Fiducials_Counters counters = fiducials->counters;
+    CV_Point2D32F_Vector corners = fiducials->corners;
+    Fiducials_Decoder decoder = fiducials->decoders[0];
+
+    // Track all of the corners at once and then start over with the
+    // tags that survive.  The survivors are appended in order, so they
+    // never overwrite a tag that has not been looked at yet:
+    Unsigned size = corner_tracker->size;
+    Corner_Tracker__track(corner_tracker, fiducials->gray_image);
+    Corner_Tracker__clear(corner_tracker);
+
+    Unsigned tracked_size = 0;
+    for (Unsigned index = 0; index < size; index++) {
+	Unsigned tag_id = corner_tracker->tag_ids[index];
+	if (!corner_tracker->tracked[index] ||
+	  Fiducials_Frame__tag_find(frame, tag_id)) {
+	    continue;
+	}
+
+	// Load the tracked corners into *corners*:
+	Double gray_corners[8];
+	Corner_Tracker__corners_get(corner_tracker, index, gray_corners);
+	for (Unsigned corner_index = 0; corner_index < 4; corner_index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, corner_index);
+	    Double x = gray_corners[2 * corner_index];
+	    Double y = gray_corners[2 * corner_index + 1];
+	    if (fiducials->undistort_sparse) {
+		CV__lens_undistort(fiducials->lens, &x, &y);
+	    }
+	    CV_Point2D32F__x_set(corner, x);
+	    CV_Point2D32F__y_set(corner, y);
+	}
+	if (!Fiducials__quad_shape_check(corners)) {
+	    continue;
+	}
+	CV_Point2D32F_Vector__corners_normalize(corners);
+
+	// Make sure that the tracked corners still have a dark border
+	// with light around it, just like a decoded tag:
+	Fiducials_Decoder__tag_points_compute(decoder, corners);
+	CV_Point2D32F_Vector references = decoder->references;
+	Integer white_darkest =
+	  Fiducials_Decoder__points_minimum(decoder, references, 0, 3);
+	Integer black_lightest =
+	  Fiducials_Decoder__points_maximum(decoder, references, 4, 7);
+	if (black_lightest >= white_darkest) {
+	    continue;
+	}
+
+	// We have the tag again:
+	Unsigned direction_index = corner_tracker->directions[index];
+	Fiducials_Frame__tag_append(frame, tag_id, direction_index, corners);
+	Corner_Tracker__append(
+	  corner_tracker, tag_id, direction_index, gray_corners);
+	Fiducials__roi_append(fiducials, gray_corners, 1);
+	counters->tags_tracked += 1;
+	tracked_size += 1;
+    }
+    return tracked_size;
+}
+
+/// @brief Return a new *Fiducials_Create* object.
+/// @returns a new *Fiducials_Create* object.
+///
+/// *Fiducials_Create__create*() will return a new *Fiducials_Create*
+/// object with every field cleared.  The fields need to be filled in
+/// prior to calling *Fiducials__create*().  *Fiducials__create*() copies
+/// what it needs, so the object can be released with
+/// *Fiducials_Create__free*() as soon as it returns.  Each caller gets
+/// its own object, so several *Fiducials* objects can be created at once
+/// (e.g. on different threads.)
+
+Fiducials_Create Fiducials_Create__create(void) {
+    Fiducials_Create fiducials_create =
+      Memory__new(Fiducials_Create, "Fiducials_Create__create");
+    fiducials_create->fiducials_path = (String_Const)0;
+    fiducials_create->lens_calibrate_file_name = (String_Const)0;
+    fiducials_create->undistort_sparse = (Logical)0;
+    fiducials_create->announce_object = (Memory)0;
+    fiducials_create->arc_announce_routine =
+      (Fiducials_Arc_Announce_Routine)0;
+    fiducials_create->location_announce_routine =
+      (Fiducials_Location_Announce_Routine)0;
+    fiducials_create->tag_announce_routine =
+      (Fiducials_Tag_Announce_Routine)0;
+    fiducials_create->fiducial_announce_routine =
+      (Fiducials_Fiducial_Announce_Routine)0;
+    fiducials_create->log_file_name = (String_Const)0;
+    fiducials_create->map_base_name = (String_Const)0;
+    fiducials_create->tag_heights_file_name = (String_Const)0;
+    fiducials_create->tag_dictionary = (Tag_Dictionary)0;
+    return fiducials_create;
+}
+
+/// @brief Release the storage associated with *fiducials_create*.
+/// @param fiducials_create is the *Fiducials_Create* object to release.
+///
+/// *Fiducials_Create__free*() will release the storage associated with
+/// *fiducials_create*.
+
+void Fiducials_Create__free(Fiducials_Create fiducials_create) {
+    Memory__free((Memory)fiducials_create);
+}
+
+/// @brief Run one candidate through the rejection cascade and the decode.
+/// @param decoder is the *Fiducials_Decoder* to decode with.
+/// @param candidate_index is the index of the candidate quadrilateral in
+/// the *quad_finder* of *fiducials*.
+///
+/// *Fiducials_Decoder__candidate_decode*() will lift the corners of the
+/// candidate quadrilateral at *candidate_index* to full resolution, skip
+/// it if it is in the *quad_cache*, run it through the shape and border
+/// probe tests, find its sub pixel corners, check its border contrast and
+/// then sample and decode its 64 bits.  The outcome is stored in the
+/// *Fiducials_Candidate* at *candidate_index* in the *candidates* of
+/// *fiducials*.  Only *decoder* and that *Fiducials_Candidate* are
+/// written (apart from the debug images), so different candidates can be
+/// decoded on different threads.
+
+void Fiducials_Decoder__candidate_decode(
+  Fiducials_Decoder decoder, Unsigned candidate_index) {
+    // Grab some values from *decoder* and *fiducials*:
+    Fiducials fiducials = decoder->fiducials;
+    Fiducials_Candidate candidate = fiducials->candidates + candidate_index;
+    CV_Point2D32F_Vector corners = decoder->corners;
+    CV_Image debug_image = fiducials->debug_image;
+    Unsigned debug_index = decoder->debug_index;
+    CV_Image gray_image = fiducials->gray_image;
+    File log_file = fiducials->log_file;
+    Double *quad = fiducials->quad_finder->quads + 8 * candidate_index;
+    Integer scale = decoder->scale;
+
+    // Copy the 4 corners from *quad* to {corners} and lift them from
+    // the decimated image back up to full resolution:
+    Double corner_offset = (Double)(scale - 1) / 2.0;
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner =
+	  CV_Point2D32F_Vector__fetch1(corners, index);
+	CV_Point2D32F__x_set(corner,
+	  (Double)scale * quad[2 * index] + corner_offset);
+	CV_Point2D32F__y_set(corner,
+	  (Double)scale * quad[2 * index + 1] + corner_offset);
+    }
+
+    // Skip the candidates that failed to decode in the same place in
+    // the last few frames (i.e. ceiling features that look like tags).
+    // *quad_cache* is only updated once all of the candidates of a frame
+    // are decoded:
+    candidate->key = 0;
+    if (fiducials->quad_caching) {
+	candidate->key = Quad_Cache__key(corners);
+	if (Quad_Cache__lookup(fiducials->quad_cache,
+	  candidate->key, decoder->sequence_number)) {
+	    candidate->status = FIDUCIALS_CANDIDATE_CACHED;
+	    return;
+	}
+    }
+
+    if (fiducials->candidate_cascade) {
+	// Toss out candidates that are too long and skinny to be a tag:
+	if (!Fiducials__quad_shape_check(corners)) {
+	    candidate->status = FIDUCIALS_CANDIDATE_SHAPE;
+	    return;
+	}
+
+	// Before spending time on the sub pixel corners, make sure that
+	// the rough corners have a dark border with light around it:
+	if (!Fiducials__border_probe(fiducials, corners)) {
+	    candidate->status = FIDUCIALS_CANDIDATE_PROBE;
+	    return;
+	}
+    }
+
+    // Now find the sub pixel corners of {corners} at full resolution.
+    // Either fit lines to the 4 edges (one pass per edge) or search
+    // for each corner iteratively, which is also the fallback for when
+    // the edges can not be fit:
+    if (!fiducials->corners_line_fit || !CV_Image__corners_line_fit(
+      gray_image, corners, (Double)scale + 2.0)) {
+	CV_Image__find_corner_sub_pix(gray_image, corners, 4,
+	  fiducials->size_5x5, fiducials->size_m1xm1,
+	  fiducials->term_criteria);
+    }
+
+    // Remember the sub pixel corners in *gray_image* for
+    // *corner_tracker*:
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner =
+	  CV_Point2D32F_Vector__fetch1(corners, index);
+	candidate->gray_corners[2 * index] = CV_Point2D32F__x_get(corner);
+	candidate->gray_corners[2 * index + 1] = CV_Point2D32F__y_get(corner);
+    }
+
+    // When undistorting sparsely, *gray_image* is still distorted,
+    // so undistort just the 4 {corners}:
+    if (fiducials->undistort_sparse) {
+	for (Unsigned index = 0; index < 4; index++) {
+	    CV_Point2D32F corner =
+	      CV_Point2D32F_Vector__fetch1(corners, index);
+	    Double x = CV_Point2D32F__x_get(corner);
+	    Double y = CV_Point2D32F__y_get(corner);
+	    CV__lens_undistort(fiducials->lens, &x, &y);
+	    CV_Point2D32F__x_set(corner, x);
+	    CV_Point2D32F__y_set(corner, y);
+	}
+    }
+
+    // Ensure that the corners are in a counter_clockwise direction:
+    CV_Point2D32F_Vector__corners_normalize(corners);
+
+    // For debugging show the 4 corners of the possible tag where
+    //corner0=red, corner1=green, corner2=blue, corner3=purple:
+    if (debug_index == 8) {
+	for (Unsigned index = 0; index < 4; index++) {
+	    Integer x = CV__round(quad[2 * index]);
+	    Integer y = CV__round(quad[2 * index + 1]);
+	    CV_Scalar color = (CV_Scalar)0;
+	    String text = (String)0;
+	    switch (index) {
+	      case 0:
+		color = fiducials->red;
+		text = "red";
+		break;
+	      case 1:
+		color = fiducials->green;
+		text = "green";
+		break;
+	      case 2:
+		color = fiducials->blue;
+		text = "blue";
+		break;
+	      case 3:
+		color = fiducials->purple;
+		text = "purple";
+		break;
+	      default:
+		assert(0);
+	    }
+	    CV_Image__cross_draw(debug_image, x, y, color);
+	    File__format(log_file,
+	      "poly_point[%d]=(%d:%d) %s\n", index, x, y, text);
+	}
+    }
+
+    // Compute the 8 reference points for deciding whether the
+    // polygon is "tag like" in its borders along with the 64
+    // tag bit sample points in one pass:
+    Fiducials_Decoder__tag_points_compute(decoder, corners);
+    CV_Point2D32F_Vector references = decoder->references;
+
+    // Now sample the periphery of the tag and looking for the
+    // darkest white value (i.e. minimum) and the lightest black
+    // value (i.e. maximum):
+    //Integer white_darkest =
+    //  CV_Image__points_minimum(gray_image, references, 0, 3);
+    //Integer black_lightest =
+    //  CV_Image__points_maximum(gray_image, references, 4, 7);
+    Integer white_darkest =
+      Fiducials_Decoder__points_minimum(decoder, references, 0, 3);
+    Integer black_lightest =
+      Fiducials_Decoder__points_maximum(decoder, references, 4, 7);
+
+    // {threshold} should be smack between the two:
+    Integer threshold = (white_darkest + black_lightest) / 2;
+
+    // For debugging, show the 8 points that are sampled around the
+    // the tag periphery to even decide whether to do further testing.
+    // Show "black" as green crosses, and "white" as green crosses:
+    if (debug_index == 9) {
+	CV_Scalar red = fiducials->red;
+	CV_Scalar green = fiducials->green;
+	for (Unsigned index = 0; index < 8; index++) {
+	    CV_Point2D32F reference =
+	      CV_Point2D32F_Vector__fetch1(references, index);
+	    Integer x = CV__round(CV_Point2D32F__x_get(reference));
+	    Integer y = CV__round(CV_Point2D32F__y_get(reference));
+	    //Integer value =
+	    //  CV_Image__point_sample(gray_image, reference);
+	    Integer value =
+	      Fiducials__point_sample(fiducials, reference);
+	    CV_Scalar color = red;
+	    if (value < threshold) {
+		color = green;
+	    }
+	    CV_Image__cross_draw(debug_image, x, y, color);
+	    File__format(log_file, "ref[%d:%d]:%d\n", x, y, value);
+	}
+    }
+
+    // If there is not enough contrast, give up on the candidate:
+    if (black_lightest >= white_darkest) {
+	candidate->status = FIDUCIALS_CANDIDATE_BORDER;
+	return;
+    }
+
+    // Now it is time to read all the bits of the tag out:
+    CV_Point2D32F_Vector sample_points = decoder->sample_points;
+    Integer values[64];
+    Fiducials_Decoder__points_sample(decoder, sample_points, 0, 63, values);
+
+    // Extract all 64 tag bit values into *tag_bits*, where bit
+    // *index* is the bit sampled at sample point *index*:
+    uint64_t tag_bits = 0;
+    for (Unsigned index = 0; index < 64; index++) {
+	// Convert the pixel value into a {bit}:
+	Logical bit = (values[index] < threshold);
+	tag_bits |= (uint64_t)bit << index;
+
+	// For debugging:
+	if (debug_index == 10) {
+	    CV_Scalar red = fiducials->red;
+	    CV_Scalar green = fiducials->green;
+
+	    // Show white bits as {red} and black bits as {green}:
+	    CV_Scalar color = red;
+	    if (bit) {
+		color = green;
+	    }
+
+	    // Now splat a cross of {color} at ({x},{y}):
+	    CV_Point2D32F sample_point =
+	      CV_Point2D32F_Vector__fetch1(sample_points, index);
+	    Integer x = CV__round(CV_Point2D32F__x_get(sample_point));
+	    Integer y = CV__round(CV_Point2D32F__y_get(sample_point));
+	    CV_Image__cross_draw(debug_image, x, y, color);
+	}
+    }
+
+    // Now look *tag_bits* up in the tag dictionary to see if any
+    // of the 4 directions match:
+    Unsigned direction_index = 0;
+    Unsigned tag_id = 0;
+    if (!Tag_Dictionary__decode(fiducials->tag_dictionary,
+      tag_bits, &tag_id, &direction_index)) {
+	candidate->status = FIDUCIALS_CANDIDATE_DECODE;
+	return;
+    }
+
+    // Yippee!!! We have a tag:
+    if (debug_index == 11) {
+	File__format(log_file, "dir=%d Tag=%d\n", direction_index, tag_id);
+    }
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	candidate->corners[2 * index] = CV_Point2D32F__x_get(corner);
+	candidate->corners[2 * index + 1] = CV_Point2D32F__y_get(corner);
+    }
+    candidate->direction_index = direction_index;
+    candidate->status = FIDUCIALS_CANDIDATE_TAG;
+    candidate->tag_id = tag_id;
+}
+
+/// @brief Return a new *Fiducials_Decoder* for *fiducials*.
+/// @param fiducials is the *Fiducials* object to decode for.
+/// @returns a new *Fiducials_Decoder* object.
+///
+/// *Fiducials_Decoder__create*() will create and return a new
+/// *Fiducials_Decoder* with its own scratch corners, references and
+/// sample points.
+
+Fiducials_Decoder Fiducials_Decoder__create(Fiducials fiducials) {
+    Fiducials_Decoder decoder =
+      Memory__new(Fiducials_Decoder, "Fiducials_Decoder__create");
+    decoder->corners = CV_Point2D32F_Vector__create(4);
+    decoder->debug_index = 0;
+    decoder->fiducials = fiducials;
+    decoder->references = CV_Point2D32F_Vector__create(8);
+    decoder->sample_points = CV_Point2D32F_Vector__create(64);
+    decoder->scale = 1;
+    decoder->sequence_number = 0;
+    decoder->tag_points_inside = (Logical)0;
+    return decoder;
+}
+
+/// @brief Release the storage associated with *decoder*.
+/// @param decoder is the *Fiducials_Decoder* to release.
+///
+/// *Fiducials_Decoder__free*() will release the storage associated with
+/// *decoder*.
+
+void Fiducials_Decoder__free(Fiducials_Decoder decoder) {
+    Memory__free((Memory)decoder->corners);
+    Memory__free((Memory)decoder->references);
+    Memory__free((Memory)decoder->sample_points);
+    Memory__free((Memory)decoder);
+}
+
+/// @brief Return the maximum value of the points in *points*.
+/// @param decoder is the *Fiducials_Decoder* to sample with.
+/// @param points is the vector of points to sample.
+/// @param start_index is the first index to start with.
+/// @param end_index is the last index to end with.
+/// @returns the maximum sampled value.
+///
+///
+/// *Fiducials_Decoder__points_maximum*() will sweep from *start_index* to
+/// *end_index* through *points*.  Using each selected point in *points*},
+/// the corresponding value in *image* is sampled.  The minimum of the
+/// sampled point is returned.
+
+Integer Fiducials_Decoder__points_maximum(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index) {
+
+    // Start with a big value move it down:
+    Integer result = 0;
+
+    // Sample the {points} from {start_index} to {end_index}:
+    Integer values[8];
+    assert (end_index - start_index < 8);
+    Fiducials_Decoder__points_sample(
+      decoder, points, start_index, end_index, values);
+
+    // Iterate across the sampled {values}:
+    for (Unsigned index = 0; index <= end_index - start_index; index++) {
+	Integer value = values[index];
+	if (value > result) {
+	    // New maximum value:
+	    result = value;
+	}
+    }
+    return result;
+}
+
+/// @brief Return the minimum value of the points in *points*.
+/// @param decoder is the *Fiducials_Decoder* to sample with.
+/// @param points is the vector of points to sample.
+/// @param start_index is the first index to start with.
+/// @param end_index is the last index to end with.
+/// @returns the minimum sampled value.
+///
+/// *Fiducials_Decoder__points_minimum*() will sweep from *start_index* to
+/// *end_index* through *points*.  Using each selected point in *points*},
+/// the corresponding value in *image* is sampled.  The minimum of the
+/// sampled point is returned.
+
+Integer Fiducials_Decoder__points_minimum(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index) {
+
+    // Start with a big value move it down:
+    Integer result = 0x7fffffff;
+
+    // Sample the {points} from {start_index} to {end_index}:
+    Integer values[8];
+    assert (end_index - start_index < 8);
+    Fiducials_Decoder__points_sample(
+      decoder, points, start_index, end_index, values);
+
+    // Iterate across the sampled {values}:
+    for (Unsigned index = 0; index <= end_index - start_index; index++) {
+	Integer value = values[index];
+	if (value < result) {
+	    // New minimum value:
+	    result = value;
+	}
+    }
+    return result;
+}
+
+/// @brief Sample the points in *points* into *values*.
+/// @param decoder is the *Fiducials_Decoder* to sample with.
+/// @param points is the vector of points to sample.
+/// @param start_index is the first index to start with.
+/// @param end_index is the last index to end with.
+/// @param values is where the sampled values are stored.
+///
+/// *Fiducials_Decoder__points_sample*() will sample each point in *points* from
+/// *start_index* to *end_index* and store the results into *values*
+/// starting at *values*[0].  The sampled values are identical to the
+/// ones returned by *Fiducials__point_sample*().  *points* must be either
+/// the *references* or *sample_points* of *decoder* as computed by the
+/// most recent call to *Fiducials_Decoder__tag_points_compute*(); when all of
+/// those points are safely inside the image, the per pixel bounds checks
+/// are skipped.
+
+void Fiducials_Decoder__points_sample(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index,
+  Integer *values) {
+    Fiducials fiducials = decoder->fiducials;
+    if (decoder->tag_points_inside) {
+	// All points are inside, so use the unchecked weighted sum:
+	CV_Image image = fiducials->gray_image;
+	const Integer *weights = Fiducials__sample_weights(fiducials);
+	Integer denominator = 0;
+	for (Unsigned index = 0; index < 9; index++) {
+	    denominator += weights[index];
+	}
+	for (Unsigned index = start_index; index <= end_index; index++) {
+	    CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(points, index);
+	    Integer x = CV__round(CV_Point2D32F__x_get(point));
+	    Integer y = CV__round(CV_Point2D32F__y_get(point));
+	    values[index - start_index] =
+	      CV_Image__gray_weighted_sum(image, x, y, weights) / denominator;
+	}
+    } else {
+	// Some point is near (or past) the image edge; check each pixel:
+	for (Unsigned index = start_index; index <= end_index; index++) {
+	    CV_Point2D32F point = CV_Point2D32F_Vector__fetch1(points, index);
+	    values[index - start_index] =
+	      Fiducials__point_sample(fiducials, point);
+	}
+    }
+}
+
+/// @brief Decode candidates until there are none left.
+/// @param decoder_pointer is the *Fiducials_Decoder* (as a void *.)
+/// @returns 0.
+///
+/// *Fiducials_Decoder__process*() is the body of each thread of
+/// *Fiducials__candidates_decode*().  It keeps taking the next candidate
+/// that no thread has taken yet and decoding it, so the threads that get
+/// the cheap candidates (e.g. the ones rejected by the shape test) simply
+/// take more of them.
+
+void *Fiducials_Decoder__process(void *decoder_pointer) {
+    Fiducials_Decoder decoder = (Fiducials_Decoder)decoder_pointer;
+    Fiducials fiducials = decoder->fiducials;
+    Unsigned quads_size = fiducials->quad_finder->quads_size;
+    while (1) {
+	pthread_mutex_lock(&fiducials->candidates_mutex);
+	Unsigned candidate_index = fiducials->candidates_next;
+	fiducials->candidates_next = candidate_index + 1;
+	pthread_mutex_unlock(&fiducials->candidates_mutex);
+	if (candidate_index >= quads_size) {
+	    break;
+	}
+	Fiducials_Decoder__candidate_decode(decoder, candidate_index);
+    }
+    return (void *)0;
+}
+
+/// @brief Compute the reference and tag bit sample points using *corners*.
+/// @param decoder is the *Fiducials_Decoder* to store the points into.
+/// @param corners is the 4 fiducial corners.
+///
+/// *Fiducials_Decoder__tag_points_compute*() will use the 4 corners in
+/// *corners* to compute the 8 reference points into the *references*
+/// field of *decoder* and the 8 by 8 grid of tag bit sample points into
+/// the *sample_points* field of *decoder*.  All 72 points are mapped
+/// through the homography from *Fiducials__homography_compute*() in a
+/// single pass.  If the *undistort_sparse* field of *fiducials* is set,
+/// *corners* are in undistorted coordinates and the points are mapped
+/// back into the distorted image with *CV__lens_distort*().  The first
+/// 4 reference points are just outside of the quadralateral formed by
+/// *corners* (i.e. the white bounding box) and the last 4 reference
+/// points are just inside of it (i.e. the black bounding box).  The
+/// quadralateral must be convex and in the counter-clockwise direction.
+/// Bit 0 will be closest to corners[1], bit 7 will be closest to
+/// corners[0], bit 56 closest to corners[2] and bit 63 closest to
+/// corners[3].  The *tag_points_inside* field of *decoder* is set to
+/// (*Logical*)1 if every point is far enough inside the image to sample
+/// its 3x3 neighborhood without bounds checks.
+
+void Fiducials_Decoder__tag_points_compute(
+  Fiducials_Decoder decoder, CV_Point2D32F_Vector corners) {
+    Fiducials fiducials = decoder->fiducials;
+
+    // Tag space coordinates in 1/20ths of the quadralateral.  There
+    // are ten rows (or columns) enclosed by the quadralateral.  The tag
+    // bits are the middle 8 rows (or columns) at 3/20, 5/20, ..., 17/20.
+    // The references straddle the black border at 1/20 and 19/20:
+    static const Integer u20s[72] = {
+       5,  5, 15, 15,  5,  5, 15, 15,
+       3,  3,  3,  3,  3,  3,  3,  3,
+       5,  5,  5,  5,  5,  5,  5,  5,
+       7,  7,  7,  7,  7,  7,  7,  7,
+       9,  9,  9,  9,  9,  9,  9,  9,
+      11, 11, 11, 11, 11, 11, 11, 11,
+      13, 13, 13, 13, 13, 13, 13, 13,
+      15, 15, 15, 15, 15, 15, 15, 15,
+      17, 17, 17, 17, 17, 17, 17, 17};
+    static const Integer v20s[72] = {
+      -1, 21, -1, 21,  1, 19,  1, 19,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17,
+       3,  5,  7,  9, 11, 13, 15, 17};
+
+    Double homography[8];
+    Fiducials__homography_compute(corners, homography);
+
+    // Map all 72 points through {homography} in one tight loop:
+    Double xs[72];
+    Double ys[72];
+    for (Unsigned index = 0; index < 72; index++) {
+	Double u = (Double)u20s[index] / 20.0;
+	Double v = (Double)v20s[index] / 20.0;
+	Double w = homography[6] * u + homography[7] * v + 1.0;
+	xs[index] = (homography[0] * u + homography[1] * v + homography[2]) / w;
+	ys[index] = (homography[3] * u + homography[4] * v + homography[5]) / w;
+    }
+
+    // When undistorting sparsely, the *corners* are undistorted but the
+    // image is not, so map the points back into the distorted image:
+    if (fiducials->undistort_sparse) {
+	for (Unsigned index = 0; index < 72; index++) {
+	    CV__lens_distort(fiducials->lens, &xs[index], &ys[index]);
+	}
+    }
+
+    // Store the points and check that they are inside of the image:
+    CV_Image image = fiducials->gray_image;
+    Integer x_maximum = CV_Image__width_get(image) - 2;
+    Integer y_maximum = CV_Image__height_get(image) - 2;
+    CV_Point2D32F_Vector references = decoder->references;
+    CV_Point2D32F_Vector sample_points = decoder->sample_points;
+    Logical inside = (Logical)1;
+    for (Unsigned index = 0; index < 72; index++) {
+	CV_Point2D32F point = (CV_Point2D32F)0;
+	if (index < 8) {
+	    point = CV_Point2D32F_Vector__fetch1(references, index);
+	} else {
+	    point = CV_Point2D32F_Vector__fetch1(sample_points, index - 8);
+	}
+	CV_Point2D32F__x_set(point, xs[index]);
+	CV_Point2D32F__y_set(point, ys[index]);
+
+	// Use the stored (i.e. single precision) values for the check,
+	// since those are what get sampled:
+	Integer x = CV__round(CV_Point2D32F__x_get(point));
+	Integer y = CV__round(CV_Point2D32F__y_get(point));
+	if (!(1 <= x && x <= x_maximum && 1 <= y && y <= y_maximum)) {
+	    inside = (Logical)0;
+	}
+    }
+    decoder->tag_points_inside = inside;
+}
+
+/// @brief Return a new *Fiducials_Frame* for images of *image_size*.
+/// @param image_size is the size of the images.
+/// @returns a new *Fiducials_Frame* object.
+///
+/// *Fiducials_Frame__create*() will create and return a new
+/// *Fiducials_Frame* with gray scale and edge images of *image_size*
+/// and no tags.  The original image (and the debug image, if any) is
+/// supplied by the caller.
+
+Fiducials_Frame Fiducials_Frame__create(CV_Size image_size) {
+    Fiducials_Frame frame =
+      Memory__new(Fiducials_Frame, "Fiducials_Frame__create");
+    frame->contour_edge_image = (CV_Image)0;
+    frame->contour_gray_image = (CV_Image)0;
+    frame->corners = CV_Point2D32F_Vector__create(4);
+    frame->debug_image = (CV_Image)0;
+    frame->debug_index = 0;
+    frame->edge_image = CV_Image__create(image_size, CV__depth_8u, 1);
+    frame->gray_image = CV_Image__create(image_size, CV__depth_8u, 1);
+    frame->odometry_etw = 0.0;
+    frame->odometry_ex = 0.0;
+    frame->odometry_ey = 0.0;
+    frame->odometry_valid = (Logical)0;
+    frame->original_image = (CV_Image)0;
+    frame->pyramid_edge_image = (CV_Image)0;
+    frame->pyramid_gray_image = (CV_Image)0;
+    frame->pyramid_scale = 1;
+    frame->roi_pass = (Logical)0;
+    frame->roi_predicted_size = 0;
+    frame->roi_tracked_size = 0;
+    frame->sequence_number = 0;
+    frame->tags_allocated = 16;
+    frame->tag_corners = (Double *)Memory__allocate(
+      frame->tags_allocated * 8 * sizeof(Double), "Fiducials_Frame__create");
+    frame->tag_directions = (Unsigned *)Memory__allocate(
+      frame->tags_allocated * sizeof(Unsigned), "Fiducials_Frame__create");
+    frame->tag_ids = (Unsigned *)Memory__allocate(
+      frame->tags_allocated * sizeof(Unsigned), "Fiducials_Frame__create");
+    frame->tags_size = 0;
+    frame->track_pass = (Logical)0;
+    frame->track_tracked_size = 0;
+    return frame;
+}
+
+/// @brief Release the storage associated with *frame*.
+/// @param frame is the *Fiducials_Frame* to release.
+///
+/// *Fiducials_Frame__free*() will release the storage associated with
+/// *frame*, but not its original image, which belongs to the caller.
+
+void Fiducials_Frame__free(Fiducials_Frame frame) {
+    Memory__free((Memory)frame->corners);
+    CV__release_image(frame->edge_image);
+    CV__release_image(frame->gray_image);
+    if (frame->pyramid_gray_image != (CV_Image)0) {
+	CV__release_image(frame->pyramid_gray_image);
+	CV__release_image(frame->pyramid_edge_image);
+    }
+    Memory__free((Memory)frame->tag_corners);
+    Memory__free((Memory)frame->tag_directions);
+    Memory__free((Memory)frame->tag_ids);
+    Memory__free((Memory)frame);
+}
+
+/// @brief Append a found tag to *frame*.
+/// @param frame is the *Fiducials_Frame* to append to.
+/// @param tag_id is the id of the tag.
+/// @param direction_index is the direction that the tag decoded in.
+/// @param corners is the 4 (counter-clockwise) corners of the tag.
+///
+/// *Fiducials_Frame__tag_append*() will append the tag with *tag_id*,
+/// *direction_index* and *corners* to the tags of *frame*, making room
+/// for more tags as needed.
+
+void Fiducials_Frame__tag_append(Fiducials_Frame frame,
+  Unsigned tag_id, Unsigned direction_index, CV_Point2D32F_Vector corners) {
+    // Make sure there is room:
+    Unsigned tags_size = frame->tags_size;
+    if (tags_size >= frame->tags_allocated) {
+	frame->tags_allocated *= 2;
+	frame->tag_corners = (Double *)Memory__reallocate(
+	  (Memory)frame->tag_corners,
+	  frame->tags_allocated * 8 * sizeof(Double),
+	  "Fiducials_Frame__tag_append");
+	frame->tag_directions = (Unsigned *)Memory__reallocate(
+	  (Memory)frame->tag_directions,
+	  frame->tags_allocated * sizeof(Unsigned),
+	  "Fiducials_Frame__tag_append");
+	frame->tag_ids = (Unsigned *)Memory__reallocate(
+	  (Memory)frame->tag_ids, frame->tags_allocated * sizeof(Unsigned),
+	  "Fiducials_Frame__tag_append");
+    }
+
+    // Append the tag:
+    Double *tag_corners = frame->tag_corners + 8 * tags_size;
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	tag_corners[2 * index] = CV_Point2D32F__x_get(corner);
+	tag_corners[2 * index + 1] = CV_Point2D32F__y_get(corner);
+    }
+    frame->tag_directions[tags_size] = direction_index;
+    frame->tag_ids[tags_size] = tag_id;
+    frame->tags_size = tags_size + 1;
+}
+
+/// @brief Return whether *frame* already has the tag with *tag_id*.
+/// @param frame is the *Fiducials_Frame* to search.
+/// @param tag_id is the tag id to search for.
+/// @returns (*Logical*)1 if *tag_id* is one of the tags of *frame*.
+///
+/// *Fiducials_Frame__tag_find*() will return (*Logical*)1 if the tag with
+/// *tag_id* has already been appended to *frame* and (*Logical*)0
+/// otherwise.
+
+Logical Fiducials_Frame__tag_find(Fiducials_Frame frame, Unsigned tag_id) {
+    Unsigned tags_size = frame->tags_size;
+    for (Unsigned index = 0; index < tags_size; index++) {
+	if (frame->tag_ids[index] == tag_id) {
+	    return (Logical)1;
+	}
+    }
+    return (Logical)0;
 }
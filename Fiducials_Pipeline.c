@@ -0,0 +1,306 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <pthread.h>
+
+#include "CV.h"
+#include "Fiducials.h"
+#include "Fiducials_Pipeline.h"
+#include "Integer.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Unsigned.h"
+
+/// @brief Return a new *Fiducials_Pipeline* that processes with
+/// *fiducials*.
+/// @param fiducials is the *Fiducials* object to process the frames with.
+/// @returns a new *Fiducials_Pipeline* object.
+///
+/// *Fiducials_Pipeline__create*() will create and return a new
+/// *Fiducials_Pipeline* with *FIDUCIALS_PIPELINE_FRAMES* frames and start
+/// its three stage threads.  The frame to frame shortcuts and the debug
+/// images of *fiducials* are turned off.  Until
+/// *Fiducials_Pipeline__free*() is called, the only other things that may
+/// be done with *fiducials* are *Fiducials_Pipeline__push*() and
+/// *Fiducials_Pipeline__flush*().
+
+Fiducials_Pipeline Fiducials_Pipeline__create(Fiducials fiducials) {
+    // Turn off everything that needs the results of the previous frame
+    // before the next frame is preprocessed.  *pipelined* keeps
+    // *Fiducials__frame_update*() from anchoring the odometry again:
+    fiducials->corners_tracking = (Logical)0;
+    fiducials->odometry_anchored = (Logical)0;
+    fiducials->pipelined = (Logical)1;
+    fiducials->quad_caching = (Logical)0;
+    fiducials->roi_tracking = (Logical)0;
+
+    // The debug image of *fiducials* would be drawn into by every stage,
+    // so the frames get none (their *debug_image* is null) and nothing
+    // is drawn for *debug_index* either:
+    fiducials->debug_index = 0;
+
+    // Create *pipeline* with all of its frames in *free_queue*:
+    Fiducials_Pipeline pipeline =
+      Memory__new(Fiducials_Pipeline, "Fiducials_Pipeline__create");
+    pipeline->detect_queue = Fiducials_Queue__create();
+    pipeline->fiducials = fiducials;
+    pipeline->free_queue = Fiducials_Queue__create();
+    pipeline->preprocess_queue = Fiducials_Queue__create();
+    pipeline->update_queue = Fiducials_Queue__create();
+    for (Unsigned index = 0; index < FIDUCIALS_PIPELINE_FRAMES; index++) {
+	Fiducials_Frame frame = Fiducials_Frame__create(fiducials->image_size);
+	pipeline->frames[index] = frame;
+	Fiducials_Queue__push(pipeline->free_queue, frame);
+    }
+
+    // Start up the stage threads:
+    Integer result = pthread_create(&pipeline->preprocess_thread,
+      (pthread_attr_t *)0, Fiducials_Pipeline__preprocess_thread,
+      (void *)pipeline);
+    assert (result == 0);
+    result = pthread_create(&pipeline->detect_thread,
+      (pthread_attr_t *)0, Fiducials_Pipeline__detect_thread,
+      (void *)pipeline);
+    assert (result == 0);
+    result = pthread_create(&pipeline->update_thread,
+      (pthread_attr_t *)0, Fiducials_Pipeline__update_thread,
+      (void *)pipeline);
+    assert (result == 0);
+    return pipeline;
+}
+
+/// @brief Search the preprocessed frames for tags.
+/// @param pipeline_pointer is the *Fiducials_Pipeline* (as a void *.)
+/// @returns 0.
+///
+/// *Fiducials_Pipeline__detect_thread*() is the body of the second stage
+/// thread of the pipeline.  It runs *Fiducials__frame_detect*() on each
+/// frame from *detect_queue* and passes it on to *update_queue* until it
+/// gets the null frame (which is passed on as well.)
+
+void *Fiducials_Pipeline__detect_thread(void *pipeline_pointer) {
+    Fiducials_Pipeline pipeline = (Fiducials_Pipeline)pipeline_pointer;
+    while (1) {
+	Fiducials_Frame frame = Fiducials_Queue__pop(pipeline->detect_queue);
+	if (frame != (Fiducials_Frame)0) {
+	    Fiducials__frame_detect(pipeline->fiducials, frame);
+	}
+	Fiducials_Queue__push(pipeline->update_queue, frame);
+	if (frame == (Fiducials_Frame)0) {
+	    break;
+	}
+    }
+    return (void *)0;
+}
+
+/// @brief Wait for every pushed frame to be processed.
+/// @param pipeline is the *Fiducials_Pipeline* to wait for.
+///
+/// *Fiducials_Pipeline__flush*() will wait until every frame pushed into
+/// *pipeline* has made it through all three stages (and all of its
+/// announcements have been made.)
+
+void Fiducials_Pipeline__flush(Fiducials_Pipeline pipeline) {
+    // Each frame is back in *free_queue* once it is processed:
+    Fiducials_Frame frames[FIDUCIALS_PIPELINE_FRAMES];
+    Fiducials_Queue free_queue = pipeline->free_queue;
+    for (Unsigned index = 0; index < FIDUCIALS_PIPELINE_FRAMES; index++) {
+	frames[index] = Fiducials_Queue__pop(free_queue);
+    }
+    for (Unsigned index = 0; index < FIDUCIALS_PIPELINE_FRAMES; index++) {
+	Fiducials_Queue__push(free_queue, frames[index]);
+    }
+}
+
+/// @brief Release the storage associated with *pipeline*.
+/// @param pipeline is the *Fiducials_Pipeline* to release.
+///
+/// *Fiducials_Pipeline__free*() will finish processing every frame pushed
+/// into *pipeline*, shut down its stage threads and release its storage.
+/// The *Fiducials* object can be used on its own again afterwards.
+
+void Fiducials_Pipeline__free(Fiducials_Pipeline pipeline) {
+    // Send the null frame through the stages and wait for them to exit:
+    Fiducials_Queue__push(pipeline->preprocess_queue, (Fiducials_Frame)0);
+    Integer result = pthread_join(pipeline->preprocess_thread, (void **)0);
+    assert (result == 0);
+    result = pthread_join(pipeline->detect_thread, (void **)0);
+    assert (result == 0);
+    result = pthread_join(pipeline->update_thread, (void **)0);
+    assert (result == 0);
+
+    // Release the frames (including the original images that they own):
+    for (Unsigned index = 0; index < FIDUCIALS_PIPELINE_FRAMES; index++) {
+	Fiducials_Frame frame = pipeline->frames[index];
+	if (frame->original_image != (CV_Image)0) {
+	    CV__release_image(frame->original_image);
+	}
+	Fiducials_Frame__free(frame);
+    }
+    Fiducials_Queue__free(pipeline->detect_queue);
+    Fiducials_Queue__free(pipeline->free_queue);
+    Fiducials_Queue__free(pipeline->preprocess_queue);
+    Fiducials_Queue__free(pipeline->update_queue);
+
+    // Point *fiducials* back at the images of its own frame:
+    Fiducials fiducials = pipeline->fiducials;
+    fiducials->edge_image = fiducials->frame->edge_image;
+    fiducials->gray_image = fiducials->frame->gray_image;
+    fiducials->pipelined = (Logical)0;
+    Memory__free((Memory)pipeline);
+}
+
+/// @brief Preprocess the pushed frames.
+/// @param pipeline_pointer is the *Fiducials_Pipeline* (as a void *.)
+/// @returns 0.
+///
+/// *Fiducials_Pipeline__preprocess_thread*() is the body of the first
+/// stage thread of the pipeline.  It runs *Fiducials__frame_preprocess*()
+/// on each frame from *preprocess_queue* and passes it on to
+/// *detect_queue* until it gets the null frame (which is passed on as
+/// well.)
+
+void *Fiducials_Pipeline__preprocess_thread(void *pipeline_pointer) {
+    Fiducials_Pipeline pipeline = (Fiducials_Pipeline)pipeline_pointer;
+    while (1) {
+	Fiducials_Frame frame =
+	  Fiducials_Queue__pop(pipeline->preprocess_queue);
+	if (frame != (Fiducials_Frame)0) {
+	    Fiducials__frame_preprocess(pipeline->fiducials, frame);
+	}
+	Fiducials_Queue__push(pipeline->detect_queue, frame);
+	if (frame == (Fiducials_Frame)0) {
+	    break;
+	}
+    }
+    return (void *)0;
+}
+
+/// @brief Push *image* into *pipeline*.
+/// @param pipeline is the *Fiducials_Pipeline* to push into.
+/// @param image is the next 8-bit gray scale or color image to process.
+///
+/// *Fiducials_Pipeline__push*() will copy *image* into a free frame of
+/// *pipeline* and queue it to be processed.  This only waits when every
+/// frame is still in the pipeline.  *image* can be reused as soon as
+/// this returns.
+
+void Fiducials_Pipeline__push(Fiducials_Pipeline pipeline, CV_Image image) {
+    Fiducials_Frame frame = Fiducials_Queue__pop(pipeline->free_queue);
+
+    // (Re)create the original image of *frame* if it does not match:
+    Integer width = CV_Image__width_get(image);
+    Integer height = CV_Image__height_get(image);
+    Integer channels = CV_Image__channels_get(image);
+    CV_Image original_image = frame->original_image;
+    if (original_image == (CV_Image)0 ||
+      CV_Image__width_get(original_image) != width ||
+      CV_Image__height_get(original_image) != height ||
+      CV_Image__channels_get(original_image) != channels) {
+	if (original_image != (CV_Image)0) {
+	    CV__release_image(original_image);
+	}
+	CV_Size size = CV_Size__create(width, height);
+	original_image = CV_Image__create(size, CV__depth_8u, channels);
+	CV_Size__free(size);
+	frame->original_image = original_image;
+    }
+    CV_Image__copy(image, original_image, (CV_Image)0);
+
+    // The frames have no debug image, so there is nothing to draw:
+    frame->debug_index = 0;
+    Fiducials_Queue__push(pipeline->preprocess_queue, frame);
+}
+
+/// @brief Update the map with the searched frames.
+/// @param pipeline_pointer is the *Fiducials_Pipeline* (as a void *.)
+/// @returns 0.
+///
+/// *Fiducials_Pipeline__update_thread*() is the body of the last stage
+/// thread of the pipeline.  It runs *Fiducials__frame_update*() on each
+/// frame from *update_queue* (which makes all of the announcements) and
+/// returns it to *free_queue* until it gets the null frame.
+
+void *Fiducials_Pipeline__update_thread(void *pipeline_pointer) {
+    Fiducials_Pipeline pipeline = (Fiducials_Pipeline)pipeline_pointer;
+    while (1) {
+	Fiducials_Frame frame = Fiducials_Queue__pop(pipeline->update_queue);
+	if (frame == (Fiducials_Frame)0) {
+	    break;
+	}
+	Fiducials__frame_update(pipeline->fiducials, frame);
+	Fiducials_Queue__push(pipeline->free_queue, frame);
+    }
+    return (void *)0;
+}
+
+/// @brief Return a new empty *Fiducials_Queue* object.
+/// @returns a new empty *Fiducials_Queue* object.
+///
+/// *Fiducials_Queue__create*() will create and return a new empty
+/// *Fiducials_Queue* object.
+
+Fiducials_Queue Fiducials_Queue__create(void) {
+    Fiducials_Queue queue =
+      Memory__new(Fiducials_Queue, "Fiducials_Queue__create");
+    Integer result = pthread_mutex_init(&queue->mutex,
+      (pthread_mutexattr_t *)0);
+    assert (result == 0);
+    result = pthread_cond_init(&queue->condition,
+      (pthread_condattr_t *)0);
+    assert (result == 0);
+    queue->head = 0;
+    queue->size = 0;
+    return queue;
+}
+
+/// @brief Release the storage associated with *queue*.
+/// @param queue is the *Fiducials_Queue* object to release.
+///
+/// *Fiducials_Queue__free*() will release the storage associated with
+/// *queue*, but not the frames in it.
+
+void Fiducials_Queue__free(Fiducials_Queue queue) {
+    pthread_cond_destroy(&queue->condition);
+    pthread_mutex_destroy(&queue->mutex);
+    Memory__free((Memory)queue);
+}
+
+/// @brief Remove and return the oldest frame in *queue*.
+/// @param queue is the *Fiducials_Queue* to pop from.
+/// @returns the oldest frame in *queue*.
+///
+/// *Fiducials_Queue__pop*() will wait until *queue* is not empty, and
+/// then remove and return its oldest frame.
+
+Fiducials_Frame Fiducials_Queue__pop(Fiducials_Queue queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->size == 0) {
+	pthread_cond_wait(&queue->condition, &queue->mutex);
+    }
+    Unsigned head = queue->head;
+    Fiducials_Frame frame = queue->frames[head];
+    queue->head = (head + 1) % (FIDUCIALS_PIPELINE_FRAMES + 1);
+    queue->size -= 1;
+    pthread_mutex_unlock(&queue->mutex);
+    return frame;
+}
+
+/// @brief Append *frame* to *queue*.
+/// @param queue is the *Fiducials_Queue* to push onto.
+/// @param frame is the frame (or null frame) to push.
+///
+/// *Fiducials_Queue__push*() will append *frame* to *queue* and wake up
+/// the thread waiting for it.  There are never more frames than *queue*
+/// has room for, so this never waits.
+
+void Fiducials_Queue__push(Fiducials_Queue queue, Fiducials_Frame frame) {
+    pthread_mutex_lock(&queue->mutex);
+    Unsigned size = queue->size;
+    assert (size < FIDUCIALS_PIPELINE_FRAMES + 1);
+    queue->frames[(queue->head + size) % (FIDUCIALS_PIPELINE_FRAMES + 1)] =
+      frame;
+    queue->size = size + 1;
+    pthread_cond_broadcast(&queue->condition);
+    pthread_mutex_unlock(&queue->mutex);
+}
@@ -146,7 +146,7 @@ int main(int arguments_size, char * arguments[]) {
 
 		    // Load up *fiducials_create*:
 		    Fiducials_Create fiducials_create =
-		      Fiducials_Create__one_and_only();
+		      Fiducials_Create__create();
 		    fiducials_create->fiducials_path = (String_Const)".";
 		    fiducials_create->lens_calibrate_file_name =
 		      (String_Const)0;
@@ -163,6 +163,7 @@ int main(int arguments_size, char * arguments[]) {
 
 		    fiducials =
 		      Fiducials__create(display_image, fiducials_create);
+		    Fiducials_Create__free(fiducials_create);
 		    fiducials->debug_index = 11;
 		}
 
@@ -61,6 +61,7 @@ Memory List__fetch(List list, Unsigned index) {
 /// in *list* are not freed beforehand.
 
 void List__free(List list) {
+    Memory__free((Memory)list->items);
     Memory__free((Memory)list);
 }
 
@@ -10,6 +10,16 @@
 typedef struct Map__Struct *Map_Doxygen_Fake_Out;
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "Arc.h"
 #include "CV.h"
@@ -53,11 +63,44 @@ void Map__arc_announce(Map map,
 
 void Map__arc_append(Map map, Arc arc) {
     List__append(map->all_arcs, arc, "Map__arc_append:List__append:all_arcs");
+    Map__arc_changed(map, arc);
+}
+
+/// @brief Records that *arc* in *map* has changed.
+/// @param map that contains *arc*.
+/// @param arc that has changed.
+///
+/// *Map__arc_changed*() will mark *map* as changed and remember *arc*
+/// so that the next spanning tree update can repair around it and the
+/// next journal batch records it.
+
+void Map__arc_changed(Map map, Arc arc) {
+    List__append(map->changed_arcs, arc,
+      "Map__arc_changed:List__append:changed_arcs");
+    List__append(map->journal_arcs, arc,
+      "Map__arc_changed:List__append:journal_arcs");
     map->changes_count += 1;
     map->is_changed = (Logical)1;
     map->is_saved = (Logical)0;
 }
 
+/// @brief Moves *arc* into or out of the spanning tree of *map*.
+/// @param map that contains *arc*.
+/// @param arc to move.
+/// @param in_tree is 1 to move *arc* into the tree and 0 to move it out.
+///
+/// *Map__arc_in_tree_set*() will set the spanning tree membership of
+/// *arc* to *in_tree*.  If the membership actually changes, *arc* is
+/// remembered for the next journal batch.
+
+void Map__arc_in_tree_set(Map map, Arc arc, Logical in_tree) {
+    if (arc->in_tree != in_tree) {
+	arc->in_tree = in_tree;
+	List__append(map->journal_arcs, arc,
+	  "Map__arc_in_tree_set:List__append:journal_arcs");
+    }
+}
+
 /// @brief Returns the *Arc* that contains *from_tag* and *to_tag*.
 /// @param map that has the *Arc* table.
 /// @param from_tag is the from *Tag*.
@@ -213,9 +256,7 @@ Unsigned Map__arc_update(Map map, Camera_Tag camera_from, Camera_Tag camera_to,
 
 	// Finally, upate *arc*:
 	Arc__update(arc, from_twist, floor_distance, to_twist, goodness);
-	map->changes_count += 1;
-	map->is_changed = (Logical)1;
-	map->is_saved = (Logical)0;
+	Map__arc_changed(map, arc);
 
 	// Let interested parties know that *arc* has been updated:
 	Map__arc_announce(map, arc, image, sequence_number);
@@ -225,6 +266,257 @@ Unsigned Map__arc_update(Map map, Camera_Tag camera_from, Camera_Tag camera_to,
     return changed;
 }
 
+/// @brief Restores one *Arc* record into *map*.
+/// @param map to restore into.
+/// @param binary_arc is the *Arc* record to restore.
+/// @param force is 1 to restore *binary_arc* even if it is not better.
+/// @returns the restored *Arc*.
+///
+/// *Map__binary_arc_restore*() will load *binary_arc* into the matching
+/// *Arc* of *map* if it has a better goodness or *force* is set.
+
+Arc Map__binary_arc_restore(
+  Map map, Map_Binary_Arc binary_arc, Logical force) {
+    Tag from_tag = Map__tag_lookup(map, binary_arc->from_tag_id);
+    Tag to_tag = Map__tag_lookup(map, binary_arc->to_tag_id);
+    Arc arc = Map__arc_lookup(map, from_tag, to_tag);
+    if (force || arc->goodness > binary_arc->goodness) {
+	Arc__update(arc, binary_arc->from_twist,
+	  binary_arc->distance, binary_arc->to_twist, binary_arc->goodness);
+	arc->in_tree = (Logical)binary_arc->in_tree;
+	Map__arc_announce(map, arc, (CV_Image)0, 0);
+    }
+    return arc;
+}
+
+/// @brief Compares two binary map record keys for *qsort*().
+/// @param key1 is a pointer to the first *uint64_t* key.
+/// @param key2 is a pointer to the second *uint64_t* key.
+/// @returns -1, 0, or 1 depending upon the comparison.
+///
+/// *Map__binary_key_compare*() will compare the keys pointed to by
+/// *key1* and *key2*.
+
+Integer Map__binary_key_compare(const void *key1, const void *key2) {
+    uint64_t value1 = *(const uint64_t *)key1;
+    uint64_t value2 = *(const uint64_t *)key2;
+    Integer result = 0;
+    if (value1 < value2) {
+	result = -1;
+    } else if (value1 > value2) {
+	result = 1;
+    }
+    return result;
+}
+
+/// @brief Reads a binary map file into *map*.
+/// @param map to read into.
+/// @param file_name is the binary map file to read.
+/// @returns 1 if *map* was read in and 0 otherwise.
+///
+/// *Map__binary_read*() will memory map *file_name* and restore its
+/// contents into *map*.  0 is returned if *file_name* can not be opened
+/// or is not a valid binary map file (including one with corrupt or
+/// duplicate records), in which case *map* is unchanged.
+
+Logical Map__binary_read(Map map, String_Const file_name) {
+    Logical result = (Logical)0;
+    int file_descriptor = open(file_name, O_RDONLY);
+    if (file_descriptor >= 0) {
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) == 0 &&
+	  file_status.st_size > 0 &&
+	  (Unsigned)file_status.st_size == file_status.st_size) {
+	    Unsigned size = (Unsigned)file_status.st_size;
+	    Memory memory = mmap((Memory)0, (size_t)size,
+	      PROT_READ, MAP_PRIVATE, file_descriptor, (off_t)0);
+	    if (memory != MAP_FAILED) {
+		result = Map__binary_restore(map, memory, size);
+		munmap(memory, (size_t)size);
+	    }
+	}
+	close(file_descriptor);
+    }
+    return result;
+}
+
+/// @brief Checks the *Tag* and *Arc* records of a binary map image.
+/// @param map that the records will be restored into.
+/// @param binary_tags is the first *Tag* record.
+/// @param tags_size is the number of *Tag* records.
+/// @param binary_arcs is the first *Arc* record.
+/// @param arcs_size is the number of *Arc* records.
+/// @returns 1 if the records can be restored into *map* and 0 otherwise.
+///
+/// *Map__binary_records_check*() will make sure that *map* is empty,
+/// that every *Tag* record has a unique id with a tag height, and that
+/// every *Arc* record joins two different *Tag* records and is unique.
+/// *map* is not changed.
+
+Logical Map__binary_records_check(Map map,
+  Map_Binary_Tag binary_tags, Unsigned tags_size,
+  Map_Binary_Arc binary_arcs, Unsigned arcs_size) {
+    if (List__size(map->all_tags) != 0 || List__size(map->all_arcs) != 0) {
+	return (Logical)0;
+    }
+
+    // Every *Tag* needs a tag height and an id that is not repeated:
+    Logical result = (Logical)1;
+    uint64_t *tag_keys = (uint64_t *)Memory__allocate(
+      (tags_size + arcs_size + 1) * sizeof(uint64_t),
+      "Map__binary_records_check:keys");
+    uint64_t *arc_keys = tag_keys + tags_size;
+    for (Unsigned index = 0; index < tags_size; index++) {
+	Unsigned id = binary_tags[index].id;
+	if (Map__tag_height_lookup(map, id) == (Tag_Height)0) {
+	    result = (Logical)0;
+	}
+	tag_keys[index] = (uint64_t)id;
+    }
+    qsort((void *)tag_keys, (size_t)tags_size, sizeof(uint64_t),
+      Map__binary_key_compare);
+    for (Unsigned index = 1; index < tags_size; index++) {
+	if (tag_keys[index - 1] == tag_keys[index]) {
+	    result = (Logical)0;
+	}
+    }
+
+    // Every *Arc* has to join two different *Tag*'s from the records
+    // (otherwise it would create a *Tag*) and must not be repeated:
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	uint64_t from_key = (uint64_t)binary_arcs[index].from_tag_id;
+	uint64_t to_key = (uint64_t)binary_arcs[index].to_tag_id;
+	if (from_key > to_key) {
+	    uint64_t temporary_key = from_key;
+	    from_key = to_key;
+	    to_key = temporary_key;
+	}
+	if (from_key == to_key ||
+	  bsearch((void *)&from_key, (void *)tag_keys, (size_t)tags_size,
+	  sizeof(uint64_t), Map__binary_key_compare) == (void *)0 ||
+	  bsearch((void *)&to_key, (void *)tag_keys, (size_t)tags_size,
+	  sizeof(uint64_t), Map__binary_key_compare) == (void *)0) {
+	    result = (Logical)0;
+	}
+	arc_keys[index] = (from_key << 32) | to_key;
+    }
+    qsort((void *)arc_keys, (size_t)arcs_size, sizeof(uint64_t),
+      Map__binary_key_compare);
+    for (Unsigned index = 1; index < arcs_size; index++) {
+	if (arc_keys[index - 1] == arc_keys[index]) {
+	    result = (Logical)0;
+	}
+    }
+    Memory__free((Memory)tag_keys);
+    return result;
+}
+
+/// @brief Restores *map* from a binary map image in memory.
+/// @param map to restore into.
+/// @param memory is the start of the binary map image.
+/// @param size is the number of bytes in *memory*.
+/// @returns 1 if *map* was restored and 0 otherwise.
+///
+/// *Map__binary_restore*() will validate the header and the records of
+/// the binary map image at *memory* and then load its *Tag* and *Arc*
+/// records into *map*.  Nothing is loaded and 0 is returned if either
+/// the header or any record is not valid (see
+/// *Map__binary_records_check*()), so the caller can fall back to the
+/// .xml file.
+
+Logical Map__binary_restore(Map map, Memory memory, Unsigned size) {
+    // Validate the *header* before touching any record:
+    Map_Binary_Header header = (Map_Binary_Header)memory;
+    Unsigned header_size = sizeof(struct Map_Binary_Header__Struct);
+    Unsigned tag_size = sizeof(struct Map_Binary_Tag__Struct);
+    Unsigned arc_size = sizeof(struct Map_Binary_Arc__Struct);
+    if (size < header_size || header->magic != MAP_BINARY_MAGIC ||
+      header->version != MAP_BINARY_VERSION ||
+      header->header_size != header_size || header->tag_size != tag_size ||
+      header->arc_size != arc_size) {
+	return (Logical)0;
+    }
+    Unsigned all_tags_size = header->tags_size;
+    Unsigned all_arcs_size = header->arcs_size;
+    if (all_tags_size > (size - header_size) / tag_size ||
+      all_arcs_size >
+      (size - header_size - all_tags_size * tag_size) / arc_size ||
+      header_size + all_tags_size * tag_size + all_arcs_size * arc_size
+      != size) {
+	return (Logical)0;
+    }
+    Map_Binary_Tag binary_tags =
+      (Map_Binary_Tag)((char *)memory + header_size);
+    Map_Binary_Arc binary_arcs =
+      (Map_Binary_Arc)((char *)memory + header_size +
+      all_tags_size * tag_size);
+    if (!Map__binary_records_check(map,
+      binary_tags, all_tags_size, binary_arcs, all_arcs_size)) {
+	return (Logical)0;
+    }
+    map->snapshot_generation = header->snapshot_generation;
+
+    // Load the *all_tags_size* *Tag* objects:
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	(void)Map__binary_tag_restore(map, &binary_tags[index]);
+    }
+
+    // Load the *all_arcs_size* *Arc* objects:
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	(void)Map__binary_arc_restore(map, &binary_arcs[index], (Logical)0);
+    }
+
+    // Do some final checks:
+    assert (List__size(map->all_arcs) == all_arcs_size);
+    assert (List__size(map->all_tags) == all_tags_size);
+    return (Logical)1;
+}
+
+/// @brief Restores one *Tag* record into *map*.
+/// @param map to restore into.
+/// @param binary_tag is the *Tag* record to restore.
+/// @returns the restored *Tag* or null if there is no tag height for it.
+///
+/// *Map__binary_tag_restore*() will load *binary_tag* into the matching
+/// *Tag* of *map* and announce it.  *map* is left alone if the id of
+/// *binary_tag* has no tag height.
+
+Tag Map__binary_tag_restore(Map map, Map_Binary_Tag binary_tag) {
+    Tag_Height tag_height = Map__tag_height_lookup(map, binary_tag->id);
+    if (tag_height == (Tag_Height)0) {
+	return (Tag)0;
+    }
+    Tag tag = Map__tag_lookup(map, binary_tag->id);
+    Tag__initialize(tag, binary_tag->twist,
+      binary_tag->x, binary_tag->y, binary_tag->diagonal, map->visit);
+    tag->hop_count = binary_tag->hop_count;
+    tag->z = tag_height->z;
+
+    map->tag_announce_routine(map->announce_object,
+      tag->id, tag->x, tag->y, tag->z, tag->twist,
+      tag->diagonal, tag->world_diagonal/tag->diagonal,
+      0, tag->hop_count);
+    return tag;
+}
+
+/// @brief Writes *map* out to *out_file* in binary format.
+/// @param map to write out.
+/// @param out_file to write to.
+/// @returns 1 if everything was written and 0 otherwise.
+///
+/// *Map__binary_write*() will write *map* to *out_file* in binary map
+/// format.
+
+Logical Map__binary_write(Map map, File out_file) {
+    // Put the tags out in sorted order:
+    Map__sort(map);
+
+    Map_Snapshot map_snapshot = Map_Snapshot__create(map, (String)0);
+    Logical result = Map_Snapshot__binary_write(map_snapshot, out_file);
+    Map_Snapshot__free(map_snapshot);
+    return result;
+}
+
 /// @brief Returns -1, 0, 1 depending upon the sort order of *map1* and *map2*.
 /// @param map1 is the first *Map* to compare.
 /// @param map2 is the second *Map* to compare.
@@ -278,7 +570,7 @@ Integer Map__compare(Map map1, Map map2) {
 
 /// @brief Returns a new *Map*.
 /// @param file_path is the directory/folder that the map fileis stored in.
-/// @param file_base is the base name of the map file.
+/// @param file_base is the base name of the map file (null for none).
 /// @param announce_object is an opaque object that is passed into announce
 ///        routines.
 /// @param arc_announce_routine is the arc callback routine.
@@ -302,13 +594,37 @@ Map Map__create(String_Const file_path, String_Const file_base,
     map->arcs_table = Table__create((Table_Equal_Routine)Arc__equal,
       (Table_Hash_Routine)Arc__hash, (Memory)0,
       "Map__new:Table__create:map_arcs_table"); // <Arc, Arc>
+    map->changed_arcs =
+      List__new("Map__new:List__new:changed_arcs"); // <Arc>
     map->changes_count = 0;
     map->file_base = file_base;
     map->file_path = file_path;
     map->is_changed = (Logical)0;
     map->is_saved = (Logical)1;
     map->image_log = (Logical)0;
-    map->pending_arcs = List__new("Map__new:List__new:pending_arcs"); // <Tag>
+    map->image_log_sequence_number = 0xffffffff;
+    map->journal_arcs =
+      List__new("Map__new:List__new:journal_arcs"); // <Arc>
+    map->journal_size = 0;
+    map->journal_tags =
+      List__new("Map__new:List__new:journal_tags"); // <Tag>
+    map->pending_heap = (Map_Pending)Memory__allocate(
+      sizeof(struct Map_Pending__Struct), "Map__new:pending_heap");
+    map->pending_heap_limit = 1;
+    map->pending_heap_size = 0;
+    map->pending_order = 0;
+    map->repair_tags = List__new("Map__new:List__new:repair_tags"); // <Tag>
+    map->save_busy = (Logical)0;
+    map->save_changes_count = 0;
+    map->save_changes_size = 500;
+    map->save_exit = (Logical)0;
+    map->save_failed = (Logical)0;
+    map->save_interval = 5;
+    map->save_journal = (Logical)1;
+    map->save_journal_snapshot = (Map_Snapshot)0;
+    map->save_snapshot = (Map_Snapshot)0;
+    map->save_time = (time_t)0;
+    map->snapshot_generation = 0;
     map->tag_announce_routine = tag_announce_routine;
     map->tag_heights =
       List__new("Map__new:List__new:tag_heights"); // <Tag_Height>
@@ -317,34 +633,90 @@ Map Map__create(String_Const file_path, String_Const file_base,
       "Map__new:Table__create:map_tags_table");
       // <Unsigned, Tag>
     map->temporary_arc = Arc__new("Map__new:Arc__New:temporary_arc");
+    map->tree_incremental = (Logical)1;
+    map->tree_rebuild = (Logical)1;
     map->visit = 0;
 
+    // Start up the thread that writes *map* out in the background:
+    Integer result = pthread_mutex_init(&map->save_mutex,
+      (pthread_mutexattr_t *)0);
+    assert (result == 0);
+    result = pthread_cond_init(&map->save_condition,
+      (pthread_condattr_t *)0);
+    assert (result == 0);
+    result = pthread_create(&map->save_thread,
+      (pthread_attr_t *)0, Map__save_thread, (void *)map);
+    assert (result == 0);
+
     // Read in the contents of *map_heights_file_name* into *map*:
     Map__tag_heights_xml_read(map, tag_heights_file_name);
 
-    // Restore *map* from "*map_path*/*map_base*{0,1}.xml".
-    // We try to read "...1.xml" first, followed by "...0.xml":
-    String full_map_file_name =
-      String__format("%s/%s1.xml", file_path, file_base);
-    File in_file = File__open(full_map_file_name, "r");
-    if (in_file == (File)0) {
-	// We failed to open "...1.xml"; now try "...0.xml":
-	String__free(full_map_file_name);
-	String full_map_file_name =
-	  String__format("%s/%s0.xml", file_path, file_base);
-	in_file = File__open(full_map_file_name, "r");
+    // Restore *map* from "*map_path*/*map_base*{0,1}.{bin,xml}".
+    // We try to read "...1" first, followed by "...0":
+    if (file_base != (String_Const)0) {
+	if (!Map__files_restore(map, "1")) {
+	    (void)Map__files_restore(map, "0");
+	}
+
+	// Replay the changes made since the map files were written, and
+	// place the *Tag*'s from the resulting *Arc*'s:
+	String journal_file_name =
+	  String__format("%s/%s1.journal", file_path, file_base);
+	map->journal_size = Map__journal_restore(map, journal_file_name);
+	String__free(journal_file_name);
+	if (map->journal_size != 0) {
+	    Map__spanning_tree_build(map, (CV_Image)0, 0);
+	}
+    }
+
+    // Everything restored so far is already in the map files:
+    List__trim(map->journal_arcs, 0);
+    List__trim(map->journal_tags, 0);
+    return map;
+}
+
+/// @brief Restores *map* from one generation of its map files.
+/// @param map to restore into.
+/// @param generation is the map file generation ("0" or "1").
+/// @returns 1 if *map* was restored and 0 otherwise.
+///
+/// *Map__files_restore*() will restore *map* from
+/// "*file_path*/*file_base**generation*.bin" unless it is missing,
+/// invalid, or older than the matching .xml file, in which case
+/// "*file_path*/*file_base**generation*.xml" is read instead.
+
+Logical Map__files_restore(Map map, String_Const generation) {
+    String binary_file_name = String__format("%s/%s%s.bin",
+      map->file_path, map->file_base, generation);
+    String xml_file_name = String__format("%s/%s%s.xml",
+      map->file_path, map->file_base, generation);
+
+    // Only trust the .bin file if it is at least as new as the .xml file:
+    Logical result = (Logical)0;
+    struct stat binary_status;
+    struct stat xml_status;
+    if (stat(binary_file_name, &binary_status) == 0 &&
+      (stat(xml_file_name, &xml_status) != 0 ||
+      xml_status.st_mtime <= binary_status.st_mtime)) {
+	result = Map__binary_read(map, binary_file_name);
+	if (result) {
+	    printf("Reading %s\n", binary_file_name);
+	}
+    }
+
+    // Fall back to the .xml file:
+    if (!result) {
+	File in_file = File__open(xml_file_name, "r");
 	if (in_file != (File)0) {
-	    // We opened "...0.xml", read it in:
+	    printf("Reading %s\n", xml_file_name);
 	    Map__restore(map, in_file);
 	    File__close(in_file);
+	    result = (Logical)1;
 	}
-    } else {
-	// We opened "...1.xml", read it in:
-        printf("Reading %s\n", full_map_file_name);
-        Map__restore(map, in_file);
-	File__close(in_file);
     }
-    return map;
+    String__free(binary_file_name);
+    String__free(xml_file_name);
+    return result;
 }
 
 /// @brief Releases storage associated with *map*.
@@ -356,6 +728,16 @@ void Map__free(Map map) {
     // Save the map:
     Map__save(map);
 
+    // Shut down the save thread:
+    pthread_mutex_lock(&map->save_mutex);
+    map->save_exit = (Logical)1;
+    pthread_cond_broadcast(&map->save_condition);
+    pthread_mutex_unlock(&map->save_mutex);
+    Integer result = pthread_join(map->save_thread, (void **)0);
+    assert (result == 0);
+    pthread_cond_destroy(&map->save_condition);
+    pthread_mutex_destroy(&map->save_mutex);
+
     // Release all the *Arc*'s:
     List /* <Arc> */ all_arcs = map->all_arcs;
     Unsigned arcs_size = List__size(all_arcs);
@@ -384,7 +766,11 @@ void Map__free(Map map) {
     }
     List__free(map->tag_heights);
 
-    List__free(map->pending_arcs);
+    List__free(map->changed_arcs);
+    List__free(map->journal_arcs);
+    List__free(map->journal_tags);
+    List__free(map->repair_tags);
+    Memory__free((Memory)map->pending_heap);
     Table__free(map->arcs_table);    
     Table__free(map->tags_table);
     Memory__free((Memory)map);
@@ -395,17 +781,220 @@ void Map__free(Map map) {
 /// @param image to log.
 ///
 /// *Map__image_log*() will log *image* to disk if image logging is turned on.
-
-static int last_sequence_number = 0xffffffff;
+/// Each sequence number is only logged once per *map*.
 
 void Map__image_log(Map map, CV_Image image, Unsigned sequence_number) {
     if (image != (CV_Image)0 && map->image_log &&
-      sequence_number != last_sequence_number) {
+      sequence_number != map->image_log_sequence_number) {
 	// Log the image here:
 	String file_name = String__format("log%05d.tga", sequence_number);
 	CV_Image__tga_write(image, file_name);
-	last_sequence_number = sequence_number;
+	map->image_log_sequence_number = sequence_number;
+    }
+}
+
+/// @brief Replays a map journal file into *map*.
+/// @param map to replay into.
+/// @param file_name is the map journal file to replay.
+/// @returns the number of records replayed.
+///
+/// *Map__journal_restore*() will memory map *file_name* and replay each
+/// of its records into *map* in order.  A partial record at the end
+/// (from a crash in the middle of an append) is ignored and cut off of
+/// *file_name* so that the next append starts on a record boundary, as
+/// is a record that can not be replayed and everything after it.  A
+/// journal whose snapshot generation does not match *map* is ignored
+/// and emptied.  0 is returned if *file_name* does not exist.
+
+Unsigned Map__journal_restore(Map map, String_Const file_name) {
+    Unsigned records_size = 0;
+    int file_descriptor = open(file_name, O_RDONLY);
+    if (file_descriptor >= 0) {
+	struct stat file_status;
+	Unsigned size = 0;
+	if (fstat(file_descriptor, &file_status) == 0 &&
+	  (Unsigned)file_status.st_size == file_status.st_size) {
+	    size = (Unsigned)file_status.st_size;
+	}
+
+	// Make sure that the header is valid:
+	Unsigned header_size = sizeof(struct Map_Journal_Header__Struct);
+	Unsigned record_size = sizeof(struct Map_Journal_Record__Struct);
+	Unsigned tag_size = sizeof(struct Map_Binary_Tag__Struct);
+	Unsigned arc_size = sizeof(struct Map_Binary_Arc__Struct);
+	Unsigned valid_size = 0;
+	Memory memory = MAP_FAILED;
+	if (size >= header_size) {
+	    memory = mmap((Memory)0, (size_t)size,
+	      PROT_READ, MAP_PRIVATE, file_descriptor, (off_t)0);
+	}
+	if (memory != MAP_FAILED) {
+	    Map_Journal_Header header = (Map_Journal_Header)memory;
+	    if (header->magic == MAP_JOURNAL_MAGIC &&
+	      header->version == MAP_JOURNAL_VERSION &&
+	      header->tag_size == tag_size && header->arc_size == arc_size) {
+		// The records of a journal that was left behind by a crash
+		// between writing newer map files and emptying the journal
+		// are older than the map files, so they are dropped:
+		if (header->snapshot_generation == map->snapshot_generation) {
+		    valid_size = header_size;
+		} else {
+		    File__format(stderr,
+		      "Skipping '%s' (generation %d) for map generation %d\n",
+		      file_name, header->snapshot_generation,
+		      map->snapshot_generation);
+		}
+	    }
+
+	    // Replay each complete record:
+	    while (valid_size != 0 && size - valid_size >= record_size) {
+		Map_Journal_Record record =
+		  (Map_Journal_Record)((char *)memory + valid_size);
+		Memory contents = (Memory)(record + 1);
+		if (size - valid_size - record_size < record->size) {
+		    break;
+		} else if (record->kind == MAP_JOURNAL_TAG &&
+		  record->size == tag_size) {
+		    Tag tag =
+		      Map__binary_tag_restore(map, (Map_Binary_Tag)contents);
+		    if (tag == (Tag)0) {
+			break;
+		    }
+		} else if (record->kind == MAP_JOURNAL_ARC &&
+		  record->size == arc_size) {
+		    (void)Map__binary_arc_restore(map,
+		      (Map_Binary_Arc)contents, (Logical)1);
+		} else {
+		    break;
+		}
+		valid_size += record_size + record->size;
+		records_size += 1;
+	    }
+	}
+
+	// Drop anything that could not be replayed by rewriting just the
+	// records that were replayed:
+	if (valid_size != size) {
+	    File__format(stderr, "Truncating '%s' from %d to %d bytes\n",
+	      file_name, size, valid_size);
+	    String temporary_file_name = String__format("%s.tmp", file_name);
+	    File out_file = File__open(temporary_file_name, "wb");
+	    Logical truncated = (Logical)(out_file != (File)0);
+	    if (truncated) {
+		if (valid_size != 0) {
+		    truncated = (Logical)
+		      (fwrite(memory, (size_t)valid_size, 1, out_file) == 1);
+		}
+		if (ferror(out_file)) {
+		    truncated = (Logical)0;
+		}
+		File__close(out_file);
+	    }
+	    if (truncated && rename(temporary_file_name, file_name) != 0) {
+		truncated = (Logical)0;
+	    }
+	    if (!truncated) {
+		// Appending after records that can not be replayed would
+		// lose the appended records, so start the journal over:
+		(void)remove(temporary_file_name);
+		if (remove(file_name) != 0) {
+		    File__format(stderr,
+		      "Could not truncate '%s'\n", file_name);
+		}
+	    }
+	    String__free(temporary_file_name);
+	}
+	if (memory != MAP_FAILED) {
+	    munmap(memory, (size_t)size);
+	}
+	close(file_descriptor);
+    }
+    return records_size;
+}
+
+/// @brief Pops the best *Arc* off of the *map* pending heap.
+/// @param map that owns the pending heap.
+/// @returns the *Arc* with the shortest distance.
+///
+/// *Map__pending_pop*() will remove and return the *Arc* in the pending
+/// heap of *map* that has the shortest distance.  Ties are broken in
+/// favor of the lowest hop count, followed by the most recent push.
+/// An assertion failure occurs if the pending heap is empty.
+
+Arc Map__pending_pop(Map map) {
+    Map_Pending heap = map->pending_heap;
+    Unsigned size = map->pending_heap_size;
+    assert (size > 0);
+    Arc arc = heap[0].arc;
+
+    // Move the last entry to the root and sift it down:
+    size -= 1;
+    map->pending_heap_size = size;
+    if (size > 0) {
+	struct Map_Pending__Struct last = heap[size];
+	Unsigned index = 0;
+	while (1) {
+	    Unsigned child = (index << 1) + 1;
+	    if (child >= size) {
+		break;
+	    }
+	    if (child + 1 < size &&
+	      Map_Pending__compare(&heap[child + 1], &heap[child]) < 0) {
+		child += 1;
+	    }
+	    if (Map_Pending__compare(&heap[child], &last) >= 0) {
+		break;
+	    }
+	    heap[index] = heap[child];
+	    index = child;
+	}
+	heap[index] = last;
+    }
+    return arc;
+}
+
+/// @brief Pushes *arc* onto the *map* pending heap.
+/// @param map that owns the pending heap.
+/// @param arc to push.
+///
+/// *Map__pending_push*() will push *arc* onto the pending heap of *map*.
+/// The distance and lowest hop count of *arc* are captured at push time.
+
+void Map__pending_push(Map map, Arc arc) {
+    // Make sure there is room for one more entry:
+    Map_Pending heap = map->pending_heap;
+    Unsigned size = map->pending_heap_size;
+    Unsigned limit = map->pending_heap_limit;
+    if (size >= limit) {
+	limit <<= 1;
+	heap = (Map_Pending)Memory__reallocate((Memory)heap,
+	  limit * sizeof(struct Map_Pending__Struct),
+	  "Map__pending_push:Memory__reallocate:pending_heap");
+	map->pending_heap = heap;
+	map->pending_heap_limit = limit;
     }
+
+    // Fill in *pending*:
+    struct Map_Pending__Struct pending;
+    pending.arc = arc;
+    pending.distance = arc->distance;
+    pending.hop_count =
+      Unsigned__minimum(arc->from_tag->hop_count, arc->to_tag->hop_count);
+    pending.order = map->pending_order;
+    map->pending_order += 1;
+
+    // Sift *pending* up from the bottom of *heap*:
+    Unsigned index = size;
+    while (index > 0) {
+	Unsigned parent = (index - 1) >> 1;
+	if (Map_Pending__compare(&heap[parent], &pending) <= 0) {
+	    break;
+	}
+	heap[index] = heap[parent];
+	index = parent;
+    }
+    heap[index] = pending;
+    map->pending_heap_size = size + 1;
 }
 
 /// @brief Restore the contents of *Map* from *in_file*.
@@ -413,15 +1002,24 @@ void Map__image_log(Map map, CV_Image image, Unsigned sequence_number) {
 /// @param in_file is the *File* to read from.
 ///
 /// *Map__restore*() will read in an XML map file from *in_file* and
-/// store it into *map*.
+/// store it into *map*.  Map files written before snapshot generations
+/// were recorded are treated as generation 0.
 
 void Map__restore(Map map, File in_file) {
-    // Read in Map XML tag '<Map Tags_Count="xx" Arcs_Count="xx">' :
+    // Read in Map XML tag '<Map Tags_Count="xx" Arcs_Count="xx"
+    // Snapshot_Generation="xx">' :
     File__tag_match(in_file, "Map");
     Unsigned all_tags_size =
       (Unsigned)File__integer_attribute_read(in_file, "Tags_Count");
     Unsigned all_arcs_size =
       (Unsigned)File__integer_attribute_read(in_file, "Arcs_Count");
+    map->snapshot_generation = 0;
+    Character character = File__character_read(in_file);
+    (void)ungetc(character, in_file);
+    if (character == ' ') {
+	map->snapshot_generation = (Unsigned)
+	  File__integer_attribute_read(in_file, "Snapshot_Generation");
+    }
     File__string_match(in_file, ">\n");
 
     // Read in the *all_tags_size* *Tag* objects:
@@ -452,20 +1050,197 @@ void Map__restore(Map map, File in_file) {
 /// @brief Save *map* out to the file named *file_name*.
 /// @param map to save out.
 ///
-/// *Map__save*() will save *map* to the *file_name* file in XML format.
+/// *Map__save*() will save *map* to its journal or its .xml and .bin map
+/// files.  It does not return until the files have been written.
 
 void Map__save(Map map) {
-      File__format(stderr, "**********Map__save************\n");
-      if (!map->is_saved) {
-	String full_map_file_name =
-	  String__format("%s/%s1.xml", map->file_path, map->file_base);
-	File out_file = File__open(full_map_file_name, "w");
-	assert (out_file != (File)0);
-	String__free(full_map_file_name);
-	Map__write(map, out_file);
-	File__close(out_file);
-	map->is_saved = (Logical)1;
+    File__format(stderr, "**********Map__save************\n");
+    if (!map->is_saved) {
+	Map__save_queue(map);
     }
+    Map__save_flush(map);
+}
+
+/// @brief Waits for the save thread of *map* to finish writing.
+/// @param map to wait for.
+///
+/// *Map__save_flush*() will wait until every queued *Map_Snapshot* of
+/// *map* has been written out.
+
+void Map__save_flush(Map map) {
+    pthread_mutex_lock(&map->save_mutex);
+    while (map->save_snapshot != (Map_Snapshot)0 ||
+      map->save_journal_snapshot != (Map_Snapshot)0 || map->save_busy) {
+	pthread_cond_wait(&map->save_condition, &map->save_mutex);
+    }
+    pthread_mutex_unlock(&map->save_mutex);
+}
+
+/// @brief Saves *map* in the background if enough has changed.
+/// @param map to save.
+///
+/// *Map__save_request*() will queue *map* to be written out by the save
+/// thread if it has unsaved changes and either *save_interval* seconds
+/// have gone by or *save_changes_size* changes have accumulated since
+/// the last save.  Otherwise, the save is put off so that many changes
+/// are coalesced into one write.
+
+void Map__save_request(Map map) {
+    if (!map->is_saved) {
+	Unsigned changes_size = map->changes_count - map->save_changes_count;
+	Double seconds = difftime(time((time_t *)0), map->save_time);
+	if (changes_size >= map->save_changes_size ||
+	  seconds >= (Double)map->save_interval) {
+	    Map__save_queue(map);
+	}
+    }
+}
+
+/// @brief Queues the changes to *map* for the save thread as a journal batch.
+/// @param map to save.
+///
+/// *Map__save_journal_queue*() will copy the *Tag*'s and *Arc*'s of *map*
+/// that have changed since the last journal batch into a *Map_Snapshot*
+/// and hand it to the save thread to be appended to the map journal.  It
+/// is merged into the previously queued batch if that has not been
+/// started yet.
+
+void Map__save_journal_queue(Map map) {
+    String file_name =
+      String__format("%s/%s1", map->file_path, map->file_base);
+    Map_Snapshot map_snapshot = Map_Snapshot__journal_create(map, file_name);
+    map->journal_size += map_snapshot->arcs_size + map_snapshot->tags_size;
+
+    // Hand *map_snapshot* off to the save thread:
+    pthread_mutex_lock(&map->save_mutex);
+    if (map->save_journal_snapshot != (Map_Snapshot)0) {
+	Map_Snapshot__merge(map->save_journal_snapshot, map_snapshot);
+	Map_Snapshot__free(map_snapshot);
+    } else {
+	map->save_journal_snapshot = map_snapshot;
+    }
+    pthread_cond_broadcast(&map->save_condition);
+    pthread_mutex_unlock(&map->save_mutex);
+}
+
+/// @brief Queues *map* for the save thread.
+/// @param map to save.
+///
+/// *Map__save_queue*() will queue the changes to *map* as a journal
+/// batch.  Once the journal would grow to more records than *map* has
+/// *Tag*'s and *Arc*'s, the journal is compacted instead by queueing a
+/// complete *Map_Snapshot*, which also starts a new, empty journal.  A
+/// complete *Map_Snapshot* is also queued after the save thread failed
+/// to write something out, since the changes it lost are only in *map*.
+
+void Map__save_queue(Map map) {
+    Unsigned map_size = List__size(map->all_arcs) + List__size(map->all_tags);
+    Unsigned changes_size =
+      List__size(map->journal_arcs) + List__size(map->journal_tags);
+    pthread_mutex_lock(&map->save_mutex);
+    Logical save_failed = map->save_failed;
+    map->save_failed = (Logical)0;
+    pthread_mutex_unlock(&map->save_mutex);
+    if (map->file_base == (String_Const)0) {
+	// A *map* without a *file_base* has nowhere to be saved to:
+	List__trim(map->journal_arcs, 0);
+	List__trim(map->journal_tags, 0);
+    } else if (map->save_journal && !save_failed &&
+      map->journal_size + changes_size < map_size) {
+	Map__save_journal_queue(map);
+    } else {
+	Map__save_snapshot_queue(map);
+    }
+    map->is_saved = (Logical)1;
+    map->save_changes_count = map->changes_count;
+    map->save_time = time((time_t *)0);
+}
+
+/// @brief Queues a *Map_Snapshot* of *map* for the save thread.
+/// @param map to save.
+///
+/// *Map__save_snapshot_queue*() will copy the *Tag*'s and *Arc*'s of *map*
+/// into a *Map_Snapshot* and hand it to the save thread.  A previously
+/// queued *Map_Snapshot* that has not been started yet is discarded, as
+/// is any queued journal batch, since the new *Map_Snapshot* covers it.
+/// Each *Map_Snapshot* gets the next snapshot generation, which is what
+/// keeps the old journal from being replayed over it.
+
+void Map__save_snapshot_queue(Map map) {
+    String file_name =
+      String__format("%s/%s1", map->file_path, map->file_base);
+    map->snapshot_generation += 1;
+    Map_Snapshot map_snapshot = Map_Snapshot__create(map, file_name);
+    List__trim(map->journal_arcs, 0);
+    List__trim(map->journal_tags, 0);
+    map->journal_size = 0;
+
+    // Hand *map_snapshot* off to the save thread:
+    pthread_mutex_lock(&map->save_mutex);
+    if (map->save_snapshot != (Map_Snapshot)0) {
+	Map_Snapshot__free(map->save_snapshot);
+    }
+    if (map->save_journal_snapshot != (Map_Snapshot)0) {
+	Map_Snapshot__free(map->save_journal_snapshot);
+	map->save_journal_snapshot = (Map_Snapshot)0;
+    }
+    map->save_snapshot = map_snapshot;
+    pthread_cond_broadcast(&map->save_condition);
+    pthread_mutex_unlock(&map->save_mutex);
+}
+
+/// @brief Writes out the *Map_Snapshot*'s queued for *map*.
+/// @param map_pointer is the *Map* to write snapshots of.
+/// @returns (void *)0 when the thread exits.
+///
+/// *Map__save_thread*() is the body of the save thread of *map*.  It
+/// writes out each queued *Map_Snapshot* and appends each queued journal
+/// batch until *Map__free*() tells it to exit.  A queued *Map_Snapshot*
+/// is always written before a queued journal batch, since the batch
+/// holds changes made after the *Map_Snapshot* was taken.  A failed
+/// write sets *save_failed* so that the next save is a complete
+/// *Map_Snapshot*.
+
+void *Map__save_thread(void *map_pointer) {
+    Map map = (Map)map_pointer;
+    pthread_mutex_lock(&map->save_mutex);
+    while (1) {
+	Map_Snapshot map_snapshot = map->save_snapshot;
+	Map_Snapshot journal_snapshot = map->save_journal_snapshot;
+	if (map_snapshot != (Map_Snapshot)0) {
+	    // Write *map_snapshot* out without holding the lock:
+	    map->save_snapshot = (Map_Snapshot)0;
+	    map->save_busy = (Logical)1;
+	    pthread_mutex_unlock(&map->save_mutex);
+	    Logical saved = Map_Snapshot__save(map_snapshot);
+	    Map_Snapshot__free(map_snapshot);
+	    pthread_mutex_lock(&map->save_mutex);
+	    if (!saved) {
+		map->save_failed = (Logical)1;
+	    }
+	    map->save_busy = (Logical)0;
+	    pthread_cond_broadcast(&map->save_condition);
+	} else if (journal_snapshot != (Map_Snapshot)0) {
+	    // Append *journal_snapshot* without holding the lock:
+	    map->save_journal_snapshot = (Map_Snapshot)0;
+	    map->save_busy = (Logical)1;
+	    pthread_mutex_unlock(&map->save_mutex);
+	    Logical saved = Map_Snapshot__journal_append(journal_snapshot);
+	    Map_Snapshot__free(journal_snapshot);
+	    pthread_mutex_lock(&map->save_mutex);
+	    if (!saved) {
+		map->save_failed = (Logical)1;
+	    }
+	    map->save_busy = (Logical)0;
+	    pthread_cond_broadcast(&map->save_condition);
+	} else if (map->save_exit) {
+	    break;
+	} else {
+	    pthread_cond_wait(&map->save_condition, &map->save_mutex);
+	}
+    }
+    pthread_mutex_unlock(&map->save_mutex);
+    return (void *)0;
 }
 
 /// @brief Sort the contents of *map* to be in a consistent order.
@@ -479,6 +1254,317 @@ void Map__sort(Map map) {
     List__sort(map->all_arcs, (List__Compare__Routine)Arc__compare);
 }
 
+/// @brief Builds the *map* spanning tree using a binary heap.
+/// @param map to build the spanning tree for.
+/// @param image is the current image.
+/// @param sequence_number is the image sequence number.
+///
+/// *Map__spanning_tree_build*() will build a spanning tree of the *Tag*'s
+/// in *map* out of the shortest possible *Arc*'s, starting from the
+/// *Tag* with the lowest id.  Each *Tag* is placed by way of the *Arc*
+/// that adds it to the tree.  The pending *Arc*'s are kept in a binary
+/// heap, so the tree is built in O(E log E) time.
+
+void Map__spanning_tree_build(
+  Map map, CV_Image image, Unsigned sequence_number) {
+    // Increment *visit* to the next value to use for updating:
+    Unsigned visit = map->visit + 1;
+    map->visit = visit;
+
+    // We want the tag with the lowest id number to be the origin.
+    // Sort *tags* from lowest tag id to greatest:
+    List /* <Tag> */ all_tags = map->all_tags;
+    List__sort(all_tags, (List__Compare__Routine)Tag__compare);
+
+    // The first tag in {tags} has the lowest id and is forced to be the
+    // map origin:
+    Tag tag = (Tag)List__fetch(all_tags, 0);
+    tag->visit = visit;
+    tag->hop_count = 0;
+    tag->parent_arc = (Arc)0;
+    map->pending_heap_size = 0;
+    map->pending_order = 0;
+    Unsigned tree_tags_size = 1;
+
+    // Each time a *tag* is added to the spanning tree, its *Arc*'s are
+    // considered.  *Arc*'s that reach a *Tag* not yet in the tree are
+    // pushed; the rest connect two nodes of the tree and are settled
+    // right away:
+    while (tag != (Tag)0) {
+	List /* <Arc> */ arcs = tag->arcs;
+	Unsigned arcs_size = List__size(arcs);
+	for (Unsigned index = 0; index < arcs_size; index++) {
+	    Arc arc = (Arc)List__fetch(arcs, index);
+	    if (arc->visit != visit) {
+		if (arc->from_tag->visit == visit &&
+		  arc->to_tag->visit == visit) {
+		    // *arc* connects across two nodes of spanning tree:
+		    arc->visit = visit;
+		    Map__arc_in_tree_set(map, arc, (Logical)0);
+		} else {
+		    Map__pending_push(map, arc);
+		}
+	    }
+	}
+
+	// Pop *Arc*'s until one reaches a *Tag* not in the tree yet:
+	tag = (Tag)0;
+	while (map->pending_heap_size != 0) {
+	    Arc arc = Map__pending_pop(map);
+	    if (arc->visit != visit) {
+		arc->visit = visit;
+		Tag from_tag = arc->from_tag;
+		Tag to_tag = arc->to_tag;
+		Logical from_is_new = (Logical)(from_tag->visit != visit);
+		Logical to_is_new = (Logical)(to_tag->visit != visit);
+		if (from_is_new || to_is_new) {
+		    // Add the new *Tag* to spanning tree:
+		    Tag old_tag = to_tag;
+		    tag = from_tag;
+		    if (to_is_new) {
+			old_tag = from_tag;
+			tag = to_tag;
+		    }
+		    assert (old_tag->visit == visit);
+		    tag->hop_count = old_tag->hop_count + 1;
+		    tag->parent_arc = arc;
+		    tag->visit = visit;
+		    tree_tags_size += 1;
+		    (void)Tag__update_via_arc(tag, arc, image, sequence_number);
+
+		    // Mark that *arc* is part of the spanning tree:
+		    Map__arc_in_tree_set(map, arc, (Logical)1);
+		    break;
+		} else {
+		    // *arc* connects across two nodes of spanning tree:
+		    Map__arc_in_tree_set(map, arc, (Logical)0);
+		}
+	    }
+	}
+    }
+
+    // The spanning tree can only be repaired later on if it reached
+    // every *Tag*:
+    map->tree_rebuild = (Logical)(tree_tags_size != List__size(all_tags));
+    List__trim(map->changed_arcs, 0);
+}
+
+/// @brief Propagates *Tag* placements down the spanning tree from *tag*.
+/// @param map that owns the spanning tree.
+/// @param tag is the root of the subtree to propagate into.
+/// @param visit marks *Tag*'s whose parent *Arc* has changed.
+/// @param image is the current image.
+/// @param sequence_number is the image sequence number.
+///
+/// *Map__spanning_tree_propagate*() will place *tag* using its parent
+/// *Arc* and then continue down into the children of each *Tag* whose
+/// placement or hop count actually changed.  *Tag*'s marked with *visit*
+/// are always descended into, since their parent *Arc* has changed.
+
+void Map__spanning_tree_propagate(Map map,
+  Tag tag, Unsigned visit, CV_Image image, Unsigned sequence_number) {
+    List /* <Tag> */ repair_tags = map->repair_tags;
+    List__trim(repair_tags, 0);
+    List__append(repair_tags, (Memory)tag,
+      "Map__spanning_tree_propagate:List__append:repair_tags");
+    while (List__size(repair_tags) != 0) {
+	tag = (Tag)List__pop(repair_tags);
+	Arc parent_arc = tag->parent_arc;
+	Tag parent_tag = Arc__other_tag(parent_arc, tag);
+	Unsigned hop_count = parent_tag->hop_count + 1;
+	Logical moved =
+	  Tag__update_via_arc(tag, parent_arc, image, sequence_number);
+	if (moved || hop_count != tag->hop_count || tag->visit == visit) {
+	    // Push the children of *tag*:
+	    tag->hop_count = hop_count;
+	    List /* <Arc> */ arcs = tag->arcs;
+	    Unsigned arcs_size = List__size(arcs);
+	    for (Unsigned index = 0; index < arcs_size; index++) {
+		Arc arc = (Arc)List__fetch(arcs, index);
+		if (arc->in_tree && arc != parent_arc) {
+		    List__append(repair_tags, (Memory)Arc__other_tag(arc, tag),
+		      "Map__spanning_tree_propagate:List__append:repair_tags");
+		}
+	    }
+	}
+    }
+}
+
+/// @brief Repairs the *map* spanning tree after *arc* has changed.
+/// @param map that owns the spanning tree.
+/// @param arc is the *Arc* that changed.
+/// @param image is the current image.
+/// @param sequence_number is the image sequence number.
+///
+/// *Map__spanning_tree_repair*() will fix up the spanning tree of *map*
+/// after *arc* has changed, touching only the subtree that hangs off of
+/// *arc*.  If *arc* is in the tree, the shortest *Arc* that reconnects
+/// its subtree replaces it.  Otherwise, *arc* replaces the longest *Arc*
+/// on the tree path between its two *Tag*'s if it is shorter.  As long
+/// as no two *Arc* distances are equal, this is the same tree that
+/// *Map__spanning_tree_build*() would build.  All of the *Tag*'s in
+/// *map* must already be in the spanning tree.
+
+void Map__spanning_tree_repair(
+  Map map, Arc arc, CV_Image image, Unsigned sequence_number) {
+    Tag from_tag = arc->from_tag;
+    Tag to_tag = arc->to_tag;
+    if (arc->in_tree) {
+	// Mark all of the *Tag*'s in the subtree hanging off of *arc*:
+	Tag child_tag = to_tag;
+	if (from_tag->parent_arc == arc) {
+	    child_tag = from_tag;
+	}
+	assert (child_tag->parent_arc == arc);
+	Unsigned visit = map->visit + 1;
+	map->visit = visit;
+	List /* <Tag> */ repair_tags = map->repair_tags;
+	List__trim(repair_tags, 0);
+	List__append(repair_tags, (Memory)child_tag,
+	  "Map__spanning_tree_repair:List__append:repair_tags");
+	child_tag->visit = visit;
+	for (Unsigned index = 0; index < List__size(repair_tags); index++) {
+	    Tag tag = (Tag)List__fetch(repair_tags, index);
+	    List /* <Arc> */ arcs = tag->arcs;
+	    Unsigned arcs_size = List__size(arcs);
+	    for (Unsigned arcs_index = 0; arcs_index < arcs_size; arcs_index++) {
+		Arc tree_arc = (Arc)List__fetch(arcs, arcs_index);
+		if (tree_arc->in_tree && tree_arc != tag->parent_arc) {
+		    Tag tree_tag = Arc__other_tag(tree_arc, tag);
+		    tree_tag->visit = visit;
+		    List__append(repair_tags, (Memory)tree_tag,
+		      "Map__spanning_tree_repair:List__append:repair_tags");
+		}
+	    }
+	}
+
+	// Find the shortest *Arc* that connects the subtree to the rest
+	// of the tree:
+	Arc best_arc = arc;
+	Tag best_tag = child_tag;
+	Unsigned repair_tags_size = List__size(repair_tags);
+	for (Unsigned index = 0; index < repair_tags_size; index++) {
+	    Tag tag = (Tag)List__fetch(repair_tags, index);
+	    List /* <Arc> */ arcs = tag->arcs;
+	    Unsigned arcs_size = List__size(arcs);
+	    for (Unsigned arcs_index = 0; arcs_index < arcs_size; arcs_index++) {
+		Arc cross_arc = (Arc)List__fetch(arcs, arcs_index);
+		if (Arc__other_tag(cross_arc, tag)->visit != visit &&
+		  cross_arc->distance < best_arc->distance) {
+		    best_arc = cross_arc;
+		    best_tag = tag;
+		}
+	    }
+	}
+
+	// Swap in *best_arc* if it is better than *arc*, and re-propagate:
+	if (best_arc != arc) {
+	    visit = Map__spanning_tree_reroot(map, best_tag, best_arc, child_tag);
+	    Map__arc_in_tree_set(map, arc, (Logical)0);
+	    Map__arc_in_tree_set(map, best_arc, (Logical)1);
+	} else {
+	    visit = map->visit + 1;
+	    map->visit = visit;
+	}
+	Map__spanning_tree_propagate(map, best_tag, visit, image, sequence_number);
+    } else {
+	// Walk up the tree from both ends of *arc* until the paths meet,
+	// keeping track of the longest *Arc* along the way:
+	Arc longest_arc = (Arc)0;
+	Tag longest_tag = (Tag)0;
+	Tag inner_tag = (Tag)0;
+	Tag tag1 = from_tag;
+	Tag tag2 = to_tag;
+	while (tag1 != tag2) {
+	    if (tag1->hop_count >= tag2->hop_count) {
+		Arc parent_arc = tag1->parent_arc;
+		assert (parent_arc != (Arc)0);
+		if (longest_arc == (Arc)0 ||
+		  parent_arc->distance > longest_arc->distance) {
+		    longest_arc = parent_arc;
+		    longest_tag = tag1;
+		    inner_tag = from_tag;
+		}
+		tag1 = Arc__other_tag(parent_arc, tag1);
+	    } else {
+		Arc parent_arc = tag2->parent_arc;
+		assert (parent_arc != (Arc)0);
+		if (longest_arc == (Arc)0 ||
+		  parent_arc->distance > longest_arc->distance) {
+		    longest_arc = parent_arc;
+		    longest_tag = tag2;
+		    inner_tag = to_tag;
+		}
+		tag2 = Arc__other_tag(parent_arc, tag2);
+	    }
+	}
+
+	// Swap *arc* in for *longest_arc* if it is shorter, and re-propagate:
+	if (longest_arc != (Arc)0 && arc->distance < longest_arc->distance) {
+	    Unsigned visit =
+	      Map__spanning_tree_reroot(map, inner_tag, arc, longest_tag);
+	    Map__arc_in_tree_set(map, longest_arc, (Logical)0);
+	    Map__arc_in_tree_set(map, arc, (Logical)1);
+	    Map__spanning_tree_propagate(map,
+	      inner_tag, visit, image, sequence_number);
+	}
+    }
+}
+
+/// @brief Reroots a spanning tree path so that *tag* hangs off of *arc*.
+/// @param map that owns the spanning tree.
+/// @param tag is the *Tag* that gets *arc* as its new parent *Arc*.
+/// @param arc is the new parent *Arc* of *tag*.
+/// @param last_tag is the ancestor of *tag* whose parent *Arc* is dropped.
+/// @returns the visit number that the rerooted *Tag*'s are marked with.
+///
+/// *Map__spanning_tree_reroot*() will reverse the parent *Arc*'s along the
+/// tree path from *tag* up to *last_tag*, and make *arc* the parent *Arc*
+/// of *tag*.  The old parent *Arc* of *last_tag* is no longer used.
+/// Each *Tag* along the path is marked with the returned visit number.
+
+Unsigned Map__spanning_tree_reroot(Map map, Tag tag, Arc arc, Tag last_tag) {
+    Unsigned visit = map->visit + 1;
+    map->visit = visit;
+    Arc parent_arc = arc;
+    while (1) {
+	Arc old_parent_arc = tag->parent_arc;
+	tag->parent_arc = parent_arc;
+	tag->visit = visit;
+	if (tag == last_tag) {
+	    break;
+	}
+	parent_arc = old_parent_arc;
+	tag = Arc__other_tag(old_parent_arc, tag);
+    }
+    return visit;
+}
+
+/// @brief Brings the *map* spanning tree up to date.
+/// @param map to update.
+/// @param image is the current image.
+/// @param sequence_number is the image sequence number.
+///
+/// *Map__spanning_tree_update*() will repair the spanning tree of *map*
+/// around each changed *Arc* when *tree_incremental* is set and the
+/// tree still covers every *Tag*.  Otherwise, the tree is rebuilt from
+/// scratch with *Map__spanning_tree_build*().
+
+void Map__spanning_tree_update(
+  Map map, CV_Image image, Unsigned sequence_number) {
+    if (map->tree_incremental && !map->tree_rebuild) {
+	List /* <Arc> */ changed_arcs = map->changed_arcs;
+	Unsigned changed_arcs_size = List__size(changed_arcs);
+	for (Unsigned index = 0; index < changed_arcs_size; index++) {
+	    Arc arc = (Arc)List__fetch(changed_arcs, index);
+	    Map__spanning_tree_repair(map, arc, image, sequence_number);
+	}
+	List__trim(changed_arcs, 0);
+    } else {
+	Map__spanning_tree_build(map, image, sequence_number);
+    }
+}
+
 /// @brief Writes *map* out to a file called *svg_base_name*.svg.
 /// @param map is the *Map* to write out.
 /// @param svg_base_name is the base name of the .svg file to write out.
@@ -673,9 +1759,12 @@ Tag Map__tag_lookup(Map map, Unsigned tag_id) {
 	Table__insert(tags_table, memory_tag_id, (Memory)tag);
 	List__append(map->all_tags, tag,
 	  "Map__tag_lookup:List__append:all_tags");
+	List__append(map->journal_tags, tag,
+	  "Map__tag_lookup:List__append:journal_tags");
 	map->changes_count += 1;
 	map->is_changed = (Logical)1;
 	map->is_saved = (Logical)0;
+	map->tree_rebuild = (Logical)1;
     }
     return tag;
 }
@@ -687,35 +1776,12 @@ Tag Map__tag_lookup(Map map, Unsigned tag_id) {
 /// *Map__write*() will write *map* to *out_file* in XML format.
 
 void Map__write(Map map, File out_file) {
-    // Figure out how many *Arc*'s and *Tag*'s we have:
-    List all_arcs = map->all_arcs;
-    List all_tags = map->all_tags;
-    Unsigned all_tags_size = List__size(all_tags);
-    Unsigned all_arcs_size = List__size(all_arcs);
-
-    // Output <Map ...> tag:
-    File__format(out_file, "<Map");
-    File__format(out_file, " Tags_Count=\"%d\"", all_tags_size);
-    File__format(out_file, " Arcs_Count=\"%d\"", all_arcs_size);
-    File__format(out_file, ">\n");
-
     // Put the tags out in sorted order:
     Map__sort(map);
 
-    // Output each *tag in *all_tags*:
-    for (Unsigned index = 0; index < all_tags_size; index++) {
-	Tag tag = (Tag)List__fetch(all_tags, index);
-	Tag__write(tag, out_file);
-    }
-
-    // Output each *tag in *all_tags*:
-    for (Unsigned index = 0; index < all_arcs_size; index++) {
-	Arc arc = (Arc)List__fetch(all_arcs, index);
-	Arc__write(arc, out_file);
-    }
-
-    // Output the closing </Map> tag:
-    File__format(out_file, "</Map>\n");
+    Map_Snapshot map_snapshot = Map_Snapshot__create(map, (String)0);
+    Map_Snapshot__write(map_snapshot, out_file);
+    Map_Snapshot__free(map_snapshot);
 }
 
 /// @brief Updates the location of each *tag* in *map*.
@@ -727,103 +1793,482 @@ void Map__write(Map map, File out_file) {
 
 void Map__update(Map map, CV_Image image, Unsigned sequence_number) {
     if (map->is_changed) {
-	// Increment *visit* to the next value to use for updating:
-	Unsigned visit = map->visit + 1;
-	map->visit = visit;
+	// Bring the spanning tree and the *Tag* locations up to date:
+	Map__spanning_tree_update(map, image, sequence_number);
 
-	// We want the tag with the lowest id number to be the origin.
-	// Sort *tags* from lowest tag id to greatest:
-	List /* <Tag> */ all_tags = map->all_tags;
-	List__sort(all_tags, (List__Compare__Routine)Tag__compare);
-
-	// The first tag in {tags} has the lowest id and is forced to be the
-	// map origin:
-	Tag origin_tag = (Tag)List__fetch(all_tags, 0);
-	origin_tag->visit = visit;
-	origin_tag->hop_count = 0;
-	
-	// The first step is to identify all of the *Arc*'s that make a
-	// spanning tree of the *map* *Tags*'s.
-
-	// Initializd *pending_arcs* with the *Arc*'s from *orgin_tag*:
-	List /* <Arc> */ pending_arcs = map->pending_arcs;
-	List__all_append(pending_arcs, origin_tag->arcs);
-
-	// We always want to keep *pending_arcs* sorted from longest to
-	// shortest at the end.  *Arc__distance_compare*() sorts longest first:
-	List__sort(pending_arcs, (List__Compare__Routine)Arc__distance_compare);
-
-	// We keep iterating across *pending_arcs* until it goes empty.
-	// since we keep it sorted from longest to shortest (and we always
-	// look at the end), we are building a spanning tree using the shortest
-	// possible *Arc*'s:
-	while (List__size(pending_arcs) != 0) {
-	    // Pop the shortest *arc* off the end of *pending_arcs*:
-	    Arc arc = (Arc)List__pop(pending_arcs);
-
-	    // For debugging only:
-	    //File__format(stderr, "----------\n");
-	    //Unsigned size = List__size(pending_arcs);
-	    //for (Unsigned index = 0; index < size; index++) {
-	    //    Arc arc = (Arc)List__fetch(pending_arcs, index);
-	    //    File__format(stderr,
-	    //      "pending_arcs[%d]: Arc[%d,%d] dist=%f\n",
-	    //      index, arc->origin->id, arc->target->id, arc->distance);
-	    //}
-
-	    // If we already visited *arc*, just ignore it:
-	    if (arc->visit != visit) {
-		// We have not visited this *arc* in this cycle, so now we
-		// mark it as being *visit*'ed:
-		arc->visit = visit;
+	// Mark that *map* is fully updated:
+        map->is_changed = (Logical)0;
+    }
 
-		// Figure out if *origin* or *target* have been added to the
-		// spanning tree yet:
-		Tag from_tag = arc->from_tag;
-		Tag to_tag = arc->to_tag;
-		Logical from_is_new = (Logical)(from_tag->visit != visit);
-		Logical to_is_new = (Logical)(to_tag->visit != visit);
+    // Let the save thread write *map* out when enough has changed:
+    Map__save_request(map);
+}
 
-		if (from_is_new || to_is_new) {
-		    if (from_is_new) {
-			// Add *to* to spanning tree:
-			assert (!to_is_new);
-			from_tag->hop_count = to_tag->hop_count + 1;
-			List__all_append(pending_arcs, from_tag->arcs);
-			from_tag->visit = visit;
-			Tag__update_via_arc(from_tag,
-			  arc, image, sequence_number);
-		    } else {
-			// Add *from* to spanning tree:
-			assert (!from_is_new);
-			to_tag->hop_count = from_tag->hop_count + 1;
-			List__all_append(pending_arcs, to_tag->arcs);
-			to_tag->visit = visit;
-			Tag__update_via_arc(to_tag,
-			  arc, image, sequence_number);
-		    }
+// *Map_Binary_Arc* routines:
 
-		    // Mark that *arc* is part of the spanning tree:
-		    arc->in_tree = (Logical)1;
+/// @brief Loads *arc* into *binary_arc*.
+/// @param binary_arc is the *Arc* record to load.
+/// @param arc is the *Arc* to load from.
+///
+/// *Map_Binary_Arc__initialize*() will fill in *binary_arc* from *arc*.
+
+void Map_Binary_Arc__initialize(Map_Binary_Arc binary_arc, Arc arc) {
+    binary_arc->from_tag_id = arc->from_tag->id;
+    binary_arc->to_tag_id = arc->to_tag->id;
+    binary_arc->in_tree = (Unsigned)arc->in_tree;
+    binary_arc->reserved = 0;
+    binary_arc->from_twist = arc->from_twist;
+    binary_arc->distance = arc->distance;
+    binary_arc->to_twist = arc->to_twist;
+    binary_arc->goodness = arc->goodness;
+}
 
-		    // Resort *pending_arcs* to that the shortest distance
-		    // sorts to the end:
-		    List__sort(pending_arcs,
-		      (List__Compare__Routine)Arc__distance_compare);
-		} else {
-		    // *arc* connects across two nodes of spanning tree:
-		    arc->in_tree = (Logical)0;
-		}
-	    }
+// *Map_Binary_Tag* routines:
+
+/// @brief Loads *tag* into *binary_tag*.
+/// @param binary_tag is the *Tag* record to load.
+/// @param tag is the *Tag* to load from.
+///
+/// *Map_Binary_Tag__initialize*() will fill in *binary_tag* from *tag*.
+
+void Map_Binary_Tag__initialize(Map_Binary_Tag binary_tag, Tag tag) {
+    binary_tag->id = tag->id;
+    binary_tag->hop_count = tag->hop_count;
+    binary_tag->diagonal = tag->diagonal;
+    binary_tag->twist = tag->twist;
+    binary_tag->x = tag->x;
+    binary_tag->y = tag->y;
+}
+
+// *Map_Pending* routines:
+
+/// @brief Returns the heap order of *map_pending1* vs. *map_pending2*.
+/// @param map_pending1 is the first *Map_Pending* entry.
+/// @param map_pending2 is the second *Map_Pending* entry.
+/// @returns -1, 0, or 1 depending upon heap order.
+///
+/// *Map_Pending__compare*() will return -1 if *map_pending1* should be
+/// popped before *map_pending2*, 1 if it should be popped after, and 0
+/// if they are the same entry.  Shorter distances come first, followed
+/// by lower hop counts, followed by later pushes.
+
+Integer Map_Pending__compare(
+  Map_Pending map_pending1, Map_Pending map_pending2) {
+    Integer result =
+      Double__compare(map_pending1->distance, map_pending2->distance);
+    if (result == 0) {
+	result =
+	  Unsigned__compare(map_pending1->hop_count, map_pending2->hop_count);
+	if (result == 0) {
+	    result = -Unsigned__compare(map_pending1->order, map_pending2->order);
 	}
+    }
+    return result;
+}
+
+// *Map_Snapshot* routines:
+
+/// @brief Writes *map_snapshot* out to *out_file* in binary format.
+/// @param map_snapshot to write out.
+/// @param out_file to write to.
+/// @returns 1 if everything was written and 0 otherwise.
+///
+/// *Map_Snapshot__binary_write*() will write *map_snapshot* to *out_file*
+/// as a *Map_Binary_Header* followed by fixed size *Map_Binary_Tag* and
+/// *Map_Binary_Arc* records in sorted order.  Writing stops at the first
+/// failed write and 0 is returned.
+
+Logical Map_Snapshot__binary_write(Map_Snapshot map_snapshot, File out_file) {
+    Unsigned arcs_size = map_snapshot->arcs_size;
+    Unsigned tags_size = map_snapshot->tags_size;
+
+    // Output the header:
+    struct Map_Binary_Header__Struct header;
+    header.magic = MAP_BINARY_MAGIC;
+    header.version = MAP_BINARY_VERSION;
+    header.header_size = sizeof(struct Map_Binary_Header__Struct);
+    header.tags_size = tags_size;
+    header.tag_size = sizeof(struct Map_Binary_Tag__Struct);
+    header.arcs_size = arcs_size;
+    header.arc_size = sizeof(struct Map_Binary_Arc__Struct);
+    header.snapshot_generation = map_snapshot->snapshot_generation;
+    Logical result =
+      (Logical)(fwrite(&header, sizeof(header), 1, out_file) == 1);
+
+    // Output each *tag* in sorted order:
+    List /* <Tag> */ tags = List__new("Map_Snapshot__binary_write:tags");
+    for (Unsigned index = 0; index < tags_size; index++) {
+	List__append(tags, (Memory)&map_snapshot->tags[index],
+	  "Map_Snapshot__binary_write:List__append:tags");
+    }
+    List__sort(tags, (List__Compare__Routine)Tag__compare);
+    for (Unsigned index = 0; result && index < tags_size; index++) {
+	Tag tag = (Tag)List__fetch(tags, index);
+	struct Map_Binary_Tag__Struct binary_tag;
+	Map_Binary_Tag__initialize(&binary_tag, tag);
+	result = (Logical)
+	  (fwrite(&binary_tag, sizeof(binary_tag), 1, out_file) == 1);
+    }
+    List__free(tags);
+
+    // Output each *arc* in sorted order:
+    List /* <Arc> */ arcs = List__new("Map_Snapshot__binary_write:arcs");
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	List__append(arcs, (Memory)&map_snapshot->arcs[index],
+	  "Map_Snapshot__binary_write:List__append:arcs");
+    }
+    List__sort(arcs, (List__Compare__Routine)Arc__compare);
+    for (Unsigned index = 0; result && index < arcs_size; index++) {
+	Arc arc = (Arc)List__fetch(arcs, index);
+	struct Map_Binary_Arc__Struct binary_arc;
+	Map_Binary_Arc__initialize(&binary_arc, arc);
+	result = (Logical)
+	  (fwrite(&binary_arc, sizeof(binary_arc), 1, out_file) == 1);
+    }
+    List__free(arcs);
+    return result;
+}
+
+/// @brief Returns a new *Map_Snapshot* of *map*.
+/// @param map to take a snapshot of.
+/// @param file_name is the map file name to save to (takes ownership).
+/// @returns a new *Map_Snapshot*.
+///
+/// *Map_Snapshot__create*() will copy all of the *Tag*'s and *Arc*'s of
+/// *map* into a new *Map_Snapshot*.  The copied *Arc*'s still point at
+/// the live *Tag*'s, but only their (unchanging) ids are used.
+
+Map_Snapshot Map_Snapshot__create(Map map, String file_name) {
+    List /* <Arc> */ all_arcs = map->all_arcs;
+    List /* <Tag> */ all_tags = map->all_tags;
+    Unsigned arcs_size = List__size(all_arcs);
+    Unsigned tags_size = List__size(all_tags);
+
+    Map_Snapshot map_snapshot =
+      Memory__new(Map_Snapshot, "Map_Snapshot__create");
+    map_snapshot->arcs = (struct Arc__Struct *)Memory__allocate(
+      (arcs_size + 1) * sizeof(struct Arc__Struct),
+      "Map_Snapshot__create:arcs");
+    map_snapshot->arcs_size = arcs_size;
+    map_snapshot->file_name = file_name;
+    map_snapshot->snapshot_generation = map->snapshot_generation;
+    map_snapshot->tags = (struct Tag__Struct *)Memory__allocate(
+      (tags_size + 1) * sizeof(struct Tag__Struct),
+      "Map_Snapshot__create:tags");
+    map_snapshot->tags_size = tags_size;
+
+    // Copy the *Arc*'s and *Tag*'s:
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	map_snapshot->arcs[index] = *(Arc)List__fetch(all_arcs, index);
+    }
+    for (Unsigned index = 0; index < tags_size; index++) {
+	map_snapshot->tags[index] = *(Tag)List__fetch(all_tags, index);
+    }
+    return map_snapshot;
+}
+
+/// @brief Releases the storage associated with *map_snapshot*.
+/// @param map_snapshot to release.
+///
+/// *Map_Snapshot__free*() will release the storage of *map_snapshot*.
+
+void Map_Snapshot__free(Map_Snapshot map_snapshot) {
+    if (map_snapshot->file_name != (String)0) {
+	String__free(map_snapshot->file_name);
+    }
+    Memory__free((Memory)map_snapshot->arcs);
+    Memory__free((Memory)map_snapshot->tags);
+    Memory__free((Memory)map_snapshot);
+}
+
+/// @brief Appends *map_snapshot* to the end of its map journal.
+/// @param map_snapshot is the journal batch to append.
+/// @returns 1 if everything was appended and 0 otherwise.
+///
+/// *Map_Snapshot__journal_append*() will append a *MAP_JOURNAL_TAG*
+/// record for each *Tag* and a *MAP_JOURNAL_ARC* record for each *Arc*
+/// in *map_snapshot* to "*file_name*.journal".  The journal header is
+/// written first if the journal is empty.  Appending stops at the first
+/// failed write, which is reported, and 0 is returned.  Any partial
+/// record is cut off when the journal is next replayed.
+
+Logical Map_Snapshot__journal_append(Map_Snapshot map_snapshot) {
+    String file_name = String__format("%s.journal", map_snapshot->file_name);
+    File out_file = File__open(file_name, "ab");
+    Logical result = (Logical)(out_file != (File)0);
+    if (result) {
+	result = (Logical)(fseek(out_file, 0L, SEEK_END) == 0);
+    }
+    if (result && ftell(out_file) == 0L) {
+	struct Map_Journal_Header__Struct header;
+	header.magic = MAP_JOURNAL_MAGIC;
+	header.version = MAP_JOURNAL_VERSION;
+	header.tag_size = sizeof(struct Map_Binary_Tag__Struct);
+	header.arc_size = sizeof(struct Map_Binary_Arc__Struct);
+	header.snapshot_generation = map_snapshot->snapshot_generation;
+	header.reserved = 0;
+	result = (Logical)(fwrite(&header, sizeof(header), 1, out_file) == 1);
+    }
 
-	if (map->is_changed) {
-	    Map__save(map);
+    // Output the *Tag* records followed by the *Arc* records:
+    struct Map_Journal_Record__Struct record;
+    record.kind = MAP_JOURNAL_TAG;
+    record.size = sizeof(struct Map_Binary_Tag__Struct);
+    Unsigned tags_size = map_snapshot->tags_size;
+    for (Unsigned index = 0; result && index < tags_size; index++) {
+	struct Map_Binary_Tag__Struct binary_tag;
+	Map_Binary_Tag__initialize(&binary_tag, &map_snapshot->tags[index]);
+	result = (Logical)
+	  (fwrite(&record, sizeof(record), 1, out_file) == 1 &&
+	  fwrite(&binary_tag, sizeof(binary_tag), 1, out_file) == 1);
+    }
+    record.kind = MAP_JOURNAL_ARC;
+    record.size = sizeof(struct Map_Binary_Arc__Struct);
+    Unsigned arcs_size = map_snapshot->arcs_size;
+    for (Unsigned index = 0; result && index < arcs_size; index++) {
+	struct Map_Binary_Arc__Struct binary_arc;
+	Map_Binary_Arc__initialize(&binary_arc, &map_snapshot->arcs[index]);
+	result = (Logical)
+	  (fwrite(&record, sizeof(record), 1, out_file) == 1 &&
+	  fwrite(&binary_arc, sizeof(binary_arc), 1, out_file) == 1);
+    }
+    if (out_file != (File)0) {
+	if (ferror(out_file)) {
+	    result = (Logical)0;
 	}
+	File__close(out_file);
+    }
+    if (!result) {
+	File__format(stderr, "Could not append to '%s'\n", file_name);
+    }
+    String__free(file_name);
+    return result;
+}
 
-	// Mark that *map* is fully updated:
-        map->is_changed = (Logical)0;
-	map->is_saved = (Logical)0;
+/// @brief Returns a new journal batch of the changes to *map*.
+/// @param map to take the changes from.
+/// @param file_name is the map file name to save to (takes ownership).
+/// @returns a new *Map_Snapshot*.
+///
+/// *Map_Snapshot__journal_create*() will copy each *Tag* created and each
+/// *Arc* changed since the last journal batch into a new *Map_Snapshot*,
+/// and then forget about them.  An *Arc* that changed several times is
+/// only copied once.
+
+Map_Snapshot Map_Snapshot__journal_create(Map map, String file_name) {
+    List /* <Arc> */ journal_arcs = map->journal_arcs;
+    List /* <Tag> */ journal_tags = map->journal_tags;
+    List__sort(journal_arcs, (List__Compare__Routine)Arc__compare);
+    Unsigned arcs_size = List__size(journal_arcs);
+    Unsigned tags_size = List__size(journal_tags);
+
+    Map_Snapshot map_snapshot =
+      Memory__new(Map_Snapshot, "Map_Snapshot__journal_create");
+    map_snapshot->arcs = (struct Arc__Struct *)Memory__allocate(
+      (arcs_size + 1) * sizeof(struct Arc__Struct),
+      "Map_Snapshot__journal_create:arcs");
+    map_snapshot->arcs_size = 0;
+    map_snapshot->file_name = file_name;
+    map_snapshot->snapshot_generation = map->snapshot_generation;
+    map_snapshot->tags = (struct Tag__Struct *)Memory__allocate(
+      (tags_size + 1) * sizeof(struct Tag__Struct),
+      "Map_Snapshot__journal_create:tags");
+    map_snapshot->tags_size = tags_size;
+
+    // Copy the *Arc*'s, skipping duplicates, and the *Tag*'s:
+    Arc previous_arc = (Arc)0;
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	Arc arc = (Arc)List__fetch(journal_arcs, index);
+	if (arc != previous_arc) {
+	    map_snapshot->arcs[map_snapshot->arcs_size++] = *arc;
+	    previous_arc = arc;
+	}
     }
+    for (Unsigned index = 0; index < tags_size; index++) {
+	map_snapshot->tags[index] = *(Tag)List__fetch(journal_tags, index);
+    }
+    List__trim(journal_arcs, 0);
+    List__trim(journal_tags, 0);
+    return map_snapshot;
+}
+
+/// @brief Starts a new, empty map journal for *map_snapshot*.
+/// @param map_snapshot that was just saved.
+/// @returns 1 if the map journal was emptied and 0 otherwise.
+///
+/// *Map_Snapshot__journal_reset*() will replace "*file_name*.journal" with
+/// a journal that only has a header, since *map_snapshot* now holds all
+/// of the changes that were in it.  If the new journal can not be
+/// written, the old journal is removed instead, since an empty journal
+/// and a missing one are the same.  0 is returned (after reporting the
+/// error) if neither works.
+
+Logical Map_Snapshot__journal_reset(Map_Snapshot map_snapshot) {
+    String file_name = String__format("%s.journal", map_snapshot->file_name);
+    String temporary_file_name = String__format("%s.tmp", file_name);
+    File out_file = File__open(temporary_file_name, "wb");
+    Logical result = (Logical)(out_file != (File)0);
+    if (result) {
+	struct Map_Journal_Header__Struct header;
+	header.magic = MAP_JOURNAL_MAGIC;
+	header.version = MAP_JOURNAL_VERSION;
+	header.tag_size = sizeof(struct Map_Binary_Tag__Struct);
+	header.arc_size = sizeof(struct Map_Binary_Arc__Struct);
+	header.snapshot_generation = map_snapshot->snapshot_generation;
+	header.reserved = 0;
+	result = (Logical)(fwrite(&header, sizeof(header), 1, out_file) == 1);
+	if (ferror(out_file)) {
+	    result = (Logical)0;
+	}
+	File__close(out_file);
+    }
+    if (result && rename(temporary_file_name, file_name) != 0) {
+	result = (Logical)0;
+    }
+    if (!result) {
+	(void)remove(temporary_file_name);
+	result = (Logical)(remove(file_name) == 0 || errno == ENOENT);
+	if (!result) {
+	    File__format(stderr, "Could not empty '%s'\n", file_name);
+	}
+    }
+    String__free(temporary_file_name);
+    String__free(file_name);
+    return result;
+}
+
+/// @brief Appends the contents of *other_snapshot* to *map_snapshot*.
+/// @param map_snapshot to append to.
+/// @param other_snapshot to append from (it is not changed).
+///
+/// *Map_Snapshot__merge*() will append copies of the *Tag*'s and *Arc*'s
+/// in *other_snapshot* to *map_snapshot*.  It is used to combine journal
+/// batches that are waiting for the save thread.
+
+void Map_Snapshot__merge(
+  Map_Snapshot map_snapshot, Map_Snapshot other_snapshot) {
+    Unsigned arcs_size = map_snapshot->arcs_size;
+    Unsigned tags_size = map_snapshot->tags_size;
+    Unsigned other_arcs_size = other_snapshot->arcs_size;
+    Unsigned other_tags_size = other_snapshot->tags_size;
+    map_snapshot->arcs = (struct Arc__Struct *)Memory__reallocate(
+      (Memory)map_snapshot->arcs,
+      (arcs_size + other_arcs_size + 1) * sizeof(struct Arc__Struct),
+      "Map_Snapshot__merge:arcs");
+    map_snapshot->tags = (struct Tag__Struct *)Memory__reallocate(
+      (Memory)map_snapshot->tags,
+      (tags_size + other_tags_size + 1) * sizeof(struct Tag__Struct),
+      "Map_Snapshot__merge:tags");
+    for (Unsigned index = 0; index < other_arcs_size; index++) {
+	map_snapshot->arcs[arcs_size + index] = other_snapshot->arcs[index];
+    }
+    for (Unsigned index = 0; index < other_tags_size; index++) {
+	map_snapshot->tags[tags_size + index] = other_snapshot->tags[index];
+    }
+    map_snapshot->arcs_size = arcs_size + other_arcs_size;
+    map_snapshot->tags_size = tags_size + other_tags_size;
 }
 
+/// @brief Saves *map_snapshot* to its map file.
+/// @param map_snapshot to save.
+/// @returns 1 if *map_snapshot* was saved and 0 otherwise.
+///
+/// *Map_Snapshot__save*() will write *map_snapshot* to a temporary file
+/// and then rename it over the map file, so that the map file is always
+/// either the old map or the new map, never a partial one.  The .xml
+/// file is written before the .bin file so that the .bin file is never
+/// older than the .xml file it was written with.  Lastly, the map journal
+/// is emptied, since *map_snapshot* holds everything that was in it.  A
+/// crash before the journal is emptied is harmless, since the journal
+/// has an older snapshot generation than the new map files and is not
+/// replayed over them.  If a map file can not be written, an error is
+/// reported, the map files that have not been replaced yet are left
+/// alone, the map journal is not emptied, and 0 is returned.
+
+Logical Map_Snapshot__save(Map_Snapshot map_snapshot) {
+    Logical saved = (Logical)1;
+    for (Unsigned index = 0; saved && index < 2; index++) {
+	Logical is_binary = (Logical)(index == 1);
+	String file_name = String__format("%s.%s",
+	  map_snapshot->file_name, is_binary ? "bin" : "xml");
+	String temporary_file_name = String__format("%s.tmp", file_name);
+	File out_file = File__open(temporary_file_name, is_binary ? "wb" : "w");
+	if (out_file == (File)0) {
+	    saved = (Logical)0;
+	} else {
+	    if (is_binary) {
+		saved = Map_Snapshot__binary_write(map_snapshot, out_file);
+	    } else {
+		Map_Snapshot__write(map_snapshot, out_file);
+	    }
+	    if (ferror(out_file)) {
+		saved = (Logical)0;
+	    }
+	    File__close(out_file);
+	    if (saved && rename(temporary_file_name, file_name) != 0) {
+		saved = (Logical)0;
+	    }
+	    if (!saved) {
+		(void)remove(temporary_file_name);
+	    }
+	}
+	if (!saved) {
+	    File__format(stderr, "Could not write '%s'\n", file_name);
+	}
+	String__free(temporary_file_name);
+	String__free(file_name);
+    }
+    if (saved) {
+	saved = Map_Snapshot__journal_reset(map_snapshot);
+    }
+    return saved;
+}
+
+/// @brief Writes *map_snapshot* out to *out_file*.
+/// @param map_snapshot to write out.
+/// @param out_file to write to.
+///
+/// *Map_Snapshot__write*() will write *map_snapshot* to *out_file* in
+/// XML format with the *Tag*'s and *Arc*'s in sorted order.
+
+void Map_Snapshot__write(Map_Snapshot map_snapshot, File out_file) {
+    Unsigned arcs_size = map_snapshot->arcs_size;
+    Unsigned tags_size = map_snapshot->tags_size;
+
+    // Output <Map ...> tag:
+    File__format(out_file, "<Map");
+    File__format(out_file, " Tags_Count=\"%d\"", tags_size);
+    File__format(out_file, " Arcs_Count=\"%d\"", arcs_size);
+    File__format(out_file, " Snapshot_Generation=\"%d\"",
+      map_snapshot->snapshot_generation);
+    File__format(out_file, ">\n");
+
+    // Output each *tag* in sorted order:
+    List /* <Tag> */ tags = List__new("Map_Snapshot__write:tags");
+    for (Unsigned index = 0; index < tags_size; index++) {
+	List__append(tags, (Memory)&map_snapshot->tags[index],
+	  "Map_Snapshot__write:List__append:tags");
+    }
+    List__sort(tags, (List__Compare__Routine)Tag__compare);
+    for (Unsigned index = 0; index < tags_size; index++) {
+	Tag tag = (Tag)List__fetch(tags, index);
+	Tag__write(tag, out_file);
+    }
+    List__free(tags);
+
+    // Output each *arc* in sorted order:
+    List /* <Arc> */ arcs = List__new("Map_Snapshot__write:arcs");
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	List__append(arcs, (Memory)&map_snapshot->arcs[index],
+	  "Map_Snapshot__write:List__append:arcs");
+    }
+    List__sort(arcs, (List__Compare__Routine)Arc__compare);
+    for (Unsigned index = 0; index < arcs_size; index++) {
+	Arc arc = (Arc)List__fetch(arcs, index);
+	Arc__write(arc, out_file);
+    }
+    List__free(arcs);
+
+    // Output the closing </Map> tag:
+    File__format(out_file, "</Map>\n");
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+
+#include "File.h"
+#include "Integer.h"
+#include "Logical.h"
+#include "Map.h"
+#include "String.h"
+#include "Unsigned.h"
+
+extern void Map_Convert__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree);
+extern Logical Map_Convert__is_binary(String_Const file_name);
+extern void Map_Convert__tag_announce(void *announce_object, Integer id,
+  Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count);
+
+/// @brief Converts a map file between XML and binary format.
+/// @param arguments_size is the number of arguments
+/// @param arguments is the vector of command line arguments.
+/// @returns 0 for success.
+///
+/// *main*() will read the map file named by the second argument and
+/// write it out to the file named by the third argument.  The format of
+/// each file is selected by its suffix (.xml or .bin).
+
+int main(int arguments_size, char *arguments[]) {
+    if (arguments_size != 4) {
+	File__format(stderr,
+	  "Usage: Map_Convert Tag_Heights.xml from_map.{xml,bin} "
+	  "to_map.{xml,bin}\n");
+	return 1;
+    }
+    String_Const tag_heights_file_name = arguments[1];
+    String_Const from_file_name = arguments[2];
+    String_Const to_file_name = arguments[3];
+
+    // Create a *map* that is not backed by any map file:
+    Map map = Map__create(".", (String_Const)0, (void *)0,
+      Map_Convert__arc_announce, Map_Convert__tag_announce,
+      tag_heights_file_name, "Map_Convert:main:map");
+
+    // Read in *from_file_name*:
+    if (Map_Convert__is_binary(from_file_name)) {
+	if (!Map__binary_read(map, from_file_name)) {
+	    File__format(stderr,
+	      "Could not read binary map '%s'\n", from_file_name);
+	    return 1;
+	}
+    } else {
+	File in_file = File__open(from_file_name, "r");
+	if (in_file == (File)0) {
+	    File__format(stderr, "Could not open '%s'\n", from_file_name);
+	    return 1;
+	}
+	Map__restore(map, in_file);
+	File__close(in_file);
+    }
+
+    // Write out *to_file_name*:
+    Logical is_binary = Map_Convert__is_binary(to_file_name);
+    File out_file = File__open(to_file_name, is_binary ? "wb" : "w");
+    if (out_file == (File)0) {
+	File__format(stderr, "Could not open '%s'\n", to_file_name);
+	return 1;
+    }
+    Logical written = (Logical)1;
+    if (is_binary) {
+	written = Map__binary_write(map, out_file);
+    } else {
+	Map__write(map, out_file);
+    }
+    if (ferror(out_file)) {
+	written = (Logical)0;
+    }
+    File__close(out_file);
+    if (!written) {
+	File__format(stderr, "Could not write '%s'\n", to_file_name);
+	return 1;
+    }
+
+    Map__free(map);
+    return 0;
+}
+
+/// @brief Arc announce routine that does nothing.
+///
+/// *Map_Convert__arc_announce*() keeps the conversion quiet.
+
+void Map_Convert__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree) {
+}
+
+/// @brief Returns true if *file_name* names a binary map file.
+/// @param file_name is the map file name.
+/// @returns 1 if *file_name* ends in ".bin" and 0 otherwise.
+///
+/// *Map_Convert__is_binary*() will return whether *file_name* ends
+/// in ".bin".
+
+Logical Map_Convert__is_binary(String_Const file_name) {
+    Unsigned size = String__size(file_name);
+    return (Logical)(size > 4 && String__equal(file_name + size - 4, ".bin"));
+}
+
+/// @brief Tag announce routine that does nothing.
+///
+/// *Map_Convert__tag_announce*() keeps the conversion quiet.
+
+void Map_Convert__tag_announce(void *announce_object, Integer id,
+  Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count) {
+}
@@ -1,6 +1,7 @@
 // Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
 
 #include <assert.h>
+#include <time.h>
 
 #include "Arc.h"
 #include "CV.h"
@@ -15,11 +16,41 @@
 #include "Unsigned.h"
 
 extern void Map__build(Map map);
+extern void Map_Test__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree);
+extern void Map_Test__binary_corrupt_test(String_Const tag_heights_file_name);
+extern void Map_Test__binary_test(
+  String_Const tag_heights_file_name, Unsigned arcs_size);
+extern void Map_Test__file_copy(
+  String_Const from_file_name, String_Const to_file_name);
+extern Map Map_Test__grid_map_create(String_Const tag_heights_file_name,
+  String_Const file_base, Unsigned arcs_size, Unsigned *random);
+extern void Map_Test__journal_test(String_Const tag_heights_file_name,
+  Unsigned arcs_size, Unsigned changes_size);
+extern void Map_Test__map_check(Map map1, Map map2);
+extern void Map_Test__random_changes(
+  Map map, Unsigned changes_size, Unsigned *random, Logical repair);
+extern Double Map_Test__random_distance(Unsigned *random);
+extern void Map_Test__snapshot_crash_test(String_Const tag_heights_file_name,
+  Unsigned arcs_size, Unsigned changes_size);
+extern void Map_Test__spanning_tree_repair_test(
+  String_Const tag_heights_file_name, Unsigned arcs_size,
+  Unsigned changes_size);
+extern void Map_Test__spanning_tree_benchmark(
+  String_Const tag_heights_file_name, Unsigned arcs_size,
+  Logical sort_build);
+extern void Map_Test__spanning_tree_sort_build(Map map);
+extern void Map_Test__tag_announce(void *announce_object, Integer id,
+  Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count);
 
 int main(int arguments_size, char * arguments[]) {
+    String_Const tag_heights_file_name = "Tag_Heights.xml";
     Map map1 = Map__create(".", "Map_Test_Map",
       (void *)0, Fiducials__arc_announce, Fiducials__tag_announce,
-      (String_Const)0, "main:Map__new");
+      tag_heights_file_name, "main:Map__new");
     Unsigned visit = map1->visit;
 
     Double pi = 3.14159265358979323846264;
@@ -88,16 +119,803 @@ int main(int arguments_size, char * arguments[]) {
 
     Map map2 = Map__create(".", "Map_Test_Map",
       (void *)0, Fiducials__arc_announce, Fiducials__tag_announce,
-      (String_Const)0, "main:Map__new");
+      tag_heights_file_name, "main:Map__new");
 
+    // *Map__save*() writes a sorted copy, so sort *map1* to match *map2*:
+    Map__sort(map1);
     assert (Map__compare(map1, map2) == 0);
 
     List /*<Location>*/ locations =
       List__new("Map_test:main:List__new:locations");
     Map__svg_write(map1, "Map_Test", locations);
 
+    // Time the spanning tree builder on some larger maps:
+    Map_Test__spanning_tree_benchmark(tag_heights_file_name, 1000, (Logical)1);
+    Map_Test__spanning_tree_benchmark(tag_heights_file_name, 10000, (Logical)1);
+    Map_Test__spanning_tree_benchmark(
+      tag_heights_file_name, 100000, (Logical)0);
+
+    // Make sure that the binary map format reads back exactly:
+    Map_Test__binary_test(tag_heights_file_name, 100000);
+
+    // Make sure that corrupt binary maps are rejected without harm:
+    Map_Test__binary_corrupt_test(tag_heights_file_name);
+
+    // Make sure that the map journal recovers the map exactly:
+    Map_Test__journal_test(tag_heights_file_name, 10000, 1000);
+
+    // Make sure that a stale map journal is not replayed over a snapshot:
+    Map_Test__snapshot_crash_test(tag_heights_file_name, 10000, 1000);
+
+    // Make sure that spanning tree repair matches a full rebuild:
+    Map_Test__spanning_tree_repair_test(tag_heights_file_name, 1000, 1000);
+    Map_Test__spanning_tree_repair_test(tag_heights_file_name, 100000, 1000);
+
     return 0;
 }
 
+/// @brief Arc announce routine that does nothing.
+///
+/// *Map_Test__arc_announce*() keeps the benchmark maps quiet.
+
+void Map_Test__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree) {
+}
+
+/// @brief Checks that corrupt binary maps are rejected.
+/// @param tag_heights_file_name is the tag heights .xml file.
+///
+/// *Map_Test__binary_corrupt_test*() will damage a copy of the binary map
+/// written by *Map_Test__binary_test*() with a repeated *Tag*, a *Tag*
+/// without a tag height, an *Arc* to a missing *Tag*, and a repeated
+/// *Arc*.  Each copy must be rejected without changing the *Map*, and
+/// reading the map files must fall back to the .xml file.
+
+void Map_Test__binary_corrupt_test(String_Const tag_heights_file_name) {
+    // Start from scratch:
+    String_Const file_base = "Map_Test_Corrupt";
+    (void)remove("./Map_Test_Corrupt1.bin");
+    (void)remove("./Map_Test_Corrupt1.journal");
+    (void)remove("./Map_Test_Corrupt1.xml");
+
+    // Find out how big the binary map is:
+    File in_file = File__open("Map_Test_Binary.bin", "rb");
+    assert (in_file != (File)0);
+    Integer seek_result = fseek(in_file, 0L, SEEK_END);
+    assert (seek_result == 0);
+    Unsigned size = (Unsigned)ftell(in_file);
+    Unsigned header_size = sizeof(struct Map_Binary_Header__Struct);
+    Unsigned tag_size = sizeof(struct Map_Binary_Tag__Struct);
+    assert (size > header_size);
+    char *image = (char *)Memory__allocate(size, "Map_Test:image");
+
+    // Damage a fresh copy of the binary map in each of 4 ways:
+    Unsigned corruptions_size = 4;
+    for (Unsigned corruption = 0; corruption < corruptions_size;
+      corruption++) {
+	rewind(in_file);
+	size_t read_size = fread((void *)image, (size_t)size, 1, in_file);
+	assert (read_size == 1);
+	Map_Binary_Header header = (Map_Binary_Header)image;
+	Map_Binary_Tag binary_tags = (Map_Binary_Tag)(image + header_size);
+	Map_Binary_Arc binary_arcs = (Map_Binary_Arc)
+	  (image + header_size + header->tags_size * tag_size);
+	switch (corruption) {
+	  case 0:
+	    // A repeated *Tag*:
+	    binary_tags[1].id = binary_tags[0].id;
+	    break;
+	  case 1:
+	    // A *Tag* without a tag height:
+	    binary_tags[0].id = 200000;
+	    break;
+	  case 2:
+	    // An *Arc* to a *Tag* that is not in the map:
+	    binary_arcs[0].to_tag_id = 200000;
+	    break;
+	  case 3:
+	    // A repeated *Arc*:
+	    binary_arcs[1] = binary_arcs[0];
+	    break;
+	  default:
+	    assert (0);
+	    break;
+	}
+	Map map = Map__create(".", (String_Const)0, (void *)0,
+	  Map_Test__arc_announce, Map_Test__tag_announce,
+	  tag_heights_file_name, "Map_Test__binary_corrupt_test:map");
+	Logical restored = Map__binary_restore(map, (Memory)image, size);
+	assert (!restored);
+	assert (List__size(map->all_tags) == 0);
+	assert (List__size(map->all_arcs) == 0);
+	Map__free(map);
+    }
+    File__close(in_file);
+
+    // Put the last damaged copy next to a good .xml file; the .xml file
+    // must be read instead:
+    Map_Test__file_copy("./Map_Test_Binary.xml", "./Map_Test_Corrupt1.xml");
+    File out_file = File__open("./Map_Test_Corrupt1.bin", "wb");
+    assert (out_file != (File)0);
+    size_t write_size = fwrite((void *)image, (size_t)size, 1, out_file);
+    assert (write_size == 1);
+    File__close(out_file);
+    Map map = Map__create(".", file_base, (void *)0,
+      Map_Test__arc_announce, Map_Test__tag_announce,
+      tag_heights_file_name, "Map_Test__binary_corrupt_test:map");
+    Map_Binary_Header header = (Map_Binary_Header)image;
+    assert (List__size(map->all_tags) == header->tags_size);
+    assert (List__size(map->all_arcs) == header->arcs_size);
+
+    File__format(stdout, "Map corrupt: corruptions=%d tags=%d arcs=%d\n",
+      corruptions_size, List__size(map->all_tags), List__size(map->all_arcs));
+
+    // Do not write the map out again:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+    Memory__free((Memory)image);
+}
+
+/// @brief Checks the binary map format against the XML map format.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+///
+/// *Map_Test__binary_test*() will write a grid shaped map with about
+/// *arcs_size* *Arc*'s out in both XML and binary format, and time
+/// reading each back in.  The binary copy must match bit for bit.
+
+void Map_Test__binary_test(
+  String_Const tag_heights_file_name, Unsigned arcs_size) {
+    Unsigned random = 24680;
+    Map map = Map_Test__grid_map_create(
+      tag_heights_file_name, "Map_Test_Benchmark", arcs_size, &random);
+    Map__spanning_tree_build(map, (CV_Image)0, 0);
+
+    // Write *map* out in both formats:
+    File out_file = File__open("Map_Test_Binary.xml", "w");
+    assert (out_file != (File)0);
+    Map__write(map, out_file);
+    File__close(out_file);
+    out_file = File__open("Map_Test_Binary.bin", "wb");
+    assert (out_file != (File)0);
+    Logical written = Map__binary_write(map, out_file);
+    assert (written);
+    File__close(out_file);
+
+    // Time reading the XML format back in:
+    Map xml_map = Map__create(".", (String_Const)0, (void *)0,
+      Map_Test__arc_announce, Map_Test__tag_announce,
+      tag_heights_file_name, "Map_Test__binary_test:xml_map");
+    clock_t start_clock = clock();
+    File in_file = File__open("Map_Test_Binary.xml", "r");
+    assert (in_file != (File)0);
+    Map__restore(xml_map, in_file);
+    File__close(in_file);
+    Double xml_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+
+    // Time reading the binary format back in:
+    Map binary_map = Map__create(".", (String_Const)0, (void *)0,
+      Map_Test__arc_announce, Map_Test__tag_announce,
+      tag_heights_file_name, "Map_Test__binary_test:binary_map");
+    start_clock = clock();
+    Logical binary_read = Map__binary_read(binary_map, "Map_Test_Binary.bin");
+    Double binary_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+
+    // Both must have the same *Tag*'s and *Arc*'s, and the binary copy
+    // must be exact:
+    assert (binary_read);
+    assert (Map__compare(map, xml_map) == 0);
+    assert (Map__compare(map, binary_map) == 0);
+    List /* <Tag> */ all_tags = map->all_tags;
+    List /* <Tag> */ binary_tags = binary_map->all_tags;
+    Unsigned all_tags_size = List__size(all_tags);
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	Tag tag = (Tag)List__fetch(all_tags, index);
+	Tag binary_tag = (Tag)List__fetch(binary_tags, index);
+	assert (Double__compare(tag->x, binary_tag->x) == 0);
+	assert (Double__compare(tag->y, binary_tag->y) == 0);
+	assert (Double__compare(tag->twist, binary_tag->twist) == 0);
+	assert (tag->hop_count == binary_tag->hop_count);
+    }
+    List /* <Arc> */ all_arcs = map->all_arcs;
+    List /* <Arc> */ binary_arcs = binary_map->all_arcs;
+    Unsigned all_arcs_size = List__size(all_arcs);
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	Arc arc = (Arc)List__fetch(all_arcs, index);
+	Arc binary_arc = (Arc)List__fetch(binary_arcs, index);
+	assert (Double__compare(arc->distance, binary_arc->distance) == 0);
+	assert (arc->in_tree == binary_arc->in_tree);
+    }
+
+    File__format(stdout, "Map read: tags=%d arcs=%d xml=%.4fs bin=%.4fs\n",
+      all_tags_size, all_arcs_size, xml_seconds, binary_seconds);
+
+    // Do not write any of the maps out:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+    Map__free(xml_map);
+    Map__free(binary_map);
+}
+
+/// @brief Copies *from_file_name* to *to_file_name*.
+/// @param from_file_name is the file to copy.
+/// @param to_file_name is the file to create or replace.
+///
+/// *Map_Test__file_copy*() will replace *to_file_name* with a byte for
+/// byte copy of *from_file_name*.
+
+void Map_Test__file_copy(
+  String_Const from_file_name, String_Const to_file_name) {
+    File in_file = File__open(from_file_name, "rb");
+    assert (in_file != (File)0);
+    File out_file = File__open(to_file_name, "wb");
+    assert (out_file != (File)0);
+    char buffer[4096];
+    while (1) {
+	size_t size = fread(buffer, 1, sizeof(buffer), in_file);
+	if (size == 0) {
+	    break;
+	}
+	size_t written_size = fwrite(buffer, 1, size, out_file);
+	assert (written_size == size);
+    }
+    assert (!ferror(in_file) && !ferror(out_file));
+    File__close(in_file);
+    File__close(out_file);
+}
+
+/// @brief Returns a grid shaped *Map* with about *arcs_size* *Arc*'s.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param file_base is the base name of the map file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+/// @param random is the pseudo random number state.
+/// @returns the new *Map*.
+///
+/// *Map_Test__grid_map_create*() will create a *Map* where each *Tag* in
+/// a square grid gets an *Arc* of pseudo random length to its right and
+/// upper neighbors, which is about two *Arc*'s per *Tag*.
+
+Map Map_Test__grid_map_create(String_Const tag_heights_file_name,
+  String_Const file_base, Unsigned arcs_size, Unsigned *random) {
+    Map map = Map__create(".", file_base, (void *)0,
+      Map_Test__arc_announce, Map_Test__tag_announce,
+      tag_heights_file_name, "Map_Test__grid_map_create:map");
+
+    Unsigned tags_size = arcs_size / 2;
+    Unsigned columns = 1;
+    while (columns * columns < tags_size) {
+	columns += 1;
+    }
+    for (Unsigned id = 0; id < tags_size; id++) {
+	Tag tag = Map__tag_lookup(map, id);
+	Tag__initialize(tag, 0.0, 0.0, 0.0, 1.0, map->visit);
+    }
+    for (Unsigned id = 0; id < tags_size; id++) {
+	Tag tag = Map__tag_lookup(map, id);
+	if ((id + 1) % columns != 0 && id + 1 < tags_size) {
+	    Arc__create(tag, 0.0, Map_Test__random_distance(random),
+	      Map__tag_lookup(map, id + 1), 0.0, 0.0);
+	}
+	if (id + columns < tags_size) {
+	    Arc__create(tag, 0.0, Map_Test__random_distance(random),
+	      Map__tag_lookup(map, id + columns), 0.0, 0.0);
+	}
+    }
+    return map;
+}
+
+/// @brief Checks that the map journal recovers the map exactly.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+/// @param changes_size is the number of *Arc* changes to make.
+///
+/// *Map_Test__journal_test*() will save a grid shaped map with about
+/// *arcs_size* *Arc*'s, make *changes_size* random *Arc* changes, and
+/// save again, which should only append to the map journal.  A partial
+/// record is tacked onto the end of the journal to mimic a crash in the
+/// middle of an append.  Reading the map back in must then give the
+/// same *Arc*'s, spanning tree, and *Tag* locations.
+
+void Map_Test__journal_test(String_Const tag_heights_file_name,
+  Unsigned arcs_size, Unsigned changes_size) {
+    // Start from scratch:
+    String_Const file_base = "Map_Test_Journal";
+    (void)remove("./Map_Test_Journal1.bin");
+    (void)remove("./Map_Test_Journal1.journal");
+    (void)remove("./Map_Test_Journal1.xml");
+
+    // The first save has to be a complete snapshot:
+    Unsigned random = 13579;
+    Map map = Map_Test__grid_map_create(
+      tag_heights_file_name, file_base, arcs_size, &random);
+    Map__update(map, (CV_Image)0, 0);
+    Map__save(map);
+    assert (map->journal_size == 0);
+
+    // Make *changes_size* changes:
+    Map_Test__random_changes(map, changes_size, &random, (Logical)0);
+
+    // The second save should only append to the journal:
+    Map__save(map);
+    Unsigned journal_size = map->journal_size;
+    assert (journal_size != 0);
+
+    // Mimic a crash part of the way through appending a record:
+    File out_file = File__open("./Map_Test_Journal1.journal", "ab");
+    assert (out_file != (File)0);
+    File__format(out_file, "torn");
+    File__close(out_file);
+
+    // Read the map back in:
+    Map journal_map = Map__create(".", file_base, (void *)0,
+      Map_Test__arc_announce, Map_Test__tag_announce,
+      tag_heights_file_name, "Map_Test__journal_test:journal_map");
+    assert (journal_map->journal_size == journal_size);
+    Map_Test__map_check(map, journal_map);
+
+    File__format(stdout,
+      "Map journal: tags=%d arcs=%d changes=%d records=%d\n",
+      List__size(map->all_tags), List__size(map->all_arcs),
+      changes_size, journal_size);
+
+    // Do not write either map out again:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+    journal_map->is_saved = (Logical)1;
+    Map__free(journal_map);
+}
+
+/// @brief Checks that *map2* matches *map1* exactly.
+/// @param map1 is the first *Map* to check.
+/// @param map2 is the second *Map* to check.
+///
+/// *Map_Test__map_check*() will sort *map1* and *map2* and make sure
+/// that they have the same *Arc*'s, spanning tree, and *Tag* locations.
+
+void Map_Test__map_check(Map map1, Map map2) {
+    Map__sort(map1);
+    Map__sort(map2);
+    assert (Map__compare(map1, map2) == 0);
+    List /* <Arc> */ all_arcs1 = map1->all_arcs;
+    List /* <Arc> */ all_arcs2 = map2->all_arcs;
+    Unsigned all_arcs_size = List__size(all_arcs1);
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	Arc arc1 = (Arc)List__fetch(all_arcs1, index);
+	Arc arc2 = (Arc)List__fetch(all_arcs2, index);
+	assert (Double__compare(arc1->distance, arc2->distance) == 0);
+	assert (Double__compare(arc1->from_twist, arc2->from_twist) == 0);
+	assert (Double__compare(arc1->to_twist, arc2->to_twist) == 0);
+	assert (arc1->in_tree == arc2->in_tree);
+    }
+    List /* <Tag> */ all_tags1 = map1->all_tags;
+    List /* <Tag> */ all_tags2 = map2->all_tags;
+    Unsigned all_tags_size = List__size(all_tags1);
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	Tag tag1 = (Tag)List__fetch(all_tags1, index);
+	Tag tag2 = (Tag)List__fetch(all_tags2, index);
+	assert (Double__compare(tag1->x, tag2->x) == 0);
+	assert (Double__compare(tag1->y, tag2->y) == 0);
+	assert (Double__compare(tag1->twist, tag2->twist) == 0);
+	assert (tag1->hop_count == tag2->hop_count);
+    }
+}
+
+/// @brief Makes *changes_size* pseudo random *Arc* changes to *map*.
+/// @param map to change.
+/// @param changes_size is the number of *Arc* changes to make.
+/// @param random is the pseudo random number state.
+/// @param repair is 1 to only repair the spanning tree after each change.
+///
+/// *Map_Test__random_changes*() will change *changes_size* pseudo random
+/// *Arc*'s of *map* and update *map* after each one.  Every fourth change
+/// adds a new *Arc* rather than changing an existing one.  When *repair*
+/// is set, *Map__spanning_tree_update*() is called after each change
+/// instead of *Map__update*().
+
+void Map_Test__random_changes(
+  Map map, Unsigned changes_size, Unsigned *random, Logical repair) {
+    List /* <Arc> */ all_arcs = map->all_arcs;
+    List /* <Tag> */ all_tags = map->all_tags;
+    for (Unsigned index = 0; index < changes_size; index++) {
+	*random = *random * 1103515245 + 12345;
+	Arc arc = (Arc)0;
+	if ((index & 3) == 3) {
+	    Tag from_tag = (Tag)List__fetch(all_tags,
+	      (*random >> 8) % List__size(all_tags));
+	    *random = *random * 1103515245 + 12345;
+	    Tag to_tag = (Tag)List__fetch(all_tags,
+	      (*random >> 8) % List__size(all_tags));
+	    if (from_tag != to_tag) {
+		arc = Map__arc_lookup(map, from_tag, to_tag);
+	    }
+	} else {
+	    arc = (Arc)List__fetch(all_arcs,
+	      (*random >> 8) % List__size(all_arcs));
+	}
+	if (arc != (Arc)0) {
+	    Double from_twist = Map_Test__random_distance(random) - 10.0;
+	    Double distance = Map_Test__random_distance(random);
+	    Double to_twist = Map_Test__random_distance(random) - 10.0;
+	    Arc__update(arc, from_twist, distance, to_twist, 0.0);
+	    Map__arc_changed(map, arc);
+	    if (repair) {
+		Map__spanning_tree_update(map, (CV_Image)0, 0);
+	    } else {
+		Map__update(map, (CV_Image)0, 0);
+	    }
+	}
+    }
+}
+
+/// @brief Returns a pseudo random distance between 10 and 11.
+/// @param random is the pseudo random number state.
+/// @returns the pseudo random distance.
+///
+/// *Map_Test__random_distance*() will advance *random* and return a
+/// pseudo random distance between 10 and 11.
+
+Double Map_Test__random_distance(Unsigned *random) {
+    *random = *random * 1103515245 + 12345;
+    return 10.0 + (Double)(*random >> 8) / 16777216.0;
+}
+
+/// @brief Checks that a crash while saving a snapshot loses nothing.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+/// @param changes_size is the number of *Arc* changes to make each round.
+///
+/// *Map_Test__snapshot_crash_test*() will save a grid shaped map with
+/// about *arcs_size* *Arc*'s, append *changes_size* random *Arc* changes
+/// to the map journal, and then make *changes_size* more changes and save
+/// a complete snapshot.  Putting the old journal back mimics a crash
+/// after the new map files were renamed into place but before the
+/// journal was emptied.  Reading the map back in (first from the .bin
+/// file and then from the .xml file) must skip the old journal and give
+/// back the map exactly.
+
+void Map_Test__snapshot_crash_test(String_Const tag_heights_file_name,
+  Unsigned arcs_size, Unsigned changes_size) {
+    // Start from scratch:
+    String_Const file_base = "Map_Test_Crash";
+    (void)remove("./Map_Test_Crash1.bin");
+    (void)remove("./Map_Test_Crash1.journal");
+    (void)remove("./Map_Test_Crash1.xml");
+
+    // Save a snapshot followed by a journal batch:
+    Unsigned random = 97531;
+    Map map = Map_Test__grid_map_create(
+      tag_heights_file_name, file_base, arcs_size, &random);
+    Map__update(map, (CV_Image)0, 0);
+    Map__save(map);
+    Map_Test__random_changes(map, changes_size, &random, (Logical)0);
+    Map__save(map);
+    Unsigned journal_size = map->journal_size;
+    assert (journal_size != 0);
+    Map_Test__file_copy(
+      "./Map_Test_Crash1.journal", "./Map_Test_Crash1.journal.old");
+
+    // Change many of the same *Arc*'s again and save a complete snapshot:
+    Map_Test__random_changes(map, changes_size, &random, (Logical)0);
+    map->save_journal = (Logical)0;
+    Map__save(map);
+    assert (map->journal_size == 0);
+
+    // Mimic a crash before the journal was emptied and read the map back
+    // in, first from the .bin file and then from the .xml file:
+    for (Unsigned index = 0; index < 2; index++) {
+	Map reference_map = map;
+	if (index == 1) {
+	    // The .xml file rounds, so compare against a plain read of it:
+	    (void)remove("./Map_Test_Crash1.bin");
+	    (void)remove("./Map_Test_Crash1.journal");
+	    reference_map = Map__create(".", file_base, (void *)0,
+	      Map_Test__arc_announce, Map_Test__tag_announce,
+	      tag_heights_file_name,
+	      "Map_Test__snapshot_crash_test:reference_map");
+	}
+	Map_Test__file_copy(
+	  "./Map_Test_Crash1.journal.old", "./Map_Test_Crash1.journal");
+	Map crash_map = Map__create(".", file_base, (void *)0,
+	  Map_Test__arc_announce, Map_Test__tag_announce,
+	  tag_heights_file_name, "Map_Test__snapshot_crash_test:crash_map");
+	assert (crash_map->journal_size == 0);
+	assert (crash_map->snapshot_generation == map->snapshot_generation);
+	Map_Test__map_check(reference_map, crash_map);
+	crash_map->is_saved = (Logical)1;
+	Map__free(crash_map);
+	if (reference_map != map) {
+	    reference_map->is_saved = (Logical)1;
+	    Map__free(reference_map);
+	}
+    }
+    (void)remove("./Map_Test_Crash1.journal.old");
+
+    File__format(stdout,
+      "Map snapshot crash: tags=%d arcs=%d changes=%d skipped=%d\n",
+      List__size(map->all_tags), List__size(map->all_arcs),
+      changes_size, journal_size);
+
+    // Do not write the map out again:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+}
+
+/// @brief Times the spanning tree builders on a map with *arcs_size* *Arc*'s.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+/// @param sort_build is true if the reference builder is timed as well.
+///
+/// *Map_Test__spanning_tree_benchmark*() will build a grid shaped map
+/// with about *arcs_size* *Arc*'s of pseudo random length and time
+/// *Map__spanning_tree_build*() on it.  The spanning tree must reach
+/// every *Tag* and use one *Arc* per *Tag* other than the origin.  When
+/// *sort_build* is true, *Map_Test__spanning_tree_sort_build*() is timed
+/// first and the two resulting trees must be identical.
+
+void Map_Test__spanning_tree_benchmark(
+  String_Const tag_heights_file_name, Unsigned arcs_size,
+  Logical sort_build) {
+    Unsigned random = 12345;
+    Map map = Map_Test__grid_map_create(
+      tag_heights_file_name, "Map_Test_Benchmark", arcs_size, &random);
+    List /* <Arc> */ all_arcs = map->all_arcs;
+    List /* <Tag> */ all_tags = map->all_tags;
+    Unsigned all_arcs_size = List__size(all_arcs);
+    Unsigned all_tags_size = List__size(all_tags);
+
+    // Time the reference builder and remember what it produced; it is
+    // skipped for the really big maps because it takes minutes:
+    Double sort_seconds = 0.0;
+    Logical *in_trees = (Logical *)0;
+    Double *xs = (Double *)0;
+    Double *ys = (Double *)0;
+    if (sort_build) {
+	clock_t start_clock = clock();
+	Map_Test__spanning_tree_sort_build(map);
+	sort_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+	in_trees = (Logical *)Memory__allocate(
+	  all_arcs_size * sizeof(Logical), "Map_Test:in_trees");
+	for (Unsigned index = 0; index < all_arcs_size; index++) {
+	    in_trees[index] = ((Arc)List__fetch(all_arcs, index))->in_tree;
+	}
+	xs = (Double *)Memory__allocate(
+	  all_tags_size * sizeof(Double), "Map_Test:xs");
+	ys = (Double *)Memory__allocate(
+	  all_tags_size * sizeof(Double), "Map_Test:ys");
+	for (Unsigned index = 0; index < all_tags_size; index++) {
+	    Tag tag = (Tag)List__fetch(all_tags, index);
+	    xs[index] = tag->x;
+	    ys[index] = tag->y;
+	}
+    }
+
+    // Time the heap builder:
+    clock_t start_clock = clock();
+    Map__spanning_tree_build(map, (CV_Image)0, 0);
+    Double heap_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+
+    // Make sure that the tree spans *map*:
+    assert (!map->tree_rebuild);
+    Unsigned tree_arcs_size = 0;
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	if (((Arc)List__fetch(all_arcs, index))->in_tree) {
+	    tree_arcs_size += 1;
+	}
+    }
+    assert (tree_arcs_size + 1 == all_tags_size);
+
+    // Make sure that both builders agree:
+    if (sort_build) {
+	for (Unsigned index = 0; index < all_arcs_size; index++) {
+	    Arc arc = (Arc)List__fetch(all_arcs, index);
+	    assert (arc->in_tree == in_trees[index]);
+	}
+	for (Unsigned index = 0; index < all_tags_size; index++) {
+	    Tag tag = (Tag)List__fetch(all_tags, index);
+	    assert (Double__compare(tag->x, xs[index]) == 0);
+	    assert (Double__compare(tag->y, ys[index]) == 0);
+	}
+	Memory__free((Memory)in_trees);
+	Memory__free((Memory)xs);
+	Memory__free((Memory)ys);
+	File__format(stdout, "Spanning tree: tags=%d arcs=%d sort=%.4fs\n",
+	  all_tags_size, all_arcs_size, sort_seconds);
+    }
+    File__format(stdout, "Spanning tree: tags=%d arcs=%d heap=%.4fs\n",
+      all_tags_size, all_arcs_size, heap_seconds);
+
+    // Do not write the benchmark map out:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+}
+
+/// @brief Checks spanning tree repair against a full rebuild.
+/// @param tag_heights_file_name is the tag heights .xml file.
+/// @param arcs_size is the approximate number of *Arc*'s to create.
+/// @param changes_size is the number of *Arc* changes to make.
+///
+/// *Map_Test__spanning_tree_repair_test*() will build a grid shaped map
+/// with about *arcs_size* *Arc*'s, and then make *changes_size* random
+/// *Arc* changes, repairing the spanning tree after each one.  Every
+/// fourth change adds a new *Arc* rather than changing an existing one.
+/// Afterwards, the tree is rebuilt from scratch and must be identical.
+
+void Map_Test__spanning_tree_repair_test(String_Const tag_heights_file_name,
+  Unsigned arcs_size, Unsigned changes_size) {
+    Unsigned random = 54321;
+    Map map = Map_Test__grid_map_create(
+      tag_heights_file_name, "Map_Test_Benchmark", arcs_size, &random);
+    Map__spanning_tree_update(map, (CV_Image)0, 0);
+    assert (!map->tree_rebuild);
+
+    // Make *changes_size* changes and repair after each one:
+    List /* <Arc> */ all_arcs = map->all_arcs;
+    List /* <Tag> */ all_tags = map->all_tags;
+    clock_t start_clock = clock();
+    Map_Test__random_changes(map, changes_size, &random, (Logical)1);
+    Double repair_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+
+    // Remember what the repairs produced:
+    Unsigned all_arcs_size = List__size(all_arcs);
+    Unsigned all_tags_size = List__size(all_tags);
+    Logical *in_trees = (Logical *)Memory__allocate(
+      all_arcs_size * sizeof(Logical), "Map_Test:in_trees");
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	in_trees[index] = ((Arc)List__fetch(all_arcs, index))->in_tree;
+    }
+    Double *xs = (Double *)Memory__allocate(
+      all_tags_size * sizeof(Double), "Map_Test:xs");
+    Double *ys = (Double *)Memory__allocate(
+      all_tags_size * sizeof(Double), "Map_Test:ys");
+    Unsigned *hop_counts = (Unsigned *)Memory__allocate(
+      all_tags_size * sizeof(Unsigned), "Map_Test:hop_counts");
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	Tag tag = (Tag)List__fetch(all_tags, index);
+	xs[index] = tag->x;
+	ys[index] = tag->y;
+	hop_counts[index] = tag->hop_count;
+    }
+
+    // Rebuild from scratch and make sure nothing changes:
+    start_clock = clock();
+    Map__spanning_tree_build(map, (CV_Image)0, 0);
+    Double build_seconds = (Double)(clock() - start_clock) / CLOCKS_PER_SEC;
+    for (Unsigned index = 0; index < all_arcs_size; index++) {
+	Arc arc = (Arc)List__fetch(all_arcs, index);
+	assert (arc->in_tree == in_trees[index]);
+    }
+    for (Unsigned index = 0; index < all_tags_size; index++) {
+	Tag tag = (Tag)List__fetch(all_tags, index);
+	assert (Double__compare(tag->x, xs[index]) == 0);
+	assert (Double__compare(tag->y, ys[index]) == 0);
+	assert (tag->hop_count == hop_counts[index]);
+    }
+
+    File__format(stdout,
+      "Spanning tree: tags=%d arcs=%d repairs=%d repair=%.4fs build=%.4fs\n",
+      all_tags_size, all_arcs_size, changes_size,
+      repair_seconds, build_seconds);
+
+    Memory__free((Memory)in_trees);
+    Memory__free((Memory)xs);
+    Memory__free((Memory)ys);
+    Memory__free((Memory)hop_counts);
+
+    // Do not write the test map out:
+    map->is_saved = (Logical)1;
+    Map__free(map);
+}
+
+/// @brief Tag announce routine that does nothing.
+///
+/// *Map_Test__tag_announce*() keeps the benchmark maps quiet.
+
+void Map_Test__tag_announce(void *announce_object, Integer id,
+  Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count) {
+}
+
 void Map__build(Map map) {
 }
+
+/// @brief Builds the *map* spanning tree by repeated sorting.
+/// @param map to build the spanning tree for.
+///
+/// *Map_Test__spanning_tree_sort_build*() will build the same spanning
+/// tree as *Map__spanning_tree_build*(), but it resorts the pending
+/// *Arc*'s after every *Tag* that is added, which takes O(E^2 log E)
+/// time.  It is the reference that the heap builder is checked and
+/// timed against.
+
+void Map_Test__spanning_tree_sort_build(Map map) {
+    // Increment *visit* to the next value to use for updating:
+    Unsigned visit = map->visit + 1;
+    map->visit = visit;
+
+    // We want the tag with the lowest id number to be the origin.
+    // Sort *tags* from lowest tag id to greatest:
+    List /* <Tag> */ all_tags = map->all_tags;
+    List__sort(all_tags, (List__Compare__Routine)Tag__compare);
+
+    // The first tag in {tags} has the lowest id and is forced to be the
+    // map origin:
+    Tag origin_tag = (Tag)List__fetch(all_tags, 0);
+    origin_tag->visit = visit;
+    origin_tag->hop_count = 0;
+    origin_tag->parent_arc = (Arc)0;
+    Unsigned tree_tags_size = 1;
+
+    // Initialize *pending_arcs* with the *Arc*'s from *orgin_tag*:
+    List /* <Arc> */ pending_arcs =
+      List__new("Map_Test__spanning_tree_sort_build:pending_arcs");
+    List__all_append(pending_arcs, origin_tag->arcs);
+
+    // We always want to keep *pending_arcs* sorted from longest to
+    // shortest at the end.  *Arc__distance_compare*() sorts longest first:
+    List__sort(pending_arcs, (List__Compare__Routine)Arc__distance_compare);
+
+    // We keep iterating across *pending_arcs* until it goes empty.
+    // since we keep it sorted from longest to shortest (and we always
+    // look at the end), we are building a spanning tree using the shortest
+    // possible *Arc*'s:
+    while (List__size(pending_arcs) != 0) {
+	// Pop the shortest *arc* off the end of *pending_arcs*:
+	Arc arc = (Arc)List__pop(pending_arcs);
+
+	// If we already visited *arc*, just ignore it:
+	if (arc->visit != visit) {
+	    // We have not visited this *arc* in this cycle, so now we
+	    // mark it as being *visit*'ed:
+	    arc->visit = visit;
+
+	    // Figure out if *origin* or *target* have been added to the
+	    // spanning tree yet:
+	    Tag from_tag = arc->from_tag;
+	    Tag to_tag = arc->to_tag;
+	    Logical from_is_new = (Logical)(from_tag->visit != visit);
+	    Logical to_is_new = (Logical)(to_tag->visit != visit);
+
+	    if (from_is_new || to_is_new) {
+		if (from_is_new) {
+		    // Add *to* to spanning tree:
+		    assert (!to_is_new);
+		    from_tag->hop_count = to_tag->hop_count + 1;
+		    from_tag->parent_arc = arc;
+		    List__all_append(pending_arcs, from_tag->arcs);
+		    from_tag->visit = visit;
+		    (void)Tag__update_via_arc(from_tag,
+		      arc, (CV_Image)0, 0);
+		} else {
+		    // Add *from* to spanning tree:
+		    assert (!from_is_new);
+		    to_tag->hop_count = from_tag->hop_count + 1;
+		    to_tag->parent_arc = arc;
+		    List__all_append(pending_arcs, to_tag->arcs);
+		    to_tag->visit = visit;
+		    (void)Tag__update_via_arc(to_tag,
+		      arc, (CV_Image)0, 0);
+		}
+
+		// Mark that *arc* is part of the spanning tree:
+		Map__arc_in_tree_set(map, arc, (Logical)1);
+		tree_tags_size += 1;
+
+		// Resort *pending_arcs* to that the shortest distance
+		// sorts to the end:
+		List__sort(pending_arcs,
+		  (List__Compare__Routine)Arc__distance_compare);
+	    } else {
+		// *arc* connects across two nodes of spanning tree:
+		Map__arc_in_tree_set(map, arc, (Logical)0);
+	    }
+	}
+    }
+    List__free(pending_arcs);
+
+    // The spanning tree can only be repaired later on if it reached
+    // every *Tag*:
+    map->tree_rebuild = (Logical)(tree_tags_size != List__size(all_tags));
+    List__trim(map->changed_arcs, 0);
+}
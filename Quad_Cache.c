@@ -0,0 +1,165 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <math.h>
+
+#include "CV.h"
+#include "Double.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Quad_Cache.h"
+#include "Unsigned.h"
+
+/// @brief Forget every entry in *quad_cache*.
+/// @param quad_cache is the *Quad_Cache* to clear.
+///
+/// *Quad_Cache__clear*() will empty every slot of *quad_cache*.
+
+void Quad_Cache__clear(Quad_Cache quad_cache) {
+    for (Unsigned index = 0; index < QUAD_CACHE_SLOTS; index++) {
+	quad_cache->expires[index] = 0;
+	quad_cache->keys[index] = 0;
+    }
+}
+
+/// @brief Return a new empty *Quad_Cache* object.
+/// @returns a new empty *Quad_Cache* object.
+///
+/// *Quad_Cache__create*() will create and return a new empty *Quad_Cache*
+/// object.
+
+Quad_Cache Quad_Cache__create(void) {
+    Quad_Cache quad_cache = Memory__new(Quad_Cache, "Quad_Cache__create");
+    Quad_Cache__clear(quad_cache);
+    quad_cache->last_bearing = 0.0;
+    quad_cache->last_located = (Logical)0;
+    quad_cache->last_x = 0.0;
+    quad_cache->last_y = 0.0;
+    return quad_cache;
+}
+
+/// @brief Release the storage associated with *quad_cache*.
+/// @param quad_cache is the *Quad_Cache* object to release.
+///
+/// *Quad_Cache__free*() will release the storage associated with
+/// *quad_cache*.
+
+void Quad_Cache__free(Quad_Cache quad_cache) {
+    Memory__free((Memory)quad_cache);
+}
+
+/// @brief Remember that the candidate with *key* is not a tag.
+/// @param quad_cache is the *Quad_Cache* to insert into.
+/// @param key is the candidate key from *Quad_Cache__key*().
+/// @param frame is the current frame number.
+///
+/// *Quad_Cache__insert*() will remember *key* in *quad_cache* for the
+/// *QUAD_CACHE_FRAMES* frames after *frame*, replacing whatever was in
+/// its slot.
+
+void Quad_Cache__insert(Quad_Cache quad_cache, Unsigned key, Unsigned frame) {
+    Unsigned slot = Quad_Cache__slot(key);
+    quad_cache->expires[slot] = frame + QUAD_CACHE_FRAMES + 1;
+    quad_cache->keys[slot] = key;
+}
+
+/// @brief Return the cache key for the candidate with *corners*.
+/// @param corners are the 4 rough full resolution candidate corners.
+/// @returns the cache key for *corners*.
+///
+/// *Quad_Cache__key*() will return a key that packs the center and the
+/// average diagonal of the quadrilateral *corners* quantized to
+/// *QUAD_CACHE_QUANTUM* pixels.
+
+Unsigned Quad_Cache__key(CV_Point2D32F_Vector corners) {
+    Double xs[4];
+    Double ys[4];
+    for (Unsigned index = 0; index < 4; index++) {
+	CV_Point2D32F corner = CV_Point2D32F_Vector__fetch1(corners, index);
+	xs[index] = CV_Point2D32F__x_get(corner);
+	ys[index] = CV_Point2D32F__y_get(corner);
+    }
+    Double center_x = (xs[0] + xs[1] + xs[2] + xs[3]) / 4.0;
+    Double center_y = (ys[0] + ys[1] + ys[2] + ys[3]) / 4.0;
+    Double diagonal02 = hypot(xs[2] - xs[0], ys[2] - ys[0]);
+    Double diagonal13 = hypot(xs[3] - xs[1], ys[3] - ys[1]);
+    Double diagonal = (diagonal02 + diagonal13) / 2.0;
+
+    // 11 bits of X, 11 bits of Y and 10 bits of diagonal:
+    Unsigned quantum_x = (Unsigned)(center_x / QUAD_CACHE_QUANTUM) & 0x7ff;
+    Unsigned quantum_y = (Unsigned)(center_y / QUAD_CACHE_QUANTUM) & 0x7ff;
+    Unsigned quantum_diagonal =
+      (Unsigned)(diagonal / QUAD_CACHE_QUANTUM) & 0x3ff;
+    return (quantum_x << 21) | (quantum_y << 10) | quantum_diagonal;
+}
+
+/// @brief Return whether the candidate with *key* recently failed.
+/// @param quad_cache is the *Quad_Cache* to look in.
+/// @param key is the candidate key from *Quad_Cache__key*().
+/// @param frame is the current frame number.
+/// @returns (*Logical*)1 if *key* is a known non-tag.
+///
+/// *Quad_Cache__lookup*() will return (*Logical*)1 if *key* was inserted
+/// into *quad_cache* during the *QUAD_CACHE_FRAMES* frames before *frame*
+/// and (*Logical*)0 otherwise.
+
+Logical Quad_Cache__lookup(
+  Quad_Cache quad_cache, Unsigned key, Unsigned frame) {
+    Unsigned slot = Quad_Cache__slot(key);
+    return (Logical)(quad_cache->keys[slot] == key &&
+      frame < quad_cache->expires[slot]);
+}
+
+/// @brief Clear *quad_cache* if the camera moved.
+/// @param quad_cache is the *Quad_Cache* to update.
+/// @param located is (*Logical*)1 if the current frame has a location.
+/// @param x is the X coordinate of the current location.
+/// @param y is the Y coordinate of the current location.
+/// @param bearing is the bearing of the current location in radians.
+/// @param distance_per_pixel is the floor distance covered by a pixel.
+/// @param radius is the distance in pixels from the image center to a
+/// corner of the image.
+///
+/// *Quad_Cache__motion_update*() is called at the end of each frame.  It
+/// estimates how far (in pixels) the image moved from the previous
+/// location to the current one, counting a rotation as moving the image
+/// corners by *radius* times the change in bearing.  If this is more
+/// than half of *QUAD_CACHE_QUANTUM* the cached candidates are in the
+/// wrong place in the next frame, so *quad_cache* is cleared.  Since
+/// there is no way to estimate the motion without a location in both
+/// frames, *quad_cache* is also cleared when either frame has none.
+
+void Quad_Cache__motion_update(Quad_Cache quad_cache,
+  Logical located, Double x, Double y, Double bearing,
+  Double distance_per_pixel, Double radius) {
+    Logical moved = (Logical)1;
+    if (located && quad_cache->last_located && distance_per_pixel > 0.0) {
+	Double dx = x - quad_cache->last_x;
+	Double dy = y - quad_cache->last_y;
+	Double twist = Double__angle_between(quad_cache->last_bearing, bearing);
+	Double pixels = sqrt(dx * dx + dy * dy) / distance_per_pixel +
+	  fabs(twist) * radius;
+	moved = (Logical)(pixels > QUAD_CACHE_QUANTUM / 2.0);
+    }
+    if (moved) {
+	Quad_Cache__clear(quad_cache);
+    }
+    quad_cache->last_bearing = bearing;
+    quad_cache->last_located = located;
+    quad_cache->last_x = x;
+    quad_cache->last_y = y;
+}
+
+/// @brief Return the *Quad_Cache* slot index for *key*.
+/// @param key is the candidate key from *Quad_Cache__key*().
+/// @returns the slot index for *key*.
+///
+/// *Quad_Cache__slot*() will return the top *QUAD_CACHE_SLOTS_BITS* bits
+/// of a multiplicative hash of *key*, which spreads out the keys of
+/// nearby candidates.
+
+Unsigned Quad_Cache__slot(Unsigned key) {
+    Unsigned slot = (key * 2654435761u) >> (32 - QUAD_CACHE_SLOTS_BITS);
+    assert (slot < QUAD_CACHE_SLOTS);
+    return slot;
+}
@@ -0,0 +1,813 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "CV.h"
+#include "Double.h"
+#include "Integer.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Quad_Finder.h"
+#include "Unsigned.h"
+
+// The tags are black squares on a white background, so after the
+// adaptive threshold each tag is a 4-connected black component whose
+// outline is a convex quadrilateral.  *Quad_Finder__find*() finds these
+// components in 3 steps:
+//
+//   1. *Quad_Finder__runs_find*() run length encodes the black pixels and
+//      merges the runs that touch a run in the row above (union-find).
+//      For large images, *Quad_Finder__runs_banded_find*() encodes row
+//      bands in parallel and stitches them back together.
+//   2. *Quad_Finder__components_label*() gathers the runs of each
+//      component into a list and accumulates its bounding box, pixel
+//      count and centroid.
+//   3. *Quad_Finder__component_fit*() fits 4 corners to each component
+//      that survives the cheap bounding box and pixel count tests.
+//
+// This replaces *CV_Image__find_contours*(),
+// *CV_Sequence__approximate_polygon*() and
+// *CV_Sequence__check_contour_convexity*() which allocate out of a
+// *CV_Memory_Storage* for every contour, including the many contours of
+// ceiling tiles and lights that are never going to be tags.
+
+/// @brief Fit a convex quadrilateral to *component*.
+/// @param quad_finder is the *Quad_Finder* that contains the runs.
+/// @param component is the *Quad_Finder_Component* to fit.
+/// @param area_minimum is the smallest quadrilateral area to accept.
+/// @param corners is where the 8 corner coordinates are stored.
+/// @returns (*Logical*)1 if *component* is quadrilateral shaped.
+///
+/// *Quad_Finder__component_fit*() will pick the 4 corners of *component*
+/// from the end points of its runs: corner 0 is the point farthest from
+/// the centroid, corner 2 is the point farthest from corner 0, and corners
+/// 1 and 3 are the points farthest to either side of the corner 0 to
+/// corner 2 diagonal.  The quadrilateral is rejected if it is not convex,
+/// has an area of *area_minimum* or less, has one corner much closer to
+/// the diagonal than the other, or does not account for the area inside
+/// the left and right edges of *component* (e.g. a disk or a blob.)
+
+Logical Quad_Finder__component_fit(Quad_Finder quad_finder,
+  Quad_Finder_Component component, Double area_minimum, Double *corners) {
+    struct Quad_Finder_Run__Struct *runs = quad_finder->runs;
+    Double center_x = component->sum_x / (Double)component->pixels;
+    Double center_y = component->sum_y / (Double)component->pixels;
+
+    // Corner 0 is the run end point farthest from the center:
+    Double x0 = center_x;
+    Double y0 = center_y;
+    Double distance_maximum = -1.0;
+    for (Unsigned index = component->first_run;
+      index != QUAD_FINDER_RUN_NONE; index = runs[index].next) {
+	Quad_Finder_Run run = &runs[index];
+	Double y = (Double)run->y;
+	for (Unsigned end = 0; end < 2; end++) {
+	    Double x = (Double)(end == 0 ? run->start_x : run->end_x);
+	    Double distance = (x - center_x) * (x - center_x) +
+	      (y - center_y) * (y - center_y);
+	    if (distance > distance_maximum) {
+		distance_maximum = distance;
+		x0 = x;
+		y0 = y;
+	    }
+	}
+    }
+
+    // Corner 2 is the run end point farthest from corner 0:
+    Double x2 = x0;
+    Double y2 = y0;
+    distance_maximum = -1.0;
+    for (Unsigned index = component->first_run;
+      index != QUAD_FINDER_RUN_NONE; index = runs[index].next) {
+	Quad_Finder_Run run = &runs[index];
+	Double y = (Double)run->y;
+	for (Unsigned end = 0; end < 2; end++) {
+	    Double x = (Double)(end == 0 ? run->start_x : run->end_x);
+	    Double distance = (x - x0) * (x - x0) + (y - y0) * (y - y0);
+	    if (distance > distance_maximum) {
+		distance_maximum = distance;
+		x2 = x;
+		y2 = y;
+	    }
+	}
+    }
+
+    // Corners 1 and 3 are farthest to either side of the diagonal.  Along
+    // the way, add up the area inside the left and right edges of each row:
+    Double diagonal_x = x2 - x0;
+    Double diagonal_y = y2 - y0;
+    Double x1 = x0;
+    Double y1 = y0;
+    Double x3 = x0;
+    Double y3 = y0;
+    Double cross1 = 0.0;
+    Double cross3 = 0.0;
+    Double profile_area = 0.0;
+    Integer row_y = runs[component->first_run].y;
+    Integer row_start_x = runs[component->first_run].start_x;
+    Integer row_end_x = runs[component->first_run].end_x;
+    for (Unsigned index = component->first_run;
+      index != QUAD_FINDER_RUN_NONE; index = runs[index].next) {
+	Quad_Finder_Run run = &runs[index];
+	Double y = (Double)run->y;
+	for (Unsigned end = 0; end < 2; end++) {
+	    Double x = (Double)(end == 0 ? run->start_x : run->end_x);
+	    Double cross = diagonal_x * (y - y0) - diagonal_y * (x - x0);
+	    if (cross > cross1) {
+		cross1 = cross;
+		x1 = x;
+		y1 = y;
+	    }
+	    if (cross < cross3) {
+		cross3 = cross;
+		x3 = x;
+		y3 = y;
+	    }
+	}
+
+	// The runs are in row order:
+	if (run->y != row_y) {
+	    profile_area += (Double)(row_end_x - row_start_x + 1);
+	    row_y = run->y;
+	    row_start_x = run->start_x;
+	    row_end_x = run->end_x;
+	} else {
+	    if (run->start_x < row_start_x) {
+		row_start_x = run->start_x;
+	    }
+	    if (run->end_x > row_end_x) {
+		row_end_x = run->end_x;
+	    }
+	}
+    }
+    profile_area += (Double)(row_end_x - row_start_x + 1);
+
+    // Corners 1 and 3 must be on opposite sides of the diagonal and
+    // neither one can be nearly on it (e.g. a triangle):
+    cross3 = -cross3;
+    if (cross1 <= 0.0 || cross3 <= 0.0 ||
+      4.0 * cross1 < cross3 || 4.0 * cross3 < cross1) {
+	return (Logical)0;
+    }
+
+    // Corners 0 and 2 must be on opposite sides of the other diagonal:
+    Double other_x = x3 - x1;
+    Double other_y = y3 - y1;
+    Double cross0 = other_x * (y0 - y1) - other_y * (x0 - x1);
+    Double cross2 = other_x * (y2 - y1) - other_y * (x2 - x1);
+    if (!((cross0 > 0.0 && cross2 < 0.0) || (cross0 < 0.0 && cross2 > 0.0))) {
+	return (Logical)0;
+    }
+
+    // The quadrilateral must be big enough:
+    Double area = (cross1 + cross3) / 2.0;
+    if (area <= area_minimum) {
+	return (Logical)0;
+    }
+
+    // A tag has a black border, so its component has to have a fair
+    // number of pixels:
+    if (5.0 * (Double)component->pixels < area) {
+	return (Logical)0;
+    }
+
+    // The corners go through pixel centers, so the pixels stick out of
+    // the quadrilateral by about half a pixel all the way around.  More
+    // than that means that the component is not a quadrilateral:
+    Double perimeter =
+      Double__square_root((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0)) +
+      Double__square_root((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1)) +
+      Double__square_root((x3 - x2) * (x3 - x2) + (y3 - y2) * (y3 - y2)) +
+      Double__square_root((x0 - x3) * (x0 - x3) + (y0 - y3) * (y0 - y3));
+    if (profile_area > 1.1 * area + perimeter) {
+	return (Logical)0;
+    }
+
+    // We have a quadrilateral:
+    corners[0] = x0;
+    corners[1] = y0;
+    corners[2] = x1;
+    corners[3] = y1;
+    corners[4] = x2;
+    corners[5] = y2;
+    corners[6] = x3;
+    corners[7] = y3;
+    return (Logical)1;
+}
+
+/// @brief Gather the runs in *quad_finder* into connected components.
+/// @param quad_finder is the *Quad_Finder* to label the runs of.
+///
+/// *Quad_Finder__components_label*() will assign each run in
+/// *quad_finder* to a *Quad_Finder_Component*, link the runs of each
+/// component into a list in row major order, and accumulate the bounding
+/// box, pixel count and coordinate sums of each component.  Since the
+/// root of each run has a smaller index than the run, every root is
+/// labeled before any of the runs that point to it.
+
+void Quad_Finder__components_label(Quad_Finder quad_finder) {
+    Unsigned runs_size = quad_finder->runs_size;
+    struct Quad_Finder_Run__Struct *runs = quad_finder->runs;
+
+    // Make sure that there is room for a component per run:
+    if (quad_finder->components_allocated < runs_size) {
+	Unsigned components_allocated = quad_finder->components_allocated;
+	while (components_allocated < runs_size) {
+	    components_allocated *= 2;
+	}
+	quad_finder->components = (struct Quad_Finder_Component__Struct *)
+	  Memory__reallocate((Memory)quad_finder->components,
+	  components_allocated * sizeof(struct Quad_Finder_Component__Struct),
+	  "Quad_Finder__components_label");
+	quad_finder->components_allocated = components_allocated;
+    }
+    struct Quad_Finder_Component__Struct *components =
+      quad_finder->components;
+
+    Unsigned components_size = 0;
+    for (Unsigned index = 0; index < runs_size; index++) {
+	Quad_Finder_Run run = &runs[index];
+	Unsigned root = Quad_Finder__root_find(quad_finder, index);
+	Quad_Finder_Component component = (Quad_Finder_Component)0;
+	if (root == index) {
+	    // *run* starts a new component:
+	    run->component = components_size;
+	    component = &components[components_size++];
+	    component->first_run = index;
+	    component->last_run = index;
+	    component->maximum_x = run->end_x;
+	    component->maximum_y = run->y;
+	    component->minimum_x = run->start_x;
+	    component->minimum_y = run->y;
+	    component->pixels = 0;
+	    component->sum_x = 0.0;
+	    component->sum_y = 0.0;
+	} else {
+	    // Append *run* to the component of *root*:
+	    run->component = runs[root].component;
+	    component = &components[run->component];
+	    runs[component->last_run].next = index;
+	    component->last_run = index;
+	    if (run->end_x > component->maximum_x) {
+		component->maximum_x = run->end_x;
+	    }
+	    component->maximum_y = run->y;
+	    if (run->start_x < component->minimum_x) {
+		component->minimum_x = run->start_x;
+	    }
+	}
+	run->next = QUAD_FINDER_RUN_NONE;
+
+	// Accumulate the pixel count and coordinate sums:
+	Integer length = run->end_x - run->start_x + 1;
+	component->pixels += (Unsigned)length;
+	component->sum_x +=
+	  (Double)length * (Double)(run->start_x + run->end_x) / 2.0;
+	component->sum_y += (Double)length * (Double)run->y;
+    }
+    quad_finder->components_size = components_size;
+}
+
+/// @brief Return a new *Quad_Finder* object.
+/// @returns a new *Quad_Finder* object.
+///
+/// *Quad_Finder__create*() will create and return a new *Quad_Finder*
+/// object with a little room in each of its arrays.  The arrays grow as
+/// needed.
+
+Quad_Finder Quad_Finder__create(void) {
+    Quad_Finder quad_finder = Memory__new(Quad_Finder, "Quad_Finder__create");
+    for (Unsigned index = 0; index < QUAD_FINDER_BANDS_MAXIMUM; index++) {
+	quad_finder->bands[index].quad_finder = (Quad_Finder)0;
+    }
+    quad_finder->components_allocated = 1024;
+    quad_finder->components = (struct Quad_Finder_Component__Struct *)
+      Memory__allocate(quad_finder->components_allocated *
+      sizeof(struct Quad_Finder_Component__Struct), "Quad_Finder__create");
+    quad_finder->components_size = 0;
+    quad_finder->quads_allocated = 16;
+    quad_finder->duplicates = (Logical *)Memory__allocate(
+      quad_finder->quads_allocated * sizeof(Logical), "Quad_Finder__create");
+    quad_finder->quads = (Double *)Memory__allocate(
+      quad_finder->quads_allocated * 8 * sizeof(Double),
+      "Quad_Finder__create");
+    quad_finder->quads_size = 0;
+    quad_finder->runs_allocated = 1024;
+    quad_finder->runs = (struct Quad_Finder_Run__Struct *)Memory__allocate(
+      quad_finder->runs_allocated * sizeof(struct Quad_Finder_Run__Struct),
+      "Quad_Finder__create");
+    quad_finder->runs_size = 0;
+    return quad_finder;
+}
+
+/// @brief Remove the quadrilaterals that duplicate a larger one.
+/// @param quad_finder contains the quadrilaterals to check.
+/// @returns the number of quadrilaterals removed.
+///
+/// *Quad_Finder__duplicates_remove*() will remove each quadrilateral in
+/// *quad_finder* that is nested around the center of a larger one (i.e.
+/// the inner and outer borders of the same tag frame.)  A quadrilateral
+/// is a duplicate when its center is within 1/4 of the diagonal of a
+/// larger quadrilateral from that quadrilateral's center and its
+/// diagonal is more than half as long.  The surviving quadrilaterals
+/// stay in the same order.
+
+Unsigned Quad_Finder__duplicates_remove(Quad_Finder quad_finder) {
+    Double *quads = quad_finder->quads;
+    Logical *duplicates = quad_finder->duplicates;
+    Unsigned quads_size = quad_finder->quads_size;
+
+    // Mark the duplicates first, since the larger quadrilateral might
+    // be a duplicate itself:
+    for (Unsigned index = 0; index < quads_size; index++) {
+	Double center_x = 0.0;
+	Double center_y = 0.0;
+	Double diagonal =
+	  Quad_Finder__quad_measure(quads + 8 * index, &center_x, &center_y);
+	duplicates[index] = (Logical)0;
+	for (Unsigned other_index = 0;
+	  other_index < quads_size; other_index++) {
+	    Double other_x = 0.0;
+	    Double other_y = 0.0;
+	    Double other_diagonal = Quad_Finder__quad_measure(
+	      quads + 8 * other_index, &other_x, &other_y);
+
+	    // Break ties in size with the index:
+	    if (other_diagonal > diagonal ||
+	      (!(other_diagonal < diagonal) && other_index < index)) {
+		Double dx = center_x - other_x;
+		Double dy = center_y - other_y;
+		Double distance_maximum = other_diagonal / 4.0;
+		if (dx * dx + dy * dy < distance_maximum * distance_maximum &&
+		  2.0 * diagonal > other_diagonal) {
+		    duplicates[index] = (Logical)1;
+		    break;
+		}
+	    }
+	}
+    }
+
+    // Now squeeze out the duplicates:
+    Unsigned kept_size = 0;
+    for (Unsigned index = 0; index < quads_size; index++) {
+	if (!duplicates[index]) {
+	    Double *from = quads + 8 * index;
+	    Double *to = quads + 8 * kept_size;
+	    for (Unsigned coordinate = 0; coordinate < 8; coordinate++) {
+		to[coordinate] = from[coordinate];
+	    }
+	    kept_size += 1;
+	}
+    }
+    quad_finder->quads_size = kept_size;
+    return quads_size - kept_size;
+}
+
+/// @brief Find the candidate tag quadrilaterals in *edge_image*.
+/// @param quad_finder is the *Quad_Finder* to store the results in.
+/// @param edge_image is the thresholded image to search.
+/// @param area_minimum is the smallest quadrilateral area to accept.
+/// @param band_count is the number of row bands to encode in parallel.
+/// @returns the number of quadrilaterals found.
+///
+/// *Quad_Finder__find*() will find all of the black 4-connected components
+/// of *edge_image* that are shaped like convex quadrilaterals with an area
+/// larger than *area_minimum* and store their corners in the *quads*
+/// array of *quad_finder*.  See *Quad_Finder__rectangle_find*() for the
+/// details.
+
+Unsigned Quad_Finder__find(Quad_Finder quad_finder,
+  CV_Image edge_image, Double area_minimum, Unsigned band_count) {
+    quad_finder->quads_size = 0;
+    return Quad_Finder__rectangle_find(quad_finder, edge_image, area_minimum,
+      0, 0, CV_Image__width_get(edge_image),
+      CV_Image__height_get(edge_image), band_count);
+}
+
+/// @brief Release the storage associated with *quad_finder*.
+/// @param quad_finder is the *Quad_Finder* object to release.
+///
+/// *Quad_Finder__free*() will release the storage associated with
+/// *quad_finder*.
+
+void Quad_Finder__free(Quad_Finder quad_finder) {
+    for (Unsigned index = 1; index < QUAD_FINDER_BANDS_MAXIMUM; index++) {
+	Quad_Finder band_finder = quad_finder->bands[index].quad_finder;
+	if (band_finder != (Quad_Finder)0) {
+	    Quad_Finder__free(band_finder);
+	}
+    }
+    Memory__free((Memory)quad_finder->components);
+    Memory__free((Memory)quad_finder->duplicates);
+    Memory__free((Memory)quad_finder->quads);
+    Memory__free((Memory)quad_finder->runs);
+    Memory__free((Memory)quad_finder);
+}
+
+/// @brief Append a quadrilateral to *quad_finder*.
+/// @param quad_finder is the *Quad_Finder* to append to.
+/// @param corners is the 8 corner coordinates of the quadrilateral.
+///
+/// *Quad_Finder__quad_append*() will append the quadrilateral with the
+/// 8 coordinates (x0, y0, x1, y1, x2, y2, x3, y3) in *corners* to the
+/// *quads* array of *quad_finder*.
+
+void Quad_Finder__quad_append(Quad_Finder quad_finder, Double *corners) {
+    if (quad_finder->quads_size >= quad_finder->quads_allocated) {
+	quad_finder->quads_allocated *= 2;
+	quad_finder->duplicates = (Logical *)Memory__reallocate(
+	  (Memory)quad_finder->duplicates,
+	  quad_finder->quads_allocated * sizeof(Logical),
+	  "Quad_Finder__quad_append");
+	quad_finder->quads = (Double *)Memory__reallocate(
+	  (Memory)quad_finder->quads,
+	  quad_finder->quads_allocated * 8 * sizeof(Double),
+	  "Quad_Finder__quad_append");
+    }
+    Double *quad = quad_finder->quads + 8 * quad_finder->quads_size;
+    for (Unsigned index = 0; index < 8; index++) {
+	quad[index] = corners[index];
+    }
+    quad_finder->quads_size += 1;
+}
+
+/// @brief Return the diagonal and center of a quadrilateral.
+/// @param quad is the 8 corner coordinates of the quadrilateral.
+/// @param center_x is where to store the X coordinate of the center.
+/// @param center_y is where to store the Y coordinate of the center.
+/// @returns the average length of the two diagonals.
+///
+/// *Quad_Finder__quad_measure*() will store the average of the 4 corners
+/// of *quad* into *center_x* and *center_y* and return the average length
+/// of its two diagonals.
+
+Double Quad_Finder__quad_measure(
+  Double *quad, Double *center_x, Double *center_y) {
+    *center_x = (quad[0] + quad[2] + quad[4] + quad[6]) / 4.0;
+    *center_y = (quad[1] + quad[3] + quad[5] + quad[7]) / 4.0;
+    Double dx02 = quad[4] - quad[0];
+    Double dy02 = quad[5] - quad[1];
+    Double dx13 = quad[6] - quad[2];
+    Double dy13 = quad[7] - quad[3];
+    return (sqrt(dx02 * dx02 + dy02 * dy02) +
+      sqrt(dx13 * dx13 + dy13 * dy13)) / 2.0;
+}
+
+/// @brief Find the candidate tag quadrilaterals in a rectangle of
+///        *edge_image*.
+/// @param quad_finder is the *Quad_Finder* to store the results in.
+/// @param edge_image is the thresholded image to search.
+/// @param area_minimum is the smallest quadrilateral area to accept.
+/// @param left is the left column of the rectangle.
+/// @param top is the top row of the rectangle.
+/// @param width is the width of the rectangle.
+/// @param height is the height of the rectangle.
+/// @param band_count is the number of row bands to encode in parallel.
+/// @returns the number of quadrilaterals in *quad_finder*.
+///
+/// *Quad_Finder__rectangle_find*() will find all of the black 4-connected
+/// components in the *width* by *height* rectangle at (*left*, *top*) of
+/// *edge_image* that are shaped like convex quadrilaterals with an area
+/// larger than *area_minimum* and append their corners to the *quads*
+/// array of *quad_finder* (so several rectangles can be searched in a
+/// row.)  Components that touch the edge of the rectangle, whose bounding
+/// box is too small, or that have too few pixels to be a tag are rejected
+/// before any corners are fit.  The results do not depend upon
+/// *band_count*.
+
+Unsigned Quad_Finder__rectangle_find(Quad_Finder quad_finder,
+  CV_Image edge_image, Double area_minimum, Integer left, Integer top,
+  Integer width, Integer height, Unsigned band_count) {
+    Integer right = left + width;
+    Integer bottom = top + height;
+
+    // Label the components:
+    Quad_Finder__runs_banded_find(quad_finder,
+      edge_image, left, top, width, height, band_count);
+    Quad_Finder__components_label(quad_finder);
+
+    // Sweep through the components looking for quadrilaterals:
+    Unsigned components_size = quad_finder->components_size;
+    for (Unsigned index = 0; index < components_size; index++) {
+	Quad_Finder_Component component = &quad_finder->components[index];
+
+	// A quadrilateral always fits in its bounding box, and a tag has
+	// a black border of 1/5 or more of its area:
+	Integer box_width = component->maximum_x - component->minimum_x + 1;
+	Integer box_height = component->maximum_y - component->minimum_y + 1;
+	if (component->minimum_x > left && component->minimum_y > top &&
+	  component->maximum_x < right - 1 &&
+	  component->maximum_y < bottom - 1 &&
+	  (Double)(box_width * box_height) > area_minimum &&
+	  5.0 * (Double)component->pixels > area_minimum) {
+	    Double corners[8];
+	    if (Quad_Finder__component_fit(
+	      quad_finder, component, area_minimum, corners)) {
+		Quad_Finder__quad_append(quad_finder, corners);
+	    }
+	}
+    }
+    return quad_finder->quads_size;
+}
+
+/// @brief Return the root run of the component containing *run_index*.
+/// @param quad_finder is the *Quad_Finder* that contains the runs.
+/// @param run_index is the index of the run to find the root of.
+/// @returns the index of the root run.
+///
+/// *Quad_Finder__root_find*() will follow the parent links from
+/// *run_index* to its root run and then point every run along the way
+/// directly at the root.
+
+Unsigned Quad_Finder__root_find(Quad_Finder quad_finder, Unsigned run_index) {
+    struct Quad_Finder_Run__Struct *runs = quad_finder->runs;
+    Unsigned root = run_index;
+    while (runs[root].parent != root) {
+	root = runs[root].parent;
+    }
+    while (runs[run_index].parent != root) {
+	Unsigned parent = runs[run_index].parent;
+	runs[run_index].parent = root;
+	run_index = parent;
+    }
+    return root;
+}
+
+/// @brief Merge a run with the runs in the row above that it overlaps.
+/// @param quad_finder is the *Quad_Finder* that contains the runs.
+/// @param run_index is the index of the run to merge.
+/// @param previous_index is the index of the first run in the row above
+/// that might overlap the run.
+/// @param previous_end is one past the index of the last run in the row
+/// above.
+/// @returns the *previous_index* to use for the next run in the same row.
+///
+/// *Quad_Finder__run_merge*() will merge the run at *run_index* with every
+/// run from *previous_index* up to *previous_end* that it overlaps (i.e.
+/// 4-connectivity).  The root of a merged set of runs is always the run
+/// with the smallest index.  The runs in the row above that end before
+/// the run starts are skipped over for good, since they can not overlap
+/// any later run in the same row either.
+
+Unsigned Quad_Finder__run_merge(Quad_Finder quad_finder,
+  Unsigned run_index, Unsigned previous_index, Unsigned previous_end) {
+    struct Quad_Finder_Run__Struct *runs = quad_finder->runs;
+    Integer start_x = runs[run_index].start_x;
+    Integer end_x = runs[run_index].end_x;
+
+    // Skip the runs in the row above that end before the run starts:
+    while (previous_index < previous_end &&
+      runs[previous_index].end_x < start_x) {
+	previous_index++;
+    }
+
+    // Merge the run with the overlapping runs in the row above:
+    for (Unsigned index = previous_index; index < previous_end &&
+      runs[index].start_x <= end_x; index++) {
+	Unsigned root1 = Quad_Finder__root_find(quad_finder, index);
+	Unsigned root2 = Quad_Finder__root_find(quad_finder, run_index);
+	if (root1 < root2) {
+	    runs[root2].parent = root1;
+	} else if (root2 < root1) {
+	    runs[root1].parent = root2;
+	}
+    }
+    return previous_index;
+}
+
+/// @brief Append the runs of the next row band to *quad_finder*.
+/// @param quad_finder is the *Quad_Finder* to append to.
+/// @param band_finder is the *Quad_Finder* with the runs of the band.
+///
+/// *Quad_Finder__runs_append*() will append the runs of *band_finder*
+/// (which must start below the last run of *quad_finder*) to the *runs*
+/// array of *quad_finder*, so that they stay in row major order.  The
+/// runs in the first row of the band are then merged with the runs in the
+/// last row of *quad_finder* that they overlap, which stitches together
+/// the components that cross from one band into the next.  Since the
+/// parent of every run still has a smaller index and the merges always
+/// keep the smallest index as the root, the runs end up exactly the same
+/// as if the two bands had been encoded by one *Quad_Finder__runs_find*().
+
+void Quad_Finder__runs_append(
+  Quad_Finder quad_finder, Quad_Finder band_finder) {
+    Unsigned runs_size = quad_finder->runs_size;
+    Unsigned band_size = band_finder->runs_size;
+    if (band_size == 0) {
+	return;
+    }
+
+    // Make sure there is room for the runs of the band:
+    if (runs_size + band_size > quad_finder->runs_allocated) {
+	Unsigned runs_allocated = quad_finder->runs_allocated;
+	while (runs_allocated < runs_size + band_size) {
+	    runs_allocated *= 2;
+	}
+	quad_finder->runs = (struct Quad_Finder_Run__Struct *)
+	  Memory__reallocate((Memory)quad_finder->runs,
+	  runs_allocated * sizeof(struct Quad_Finder_Run__Struct),
+	  "Quad_Finder__runs_append");
+	quad_finder->runs_allocated = runs_allocated;
+    }
+
+    // Copy the runs over, moving the parents along with them:
+    struct Quad_Finder_Run__Struct *runs = quad_finder->runs;
+    struct Quad_Finder_Run__Struct *band_runs = band_finder->runs;
+    for (Unsigned index = 0; index < band_size; index++) {
+	Quad_Finder_Run run = &runs[runs_size + index];
+	*run = band_runs[index];
+	run->parent += runs_size;
+    }
+    quad_finder->runs_size = runs_size + band_size;
+
+    // Only runs in adjacent rows can touch:
+    if (runs_size == 0) {
+	return;
+    }
+    Integer previous_y = runs[runs_size - 1].y;
+    Integer first_y = runs[runs_size].y;
+    assert (first_y > previous_y);
+    if (first_y != previous_y + 1) {
+	return;
+    }
+
+    // Find the first run of the last row before the band:
+    Unsigned previous_start = runs_size - 1;
+    while (previous_start > 0 && runs[previous_start - 1].y == previous_y) {
+	previous_start--;
+    }
+
+    // Stitch the first row of the band to the row above it:
+    Unsigned previous_index = previous_start;
+    for (Unsigned index = runs_size;
+      index < runs_size + band_size && runs[index].y == first_y; index++) {
+	previous_index = Quad_Finder__run_merge(
+	  quad_finder, index, previous_index, runs_size);
+    }
+}
+
+/// @brief Run length encode the black pixels of a rectangle of *image*
+///        in parallel row bands.
+/// @param quad_finder is the *Quad_Finder* to store the runs in.
+/// @param image is the 8-bit thresholded image to encode.
+/// @param left is the left column of the rectangle.
+/// @param top is the top row of the rectangle.
+/// @param width is the width of the rectangle.
+/// @param height is the height of the rectangle.
+/// @param band_count is the number of row bands to process in parallel.
+///
+/// *Quad_Finder__runs_banded_find*() will store the same runs into
+/// *quad_finder* as *Quad_Finder__runs_find*(), but the rows are split
+/// into *band_count* bands which are run length encoded by separate
+/// threads (each into its own *Quad_Finder*) and then stitched back
+/// together in order with *Quad_Finder__runs_append*().  The results do
+/// not depend upon *band_count*.
+
+void Quad_Finder__runs_banded_find(Quad_Finder quad_finder,
+  CV_Image image, Integer left, Integer top, Integer width, Integer height,
+  Unsigned band_count) {
+    // Clamp *band_count* so that every band has at least one row:
+    if (band_count > QUAD_FINDER_BANDS_MAXIMUM) {
+	band_count = QUAD_FINDER_BANDS_MAXIMUM;
+    }
+    if ((Integer)band_count > height) {
+	band_count = (Unsigned)height;
+    }
+    if (band_count <= 1) {
+	Quad_Finder__runs_find(quad_finder, image, left, top, width, height);
+	return;
+    }
+
+    // Split the rows into *band_count* bands.  The first band is encoded
+    // straight into *quad_finder*:
+    for (Unsigned index = 0; index < band_count; index++) {
+	Quad_Finder_Band band = &quad_finder->bands[index];
+	Integer band_top = top + height * (Integer)index / (Integer)band_count;
+	Integer band_bottom =
+	  top + height * (Integer)(index + 1) / (Integer)band_count;
+	if (index == 0) {
+	    band->quad_finder = quad_finder;
+	} else if (band->quad_finder == (Quad_Finder)0) {
+	    band->quad_finder = Quad_Finder__create();
+	}
+	band->height = band_bottom - band_top;
+	band->image = image;
+	band->left = left;
+	band->top = band_top;
+	band->width = width;
+    }
+
+    // Process the first band on this thread and the rest in parallel:
+    for (Unsigned index = 1; index < band_count; index++) {
+	Quad_Finder_Band band = &quad_finder->bands[index];
+	Integer result = pthread_create(&band->thread,
+	  (pthread_attr_t *)0, Quad_Finder_Band__process, (void *)band);
+	assert (result == 0);
+    }
+    Quad_Finder_Band__process((void *)&quad_finder->bands[0]);
+    for (Unsigned index = 1; index < band_count; index++) {
+	Integer result =
+	  pthread_join(quad_finder->bands[index].thread, (void **)0);
+	assert (result == 0);
+    }
+
+    // Stitch the bands back together in order:
+    for (Unsigned index = 1; index < band_count; index++) {
+	Quad_Finder__runs_append(
+	  quad_finder, quad_finder->bands[index].quad_finder);
+    }
+}
+
+/// @brief Run length encode the black pixels of a rectangle of *image*.
+/// @param quad_finder is the *Quad_Finder* to store the runs in.
+/// @param image is the 8-bit thresholded image to encode.
+/// @param left is the left column of the rectangle.
+/// @param top is the top row of the rectangle.
+/// @param width is the width of the rectangle.
+/// @param height is the height of the rectangle.
+///
+/// *Quad_Finder__runs_find*() will store each horizontal run of 0 pixels
+/// in the *width* by *height* rectangle at (*left*, *top*) of *image*
+/// into the *runs* array of *quad_finder* in row major order.  Each run
+/// is merged with every run in the row above that it overlaps with
+/// *Quad_Finder__run_merge*().
+
+void Quad_Finder__runs_find(Quad_Finder quad_finder, CV_Image image,
+  Integer left, Integer top, Integer width, Integer height) {
+    assert (image->nChannels == 1 && image->depth == 8);
+    assert (left >= 0 && top >= 0 &&
+      left + width <= image->width && top + height <= image->height);
+    unsigned char *data = (unsigned char *)image->imageData;
+    Integer step = image->widthStep;
+    Integer right = left + width;
+    Integer bottom = top + height;
+
+    Unsigned runs_size = 0;
+    Unsigned previous_start = 0;
+    for (Integer y = top; y < bottom; y++) {
+	unsigned char *row = data + step * y;
+	Unsigned row_start = runs_size;
+	Unsigned previous_index = previous_start;
+	Integer x = left;
+	while (x < right) {
+	    // Skip over the white pixels:
+	    while (x < right && row[x] != 0) {
+		x++;
+	    }
+	    if (x >= right) {
+		break;
+	    }
+
+	    // Find the end of the black run:
+	    Integer start_x = x;
+	    while (x < right && row[x] == 0) {
+		x++;
+	    }
+	    Integer end_x = x - 1;
+
+	    // Make sure there is room for the run:
+	    if (runs_size >= quad_finder->runs_allocated) {
+		quad_finder->runs_allocated *= 2;
+		quad_finder->runs = (struct Quad_Finder_Run__Struct *)
+		  Memory__reallocate((Memory)quad_finder->runs,
+		  quad_finder->runs_allocated *
+		  sizeof(struct Quad_Finder_Run__Struct),
+		  "Quad_Finder__runs_find");
+	    }
+	    Quad_Finder_Run run = &quad_finder->runs[runs_size];
+	    run->component = 0;
+	    run->end_x = end_x;
+	    run->next = QUAD_FINDER_RUN_NONE;
+	    run->parent = runs_size;
+	    run->start_x = start_x;
+	    run->y = y;
+
+	    // Merge *run* with the overlapping runs in the row above:
+	    previous_index = Quad_Finder__run_merge(
+	      quad_finder, runs_size, previous_index, row_start);
+	    runs_size += 1;
+	    quad_finder->runs_size = runs_size;
+	}
+	previous_start = row_start;
+    }
+    quad_finder->runs_size = runs_size;
+}
+
+// *Quad_Finder_Band* routines:
+
+/// @brief Run length encode the rows of *band*.
+/// @param band_pointer is the *Quad_Finder_Band* to process.
+/// @returns (void *)0.
+///
+/// *Quad_Finder_Band__process*() will run length encode the rows of
+/// *band_pointer* into its *quad_finder* with *Quad_Finder__runs_find*().
+/// It is used directly as a thread body.
+
+void *Quad_Finder_Band__process(void *band_pointer) {
+    Quad_Finder_Band band = (Quad_Finder_Band)band_pointer;
+    Quad_Finder__runs_find(band->quad_finder, band->image,
+      band->left, band->top, band->width, band->height);
+    return (void *)0;
+}
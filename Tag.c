@@ -73,6 +73,7 @@ Tag Tag__create(Unsigned id, Map map) {
     tag->id = id;
     tag->initialized = (Logical)0;
     tag->map = map;
+    tag->parent_arc = (Arc)0;
     tag->world_diagonal = tag_height->world_diagonal;
     tag->visit = map->visit;
     tag->x = (Double)0.0;
@@ -243,12 +244,13 @@ void Tag__svg_write(Tag tag, SVG svg) {
 /// @param arc to use to find the arc to update from.
 /// @param image is the current image being processed.
 /// @param sequence_number is the image sequence number.
+/// @returns true if the position or orientation of *tag* changed.
 ///
 /// *Tag__update_via_arc*() will use the contents of *arc* to update
 /// the position and oritation of *tag*.  The position is computed using
 /// the "other" end of *arc*.
 
-void Tag__update_via_arc(
+Logical Tag__update_via_arc(
   Tag tag, Arc arc, CV_Image image, Unsigned sequence_number) {
     // Some values to use for radian/degree conversion:
     Double pi = (Double)3.14159265358979323846264;
@@ -301,6 +303,7 @@ void Tag__update_via_arc(
     Double to_tag_twist = Double__angle_normalize(angle - pi + arc_to_twist);
 
     // If *to_tag* values are to change
+    Logical changed = (Logical)0;
     if (to_tag->twist != to_tag_twist ||
       to_tag->x != to_tag_x || to_tag->y != to_tag_y) {
 	// Load new values into *to_tag*:
@@ -312,10 +315,12 @@ void Tag__update_via_arc(
 	// Let any interested party know that tag values changed.
 	Map map = to_tag->map;
 	Map__tag_announce(map, to_tag, (Logical)1, image, sequence_number);
+	changed = (Logical)1;
     }
 
     //File__format(stderr, "To_Tag[id:%d x:%.2f y:%.2f tw:%.4f] angle=%.4f\n",
     //  to_tag->id, to_tag->x, to_tag->y, to_tag->twist * r2d, angle * r2d);
+    return changed;
 }
 
 /// @brief Writes *tag* out ot *out_file* in XML format.
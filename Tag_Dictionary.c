@@ -0,0 +1,384 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+
+#include "CRC.h"
+#include "FEC.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "Tag_Dictionary.h"
+#include "Unsigned.h"
+
+// A tag is sampled as an 8 by 8 grid of bits.  Both sampled bit patterns
+// and tag words are packed into a *uint64_t* as 8 rows of 8 bits: bit
+// 8*row + column.  For a tag word, row *k* is tag byte *k* with the bit
+// order reversed (i.e. column *j* is bit 7 - *j* of the tag byte.)  This
+// makes a tag word simply the 8 tag bytes packed least significant byte
+// first.  The tag word seen in each direction is then just a rotation
+// (with a flip) of the sampled bit pattern:
+//
+//   north (0): tag word = sampled
+//   west (1):  tag word = byte_swap(transpose(sampled))
+//   south (2): tag word = byte_swap(bit_swap(sampled))
+//   east (3):  tag word = bit_swap(transpose(sampled))
+
+/// @brief Reverses the bits in each of the 8 bytes of *word*.
+/// @param word is the word to flip.
+/// @returns *word* with the bits of each byte reversed.
+///
+/// *Tag_Dictionary__bit_swap*() will mirror each row of the 8 by 8 bit
+/// matrix in *word* left to right.
+
+uint64_t Tag_Dictionary__bit_swap(uint64_t word) {
+    word = ((word >> 1) & 0x5555555555555555ULL) |
+      ((word & 0x5555555555555555ULL) << 1);
+    word = ((word >> 2) & 0x3333333333333333ULL) |
+      ((word & 0x3333333333333333ULL) << 2);
+    word = ((word >> 4) & 0x0f0f0f0f0f0f0f0fULL) |
+      ((word & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return word;
+}
+
+/// @brief Reverses the order of the 8 bytes of *word*.
+/// @param word is the word to flip.
+/// @returns *word* with its bytes reversed.
+///
+/// *Tag_Dictionary__byte_swap*() will mirror the 8 by 8 bit matrix
+/// in *word* top to bottom.
+
+uint64_t Tag_Dictionary__byte_swap(uint64_t word) {
+    word = ((word >> 8) & 0x00ff00ff00ff00ffULL) |
+      ((word & 0x00ff00ff00ff00ffULL) << 8);
+    word = ((word >> 16) & 0x0000ffff0000ffffULL) |
+      ((word & 0x0000ffff0000ffffULL) << 16);
+    return (word >> 32) | (word << 32);
+}
+
+/// @brief Returns the tag word for *tag_id*.
+/// @param tag_dictionary that has the Reed-Solomon encoder.
+/// @param tag_id is the tag id.
+/// @returns the 8 tag bytes packed least significant byte first.
+///
+/// *Tag_Dictionary__codeword*() will compute the 8 tag bytes the same
+/// way that *Tags* does: the 16-bit id, then its CRC, then 4 bytes of
+/// FEC parity.
+
+uint64_t Tag_Dictionary__codeword(
+  Tag_Dictionary tag_dictionary, Unsigned tag_id) {
+    Unsigned tag_bytes[8];
+    for (Unsigned index = 0; index < 8; index++) {
+	tag_bytes[index] = 0;
+    }
+    tag_bytes[1] = (tag_id >> 8) & 0xff;
+    tag_bytes[0] = tag_id & 0xff;
+    Unsigned crc = CRC__compute(tag_bytes, 2);
+    tag_bytes[3] = (crc >> 8) & 0xff;
+    tag_bytes[2] = crc & 0xff;
+    FEC__parity(tag_dictionary->fec, tag_bytes, 8);
+
+    uint64_t word = 0;
+    for (Unsigned index = 0; index < 8; index++) {
+	word |= (uint64_t)tag_bytes[index] << (index << 3);
+    }
+    return word;
+}
+
+/// @brief Returns a new *Tag_Dictionary* of every tag id in all directions.
+/// @param fec is the Reed-Solomon decoder to use for noisy bit patterns.
+/// @returns a new *Tag_Dictionary*.
+///
+/// *Tag_Dictionary__create*() will compute the sampled bit pattern of
+/// every possible 16-bit tag id in each of its 4 directions, using the
+/// same CRC and FEC parity computation that *Tags* uses to draw a tag,
+/// and store them all in a new *Tag_Dictionary*.  When two directions
+/// produce the same bit pattern, the lower direction is kept, since
+/// that is the one *Tag_Dictionary__fec_decode*() would find first.
+
+Tag_Dictionary Tag_Dictionary__create(FEC fec) {
+    Unsigned slots_size = 1 << TAG_DICTIONARY_SLOTS_BITS;
+    Unsigned filter_size = 1 << (TAG_DICTIONARY_FILTER_BITS - 6);
+    Tag_Dictionary tag_dictionary =
+      Memory__new(Tag_Dictionary, "Tag_Dictionary__create");
+    tag_dictionary->codewords = (uint64_t *)Memory__allocate(
+      slots_size * sizeof(uint64_t), "Tag_Dictionary__create:codewords");
+    tag_dictionary->entries = (Unsigned *)Memory__allocate(
+      slots_size * sizeof(Unsigned), "Tag_Dictionary__create:entries");
+    tag_dictionary->filter = (uint64_t *)Memory__allocate(
+      filter_size * sizeof(uint64_t), "Tag_Dictionary__create:filter");
+    tag_dictionary->fec = fec;
+    tag_dictionary->slots_mask = slots_size - 1;
+    for (Unsigned index = 0; index < slots_size; index++) {
+	tag_dictionary->codewords[index] = 0;
+	tag_dictionary->entries[index] = TAG_DICTIONARY_EMPTY;
+    }
+    for (Unsigned index = 0; index < filter_size; index++) {
+	tag_dictionary->filter[index] = 0;
+    }
+
+    // Fill in all 4 directions of all 65536 tag ids:
+    for (Unsigned tag_id = 0; tag_id < 65536; tag_id++) {
+	uint64_t codeword = Tag_Dictionary__codeword(tag_dictionary, tag_id);
+	for (Unsigned direction = 0; direction < 4; direction++) {
+	    uint64_t bits = Tag_Dictionary__unorient(codeword, direction);
+	    Tag_Dictionary__insert(tag_dictionary, bits, tag_id, direction);
+	}
+    }
+    return tag_dictionary;
+}
+
+/// @brief Decodes a sampled bit pattern into a tag id and direction.
+/// @param tag_dictionary to use for decoding.
+/// @param bits is the sampled bit pattern.
+/// @param tag_id is where the tag id is returned.
+/// @param direction is where the direction (0-3) is returned.
+/// @returns 1 if *bits* decoded to a tag and 0 otherwise.
+///
+/// *Tag_Dictionary__decode*() will look *bits* up in *tag_dictionary*
+/// and only fall back to Reed-Solomon error correction if *bits* is not
+/// an exact match (i.e. some of the bits are noisy.)  An exact match
+/// always wins, even when FEC would have "corrected" *bits* into some
+/// other tag in a lower direction.  Most noisy bit patterns are turned
+/// away by the filter in *Tag_Dictionary__lookup*(), so the miss costs
+/// little more than the FEC itself.
+
+Logical Tag_Dictionary__decode(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction) {
+    return (Logical)(
+      Tag_Dictionary__lookup(tag_dictionary, bits, tag_id, direction) ||
+      Tag_Dictionary__fec_decode(tag_dictionary, bits, tag_id, direction));
+}
+
+/// @brief Decodes a sampled bit pattern using Reed-Solomon error correction.
+/// @param tag_dictionary to use for decoding.
+/// @param bits is the sampled bit pattern.
+/// @param tag_id is where the tag id is returned.
+/// @param direction is where the direction (0-3) is returned.
+/// @returns 1 if *bits* decoded to a tag and 0 otherwise.
+///
+/// *Tag_Dictionary__fec_decode*() will try each of the 4 directions in
+/// turn, rotating *bits* into a tag word, running FEC (Forward Error
+/// Correction) over it and checking the CRC (Cyclic Redundancy Check).
+/// The first direction that passes both is returned.
+
+Logical Tag_Dictionary__fec_decode(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction) {
+    for (Unsigned direction_index = 0;
+      direction_index < 4; direction_index++) {
+	uint64_t word = Tag_Dictionary__orient(bits, direction_index);
+
+	// Now we need to do some FEC (Forward Error Correction) and see if
+	// the two CRC's match:
+	if (FEC__word_correct(tag_dictionary->fec, &word)) {
+	    Unsigned id_bytes[2];
+	    id_bytes[0] = word & 0xff;
+	    id_bytes[1] = (word >> 8) & 0xff;
+	    Unsigned computed_crc = CRC__compute(id_bytes, 2);
+	    Unsigned tag_crc = (word >> 16) & 0xffff;
+	    if (computed_crc == tag_crc) {
+		*tag_id = word & 0xffff;
+		*direction = direction_index;
+		return (Logical)1;
+	    }
+	}
+    }
+    return (Logical)0;
+}
+
+/// @brief Releases the storage of *tag_dictionary*.
+/// @param tag_dictionary to release.
+///
+/// *Tag_Dictionary__free*() will release the storage of *tag_dictionary*.
+/// The *FEC* object is not released.
+
+void Tag_Dictionary__free(Tag_Dictionary tag_dictionary) {
+    Memory__free((Memory)tag_dictionary->codewords);
+    Memory__free((Memory)tag_dictionary->entries);
+    Memory__free((Memory)tag_dictionary->filter);
+    Memory__free((Memory)tag_dictionary);
+}
+
+/// @brief Returns the filter bit index of *bits*.
+/// @param bits is the sampled bit pattern to hash.
+/// @returns the bit index into the *filter* of a *Tag_Dictionary*.
+///
+/// *Tag_Dictionary__filter_bit*() will return a filter bit index from the
+/// top bits of the same multiplicative hash that *Tag_Dictionary__hash*()
+/// uses.  The filter has twice as many bits as there are slots, so only
+/// about a quarter of its bits are set.
+
+Unsigned Tag_Dictionary__filter_bit(uint64_t bits) {
+    return (Unsigned)((bits * 0x9e3779b97f4a7c15ULL) >>
+      (64 - TAG_DICTIONARY_FILTER_BITS));
+}
+
+/// @brief Returns the home slot of *bits*.
+/// @param bits is the sampled bit pattern to hash.
+/// @returns the home slot index of *bits*.
+///
+/// *Tag_Dictionary__hash*() will return a slot index from the top bits
+/// of a multiplicative (Fibonacci) hash of *bits*.
+
+Unsigned Tag_Dictionary__hash(uint64_t bits) {
+    return (Unsigned)((bits * 0x9e3779b97f4a7c15ULL) >>
+      (64 - TAG_DICTIONARY_SLOTS_BITS));
+}
+
+/// @brief Inserts *bits* into *tag_dictionary*.
+/// @param tag_dictionary to insert into.
+/// @param bits is the sampled bit pattern.
+/// @param tag_id is the tag id that *bits* decodes to.
+/// @param direction is the direction that *bits* decodes to.
+///
+/// *Tag_Dictionary__insert*() will insert *bits* into *tag_dictionary*
+/// unless it is already present, in which case the entry with the lower
+/// direction is kept.  The filter bit for *bits* is set as well.
+
+void Tag_Dictionary__insert(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned tag_id, Unsigned direction) {
+    uint64_t *codewords = tag_dictionary->codewords;
+    Unsigned *entries = tag_dictionary->entries;
+    Unsigned slots_mask = tag_dictionary->slots_mask;
+    Unsigned slot = Tag_Dictionary__hash(bits);
+    Unsigned filter_bit = Tag_Dictionary__filter_bit(bits);
+    tag_dictionary->filter[filter_bit >> 6] |=
+      (uint64_t)1 << (filter_bit & 63);
+    while (entries[slot] != TAG_DICTIONARY_EMPTY) {
+	if (codewords[slot] == bits) {
+	    if (direction < (entries[slot] >> 16)) {
+		entries[slot] = tag_id | (direction << 16);
+	    }
+	    return;
+	}
+	slot = (slot + 1) & slots_mask;
+    }
+    codewords[slot] = bits;
+    entries[slot] = tag_id | (direction << 16);
+}
+
+/// @brief Looks up the exact sampled bit pattern *bits*.
+/// @param tag_dictionary to look in.
+/// @param bits is the sampled bit pattern.
+/// @param tag_id is where the tag id is returned.
+/// @param direction is where the direction (0-3) is returned.
+/// @returns 1 if *bits* was found and 0 otherwise.
+///
+/// *Tag_Dictionary__lookup*() will look up *bits* in *tag_dictionary* and
+/// return the tag id and direction it belongs to.  If the filter bit for
+/// *bits* is clear, *bits* can not be present and the (cache missing)
+/// probe of the slots is skipped.
+
+Logical Tag_Dictionary__lookup(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction) {
+    uint64_t *codewords = tag_dictionary->codewords;
+    Unsigned *entries = tag_dictionary->entries;
+    Unsigned slots_mask = tag_dictionary->slots_mask;
+    Unsigned filter_bit = Tag_Dictionary__filter_bit(bits);
+    if (((tag_dictionary->filter[filter_bit >> 6] >>
+      (filter_bit & 63)) & 1) == 0) {
+	return (Logical)0;
+    }
+    Unsigned slot = Tag_Dictionary__hash(bits);
+    while (1) {
+	Unsigned entry = entries[slot];
+	if (entry == TAG_DICTIONARY_EMPTY) {
+	    return (Logical)0;
+	}
+	if (codewords[slot] == bits) {
+	    *tag_id = entry & 0xffff;
+	    *direction = entry >> 16;
+	    return (Logical)1;
+	}
+	slot = (slot + 1) & slots_mask;
+    }
+}
+
+/// @brief Returns the tag word seen in *direction* for *bits*.
+/// @param bits is the sampled bit pattern.
+/// @param direction is the direction (0-3).
+/// @returns the tag word.
+///
+/// *Tag_Dictionary__orient*() will rotate (and flip) the sampled bit
+/// pattern *bits* into the tag word it holds if the tag is in
+/// *direction*.
+
+uint64_t Tag_Dictionary__orient(uint64_t bits, Unsigned direction) {
+    uint64_t word = bits;
+    switch (direction) {
+      case 0:
+	break;
+      case 1:
+	word = Tag_Dictionary__byte_swap(Tag_Dictionary__transpose(bits));
+	break;
+      case 2:
+	word = Tag_Dictionary__byte_swap(Tag_Dictionary__bit_swap(bits));
+	break;
+      case 3:
+	word = Tag_Dictionary__bit_swap(Tag_Dictionary__transpose(bits));
+	break;
+      default:
+	assert (0);
+	break;
+    }
+    return word;
+}
+
+/// @brief Returns the sampled bit pattern of *tag_id* in *direction*.
+/// @param tag_dictionary that has the Reed-Solomon encoder.
+/// @param tag_id is the tag id.
+/// @param direction is the direction (0-3).
+/// @returns the sampled bit pattern.
+///
+/// *Tag_Dictionary__tag_bits*() will return the 64 bits that sampling a
+/// tag with *tag_id* in *direction* produces.
+
+uint64_t Tag_Dictionary__tag_bits(
+  Tag_Dictionary tag_dictionary, Unsigned tag_id, Unsigned direction) {
+    return Tag_Dictionary__unorient(
+      Tag_Dictionary__codeword(tag_dictionary, tag_id), direction);
+}
+
+/// @brief Transposes the 8 by 8 bit matrix in *word*.
+/// @param word is the word to transpose.
+/// @returns the transposed *word*.
+///
+/// *Tag_Dictionary__transpose*() will swap bit 8*row* + *column* with
+/// bit 8*column* + *row* for all rows and columns.
+
+uint64_t Tag_Dictionary__transpose(uint64_t word) {
+    uint64_t swap = (word ^ (word >> 7)) & 0x00aa00aa00aa00aaULL;
+    word ^= swap ^ (swap << 7);
+    swap = (word ^ (word >> 14)) & 0x0000cccc0000ccccULL;
+    word ^= swap ^ (swap << 14);
+    swap = (word ^ (word >> 28)) & 0x00000000f0f0f0f0ULL;
+    word ^= swap ^ (swap << 28);
+    return word;
+}
+
+/// @brief Returns the sampled bit pattern of tag word *word* in *direction*.
+/// @param word is the tag word.
+/// @param direction is the direction (0-3).
+/// @returns the sampled bit pattern.
+///
+/// *Tag_Dictionary__unorient*() is the inverse of
+/// *Tag_Dictionary__orient*().
+
+uint64_t Tag_Dictionary__unorient(uint64_t word, Unsigned direction) {
+    uint64_t bits = word;
+    switch (direction) {
+      case 0:
+	break;
+      case 1:
+	bits = Tag_Dictionary__transpose(Tag_Dictionary__byte_swap(word));
+	break;
+      case 2:
+	bits = Tag_Dictionary__bit_swap(Tag_Dictionary__byte_swap(word));
+	break;
+      case 3:
+	bits = Tag_Dictionary__transpose(Tag_Dictionary__bit_swap(word));
+	break;
+      default:
+	assert (0);
+	break;
+    }
+    return bits;
+}
@@ -0,0 +1,922 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "CV.h"
+#include "Double.h"
+#include "File.h"
+#include "Fiducials.h"
+#include "Fiducials_Pipeline.h"
+#include "Integer.h"
+#include "List.h"
+#include "Logical.h"
+#include "Memory.h"
+#include "String.h"
+#include "Unsigned.h"
+
+/// @brief *Threshold_Benchmark* is a pointer to a
+/// *Threshold_Benchmark__Struct* object.
+typedef struct Threshold_Benchmark__Struct *Threshold_Benchmark;
+
+/// @brief *Threshold_Benchmark_Gate* is a pointer to a
+/// *Threshold_Benchmark_Gate__Struct* object.
+typedef struct Threshold_Benchmark_Gate__Struct *Threshold_Benchmark_Gate;
+
+/// @brief A *Threshold_Benchmark_Gate* holds the instance threads back
+/// until all of them are ready to process their images.
+struct Threshold_Benchmark_Gate__Struct {
+    /// @brief Signaled when the last thread arrives.
+    pthread_cond_t condition;
+
+    /// @brief Protects *waiting*.
+    pthread_mutex_t mutex;
+
+    /// @brief The number of threads that have not arrived yet.
+    Unsigned waiting;
+};
+
+/// @brief A *Threshold_Benchmark* is one named mode of the benchmark.  It
+/// holds the *Fiducials* settings of the mode and records every tag found
+/// while running *Fiducials__process*() over a set of images with them.
+struct Threshold_Benchmark__Struct {
+    /// @brief (*Logical*)1 to enable the candidate rejection cascade.
+    Logical candidate_cascade;
+
+    /// @brief (*Logical*)1 to track the corners of the previous tags
+    /// instead of searching for tags in most frames.
+    Logical corners_tracking;
+
+    /// @brief The candidate rejection counts summed over all the images.
+    struct Fiducials_Counters__Struct counters;
+
+    /// @brief The number of threads to decode candidates on.
+    Unsigned decode_threads;
+
+    /// @brief (image index << 16) | tag id for each tag found.
+    Unsigned *detections;
+
+    /// @brief Number of entries allocated in *detections*.
+    Unsigned detections_allocated;
+
+    /// @brief Number of entries used in *detections*.
+    Unsigned detections_size;
+
+    /// @brief The wall clock time when the last image was processed.
+    Double end_time;
+
+    /// @brief The *Fiducials* object that the mode is being run with (its
+    /// *update_sequence_number* is the index of the image that the tags
+    /// are announced for.)
+    Fiducials fiducials;
+
+    /// @brief The gate to wait at before processing the images (or null
+    /// to start right away.)
+    Threshold_Benchmark_Gate gate;
+
+    /// @brief The images for *Threshold_Benchmark__instance_run*() to
+    /// process.
+    List /* <CV_Image> */ images;
+
+    /// @brief The name of the mode.
+    String label;
+
+    /// @brief The name of the log file for *Fiducials__create*().
+    String_Const log_file_name;
+
+    /// @brief (*Logical*)1 to process the images through a
+    /// *Fiducials_Pipeline* instead of with *Fiducials__process*().
+    Logical pipelined;
+
+    /// @brief The average time per frame spent in *Fiducials__process*()
+    /// (or for a pipelined mode, the total time divided by the number of
+    /// frames.)
+    Double process_time;
+
+    /// @brief The decimation factor to find contours at.
+    Unsigned pyramid_scale;
+
+    /// @brief (*Logical*)1 to enable the non-tag quadrilateral cache.
+    Logical quad_caching;
+
+    /// @brief (*Logical*)1 to only search the regions of interest around
+    /// the previous tags in most frames.
+    Logical roi_tracking;
+
+    /// @brief The wall clock time when the first image was processed.
+    Double start_time;
+
+    /// @brief The *Tag_Dictionary* shared by every *Fiducials* object (or
+    /// null to let each of them build its own.)
+    Tag_Dictionary tag_dictionary;
+
+    /// @brief The thread that *Threshold_Benchmark__instance_run*() runs on.
+    pthread_t thread;
+
+    /// @brief The number of box threshold row bands.
+    Unsigned threshold_bands;
+
+    /// @brief (*Logical*)1 for the Gaussian threshold.
+    Logical threshold_gaussian;
+
+    /// @brief The average time per frame spent thresholding.
+    Double threshold_time;
+};
+
+extern void Threshold_Benchmark__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree);
+extern void Threshold_Benchmark__counters_show(
+  Threshold_Benchmark threshold_benchmark);
+extern Threshold_Benchmark Threshold_Benchmark__create(String label);
+extern Integer Threshold_Benchmark__detection_compare(
+  const void *detection1, const void *detection2);
+extern void Threshold_Benchmark__fiducial_announce(void *announce_object,
+  Integer id, Integer direction, Double world_diagonal,
+  Double x1, Double y1, Double x2, Double y2,
+  Double x3, Double y3, Double x4, Double y4);
+extern void Threshold_Benchmark__free(Threshold_Benchmark threshold_benchmark);
+extern void *Threshold_Benchmark__instance_run(
+  void *threshold_benchmark_pointer);
+extern Double Threshold_Benchmark__instances_run(
+  Threshold_Benchmark reference, List /* <CV_Image> */ images,
+  Unsigned instances_size, Unsigned *differences);
+extern void Threshold_Benchmark__location_announce(void *announce_object,
+  Integer id, Double x, Double y, Double z, Double bearing);
+extern Threshold_Benchmark Threshold_Benchmark__mode_add(
+  List /* <Threshold_Benchmark> */ modes, String label);
+extern void Threshold_Benchmark__mode_run(
+  Threshold_Benchmark threshold_benchmark, List /* <CV_Image> */ images);
+extern Unsigned Threshold_Benchmark__recall_count(
+  Threshold_Benchmark reference, Threshold_Benchmark threshold_benchmark);
+extern void Threshold_Benchmark__tag_announce(void *announce_object,
+  Integer id, Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count);
+extern Double Threshold_Benchmark__threshold_time(
+  List /* <CV_Image> */ images, Logical threshold_gaussian,
+  Unsigned threshold_bands, Unsigned pyramid_scale);
+extern Double Threshold_Benchmark__time(void);
+extern void Threshold_Benchmark_Gate__wait(Threshold_Benchmark_Gate gate);
+
+/// @brief Compare the Gaussian and box adaptive thresholds.
+/// @param arguments_size is the number of arguments
+/// @param arguments is the vector of command line arguments.
+/// @returns 0 for success and 1 if any instance found different tags.
+///
+/// *main*() will read in the .pnm and .tga images listed in *arguments*
+/// (which must all be the same size) and compare the original 45x45
+/// Gaussian adaptive threshold against the 25x25 box threshold with one
+/// row band, with "--bands *N*" row bands (4 by default) and with one row
+/// band on an image decimated by "--pyramid *N*" (2 by default).  For each
+/// mode it reports the time per frame spent thresholding, the time per
+/// frame spent in *Fiducials__process*(), the number of tags found and
+/// the fraction of the tags found by the Gaussian threshold that were
+/// also found (i.e. the recall).  The row bands are used for the gray
+/// scale conversion and the run length encoding of the candidate
+/// quadrilaterals as well as for the box threshold, so the bands mode
+/// finds exactly the same tags as the one band mode.  With "--4k", each
+/// image is tiled into a synthetic 3840x2160 frame to show how the bands
+/// scale on a high resolution sensor.  The one band box threshold is
+/// also run with the candidate rejection cascade turned off and with the
+/// non-tag quadrilateral cache turned off to show how much time each of
+/// them saves, and with *roi_tracking* and then *corners_tracking* turned
+/// on (the images are treated as consecutive frames) to show how much
+/// time each kind of tracking saves.  It is also run with the candidates
+/// decoded on "--decoders *N*" threads (4 by default), which finds exactly
+/// the same tags, and through a *Fiducials_Pipeline* (which runs the
+/// three stages of *Fiducials__process*() on their own threads and turns
+/// the cache and the tracking off.)  The number of candidates rejected at
+/// each stage of the cascade (including the cache hits) and the number of
+/// cache misses are reported for every mode.  Lastly, "--instances *N*"
+/// (4 by default) independent *Fiducials* objects are run over the images
+/// at the same time on their own threads to check that each of them finds
+/// exactly the same tags as the one band mode and to show how the
+/// throughput scales with the number of cores.  The exit status is 1
+/// when any of them does not.  For example:
+///
+///        Threshold_Benchmark lr/*.pnm 3.6mm_28Sep2013/*.tga
+///        Threshold_Benchmark --4k --bands 8 lr/*.pnm
+
+int main(int arguments_size, char *arguments[]) {
+    // Parse the command line arguments:
+    List /* <CV_Image> */ images =
+      List__new("Threshold_Benchmark:main:List__new:images");
+    Unsigned bands = 4;
+    Unsigned decoders = 4;
+    Unsigned instances = 4;
+    Unsigned pyramid_scale = 2;
+    Logical synthetic_4k = (Logical)0;
+    for (Integer index = 1; index < arguments_size; index++) {
+	String argument = arguments[index];
+	Unsigned size = String__size(argument);
+	CV_Image image = (CV_Image)0;
+	if (String__equal(argument, "--4k")) {
+	    synthetic_4k = (Logical)1;
+	} else if (String__equal(argument, "--bands") &&
+	  index + 1 < arguments_size) {
+	    index += 1;
+	    bands = String__to_unsigned(arguments[index]);
+	} else if (String__equal(argument, "--decoders") &&
+	  index + 1 < arguments_size) {
+	    index += 1;
+	    decoders = String__to_unsigned(arguments[index]);
+	} else if (String__equal(argument, "--instances") &&
+	  index + 1 < arguments_size) {
+	    index += 1;
+	    instances = String__to_unsigned(arguments[index]);
+	} else if (String__equal(argument, "--pyramid") &&
+	  index + 1 < arguments_size) {
+	    index += 1;
+	    pyramid_scale = String__to_unsigned(arguments[index]);
+	} else if (size > 4 && String__equal(argument + size - 4, ".pnm")) {
+	    image = CV_Image__pnm_read(argument);
+	} else if (size > 4 && String__equal(argument + size - 4, ".tga")) {
+	    image = CV_Image__tga_read((CV_Image)0, argument);
+	} else {
+	    File__format(stderr, "Unrecoginized argument '%s'\n", argument);
+	}
+	if (image != (CV_Image)0) {
+	    List__append(images, (Memory)image,
+	      "Threshold_Benchmark:main:List__append:images");
+	}
+    }
+    Unsigned images_size = List__size(images);
+    if (images_size == 0) {
+	File__format(stderr,
+	  "Usage: Threshold_Benchmark [--4k] [--bands N] [--decoders N]"
+	  " [--instances N] [--pyramid N] *.pnm *.tga\n");
+	return 1;
+    }
+
+    // *Fiducials* needs all the images to be the same size:
+    CV_Image image0 = (CV_Image)List__fetch(images, 0);
+    for (Unsigned index = 1; index < images_size; index++) {
+	CV_Image image = (CV_Image)List__fetch(images, index);
+	assert (CV_Image__width_get(image) == CV_Image__width_get(image0) &&
+	  CV_Image__height_get(image) == CV_Image__height_get(image0));
+    }
+
+    // With "--4k", replace each image with a 3840x2160 frame tiled with
+    // copies of it:
+    if (synthetic_4k) {
+	List /* <CV_Image> */ frames =
+	  List__new("Threshold_Benchmark:main:List__new:frames");
+	CV_Size frame_size = CV_Size__create(3840, 2160);
+	for (Unsigned index = 0; index < images_size; index++) {
+	    CV_Image image = (CV_Image)List__fetch(images, index);
+	    Integer channels = CV_Image__channels_get(image);
+	    CV_Image frame =
+	      CV_Image__create(frame_size, CV__depth_8u, (Unsigned)channels);
+	    CV_Image__repeat(image, frame);
+	    List__append(frames, (Memory)frame,
+	      "Threshold_Benchmark:main:List__append:frames");
+	    CV__release_image(image);
+	}
+	CV_Size__free(frame_size);
+	List__free(images);
+	images = frames;
+    }
+
+    // Describe each mode by how it differs from the one band box
+    // threshold that *Threshold_Benchmark__create*() sets up:
+    List /* <Threshold_Benchmark> */ modes =
+      List__new("Threshold_Benchmark:main:List__new:modes");
+    Threshold_Benchmark gaussian =
+      Threshold_Benchmark__mode_add(modes, String__format("gaussian 45x45"));
+    gaussian->threshold_gaussian = (Logical)1;
+    Threshold_Benchmark box = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 1 band"));
+    Threshold_Benchmark mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 %d bands", bands));
+    mode->threshold_bands = bands;
+    mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 pyramid %d", pyramid_scale));
+    mode->pyramid_scale = pyramid_scale;
+    mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 no cascade"));
+    mode->candidate_cascade = (Logical)0;
+    mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 no cache"));
+    mode->quad_caching = (Logical)0;
+    Threshold_Benchmark tracking = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 tracking"));
+    tracking->roi_tracking = (Logical)1;
+    Threshold_Benchmark corners = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 corners"));
+    corners->corners_tracking = (Logical)1;
+    mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 %d decoders", decoders));
+    mode->decode_threads = decoders;
+    mode = Threshold_Benchmark__mode_add(modes,
+      String__format("box 25x25 pipeline"));
+    mode->pipelined = (Logical)1;
+
+    // Run each mode, sharing one *tag_dictionary* between all of the
+    // *Fiducials* objects:
+    Tag_Dictionary tag_dictionary =
+      Tag_Dictionary__create(FEC__create(8, 4, 4));
+    Unsigned modes_size = List__size(modes);
+    for (Unsigned index = 0; index < modes_size; index++) {
+	mode = (Threshold_Benchmark)List__fetch(modes, index);
+	mode->tag_dictionary = tag_dictionary;
+	mode->threshold_time = Threshold_Benchmark__threshold_time(images,
+	  mode->threshold_gaussian, mode->threshold_bands,
+	  mode->pyramid_scale);
+	Threshold_Benchmark__mode_run(mode, images);
+    }
+    Unsigned instance_differences = 0;
+    Unsigned instances_differences = 0;
+    Double instance_process_time = 0.0;
+    Double instances_process_time = 0.0;
+    if (instances > 0) {
+	instance_process_time = Threshold_Benchmark__instances_run(
+	  box, images, 1, &instance_differences);
+	instances_process_time = Threshold_Benchmark__instances_run(
+	  box, images, instances, &instances_differences);
+	instances_differences += instance_differences;
+    }
+
+    // Print out the results with the recall measured against *gaussian*:
+    File__format(stdout, "%d images\n", images_size);
+    File__format(stdout,
+      "mode                threshold(ms) process(ms)  tags  recall\n");
+    for (Unsigned index = 0; index < modes_size; index++) {
+	mode = (Threshold_Benchmark)List__fetch(modes, index);
+	Double recall = 1.0;
+	if (gaussian->detections_size > 0) {
+	    Unsigned count = Threshold_Benchmark__recall_count(gaussian, mode);
+	    recall = (Double)count / (Double)gaussian->detections_size;
+	}
+	File__format(stdout, "%-20s %10.3f  %10.3f %5d  %.3f\n", mode->label,
+	  mode->threshold_time * 1000.0, mode->process_time * 1000.0,
+	  mode->detections_size, recall);
+    }
+    File__format(stdout, "\n");
+    File__format(stdout, "mode                 candidates    dup  cache"
+      "  shape  probe border decode   tags misses\n");
+    for (Unsigned index = 0; index < modes_size; index++) {
+	Threshold_Benchmark__counters_show(
+	  (Threshold_Benchmark)List__fetch(modes, index));
+    }
+    File__format(stdout, "\n");
+    File__format(stdout, "tracking searched %d full frames and %d regions"
+      " of interest frames\n", tracking->counters.frames_full,
+      tracking->counters.frames_roi);
+    File__format(stdout, "corners searched %d frames and tracked %d tags"
+      " through %d frames\n", corners->counters.frames_full,
+      corners->counters.tags_tracked, corners->counters.frames_tracked);
+    if (instances > 0) {
+	File__format(stdout, "%d instances took %.3f ms per frame versus"
+	  " %.3f ms for one instance (%.2f times the throughput) and %d of"
+	  " them found different tags\n", instances,
+	  instances_process_time * 1000.0, instance_process_time * 1000.0,
+	  instance_process_time / instances_process_time,
+	  instances_differences);
+    }
+
+    // Release everything:
+    for (Unsigned index = 0; index < modes_size; index++) {
+	Threshold_Benchmark__free(
+	  (Threshold_Benchmark)List__fetch(modes, index));
+    }
+    List__free(modes);
+    FEC__free(tag_dictionary->fec);
+    Tag_Dictionary__free(tag_dictionary);
+    for (Unsigned index = 0; index < images_size; index++) {
+	CV__release_image((CV_Image)List__fetch(images, index));
+    }
+    List__free(images);
+    return (instances_differences > 0) ? 1 : 0;
+}
+
+/// @brief Ignore an arc announcement.
+/// @param announce_object is unused.
+/// @param from_id is unused.
+/// @param from_x is unused.
+/// @param from_y is unused.
+/// @param from_z is unused.
+/// @param to_id is unused.
+/// @param to_x is unused.
+/// @param to_y is unused.
+/// @param to_z is unused.
+/// @param goodness is unused.
+/// @param in_spanning_tree is unused.
+///
+/// *Threshold_Benchmark__arc_announce*() does nothing so that the
+/// benchmark output is not cluttered with arc announcements.
+
+void Threshold_Benchmark__arc_announce(void *announce_object,
+  Integer from_id, Double from_x, Double from_y, Double from_z,
+  Integer to_id, Double to_x, Double to_y, Double to_z,
+  Double goodness, Logical in_spanning_tree) {
+}
+
+/// @brief Print the candidate rejection counts for one mode.
+/// @param threshold_benchmark contains the counts to print.
+///
+/// *Threshold_Benchmark__counters_show*() will print one row of the
+/// candidate rejection table for *threshold_benchmark* labeled with its
+/// *label*.
+
+void Threshold_Benchmark__counters_show(
+  Threshold_Benchmark threshold_benchmark) {
+    Fiducials_Counters counters = &threshold_benchmark->counters;
+    File__format(stdout, "%-20s %11d %6d %6d %6d %6d %6d %6d %6d %6d\n",
+      threshold_benchmark->label, counters->candidates,
+      counters->rejected_duplicate, counters->cache_hits,
+      counters->rejected_shape, counters->rejected_probe,
+      counters->rejected_border, counters->rejected_decode, counters->tags,
+      counters->cache_misses);
+}
+
+/// @brief Return a new one band box threshold *Threshold_Benchmark*.
+/// @param label is the name of the mode (which is taken over.)
+/// @returns a new *Threshold_Benchmark* object.
+///
+/// *Threshold_Benchmark__create*() will create and return a new
+/// *Threshold_Benchmark* named *label* that runs the 25x25 box threshold
+/// with one row band, the candidate rejection cascade and the non-tag
+/// quadrilateral cache, and decodes on one thread.  The other modes are
+/// made by changing its settings before it is run.
+
+Threshold_Benchmark Threshold_Benchmark__create(String label) {
+    Threshold_Benchmark threshold_benchmark =
+      Memory__new(Threshold_Benchmark, "Threshold_Benchmark__create");
+    threshold_benchmark->candidate_cascade = (Logical)1;
+    threshold_benchmark->corners_tracking = (Logical)0;
+    threshold_benchmark->decode_threads = 1;
+    threshold_benchmark->detections = (Unsigned *)0;
+    threshold_benchmark->detections_allocated = 0;
+    threshold_benchmark->detections_size = 0;
+    threshold_benchmark->end_time = 0.0;
+    threshold_benchmark->fiducials = (Fiducials)0;
+    threshold_benchmark->gate = (Threshold_Benchmark_Gate)0;
+    threshold_benchmark->images = (List)0;
+    threshold_benchmark->label = label;
+    threshold_benchmark->log_file_name = "Threshold_Benchmark.log";
+    threshold_benchmark->pipelined = (Logical)0;
+    threshold_benchmark->process_time = 0.0;
+    threshold_benchmark->pyramid_scale = 1;
+    threshold_benchmark->quad_caching = (Logical)1;
+    threshold_benchmark->roi_tracking = (Logical)0;
+    threshold_benchmark->start_time = 0.0;
+    threshold_benchmark->tag_dictionary = (Tag_Dictionary)0;
+    threshold_benchmark->threshold_bands = 1;
+    threshold_benchmark->threshold_gaussian = (Logical)0;
+    threshold_benchmark->threshold_time = 0.0;
+    return threshold_benchmark;
+}
+
+/// @brief Compare two detections for *qsort*().
+/// @param detection1 is a pointer to the first *Unsigned* detection.
+/// @param detection2 is a pointer to the second *Unsigned* detection.
+/// @returns -1, 0, or 1 depending upon the comparison.
+///
+/// *Threshold_Benchmark__detection_compare*() will compare the
+/// detections pointed to by *detection1* and *detection2*.
+
+Integer Threshold_Benchmark__detection_compare(
+  const void *detection1, const void *detection2) {
+    return Unsigned__compare(
+      *(const Unsigned *)detection1, *(const Unsigned *)detection2);
+}
+
+/// @brief Record a found fiducial.
+/// @param announce_object is the *Threshold_Benchmark* object.
+/// @param id is the tag id.
+/// @param direction is unused.
+/// @param world_diagonal is unused.
+/// @param x1 is unused.
+/// @param y1 is unused.
+/// @param x2 is unused.
+/// @param y2 is unused.
+/// @param x3 is unused.
+/// @param y3 is unused.
+/// @param x4 is unused.
+/// @param y4 is unused.
+///
+/// *Threshold_Benchmark__fiducial_announce*() will append *id* for the
+/// current image to the detections in *announce_object*.
+
+void Threshold_Benchmark__fiducial_announce(void *announce_object,
+  Integer id, Integer direction, Double world_diagonal,
+  Double x1, Double y1, Double x2, Double y2,
+  Double x3, Double y3, Double x4, Double y4) {
+    Threshold_Benchmark threshold_benchmark =
+      (Threshold_Benchmark)announce_object;
+
+    // Make sure there is room for one more detection:
+    Unsigned size = threshold_benchmark->detections_size;
+    if (size >= threshold_benchmark->detections_allocated) {
+	Unsigned allocated = 2 * threshold_benchmark->detections_allocated;
+	threshold_benchmark->detections = (Unsigned *)Memory__reallocate(
+	  (Memory)threshold_benchmark->detections,
+	  allocated * sizeof(Unsigned),
+	  "Threshold_Benchmark__fiducial_announce");
+	threshold_benchmark->detections_allocated = allocated;
+    }
+    Unsigned image_index =
+      threshold_benchmark->fiducials->update_sequence_number;
+    threshold_benchmark->detections[size] =
+      (image_index << 16) | ((Unsigned)id & 0xffff);
+    threshold_benchmark->detections_size = size + 1;
+}
+
+/// @brief Release the storage associated with *threshold_benchmark*.
+/// @param threshold_benchmark is the *Threshold_Benchmark* to release.
+///
+/// *Threshold_Benchmark__free*() will release the storage associated with
+/// *threshold_benchmark* (including its detections and *label*.)
+
+void Threshold_Benchmark__free(Threshold_Benchmark threshold_benchmark) {
+    if (threshold_benchmark->detections != (Unsigned *)0) {
+	Memory__free((Memory)threshold_benchmark->detections);
+    }
+    String__free(threshold_benchmark->label);
+    Memory__free((Memory)threshold_benchmark);
+}
+
+/// @brief Run *Threshold_Benchmark__mode_run*() on a thread.
+/// @param threshold_benchmark_pointer is the *Threshold_Benchmark* to run.
+/// @returns (void *)0.
+///
+/// *Threshold_Benchmark__instance_run*() will run the *images* of
+/// *threshold_benchmark_pointer* through a *Fiducials* object of its own
+/// with its settings.  It is used directly as a thread body.
+
+void *Threshold_Benchmark__instance_run(void *threshold_benchmark_pointer) {
+    Threshold_Benchmark threshold_benchmark =
+      (Threshold_Benchmark)threshold_benchmark_pointer;
+    Threshold_Benchmark__mode_run(
+      threshold_benchmark, threshold_benchmark->images);
+    return (void *)0;
+}
+
+/// @brief Run several independent *Fiducials* objects at the same time.
+/// @param reference is the one band box threshold *Threshold_Benchmark*.
+/// @param images is the list of images to process.
+/// @param instances_size is the number of *Fiducials* objects (and
+/// threads) to run.
+/// @param differences is where the number of instances that did not find
+/// the same tags as *reference* is stored.
+/// @returns the wall clock time per frame over all of the instances.
+///
+/// *Threshold_Benchmark__instances_run*() will run *images* through
+/// *instances_size* *Fiducials* objects at the same time, each on its own
+/// thread with the same settings as *reference*.  Since the *Fiducials*
+/// objects only share the read only *Tag_Dictionary*, each of them must
+/// find exactly the same tags as *reference*, and the time per frame
+/// should shrink in proportion to the number of cores.  Creating a
+/// *Fiducials* object takes longer than processing a few images, so
+/// each instance waits at a gate until all of them are created, and only
+/// the time from the first instance starting on its images to the last
+/// one finishing is counted.  Each instance writes its own log file.
+
+Double Threshold_Benchmark__instances_run(
+  Threshold_Benchmark reference, List /* <CV_Image> */ images,
+  Unsigned instances_size, Unsigned *differences) {
+    struct Threshold_Benchmark_Gate__Struct gate_struct;
+    Threshold_Benchmark_Gate gate = &gate_struct;
+    Integer result = pthread_mutex_init(&gate->mutex,
+      (pthread_mutexattr_t *)0);
+    assert (result == 0);
+    result = pthread_cond_init(&gate->condition, (pthread_condattr_t *)0);
+    assert (result == 0);
+    gate->waiting = instances_size;
+
+    // Each instance starts out with the settings of *reference*
+    // (*Threshold_Benchmark__mode_run*() gives it detections of its own):
+    Threshold_Benchmark instances = (Threshold_Benchmark)Memory__allocate(
+      instances_size * sizeof(struct Threshold_Benchmark__Struct),
+      "Threshold_Benchmark__instances_run");
+    for (Unsigned index = 0; index < instances_size; index++) {
+	instances[index] = *reference;
+	instances[index].gate = gate;
+	instances[index].images = images;
+	instances[index].log_file_name =
+	  String__format("Threshold_Benchmark_%d.log", index);
+    }
+
+    // Run all of the instances at once:
+    for (Unsigned index = 0; index < instances_size; index++) {
+	Threshold_Benchmark instance = &instances[index];
+	result = pthread_create(&instance->thread,
+	  (pthread_attr_t *)0, Threshold_Benchmark__instance_run,
+	  (void *)instance);
+	assert (result == 0);
+    }
+    for (Unsigned index = 0; index < instances_size; index++) {
+	result = pthread_join(instances[index].thread, (void **)0);
+	assert (result == 0);
+    }
+    result = pthread_cond_destroy(&gate->condition);
+    assert (result == 0);
+    result = pthread_mutex_destroy(&gate->mutex);
+    assert (result == 0);
+
+    // Time from the first instance starting to the last one finishing:
+    Double start_time = instances[0].start_time;
+    Double end_time = instances[0].end_time;
+    for (Unsigned index = 1; index < instances_size; index++) {
+	start_time = Double__minimum(start_time, instances[index].start_time);
+	end_time = Double__maximum(end_time, instances[index].end_time);
+    }
+    Double time = end_time - start_time;
+
+    // Count the instances that did not find exactly the tags of
+    // *reference*:
+    Unsigned differences_size = 0;
+    for (Unsigned index = 0; index < instances_size; index++) {
+	Threshold_Benchmark instance = &instances[index];
+	if (instance->detections_size != reference->detections_size ||
+	  Threshold_Benchmark__recall_count(reference, instance) !=
+	  reference->detections_size) {
+	    differences_size += 1;
+	}
+	Memory__free((Memory)instance->detections);
+	String__free(instance->log_file_name);
+    }
+    Memory__free((Memory)instances);
+    *differences = differences_size;
+    return time / (Double)(instances_size * List__size(images));
+}
+
+/// @brief Ignore a location announcement.
+/// @param announce_object is unused.
+/// @param id is unused.
+/// @param x is unused.
+/// @param y is unused.
+/// @param z is unused.
+/// @param bearing is unused.
+///
+/// *Threshold_Benchmark__location_announce*() does nothing so that the
+/// benchmark output is not cluttered with location announcements.
+
+void Threshold_Benchmark__location_announce(void *announce_object,
+  Integer id, Double x, Double y, Double z, Double bearing) {
+}
+
+/// @brief Append a new mode to *modes*.
+/// @param modes is the list of modes to append to.
+/// @param label is the name of the mode (which is taken over.)
+/// @returns the new *Threshold_Benchmark* mode.
+///
+/// *Threshold_Benchmark__mode_add*() will create a one band box threshold
+/// *Threshold_Benchmark* named *label*, append it to *modes* and return
+/// it so that its settings can be changed.
+
+Threshold_Benchmark Threshold_Benchmark__mode_add(
+  List /* <Threshold_Benchmark> */ modes, String label) {
+    Threshold_Benchmark mode = Threshold_Benchmark__create(label);
+    List__append(modes, (Memory)mode,
+      "Threshold_Benchmark__mode_add:List__append:modes");
+    return mode;
+}
+
+/// @brief Run *Fiducials__process*() over *images* with one mode.
+/// @param threshold_benchmark is the mode to run (and where the found tags
+/// are recorded.)
+/// @param images is the list of images to process.
+///
+/// *Threshold_Benchmark__mode_run*() will create a *Fiducials* object with
+/// the settings of *threshold_benchmark*, run each image in *images*
+/// through *Fiducials__process*(), and record the tags found in
+/// *threshold_benchmark* sorted by image and tag id along with the
+/// candidate rejection counts and the average time per frame in
+/// *process_time*.
+
+void Threshold_Benchmark__mode_run(
+  Threshold_Benchmark threshold_benchmark, List /* <CV_Image> */ images) {
+    // Initialize *threshold_benchmark*:
+    threshold_benchmark->detections_allocated = 16;
+    threshold_benchmark->detections = (Unsigned *)Memory__allocate(
+      threshold_benchmark->detections_allocated * sizeof(Unsigned),
+      "Threshold_Benchmark__mode_run");
+    threshold_benchmark->detections_size = 0;
+
+    // Create *fiducials* with no map files and quiet announce routines:
+    CV_Image image0 = (CV_Image)List__fetch(images, 0);
+    Fiducials_Create fiducials_create = Fiducials_Create__create();
+    fiducials_create->fiducials_path = (String_Const)".";
+    fiducials_create->announce_object = (Memory)threshold_benchmark;
+    fiducials_create->arc_announce_routine =
+      Threshold_Benchmark__arc_announce;
+    fiducials_create->location_announce_routine =
+      Threshold_Benchmark__location_announce;
+    fiducials_create->tag_announce_routine =
+      Threshold_Benchmark__tag_announce;
+    fiducials_create->fiducial_announce_routine =
+      Threshold_Benchmark__fiducial_announce;
+    fiducials_create->log_file_name = threshold_benchmark->log_file_name;
+    fiducials_create->map_base_name = (String_Const)0;
+    fiducials_create->tag_heights_file_name =
+      (String_Const)"Tag_Heights.xml";
+    fiducials_create->tag_dictionary = threshold_benchmark->tag_dictionary;
+    Fiducials fiducials = Fiducials__create(image0, fiducials_create);
+    Fiducials_Create__free(fiducials_create);
+    threshold_benchmark->fiducials = fiducials;
+    fiducials->threshold_gaussian = threshold_benchmark->threshold_gaussian;
+    fiducials->threshold_bands = threshold_benchmark->threshold_bands;
+    fiducials->pyramid_scale = threshold_benchmark->pyramid_scale;
+    fiducials->candidate_cascade = threshold_benchmark->candidate_cascade;
+    fiducials->quad_caching = threshold_benchmark->quad_caching;
+    fiducials->roi_tracking = threshold_benchmark->roi_tracking;
+    fiducials->corners_tracking = threshold_benchmark->corners_tracking;
+    fiducials->decode_threads = threshold_benchmark->decode_threads;
+
+    // Wait for the other instances (if any) to be created:
+    if (threshold_benchmark->gate != (Threshold_Benchmark_Gate)0) {
+	Threshold_Benchmark_Gate__wait(threshold_benchmark->gate);
+    }
+
+    // Process each image:
+    Unsigned images_size = List__size(images);
+    Double time = 0.0;
+    if (threshold_benchmark->pipelined) {
+	// The stages of the frames overlap, so only the total time from the
+	// first push until the last frame is done means anything:
+	Fiducials_Pipeline pipeline = Fiducials_Pipeline__create(fiducials);
+	threshold_benchmark->start_time = Threshold_Benchmark__time();
+	for (Unsigned index = 0; index < images_size; index++) {
+	    Fiducials_Pipeline__push(
+	      pipeline, (CV_Image)List__fetch(images, index));
+	}
+	Fiducials_Pipeline__flush(pipeline);
+	threshold_benchmark->end_time = Threshold_Benchmark__time();
+	time = threshold_benchmark->end_time - threshold_benchmark->start_time;
+	Fiducials_Pipeline__free(pipeline);
+    } else {
+	threshold_benchmark->start_time = Threshold_Benchmark__time();
+	for (Unsigned index = 0; index < images_size; index++) {
+	    CV_Image image = (CV_Image)List__fetch(images, index);
+	    Fiducials__image_set(fiducials, image);
+	    Double start_time = Threshold_Benchmark__time();
+	    Fiducials__process(fiducials);
+	    time += Threshold_Benchmark__time() - start_time;
+	}
+	threshold_benchmark->end_time = Threshold_Benchmark__time();
+    }
+    threshold_benchmark->counters = *fiducials->counters;
+    Fiducials__free(fiducials);
+    threshold_benchmark->fiducials = (Fiducials)0;
+
+    // Sort the detections to make recall counting easy:
+    qsort((void *)threshold_benchmark->detections,
+      (size_t)threshold_benchmark->detections_size, sizeof(Unsigned),
+      Threshold_Benchmark__detection_compare);
+    threshold_benchmark->process_time = time / (Double)images_size;
+}
+
+/// @brief Return the number of tags in *reference* also found by
+///        *threshold_benchmark*.
+/// @param reference is the *Threshold_Benchmark* to compare against.
+/// @param threshold_benchmark is the *Threshold_Benchmark* to check.
+/// @returns the number of matching detections.
+///
+/// *Threshold_Benchmark__recall_count*() will return the number of
+/// detections in *reference* that are matched by a detection of the same
+/// tag in the same image in *threshold_benchmark*.  Both detection lists
+/// must be sorted.
+
+Unsigned Threshold_Benchmark__recall_count(
+  Threshold_Benchmark reference, Threshold_Benchmark threshold_benchmark) {
+    Unsigned count = 0;
+    Unsigned index = 0;
+    Unsigned size = threshold_benchmark->detections_size;
+    for (Unsigned reference_index = 0;
+      reference_index < reference->detections_size; reference_index++) {
+	Unsigned detection = reference->detections[reference_index];
+	while (index < size &&
+	  threshold_benchmark->detections[index] < detection) {
+	    index += 1;
+	}
+	if (index < size &&
+	  threshold_benchmark->detections[index] == detection) {
+	    count += 1;
+	    index += 1;
+	}
+    }
+    return count;
+}
+
+/// @brief Ignore a tag announcement.
+/// @param announce_object is unused.
+/// @param id is unused.
+/// @param x is unused.
+/// @param y is unused.
+/// @param z is unused.
+/// @param twist is unused.
+/// @param diagonal is unused.
+/// @param distance_per_pixel is unused.
+/// @param visible is unused.
+/// @param hop_count is unused.
+///
+/// *Threshold_Benchmark__tag_announce*() does nothing so that the
+/// benchmark output is not cluttered with tag announcements.
+
+void Threshold_Benchmark__tag_announce(void *announce_object,
+  Integer id, Double x, Double y, Double z, Double twist, Double diagonal,
+  Double distance_per_pixel, Logical visible, Integer hop_count) {
+}
+
+/// @brief Return the time spent thresholding each of *images*.
+/// @param images is the list of images to threshold.
+/// @param threshold_gaussian is (*Logical*)1 for the Gaussian threshold.
+/// @param threshold_bands is the number of box threshold row bands.
+/// @param pyramid_scale is the decimation factor to threshold at.
+/// @returns the average time per frame in seconds.
+///
+/// *Threshold_Benchmark__threshold_time*() will convert each image in
+/// *images* to gray scale and time just the decimation and adaptive
+/// threshold steps of *Fiducials__process*() using the mode specified by
+/// *threshold_gaussian*, *threshold_bands* and *pyramid_scale*.
+
+Double Threshold_Benchmark__threshold_time(List /* <CV_Image> */ images,
+  Logical threshold_gaussian, Unsigned threshold_bands,
+  Unsigned pyramid_scale) {
+    CV_Image image0 = (CV_Image)List__fetch(images, 0);
+    CV_Size size = CV_Size__create(
+      CV_Image__width_get(image0), CV_Image__height_get(image0));
+    Integer scale = (Integer)pyramid_scale;
+    CV_Size pyramid_size = CV_Size__create(
+      CV_Image__width_get(image0) / scale,
+      CV_Image__height_get(image0) / scale);
+    CV_Image gray_image = CV_Image__create(size, CV__depth_8u, 1);
+    CV_Image pyramid_image = CV_Image__create(pyramid_size, CV__depth_8u, 1);
+    CV_Image edge_image = CV_Image__create(pyramid_size, CV__depth_8u, 1);
+
+    Unsigned repeats = 10;
+    Unsigned images_size = List__size(images);
+    Double time = 0.0;
+    for (Unsigned index = 0; index < images_size; index++) {
+	// Convert *image* to gray scale:
+	CV_Image image = (CV_Image)List__fetch(images, index);
+	if (CV_Image__channels_get(image) == 3) {
+	    CV_Image__convert_color(image, gray_image, CV__rgb_to_gray);
+	} else {
+	    CV_Image__copy(image, gray_image, (CV_Image)0);
+	}
+
+	// Time the threshold with the same parameters as *Fiducials__process*:
+	Double start_time = Threshold_Benchmark__time();
+	for (Unsigned repeat = 0; repeat < repeats; repeat++) {
+	    CV_Image threshold_image = gray_image;
+	    if (scale > 1) {
+		CV_Image__gray_decimate(
+		  gray_image, pyramid_image, pyramid_scale);
+		threshold_image = pyramid_image;
+	    }
+	    if (threshold_gaussian) {
+		CV_Image__adaptive_threshold(threshold_image, edge_image,
+		  255.0, CV__adaptive_thresh_gaussian_c, CV__thresh_binary,
+		  (45 / scale) | 1, 5.0);
+	    } else {
+		CV_Image__box_threshold(threshold_image, edge_image,
+		  255, (25 / scale) | 1, 5.0, threshold_bands);
+	    }
+	}
+	time += Threshold_Benchmark__time() - start_time;
+    }
+
+    CV__release_image(gray_image);
+    CV__release_image(pyramid_image);
+    CV__release_image(edge_image);
+    CV_Size__free(size);
+    CV_Size__free(pyramid_size);
+    return time / (Double)(images_size * repeats);
+}
+
+/// @brief Return the current wall clock time in seconds.
+/// @returns the current time in seconds.
+///
+/// *Threshold_Benchmark__time*() will return the current wall clock time.
+/// Wall clock time is used rather than *clock*() since the banded
+/// threshold runs on several threads.
+
+Double Threshold_Benchmark__time(void) {
+    struct timeval time_value;
+    Integer result = gettimeofday(&time_value, (struct timezone *)0);
+    assert (result == 0);
+    return (Double)time_value.tv_sec + (Double)time_value.tv_usec / 1000000.0;
+}
+
+/// @brief Wait until every thread has arrived at *gate*.
+/// @param gate is the *Threshold_Benchmark_Gate* to wait at.
+///
+/// *Threshold_Benchmark_Gate__wait*() will count the calling thread as
+/// arrived at *gate* and wait until the *waiting* count reaches zero.
+
+void Threshold_Benchmark_Gate__wait(Threshold_Benchmark_Gate gate) {
+    pthread_mutex_lock(&gate->mutex);
+    gate->waiting -= 1;
+    if (gate->waiting == 0) {
+	pthread_cond_broadcast(&gate->condition);
+    }
+    while (gate->waiting > 0) {
+	pthread_cond_wait(&gate->condition, &gate->mutex);
+    }
+    pthread_mutex_unlock(&gate->mutex);
+}
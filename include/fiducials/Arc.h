@@ -97,6 +97,7 @@ extern Arc Arc__create(Tag from_tag, Double from_twist,
 extern void Arc__free(Arc arc);
 extern Arc Arc__new(String from);
 extern Unsigned Arc__hash(Arc arc);
+extern Tag Arc__other_tag(Arc arc, Tag tag);
 extern Arc Arc__read(File out_file, Map map);
 extern void Arc__svg_write(Arc arc, SVG svg);
 extern void Arc__update(
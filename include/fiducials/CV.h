@@ -3,6 +3,8 @@
 #if !defined(CV_C_H_INCLUDED)
 #define CV_C_H_INCLUDED 1
 
+#include <pthread.h>
+
 #include "opencv/cv.h"
 #include "opencv/highgui.h"
 
@@ -16,6 +18,7 @@
 extern "C" {
 #endif
 typedef CvContour *CV_Contour;
+typedef struct CV_Gray_Band__Struct *CV_Gray_Band;
 typedef IplImage *CV_Image;
 typedef CvMat *CV_Matrix;
 typedef CvMemStorage *CV_Memory_Storage;
@@ -27,6 +30,85 @@ typedef CvSeq *CV_Sequence;
 typedef CvSize *CV_Size;
 typedef CvSlice *CV_Slice;
 typedef CvTermCriteria *CV_Term_Criteria;
+typedef struct CV_Threshold_Band__Struct *CV_Threshold_Band;
+
+/// @brief Marks a *CV__remap_table_create*() entry that maps outside of
+/// the source image.
+#define CV_REMAP_OUTSIDE 0xffffffff
+
+/// @brief The most gradient samples *CV_Image__corners_line_fit*() takes
+/// along each side of a quadrilateral.
+#define CV_LINE_FIT_SAMPLES_MAXIMUM 32
+
+/// @brief The smallest step in gray level (over 1 pixel) that
+/// *CV_Image__corners_line_fit*() will accept as a point on an edge.
+#define CV_LINE_FIT_STEP_MINIMUM 8
+
+/// @brief Number of lens parameters read by *CV__lens_calibrate_read*().
+#define CV_LENS_SIZE 8
+
+/// @brief The most row bands *CV_Image__box_threshold*() and
+/// *CV_Image__gray_undistort_smooth*() will use.
+#define CV_THRESHOLD_BANDS_MAXIMUM 16
+
+/// @brief A *CV_Gray_Band* is a horizontal band of rows that
+/// *CV_Image__gray_undistort_smooth*() converts on its own thread.
+struct CV_Gray_Band__Struct {
+    /// @brief (*Logical*)1 to apply a 3x3 Gaussian blur.
+    Logical blur;
+
+    /// @brief 8-bit gray scale image to write the band into.
+    CV_Image destination_image;
+
+    /// @brief One past the last row of the band.
+    Integer end_row;
+
+    /// @brief Remap table from *CV__remap_table_create*().
+    Unsigned *remap_table;
+
+    /// @brief 8-bit gray scale or BGR image to convert.
+    CV_Image source_image;
+
+    /// @brief First row of the band.
+    Integer start_row;
+
+    /// @brief Thread that processes the band.
+    pthread_t thread;
+};
+
+/// @brief A *CV_Threshold_Band* is a horizontal band of rows that
+/// *CV_Image__box_threshold*() thresholds on its own thread.
+struct CV_Threshold_Band__Struct {
+    /// @brief Odd width and height of the box to average over.
+    Integer block_size;
+
+    /// @brief Amount the mean is lowered by before comparing.
+    Integer delta;
+
+    /// @brief Image to write the thresholded rows into.
+    CV_Image destination_image;
+
+    /// @brief One past the last column of the band.
+    Integer end_column;
+
+    /// @brief One past the last row of the band.
+    Integer end_row;
+
+    /// @brief Value written for pixels above the threshold.
+    Integer maximum_value;
+
+    /// @brief 8-bit gray scale image to threshold.
+    CV_Image source_image;
+
+    /// @brief First column of the band.
+    Integer start_column;
+
+    /// @brief First row of the band.
+    Integer start_row;
+
+    /// @brief Thread that processes the band.
+    pthread_t thread;
+};
 
 extern Integer CV__chain_approx_simple;
 extern Integer CV__adaptive_thresh_gaussian_c;
@@ -34,11 +116,19 @@ extern Integer CV__depth_8u;
 extern Integer CV__gaussian;
 extern Integer CV__gray_to_rgb;
 extern Integer CV__poly_approx_dp;
+extern Integer CV__retr_ccomp;
 extern Integer CV__retr_list;
 extern Integer CV__rgb_to_gray;
 extern Integer CV__thresh_binary;
 extern Integer CV__window_auto_size;
+extern CV_Slice CV__whole_seq;
 
+extern Integer CV__lens_calibrate_read(
+  String_Const calibrate_file_name, Double *lens);
+extern void CV__lens_distort(Double *lens, Double *x, Double *y);
+extern void CV__lens_undistort(Double *lens, Double *x, Double *y);
+extern Unsigned *CV__remap_table_create(
+  CV_Image map_x, CV_Image map_y, Integer width, Integer height);
 extern Integer CV__round(Double value);
 extern Integer CV__undistortion_setup(String_Const calibrate_file_name,
   Integer width, Integer height, CV_Image *mapx, CV_Image *mapy);
@@ -48,11 +138,19 @@ extern void CV_Image__adaptive_threshold(CV_Image source_image,
   Integer threshold_type, Integer block_size, Double parameter1);
 extern void CV_Image__blob_draw(
   CV_Image image, Integer x, Integer y, CV_Scalar color);
+extern void CV_Image__box_threshold(CV_Image source_image,
+  CV_Image destination_image, Integer maximum_value, Integer block_size,
+  Double parameter1, Unsigned band_count);
+extern void CV_Image__box_threshold_rectangle(CV_Image source_image,
+  CV_Image destination_image, Integer maximum_value, Integer block_size,
+  Double parameter1, Integer x, Integer y, Integer width, Integer height);
 extern Integer CV_Image__channels_get(CV_Image image);
 extern void CV_Image__convert_color(
   CV_Image source_image, CV_Image destination_image, Integer conversion_code);
 extern void CV_Image__copy(
   CV_Image source_image, CV_Image destination_image, CV_Image mask);
+extern Logical CV_Image__corners_line_fit(
+  CV_Image image, CV_Point2D32F_Vector corners, Double search_distance);
 extern CV_Image CV_Image__create(
   CV_Size size, Unsigned depth, Unsigned channels);
 extern CV_Image CV_Image__header_create(
@@ -70,8 +168,25 @@ extern void CV_Image__find_corner_sub_pix(CV_Image image,
   CV_Size zero_zone, CV_Term_Criteria criteria);
 extern void CV_Image__flip(
   CV_Image from_image, CV_Image to_image, Integer flip_code);
+extern void CV_Image__gray_decimate(
+  CV_Image source_image, CV_Image destination_image, Unsigned scale);
 extern Integer CV_Image__gray_fetch(CV_Image image, Integer x, Integer y);
+extern Double CV_Image__gray_interpolate(CV_Image image, Double x, Double y);
+extern void CV_Image__gray_remap_row(CV_Image source_image,
+  Unsigned *remap_row, Integer width, unsigned char *gray_row);
+extern void CV_Image__gray_undistort_smooth(CV_Image source_image,
+  CV_Image destination_image, Unsigned *remap_table, Logical blur,
+  Unsigned band_count);
+extern void CV_Image__gray_undistort_smooth_rectangle(CV_Image source_image,
+  CV_Image destination_image, Unsigned *remap_table, Logical blur,
+  Integer left, Integer top, Integer width, Integer height);
+extern Integer CV_Image__gray_weighted_sum(
+  CV_Image image, Integer x, Integer y, const Integer *weights);
 extern Integer CV_Image__height_get(CV_Image image);
+extern void CV_Image__optical_flow_pyramid_lk(CV_Image previous_image,
+  CV_Image current_image, CV_Point2D32F_Vector previous_points,
+  CV_Point2D32F_Vector current_points, Integer count, CV_Size window,
+  Integer levels, char *status, float *errors, CV_Term_Criteria criteria);
 extern Integer CV_Image__points_maximum(CV_Image image,
   CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index);
 extern Integer CV_Image__points_minimum(CV_Image image,
@@ -79,11 +194,14 @@ extern Integer CV_Image__points_minimum(CV_Image image,
 extern Integer CV_Image__point_sample(CV_Image image, CV_Point2D32F point);
 extern void CV_Image__remap(CV_Image source_image, CV_Image destination_image,
   CV_Image map_x, CV_Image map_y, Integer flags, CV_Scalar fill_value);
+extern void CV_Image__repeat(CV_Image source_image, CV_Image destination_image);
 extern Integer CV_Image__save(
   CV_Image image, String_Const file_name, Integer *parameters);
 extern void CV_Image__smooth(CV_Image source_image, CV_Image destination_image,
   Integer smooth_type, Integer parameter1, Integer parameter2,
   Double parameter3, Double parameter4);
+extern void CV_Image__store3(
+  CV_Image image, Unsigned x, Unsigned y, Unsigned channel, Unsigned value);
 extern CV_Image CV_Image__pnm_read(String_Const file_base_name);
 extern void CV_Image__pnm_write(CV_Image image, String_Const file_base_name);
 extern CV_Image CV_Image__tga_read(CV_Image image, String_Const file_name);
@@ -126,6 +244,7 @@ extern CV_Sequence CV_Sequence__approximate_polygon(CV_Sequence contour,
 extern Double CV_Sequence__arc_length(
  CV_Sequence contour, CV_Slice slice, Integer is_closed);
 extern Logical CV_Sequence__check_contour_convexity(CV_Sequence contour);
+extern CV_Sequence CV_Sequence__child_get(CV_Sequence sequence);
 extern Double CV_Sequence__contour_area(
   CV_Sequence contour, CV_Slice slice, Integer oriented);
 extern CV_Sequence CV_Sequence__next_get(CV_Sequence sequence);
@@ -135,6 +254,10 @@ extern Integer CV_Sequence__total_get(CV_Sequence sequence);
 extern CV_Size CV_Size__create(Integer width, Integer height);
 extern void CV_Size__free(CV_Size cv_size);
 
+extern void *CV_Gray_Band__process(void *band);
+
+extern void *CV_Threshold_Band__process(void *band);
+
 extern void CV__release_image(CV_Image image);
 #ifdef __cplusplus
 }
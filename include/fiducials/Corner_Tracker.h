@@ -0,0 +1,87 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#if !defined(CORNER_TRACKER_H_INCLUDED)
+#define CORNER_TRACKER_H_INCLUDED 1
+
+/// @brief *Corner_Tracker* is a pointer to a *Corner_Tracker__Struct*
+/// object.
+typedef struct Corner_Tracker__Struct *Corner_Tracker;
+
+/// @brief The largest mean pixel difference between the window around
+/// a corner and the window around where it was tracked to.
+#define CORNER_TRACKER_ERROR_MAXIMUM 20.0
+
+/// @brief Number of pyramid levels (above the image) to track over.
+#define CORNER_TRACKER_LEVELS 3
+
+/// @brief The most tags that a *Corner_Tracker* will track.
+#define CORNER_TRACKER_TAGS_MAXIMUM 32
+
+/// @brief Width and height of the tracking window at each pyramid level.
+#define CORNER_TRACKER_WINDOW 15
+
+#include "CV.h"
+#include "Double.h"
+#include "Logical.h"
+#include "Unsigned.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// @brief A *Corner_Tracker* follows the 4 corners of each tag found in
+/// one frame into the next frame with pyramidal optical flow, so that the
+/// tags can be located without being found and decoded again.  It keeps
+/// its own copy of the gray scale image that the corners were found in.
+struct Corner_Tracker__Struct {
+    /// @brief When to stop iterating at each pyramid level.
+    CV_Term_Criteria criteria;
+
+    /// @brief The corners tracked into the current frame (4 per tag.)
+    CV_Point2D32F_Vector current_points;
+
+    /// @brief The decode direction of each tag.
+    Unsigned directions[CORNER_TRACKER_TAGS_MAXIMUM];
+
+    /// @brief The tracking error for each corner.
+    float errors[4 * CORNER_TRACKER_TAGS_MAXIMUM];
+
+    /// @brief The gray scale image that *previous_points* are in.
+    CV_Image previous_image;
+
+    /// @brief The corners to track (4 per tag.)
+    CV_Point2D32F_Vector previous_points;
+
+    /// @brief The number of tags to track.
+    Unsigned size;
+
+    /// @brief 1 for each corner that was tracked and 0 otherwise.
+    char status[4 * CORNER_TRACKER_TAGS_MAXIMUM];
+
+    /// @brief The id of each tag.
+    Unsigned tag_ids[CORNER_TRACKER_TAGS_MAXIMUM];
+
+    /// @brief (*Logical*)1 for each tag whose 4 corners were tracked.
+    Logical tracked[CORNER_TRACKER_TAGS_MAXIMUM];
+
+    /// @brief The tracking window size.
+    CV_Size window;
+};
+
+// *Corner_Tracker* routines:
+
+extern void Corner_Tracker__append(Corner_Tracker corner_tracker,
+  Unsigned tag_id, Unsigned direction, Double *corners);
+extern void Corner_Tracker__clear(Corner_Tracker corner_tracker);
+extern void Corner_Tracker__corners_get(
+  Corner_Tracker corner_tracker, Unsigned index, Double *corners);
+extern Corner_Tracker Corner_Tracker__create(void);
+extern void Corner_Tracker__free(Corner_Tracker corner_tracker);
+extern void Corner_Tracker__image_save(
+  Corner_Tracker corner_tracker, CV_Image image);
+extern Unsigned Corner_Tracker__track(
+  Corner_Tracker corner_tracker, CV_Image image);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined(CORNER_TRACKER_H_INCLUDED)
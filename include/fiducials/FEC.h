@@ -49,6 +49,8 @@ typedef struct _rvFec rvFec;
 
 typedef struct _rvFec *FEC;
 
+#include <stdint.h>
+
 #include "Logical.h"
 #include "Unsigned.h"
 
@@ -70,12 +72,17 @@ struct _rvFec
     uintGF *gg;                 // Generator polynomial g(x)
     uintGF *alphaTo;            // Index to polynomial form conversion table.
     uintGF *indexOf;            // Polynomial to index form conversion table.
+
+    // Tag code tables, only present for the (8,4,4) tag code.
+    uintGF *alphaToLong;        // alphaTo[] that does not need modnn().
+    uintGF *tagSyndromes;       // Syndrome of each byte in each position.
 };
 
 // Forward error correcting methods.
 rvFec* rvFec_New(rvInt16 symbolSize, rvInt16 dataSize, rvInt16 paritySize);
 rvInt16 rvFec_Parity(rvFec* self, rvUint8* dataBuffer, rvUint8* parityBuffer);
 rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer);
+rvInt16 rvFec_TagCorrect(rvFec* self, rvUint8* blockBuffer);
 
 #ifdef __cplusplus
 } // "C"
@@ -84,7 +91,10 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer);
 // External declarations:
 
 Logical FEC__correct(FEC fec, Unsigned *data, Unsigned size);
+Logical FEC__reference_correct(FEC fec, Unsigned *data, Unsigned size);
+Logical FEC__word_correct(FEC fec, uint64_t *word);
 void FEC__parity(FEC fec, Unsigned *data, Unsigned size);
 FEC FEC__create(Unsigned symbol_size, Unsigned data_size, Unsigned parity_size);
+void FEC__free(FEC fec);
 
 #endif // !defined(FEC_C_H_INCLUDED)
@@ -4,10 +4,15 @@
 #define FIDUCIALS_H_INCLUDED 1
 
 typedef struct Fiducials__Struct *Fiducials;
+typedef struct Fiducials_Candidate__Struct *Fiducials_Candidate;
+typedef struct Fiducials_Counters__Struct *Fiducials_Counters;
 typedef struct Fiducials_Create__Struct *Fiducials_Create;
+typedef struct Fiducials_Decoder__Struct *Fiducials_Decoder;
+typedef struct Fiducials_Frame__Struct *Fiducials_Frame;
 typedef struct Fiducials_Results__Struct *Fiducials_Results;
 
 #include <assert.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 // #include scalar typedef's first so we can define the announce routine
@@ -39,6 +44,7 @@ typedef void (*Fiducials_Fiducial_Announce_Routine)(void *announce_object,
 // #include everything else:
 #include "Camera_Tag.h"
 #include "Character.h"
+#include "Corner_Tracker.h"
 #include "CRC.h"
 #include "CV.h"
 #include "File.h"
@@ -47,13 +53,71 @@ typedef void (*Fiducials_Fiducial_Announce_Routine)(void *announce_object,
 #include "High_GUI2.h"
 #include "List.h"
 #include "Map.h"
+#include "Quad_Cache.h"
+#include "Quad_Finder.h"
 #include "String.h"
 #include "Tag.h"
+#include "Tag_Dictionary.h"
 #include "Unsigned.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
+/// @brief The largest ratio between the longest and shortest sides (or
+/// diagonals) of a candidate tag; see *Fiducials__quad_shape_check*().
+#define FIDUCIALS_ASPECT_MAXIMUM 4.0
+
+/// @brief The *status* of a *Fiducials_Candidate* that was skipped
+/// because it is in the *quad_cache*.
+#define FIDUCIALS_CANDIDATE_CACHED 0
+
+/// @brief The *status* of a *Fiducials_Candidate* that is the wrong shape.
+#define FIDUCIALS_CANDIDATE_SHAPE 1
+
+/// @brief The *status* of a *Fiducials_Candidate* that failed the border
+/// probe.
+#define FIDUCIALS_CANDIDATE_PROBE 2
+
+/// @brief The *status* of a *Fiducials_Candidate* without enough border
+/// contrast after the sub-pixel corner refinement.
+#define FIDUCIALS_CANDIDATE_BORDER 3
+
+/// @brief The *status* of a *Fiducials_Candidate* that did not decode.
+#define FIDUCIALS_CANDIDATE_DECODE 4
+
+/// @brief The *status* of a *Fiducials_Candidate* that decoded as a tag.
+#define FIDUCIALS_CANDIDATE_TAG 5
+
+/// @brief The most threads that *Fiducials__candidates_decode*() spreads
+/// the candidates over.
+#define FIDUCIALS_DECODERS_MAXIMUM 8
+
+/// @brief The smallest tag diagonal (in pixels) that the contours of a
+/// decimated image can still find; see *Fiducials__pyramid_scale_select*().
+#define FIDUCIALS_PYRAMID_DIAGONAL_MINIMUM 12.0
+
+/// @brief The half size (in tag diagonals) of the box around a tag
+/// predicted by *Fiducials__tags_predict*(), which is then padded by
+/// *Fiducials__roi_append*().  It has to cover the map and odometry error.
+#define FIDUCIALS_PREDICT_SLACK 1.0
+
+/// @brief The default number of frames from one full frame pass to the
+/// next when *roi_tracking* is enabled.
+#define FIDUCIALS_ROI_FULL_INTERVAL 15
+
+/// @brief The number of pixels around each region of interest that are
+/// preprocessed so that the threshold box has valid pixels to average.
+#define FIDUCIALS_ROI_MARGIN 32
+
+/// @brief The padding added to each side of the bounding box of a tag to
+/// get its region of interest, as a fraction of the bounding box size.
+/// It has to cover the motion of the tag from one frame to the next.
+#define FIDUCIALS_ROI_PADDING 0.75
+
+/// @brief The default number of frames from one full detection to the
+/// next when *corners_tracking* is enabled.
+#define FIDUCIALS_TRACK_FULL_INTERVAL 10
+
 typedef Logical Mapping[64];
 typedef struct timeval *Time_Value;
 
@@ -65,50 +129,127 @@ struct Fiducials__Struct {
     Logical blur;
     List /* <Camera_Tag> */ camera_tags;
     List /* <Camera_Tag> */ camera_tags_pool;
+    Logical candidate_cascade;
+    Fiducials_Candidate candidates;
+    Unsigned candidates_allocated;
+    pthread_mutex_t candidates_mutex;
+    Unsigned candidates_next;
+    Corner_Tracker corner_tracker;
     CV_Point2D32F_Vector corners;
+    Logical corners_line_fit;
+    Logical corners_tracking;
+    Fiducials_Counters counters;
+    Logical contours_reference;
     List /* <Tag> */current_visibles;
     CV_Scalar cyan;
     CV_Image debug_image;
     Unsigned debug_index;
+    Unsigned decode_threads;
+    Fiducials_Decoder decoders[FIDUCIALS_DECODERS_MAXIMUM];
     CV_Image edge_image;
     FEC fec;
+    Fiducials_Frame frame;
     CV_Image gray_image;
     CV_Scalar green;
     CV_Size image_size;
     Double last_x;
+    Double lens[CV_LENS_SIZE];
     Double last_y;
     Fiducials_Location_Announce_Routine location_announce_routine;
     Fiducials_Fiducial_Announce_Routine fiducial_announce_routine;
     List /* <Location> */ locations;
     File log_file;
     Map map;
+    Logical odometry_anchored;
+    Double odometry_anchor_etw;
+    Double odometry_anchor_ex;
+    Double odometry_anchor_ey;
+    Double odometry_anchor_rtw;
+    Double odometry_anchor_rx;
+    Double odometry_anchor_ry;
+    Double odometry_etw;
+    Double odometry_ex;
+    Double odometry_ey;
+    Logical odometry_valid;
     CV_Point origin;
     CV_Image original_image;
-    Logical **mappings;
     CV_Image map_x;
     CV_Image map_y;
     String_Const path;
+    Logical pipelined;
+    Logical preprocess_reference;
     List /* <Tag> */ previous_visibles;
     CV_Scalar purple;
+    Unsigned pyramid_scale;
+    Quad_Cache quad_cache;
+    Logical quad_caching;
+    Quad_Finder quad_finder;
     CV_Scalar red;
-    CV_Point2D32F_Vector references;
+    Unsigned *remap_table;
     Fiducials_Results results;
-    CV_Point2D32F_Vector sample_points;
+    Unsigned roi_countdown;
+    Unsigned roi_full_interval;
+    Logical roi_tracking;
+    Integer *rois;
+    Unsigned rois_allocated;
+    Unsigned rois_size;
     Unsigned sequence_number;
     CV_Size size_5x5;
     CV_Size size_m1xm1;
     CV_Memory_Storage storage;
     Fiducials_Tag_Announce_Routine tag_announce_routine;
-    Logical tag_bits[64];	// FIXME: Make this Logical *tag_bits;
+    Double tag_area_minimum;
+    Double tag_diagonal_minimum;
+    Tag_Dictionary tag_dictionary;
+    Logical tag_dictionary_owned;
     CV_Image temporary_gray_image;
     CV_Term_Criteria term_criteria;
+    Unsigned threshold_bands;
+    Logical threshold_gaussian;
+    Unsigned track_countdown;
+    Unsigned track_full_interval;
+    Logical undistort_sparse;
+    Unsigned update_sequence_number;
     Unsigned weights_index;
     Logical y_flip;
 };
 
+/// @brief *Fiducials_Counters* counts the candidate tags that
+/// *Fiducials__process*() looks at and the stage of the rejection cascade
+/// that each rejected candidate dies in.  The stages are in order of cost:
+/// nested duplicate (*Quad_Finder__duplicates_remove*()), recent non-tag
+/// (a hit in *quad_cache*, counted in *cache_hits*), shape
+/// (*Fiducials__quad_shape_check*()), border probe
+/// (*Fiducials__border_probe*()), border contrast after the sub-pixel
+/// corner refinement, tag decode, and finally a second sighting of an
+/// already decoded tag in the same frame.  The frames that are searched
+/// in full, the ones where only the regions of interest are searched
+/// (see *roi_tracking*), the ones where some of those regions were
+/// predicted from the map and odometry (see *Fiducials__odometry_set*())
+/// and the ones where the tag corners are tracked instead of searched for
+/// (see *corners_tracking*) are counted as well, along with the tags that
+/// were found by tracking.
+struct Fiducials_Counters__Struct {
+    Unsigned cache_hits;
+    Unsigned cache_misses;
+    Unsigned candidates;
+    Unsigned frames_full;
+    Unsigned frames_predicted;
+    Unsigned frames_roi;
+    Unsigned frames_tracked;
+    Unsigned rejected_border;
+    Unsigned rejected_decode;
+    Unsigned rejected_duplicate;
+    Unsigned rejected_probe;
+    Unsigned rejected_shape;
+    Unsigned tags;
+    Unsigned tags_tracked;
+};
+
 struct Fiducials_Create__Struct {
     String_Const fiducials_path;
     String_Const lens_calibrate_file_name;  
+    Logical undistort_sparse;
     Memory announce_object;
     Fiducials_Arc_Announce_Routine arc_announce_routine;
     Fiducials_Location_Announce_Routine location_announce_routine;
@@ -117,6 +258,153 @@ struct Fiducials_Create__Struct {
     String_Const log_file_name;
     String_Const map_base_name;
     String_Const tag_heights_file_name;
+    Tag_Dictionary tag_dictionary;
+};
+
+/// @brief A *Fiducials_Candidate* is the outcome of running one candidate
+/// quadrilateral through the rejection cascade and the decode.  The
+/// candidates of a frame are decoded independently (possibly on several
+/// threads) and then merged in candidate order.
+struct Fiducials_Candidate__Struct {
+    /// @brief The 4 undistorted counter-clockwise corners (x0, y0, ...)
+    /// of the tag.
+    Double corners[8];
+
+    /// @brief The direction that the tag decoded in.
+    Unsigned direction_index;
+
+    /// @brief The sub-pixel corners in *gray_image* (for *corner_tracker*.)
+    Double gray_corners[8];
+
+    /// @brief The *quad_cache* key of the candidate.
+    Unsigned key;
+
+    /// @brief How far the candidate got (FIDUCIALS_CANDIDATE_*.)
+    Unsigned status;
+
+    /// @brief The id of the tag.
+    Unsigned tag_id;
+};
+
+/// @brief A *Fiducials_Decoder* is the scratch space that one thread of
+/// *Fiducials__candidates_decode*() decodes candidates with.  Everything
+/// else that the decode looks at is only read.
+struct Fiducials_Decoder__Struct {
+    /// @brief The corners of the current candidate.
+    CV_Point2D32F_Vector corners;
+
+    /// @brief The debug index that the frame is processed with.
+    Unsigned debug_index;
+
+    /// @brief The *Fiducials* object to decode for.
+    Fiducials fiducials;
+
+    /// @brief The 8 reference points around the tag border.
+    CV_Point2D32F_Vector references;
+
+    /// @brief The 64 tag bit sample points.
+    CV_Point2D32F_Vector sample_points;
+
+    /// @brief The decimation that the candidates were found at.
+    Integer scale;
+
+    /// @brief The number of the frame (for *quad_cache*.)
+    Unsigned sequence_number;
+
+    /// @brief (*Logical*)1 if the *references* and *sample_points* can be
+    /// sampled without bounds checks.
+    Logical tag_points_inside;
+
+    /// @brief The thread that the decoder runs on.
+    pthread_t thread;
+};
+
+/// @brief A *Fiducials_Frame* holds everything that belongs to one frame
+/// as it moves through the three stages of *Fiducials__process*():
+/// *Fiducials__frame_preprocess*() fills in the gray scale and edge images
+/// and decides what kind of pass the frame gets,
+/// *Fiducials__frame_detect*() finds and decodes the tags, and
+/// *Fiducials__frame_update*() feeds the tags to the map.  Since a frame
+/// has its own images and tags, different frames can be in different
+/// stages at the same time (see *Fiducials_Pipeline*.)
+struct Fiducials_Frame__Struct {
+    /// @brief The edge image that the contours are found in.
+    CV_Image contour_edge_image;
+
+    /// @brief The gray scale image that goes with *contour_edge_image*.
+    CV_Image contour_gray_image;
+
+    /// @brief The 4 corners of the current tag.
+    CV_Point2D32F_Vector corners;
+
+    /// @brief The debug image to draw into (or 0 to draw none; not owned.)
+    CV_Image debug_image;
+
+    /// @brief The debug index to process the frame with.
+    Unsigned debug_index;
+
+    /// @brief The edge (thresholded) image.
+    CV_Image edge_image;
+
+    /// @brief The gray scale image.
+    CV_Image gray_image;
+
+    /// @brief The odometry bearing from *Fiducials__odometry_set*().
+    Double odometry_etw;
+
+    /// @brief The odometry X coordinate.
+    Double odometry_ex;
+
+    /// @brief The odometry Y coordinate.
+    Double odometry_ey;
+
+    /// @brief (*Logical*)1 if the odometry was set for the frame.
+    Logical odometry_valid;
+
+    /// @brief The original image (owned by the caller.)
+    CV_Image original_image;
+
+    /// @brief The decimated edge image (or 0 if none was needed yet.)
+    CV_Image pyramid_edge_image;
+
+    /// @brief The decimated gray scale image.
+    CV_Image pyramid_gray_image;
+
+    /// @brief The decimation of *contour_edge_image* (1 for none.)
+    Unsigned pyramid_scale;
+
+    /// @brief (*Logical*)1 if only the regions of interest are searched.
+    Logical roi_pass;
+
+    /// @brief The number of regions of interest predicted from the map.
+    Unsigned roi_predicted_size;
+
+    /// @brief The number of regions of interest around tracked tags.
+    Unsigned roi_tracked_size;
+
+    /// @brief The number of the frame.
+    Unsigned sequence_number;
+
+    /// @brief The 8 corner coordinates (x0, y0, ..., x3, y3) of each tag.
+    Double *tag_corners;
+
+    /// @brief The decode direction of each tag.
+    Unsigned *tag_directions;
+
+    /// @brief The id of each tag.
+    Unsigned *tag_ids;
+
+    /// @brief The number of tags that the tag arrays have room for.
+    Unsigned tags_allocated;
+
+    /// @brief The number of tags found in the frame.
+    Unsigned tags_size;
+
+    /// @brief (*Logical*)1 if the tag corners are tracked instead.
+    Logical track_pass;
+
+    /// @brief The number of tags that the corner tracker is following.
+    Unsigned track_tracked_size;
 };
 
 struct Fiducials_Results__Struct {
@@ -128,31 +416,76 @@ extern void Fiducials__arc_announce(void *announce_object,
   Integer from_id, Double from_x, Double from_y, Double from_z,
   Integer to_id, Double to_x, Double to_y, Double to_z,
   Double goodness, Logical in_spanning_tree);
+extern Logical Fiducials__border_probe(
+  Fiducials fiducials, CV_Point2D32F_Vector corners);
+extern Camera_Tag Fiducials__camera_tag_add(Fiducials fiducials,
+  Unsigned tag_id, Unsigned direction_index, CV_Point2D32F_Vector corners);
+extern Camera_Tag Fiducials__camera_tag_find(
+  List /* <Camera_Tag> */ camera_tags, Unsigned tag_id);
+extern void Fiducials__candidates_decode(Fiducials fiducials,
+  Unsigned debug_index, Integer scale, Unsigned sequence_number);
+extern void Fiducials__counters_reset(Fiducials fiducials);
 extern Fiducials Fiducials__create(
   CV_Image original_image, Fiducials_Create fiducials_create);
+extern void Fiducials__frame_detect(
+  Fiducials fiducials, Fiducials_Frame frame);
+extern void Fiducials__frame_preprocess(
+  Fiducials fiducials, Fiducials_Frame frame);
+extern Fiducials_Results Fiducials__frame_update(
+  Fiducials fiducials, Fiducials_Frame frame);
 extern void Fiducials__free(Fiducials fiduicals);
+extern void Fiducials__homography_compute(
+  CV_Point2D32F_Vector corners, Double *homography);
 extern void Fiducials__image_set(Fiducials fiducials, CV_Image image);
 extern void Fiducials__image_show(Fiducials fiducials, Logical show);
 extern void Fiducials__location_announce(void *object, Integer id,
   Double x, Double y, Double z, Double bearing);
+extern void Fiducials__odometry_set(
+  Fiducials fiducials, Double ex, Double ey, Double etw);
 extern Integer Fiducials__point_sample(
   Fiducials fiducials, CV_Point2D32F point);
-extern Integer Fiducials__points_maximum(Fiducials fiducials,
-  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index);
-extern Integer Fiducials__points_minimum(Fiducials fiducials,
-  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index);
 extern Fiducials_Results Fiducials__process(Fiducials fiducials);
-extern CV_Point2D32F_Vector Fiducials__references_compute(
-  Fiducials fiducials, CV_Point2D32F_Vector corners);
-extern void Fiducials__sample_points_compute(
-  CV_Point2D32F_Vector corners, CV_Point2D32F_Vector sample_points);
+extern Unsigned Fiducials__pyramid_scale_select(
+  Fiducials fiducials, Unsigned debug_index);
+extern Logical Fiducials__quad_shape_check(CV_Point2D32F_Vector corners);
+extern void Fiducials__roi_append(
+  Fiducials fiducials, Double *quad, Integer scale);
+extern void Fiducials__rois_merge(Fiducials fiducials);
+extern const Integer *Fiducials__sample_weights(Fiducials fiducials);
 extern void Fiducials__sample_points_helper(
   String_Const label, CV_Point2D32F corner, CV_Point2D32F sample_point);
+extern Double Fiducials__tag_diagonal_minimum(Map map, Double *lens);
 extern void Fiducials__tag_announce(void *announce_object,
   Integer id, Double x, Double y, Double z, Double twist,
   Double diagonal, Double distance_per_pixel,
   Logical visible, Integer hop_count);
-extern Fiducials_Create Fiducials_Create__one_and_only(void);
+extern Logical Fiducials__tag_project(Fiducials fiducials, Tag tag,
+  Double rx, Double ry, Double rtw, Double *image_x, Double *image_y);
+extern Unsigned Fiducials__tags_predict(Fiducials fiducials);
+extern Unsigned Fiducials__tags_track(
+  Fiducials fiducials, Fiducials_Frame frame);
+extern Fiducials_Create Fiducials_Create__create(void);
+extern void Fiducials_Create__free(Fiducials_Create fiducials_create);
+extern void Fiducials_Decoder__candidate_decode(
+  Fiducials_Decoder decoder, Unsigned candidate_index);
+extern Fiducials_Decoder Fiducials_Decoder__create(Fiducials fiducials);
+extern void Fiducials_Decoder__free(Fiducials_Decoder decoder);
+extern Integer Fiducials_Decoder__points_maximum(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index);
+extern Integer Fiducials_Decoder__points_minimum(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index);
+extern void Fiducials_Decoder__points_sample(Fiducials_Decoder decoder,
+  CV_Point2D32F_Vector points, Unsigned start_index, Unsigned end_index,
+  Integer *values);
+extern void *Fiducials_Decoder__process(void *decoder_pointer);
+extern void Fiducials_Decoder__tag_points_compute(
+  Fiducials_Decoder decoder, CV_Point2D32F_Vector corners);
+extern Fiducials_Frame Fiducials_Frame__create(CV_Size image_size);
+extern void Fiducials_Frame__free(Fiducials_Frame frame);
+extern void Fiducials_Frame__tag_append(Fiducials_Frame frame,
+  Unsigned tag_id, Unsigned direction_index, CV_Point2D32F_Vector corners);
+extern Logical Fiducials_Frame__tag_find(
+  Fiducials_Frame frame, Unsigned tag_id);
 
 #ifdef __cplusplus
 }
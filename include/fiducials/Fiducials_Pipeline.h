@@ -0,0 +1,112 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#if !defined(FIDUCIALS_PIPELINE_H_INCLUDED)
+#define FIDUCIALS_PIPELINE_H_INCLUDED 1
+
+/// @brief *Fiducials_Pipeline* is a pointer to a
+/// *Fiducials_Pipeline__Struct* object.
+typedef struct Fiducials_Pipeline__Struct *Fiducials_Pipeline;
+
+/// @brief *Fiducials_Queue* is a pointer to a *Fiducials_Queue__Struct*
+/// object.
+typedef struct Fiducials_Queue__Struct *Fiducials_Queue;
+
+/// @brief The number of frames that can be in a *Fiducials_Pipeline* at
+/// once (one per stage plus one being filled in by the caller.)
+#define FIDUCIALS_PIPELINE_FRAMES 4
+
+#include <pthread.h>
+
+#include "CV.h"
+#include "Fiducials.h"
+#include "Unsigned.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// @brief A *Fiducials_Queue* is a bounded first in first out queue of
+/// *Fiducials_Frame*'s that hands the frames from one stage thread of a
+/// *Fiducials_Pipeline* to the next.  A null frame tells the stage
+/// threads to exit.
+struct Fiducials_Queue__Struct {
+    /// @brief Signaled whenever a frame is pushed.
+    pthread_cond_t condition;
+
+    /// @brief The ring of queued frames (plus room for the null frame.)
+    Fiducials_Frame frames[FIDUCIALS_PIPELINE_FRAMES + 1];
+
+    /// @brief The index in *frames* of the oldest frame.
+    Unsigned head;
+
+    /// @brief Protects everything in the queue.
+    pthread_mutex_t mutex;
+
+    /// @brief The number of queued frames.
+    Unsigned size;
+};
+
+/// @brief A *Fiducials_Pipeline* runs the three stages of
+/// *Fiducials__process*() on three threads, so that the next frame is
+/// preprocessed while the current frame is searched for tags and the
+/// previous frame updates the map.  Each frame has its own images, so
+/// the stages never share one.  The one debug image of *Fiducials* would
+/// be shared, so the frames are processed without any.  Since every stage
+/// handles the frames in the order that they were pushed, the tags and
+/// locations are announced in frame order (on the update thread), and
+/// the announce routines can read *update_sequence_number* to tell which
+/// pushed frame they are called for.  The frame to frame shortcuts
+/// (*quad_caching*, *roi_tracking*, *corners_tracking* and the odometry
+/// predictions) need the results of the previous frame before the next
+/// one is preprocessed, so they are turned off.
+struct Fiducials_Pipeline__Struct {
+    /// @brief The queue of preprocessed frames to search for tags.
+    Fiducials_Queue detect_queue;
+
+    /// @brief The thread that runs *Fiducials__frame_detect*().
+    pthread_t detect_thread;
+
+    /// @brief The *Fiducials* object that the frames are processed with.
+    Fiducials fiducials;
+
+    /// @brief All of the frames.
+    Fiducials_Frame frames[FIDUCIALS_PIPELINE_FRAMES];
+
+    /// @brief The queue of frames that are ready to be pushed.
+    Fiducials_Queue free_queue;
+
+    /// @brief The queue of pushed frames to preprocess.
+    Fiducials_Queue preprocess_queue;
+
+    /// @brief The thread that runs *Fiducials__frame_preprocess*().
+    pthread_t preprocess_thread;
+
+    /// @brief The queue of searched frames to update the map with.
+    Fiducials_Queue update_queue;
+
+    /// @brief The thread that runs *Fiducials__frame_update*().
+    pthread_t update_thread;
+};
+
+// *Fiducials_Pipeline* routines:
+
+extern Fiducials_Pipeline Fiducials_Pipeline__create(Fiducials fiducials);
+extern void *Fiducials_Pipeline__detect_thread(void *pipeline_pointer);
+extern void Fiducials_Pipeline__flush(Fiducials_Pipeline pipeline);
+extern void Fiducials_Pipeline__free(Fiducials_Pipeline pipeline);
+extern void *Fiducials_Pipeline__preprocess_thread(void *pipeline_pointer);
+extern void Fiducials_Pipeline__push(
+  Fiducials_Pipeline pipeline, CV_Image image);
+extern void *Fiducials_Pipeline__update_thread(void *pipeline_pointer);
+
+// *Fiducials_Queue* routines:
+
+extern Fiducials_Queue Fiducials_Queue__create(void);
+extern void Fiducials_Queue__free(Fiducials_Queue queue);
+extern Fiducials_Frame Fiducials_Queue__pop(Fiducials_Queue queue);
+extern void Fiducials_Queue__push(
+  Fiducials_Queue queue, Fiducials_Frame frame);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined(FIDUCIALS_PIPELINE_H_INCLUDED)
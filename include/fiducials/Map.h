@@ -3,6 +3,9 @@
 #if !defined(MAP_H_INCLUDED)
 #define MAP_H_INCLUDED 1
 
+#include <pthread.h>
+#include <time.h>
+
 #include "File.h"
 #include "List.h"
 #include "Location.h"
@@ -12,6 +15,46 @@
 /// @brief *Map* is the representation of a fiducial marker map.
 typedef struct Map__Struct *Map;
 
+/// @brief *Map_Journal_Header* is the header of a map journal file.
+typedef struct Map_Journal_Header__Struct *Map_Journal_Header;
+
+/// @brief *Map_Journal_Record* precedes each record in a map journal file.
+typedef struct Map_Journal_Record__Struct *Map_Journal_Record;
+
+/// @brief *Map_Pending* is one entry of the pending *Arc* heap.
+typedef struct Map_Pending__Struct *Map_Pending;
+
+/// @brief *Map_Snapshot* is a copy of a *Map* that is waiting to be saved.
+typedef struct Map_Snapshot__Struct *Map_Snapshot;
+
+/// @brief *Map_Binary_Arc* is one *Arc* record in a binary map file.
+typedef struct Map_Binary_Arc__Struct *Map_Binary_Arc;
+
+/// @brief *Map_Binary_Header* is the header of a binary map file.
+typedef struct Map_Binary_Header__Struct *Map_Binary_Header;
+
+/// @brief *Map_Binary_Tag* is one *Tag* record in a binary map file.
+typedef struct Map_Binary_Tag__Struct *Map_Binary_Tag;
+
+/// @brief Identifies a binary map file ("FMAP" in little endian order).
+#define MAP_BINARY_MAGIC 0x50414d46
+
+/// @brief Binary map file format version.
+#define MAP_BINARY_VERSION 2
+
+/// @brief Journal record kind for an *Arc* that was created, improved,
+/// or moved into or out of the spanning tree.
+#define MAP_JOURNAL_ARC 2
+
+/// @brief Identifies a map journal file ("FJNL" in little endian order).
+#define MAP_JOURNAL_MAGIC 0x4c4e4a46
+
+/// @brief Journal record kind for a *Tag* that was created.
+#define MAP_JOURNAL_TAG 1
+
+/// @brief Map journal file format version.
+#define MAP_JOURNAL_VERSION 2
+
 #include "Arc.h"
 #include "Tag.h"
 #include "Camera_Tag.h"
@@ -38,10 +81,13 @@ struct Map__Struct {
     /// @brief An lookup *Arc* table.
     Table /* <Arc, Arc> */ arcs_table;
 
+    /// @brief *Arc*'s that have changed since the last spanning tree update.
+    List /* <Arc> */ changed_arcs;
+
     /// @brief Number of map changes:
     Unsigned changes_count;
 
-    /// @brief Base name of map file name.
+    /// @brief Base name of map file name (null if there is no map file).
     String_Const file_base;
 
     /// @brief Directory/folder of map file.
@@ -50,14 +96,83 @@ struct Map__Struct {
     /// @brief True if images that change map need to be recorded.
     Logical image_log;
 
+    /// @brief Sequence number of the last image logged by *Map__image_log*().
+    Unsigned image_log_sequence_number;
+
+    /// @brief *Arc*'s that have changed since the last journal batch.
+    List /* <Arc> */ journal_arcs;
+
+    /// @brief Number of records in the journal since the last snapshot.
+    Unsigned journal_size;
+
+    /// @brief *Tag*'s that were created since the last journal batch.
+    List /* <Tag> */ journal_tags;
+
     /// @brief True if map has changed since last update.
     Logical is_changed;
 
     /// @brief True if changed map has been saved.
     Logical is_saved;
 
-    /// @brief List of pending *Arc*'s for map tree extraction.
-    List /* <Arc> */ pending_arcs;
+    /// @brief Binary heap of pending *Arc*'s for map tree extraction.
+    Map_Pending pending_heap;
+
+    /// @brief Number of entries allocated for *pending_heap*.
+    Unsigned pending_heap_limit;
+
+    /// @brief Number of entries currently in *pending_heap*.
+    Unsigned pending_heap_size;
+
+    /// @brief Push counter used to break ties in *pending_heap*.
+    Unsigned pending_order;
+
+    /// @brief Scratch list of *Tag*'s used for spanning tree repair.
+    List /* <Tag> */ repair_tags;
+
+    /// @brief True while the save thread is writing a *Map_Snapshot*.
+    Logical save_busy;
+
+    /// @brief *changes_count* when the last *Map_Snapshot* was taken.
+    Unsigned save_changes_count;
+
+    /// @brief Save once this many changes have accumulated.
+    Unsigned save_changes_size;
+
+    /// @brief Signalled when *save_snapshot*, *save_journal_snapshot*,
+    /// or *save_busy* changes.
+    pthread_cond_t save_condition;
+
+    /// @brief True when the save thread should exit.
+    Logical save_exit;
+
+    /// @brief True if the save thread failed to write something out.
+    Logical save_failed;
+
+    /// @brief Save once this many seconds have gone by since the last save.
+    Unsigned save_interval;
+
+    /// @brief True if changes are appended to the map journal.
+    Logical save_journal;
+
+    /// @brief The next journal batch for the save thread to append.
+    Map_Snapshot save_journal_snapshot;
+
+    /// @brief Protects *save_busy*, *save_exit*, *save_failed*,
+    /// *save_journal_snapshot*, and *save_snapshot*.
+    pthread_mutex_t save_mutex;
+
+    /// @brief The next *Map_Snapshot* for the save thread to write.
+    Map_Snapshot save_snapshot;
+
+    /// @brief The background thread that writes the map file.
+    pthread_t save_thread;
+
+    /// @brief The time when the last *Map_Snapshot* was taken.
+    time_t save_time;
+
+    /// @brief Generation of the newest map files.  The map journal is only
+    /// replayed over map files of the same generation.
+    Unsigned snapshot_generation;
 
     /// @brief Routine that is called each time a tag is changed.
     Fiducials_Tag_Announce_Routine tag_announce_routine;
@@ -71,15 +186,189 @@ struct Map__Struct {
     /// @brief a te
     Arc temporary_arc;
 
+    /// @brief True if the spanning tree is repaired instead of rebuilt.
+    Logical tree_incremental;
+
+    /// @brief True if the spanning tree must be fully rebuilt.
+    Logical tree_rebuild;
+
     /// @brief Increment *visit* each time a map update is propogated.
     Unsigned visit;
 };
 
+/// @brief A *Map_Journal_Header__Struct* is the header at the front of a
+/// map journal file.  It is followed by any number of records, each of
+/// which is a *Map_Journal_Record* followed by a *Map_Binary_Tag* or a
+/// *Map_Binary_Arc*.  Records hold the complete state of their *Tag* or
+/// *Arc*, so replaying one more than once does no harm.  Replaying them
+/// over newer map files does harm, so the journal is skipped unless its
+/// *snapshot_generation* matches that of the map files.
+struct Map_Journal_Header__Struct {
+    /// @brief Always *MAP_JOURNAL_MAGIC*.
+    Unsigned magic;
+
+    /// @brief Always *MAP_JOURNAL_VERSION*.
+    Unsigned version;
+
+    /// @brief Size of one *Map_Binary_Tag* record in bytes.
+    Unsigned tag_size;
+
+    /// @brief Size of one *Map_Binary_Arc* record in bytes.
+    Unsigned arc_size;
+
+    /// @brief Generation of the map files that the records follow.
+    Unsigned snapshot_generation;
+
+    /// @brief Unused; keeps the records 8 byte aligned.
+    Unsigned reserved;
+};
+
+/// @brief A *Map_Journal_Record__Struct* precedes each map journal record.
+struct Map_Journal_Record__Struct {
+    /// @brief Either *MAP_JOURNAL_TAG* or *MAP_JOURNAL_ARC*.
+    Unsigned kind;
+
+    /// @brief The number of bytes of record that follow.
+    Unsigned size;
+};
+
+/// @brief A *Map_Pending__Struct* is one entry of the pending *Arc* heap.
+///
+/// The sort key is captured when the *Arc* is pushed so that the heap
+/// stays valid while *Tag* hop counts change underneath it.
+struct Map_Pending__Struct {
+    /// @brief The pending *Arc*.
+    Arc arc;
+
+    /// @brief The *Arc* distance when it was pushed.
+    Double distance;
+
+    /// @brief The lowest *Tag* hop count when it was pushed.
+    Unsigned hop_count;
+
+    /// @brief Push order; later pushes win ties.
+    Unsigned order;
+};
+
+/// @brief A *Map_Binary_Arc__Struct* is one fixed size *Arc* record
+/// in a binary map file.  Twists are in radians.
+struct Map_Binary_Arc__Struct {
+    /// @brief The from *Tag* id.
+    Unsigned from_tag_id;
+
+    /// @brief The to *Tag* id.
+    Unsigned to_tag_id;
+
+    /// @brief 1 if the *Arc* is in the spanning tree and 0 otherwise.
+    Unsigned in_tree;
+
+    /// @brief Unused; keeps the *Double*'s 8 byte aligned.
+    Unsigned reserved;
+
+    /// @brief The *Arc* from twist.
+    Double from_twist;
+
+    /// @brief The *Arc* distance.
+    Double distance;
+
+    /// @brief The *Arc* to twist.
+    Double to_twist;
+
+    /// @brief The *Arc* goodness.
+    Double goodness;
+};
+
+/// @brief A *Map_Binary_Header__Struct* is the header at the front of a
+/// binary map file.  It is followed by *tags_size* *Map_Binary_Tag*
+/// records and then *arcs_size* *Map_Binary_Arc* records.  All values
+/// are in native (little endian) byte order.
+struct Map_Binary_Header__Struct {
+    /// @brief Always *MAP_BINARY_MAGIC*.
+    Unsigned magic;
+
+    /// @brief Always *MAP_BINARY_VERSION*.
+    Unsigned version;
+
+    /// @brief Size of this header in bytes.
+    Unsigned header_size;
+
+    /// @brief Number of *Map_Binary_Tag* records.
+    Unsigned tags_size;
+
+    /// @brief Size of one *Map_Binary_Tag* record in bytes.
+    Unsigned tag_size;
+
+    /// @brief Number of *Map_Binary_Arc* records.
+    Unsigned arcs_size;
+
+    /// @brief Size of one *Map_Binary_Arc* record in bytes.
+    Unsigned arc_size;
+
+    /// @brief Generation of this map file (see *Map_Journal_Header*).
+    Unsigned snapshot_generation;
+};
+
+/// @brief A *Map_Binary_Tag__Struct* is one fixed size *Tag* record in
+/// a binary map file.  Twist is in radians.
+struct Map_Binary_Tag__Struct {
+    /// @brief The *Tag* id.
+    Unsigned id;
+
+    /// @brief The *Tag* hop count.
+    Unsigned hop_count;
+
+    /// @brief The *Tag* diagonal in pixels.
+    Double diagonal;
+
+    /// @brief The *Tag* twist.
+    Double twist;
+
+    /// @brief The *Tag* X coordinate.
+    Double x;
+
+    /// @brief The *Tag* Y coordinate.
+    Double y;
+};
+
+/// @brief A *Map_Snapshot__Struct* is a consistent copy of the *Tag*'s and
+/// *Arc*'s of a *Map* that the save thread writes out.
+struct Map_Snapshot__Struct {
+    /// @brief Copies of all of the *Arc*'s.
+    struct Arc__Struct *arcs;
+
+    /// @brief Number of *Arc*'s in *arcs*.
+    Unsigned arcs_size;
+
+    /// @brief The map file name to write to without the .xml/.bin suffix.
+    String file_name;
+
+    /// @brief Generation of the map files (see *Map_Journal_Header*).
+    Unsigned snapshot_generation;
+
+    /// @brief Copies of all of the *Tag*'s.
+    struct Tag__Struct *tags;
+
+    /// @brief Number of *Tag*'s in *tags*.
+    Unsigned tags_size;
+};
+
 // *Map* routines:
 
 extern void Map__arc_announce(
   Map map, Arc arc, CV_Image image, Unsigned sequence_number);
 extern void Map__arc_append(Map map, Arc arc);
+extern void Map__arc_changed(Map map, Arc arc);
+extern void Map__arc_in_tree_set(Map map, Arc arc, Logical in_tree);
+extern Arc Map__binary_arc_restore(
+  Map map, Map_Binary_Arc binary_arc, Logical force);
+extern Integer Map__binary_key_compare(const void *key1, const void *key2);
+extern Logical Map__binary_read(Map map, String_Const file_name);
+extern Logical Map__binary_records_check(Map map,
+  Map_Binary_Tag binary_tags, Unsigned tags_size,
+  Map_Binary_Arc binary_arcs, Unsigned arcs_size);
+extern Logical Map__binary_restore(Map map, Memory memory, Unsigned size);
+extern Tag Map__binary_tag_restore(Map map, Map_Binary_Tag binary_tag);
+extern Logical Map__binary_write(Map map, File out_file);
 extern Arc Map__arc_lookup(Map map, Tag from, Tag to);
 extern Unsigned Map__arc_update(Map map, Camera_Tag camera_from,
   Camera_Tag camera_to, CV_Image image, Unsigned sequence_number);
@@ -88,12 +377,32 @@ extern Map Map__create(String_Const map_path, String_Const map_base,
   void *announce_object, Fiducials_Arc_Announce_Routine arc_announce_routine,
   Fiducials_Tag_Announce_Routine tag_announce_routine,
   String_Const tag_heights_file_name, String from);
+extern Logical Map__files_restore(Map map, String_Const generation);
 extern void Map__free(Map map);
+extern Unsigned Map__journal_restore(Map map, String_Const file_name);
 extern Tag_Height Map__tag_height_lookup(Map map, Unsigned id);
 extern void Map__image_log(Map map, CV_Image image, Unsigned sequence_number);
+extern Arc Map__pending_pop(Map map);
+extern void Map__pending_push(Map map, Arc arc);
 extern void Map__restore(Map map, File in_file);
 extern void Map__save(Map map);
+extern void Map__save_flush(Map map);
+extern void Map__save_journal_queue(Map map);
+extern void Map__save_queue(Map map);
+extern void Map__save_request(Map map);
+extern void Map__save_snapshot_queue(Map map);
+extern void *Map__save_thread(void *map);
 extern void Map__sort(Map map);
+extern void Map__spanning_tree_build(
+  Map map, CV_Image image, Unsigned sequence_number);
+extern void Map__spanning_tree_propagate(Map map,
+  Tag tag, Unsigned visit, CV_Image image, Unsigned sequence_number);
+extern void Map__spanning_tree_repair(
+  Map map, Arc arc, CV_Image image, Unsigned sequence_number);
+extern Unsigned Map__spanning_tree_reroot(
+  Map map, Tag tag, Arc arc, Tag last_tag);
+extern void Map__spanning_tree_update(
+  Map map, CV_Image image, Unsigned sequence_number);
 extern void Map__svg_write(
   Map map, const String svg_base_name, List /*<Location>*/ locations);
 extern void Map__tag_heights_xml_read(
@@ -104,6 +413,33 @@ extern Tag Map__tag_lookup(Map map, Unsigned tag_id);
 extern void Map__update(Map map, CV_Image image, Unsigned sequence_number);
 extern void Map__write(Map map, File out_file);
 
+// *Map_Binary_Arc* routines:
+
+extern void Map_Binary_Arc__initialize(Map_Binary_Arc binary_arc, Arc arc);
+
+// *Map_Binary_Tag* routines:
+
+extern void Map_Binary_Tag__initialize(Map_Binary_Tag binary_tag, Tag tag);
+
+// *Map_Pending* routines:
+
+extern Integer Map_Pending__compare(
+  Map_Pending map_pending1, Map_Pending map_pending2);
+
+// *Map_Snapshot* routines:
+
+extern Map_Snapshot Map_Snapshot__create(Map map, String file_name);
+extern Logical Map_Snapshot__binary_write(
+  Map_Snapshot map_snapshot, File out_file);
+extern void Map_Snapshot__free(Map_Snapshot map_snapshot);
+extern Logical Map_Snapshot__journal_append(Map_Snapshot map_snapshot);
+extern Map_Snapshot Map_Snapshot__journal_create(Map map, String file_name);
+extern Logical Map_Snapshot__journal_reset(Map_Snapshot map_snapshot);
+extern void Map_Snapshot__merge(
+  Map_Snapshot map_snapshot, Map_Snapshot other_snapshot);
+extern Logical Map_Snapshot__save(Map_Snapshot map_snapshot);
+extern void Map_Snapshot__write(Map_Snapshot map_snapshot, File out_file);
+
 #ifdef __cplusplus
 }
 #endif
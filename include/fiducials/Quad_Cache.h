@@ -0,0 +1,75 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#if !defined(QUAD_CACHE_H_INCLUDED)
+#define QUAD_CACHE_H_INCLUDED 1
+
+/// @brief *Quad_Cache* is a pointer to a *Quad_Cache__Struct* object.
+typedef struct Quad_Cache__Struct *Quad_Cache;
+
+/// @brief Number of frames that a *Quad_Cache* entry is remembered for.
+#define QUAD_CACHE_FRAMES 4
+
+/// @brief Size in pixels that candidate centers and diagonals are
+/// quantized to for *Quad_Cache__key*().
+#define QUAD_CACHE_QUANTUM 4.0
+
+/// @brief Number of bits in a *Quad_Cache* slot index.
+#define QUAD_CACHE_SLOTS_BITS 7
+
+/// @brief Number of slots in a *Quad_Cache*.
+#define QUAD_CACHE_SLOTS (1 << QUAD_CACHE_SLOTS_BITS)
+
+#include "CV.h"
+#include "Double.h"
+#include "Logical.h"
+#include "Unsigned.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// @brief A *Quad_Cache* remembers the candidate quadrilaterals that
+/// recently failed to decode as tags (e.g. light panels, vents and tile
+/// corners), so that they can be skipped for the next few frames.  It is
+/// a fixed size direct mapped table indexed by the quantized candidate
+/// geometry; a newer failure simply replaces whatever was in its slot.
+/// Since the keys are image positions, the whole table is cleared
+/// whenever the camera moves.
+struct Quad_Cache__Struct {
+    /// @brief The frame number after which each slot is stale (0 is empty.)
+    Unsigned expires[QUAD_CACHE_SLOTS];
+
+    /// @brief The key stored in each slot.
+    Unsigned keys[QUAD_CACHE_SLOTS];
+
+    /// @brief Bearing of the previous location in radians.
+    Double last_bearing;
+
+    /// @brief (*Logical*)1 if the previous frame had a location.
+    Logical last_located;
+
+    /// @brief X coordinate of the previous location.
+    Double last_x;
+
+    /// @brief Y coordinate of the previous location.
+    Double last_y;
+};
+
+// *Quad_Cache* routines:
+
+extern void Quad_Cache__clear(Quad_Cache quad_cache);
+extern Quad_Cache Quad_Cache__create(void);
+extern void Quad_Cache__free(Quad_Cache quad_cache);
+extern void Quad_Cache__insert(
+  Quad_Cache quad_cache, Unsigned key, Unsigned frame);
+extern Unsigned Quad_Cache__key(CV_Point2D32F_Vector corners);
+extern Logical Quad_Cache__lookup(
+  Quad_Cache quad_cache, Unsigned key, Unsigned frame);
+extern void Quad_Cache__motion_update(Quad_Cache quad_cache,
+  Logical located, Double x, Double y, Double bearing,
+  Double distance_per_pixel, Double radius);
+extern Unsigned Quad_Cache__slot(Unsigned key);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined(QUAD_CACHE_H_INCLUDED)
@@ -0,0 +1,196 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#if !defined(QUAD_FINDER_H_INCLUDED)
+#define QUAD_FINDER_H_INCLUDED 1
+
+/// @brief *Quad_Finder* is a pointer to a *Quad_Finder__Struct* object.
+typedef struct Quad_Finder__Struct *Quad_Finder;
+
+/// @brief *Quad_Finder_Band* is a pointer to a *Quad_Finder_Band__Struct*
+/// object.
+typedef struct Quad_Finder_Band__Struct *Quad_Finder_Band;
+
+/// @brief *Quad_Finder_Component* is a pointer to a
+/// *Quad_Finder_Component__Struct* object.
+typedef struct Quad_Finder_Component__Struct *Quad_Finder_Component;
+
+/// @brief *Quad_Finder_Run* is a pointer to a *Quad_Finder_Run__Struct*
+/// object.
+typedef struct Quad_Finder_Run__Struct *Quad_Finder_Run;
+
+/// @brief The most row bands *Quad_Finder__runs_banded_find*() will use.
+#define QUAD_FINDER_BANDS_MAXIMUM 16
+
+/// @brief Marks the end of a *Quad_Finder_Run* list.
+#define QUAD_FINDER_RUN_NONE 0xffffffff
+
+#include <pthread.h>
+
+#include "CV.h"
+#include "Double.h"
+#include "Integer.h"
+#include "Logical.h"
+#include "Unsigned.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// @brief A *Quad_Finder_Band* is a horizontal band of rows that
+/// *Quad_Finder__runs_banded_find*() run length encodes on its own thread.
+struct Quad_Finder_Band__Struct {
+    /// @brief Number of rows in the band.
+    Integer height;
+
+    /// @brief 8-bit thresholded image to encode.
+    CV_Image image;
+
+    /// @brief Left column of the band.
+    Integer left;
+
+    /// @brief *Quad_Finder* that the runs of the band are stored in.
+    Quad_Finder quad_finder;
+
+    /// @brief Thread that processes the band.
+    pthread_t thread;
+
+    /// @brief Top row of the band.
+    Integer top;
+
+    /// @brief Number of columns in the band.
+    Integer width;
+};
+
+/// @brief A *Quad_Finder_Component* is one 4-connected set of black
+/// pixels in a thresholded image.
+struct Quad_Finder_Component__Struct {
+    /// @brief Index of the first *Quad_Finder_Run* in the component.
+    Unsigned first_run;
+
+    /// @brief Index of the last *Quad_Finder_Run* in the component.
+    Unsigned last_run;
+
+    /// @brief Largest X coordinate of any pixel in the component.
+    Integer maximum_x;
+
+    /// @brief Largest Y coordinate of any pixel in the component.
+    Integer maximum_y;
+
+    /// @brief Smallest X coordinate of any pixel in the component.
+    Integer minimum_x;
+
+    /// @brief Smallest Y coordinate of any pixel in the component.
+    Integer minimum_y;
+
+    /// @brief Number of pixels in the component.
+    Unsigned pixels;
+
+    /// @brief Sum of the X coordinates of all of the pixels.
+    Double sum_x;
+
+    /// @brief Sum of the Y coordinates of all of the pixels.
+    Double sum_y;
+};
+
+/// @brief A *Quad_Finder_Run* is a horizontal run of black pixels.
+struct Quad_Finder_Run__Struct {
+    /// @brief Index of the *Quad_Finder_Component* the run belongs to.
+    Unsigned component;
+
+    /// @brief X coordinate of the last pixel in the run.
+    Integer end_x;
+
+    /// @brief Index of the next run in the same component, or
+    /// *QUAD_FINDER_RUN_NONE*.
+    Unsigned next;
+
+    /// @brief Index of the parent run for union-find (always a run with a
+    /// smaller index, or the run itself for a root.)
+    Unsigned parent;
+
+    /// @brief X coordinate of the first pixel in the run.
+    Integer start_x;
+
+    /// @brief Y coordinate of the run.
+    Integer y;
+};
+
+/// @brief A *Quad_Finder* finds the dark convex quadrilaterals (i.e.
+/// candidate tags) in a thresholded image by labeling run length encoded
+/// connected components.  All of its arrays are reused from one image to
+/// the next, so once they have grown large enough no more memory is
+/// allocated.
+struct Quad_Finder__Struct {
+    /// @brief The row bands for *Quad_Finder__runs_banded_find*().  The
+    /// *quad_finder* of each band (other than the first, which uses this
+    /// *Quad_Finder*) is created the first time it is needed.
+    struct Quad_Finder_Band__Struct bands[QUAD_FINDER_BANDS_MAXIMUM];
+
+    /// @brief Number of entries allocated in *components*.
+    Unsigned components_allocated;
+
+    /// @brief The connected components found in the image.
+    struct Quad_Finder_Component__Struct *components;
+
+    /// @brief Number of entries used in *components*.
+    Unsigned components_size;
+
+    /// @brief (*Logical*)1 for each quadrilateral in *quads* that is a
+    /// duplicate of a larger one (see *Quad_Finder__duplicates_remove*()).
+    Logical *duplicates;
+
+    /// @brief Number of quadrilaterals allocated in *quads*.
+    Unsigned quads_allocated;
+
+    /// @brief The corners of each quadrilateral found as 8 *Double*'s
+    /// (x0, y0, x1, y1, x2, y2, x3, y3) going around the quadrilateral.
+    Double *quads;
+
+    /// @brief Number of quadrilaterals in *quads*.
+    Unsigned quads_size;
+
+    /// @brief Number of entries allocated in *runs*.
+    Unsigned runs_allocated;
+
+    /// @brief The black runs in the image in row major order.
+    struct Quad_Finder_Run__Struct *runs;
+
+    /// @brief Number of entries used in *runs*.
+    Unsigned runs_size;
+};
+
+// *Quad_Finder* routines:
+
+extern Logical Quad_Finder__component_fit(Quad_Finder quad_finder,
+  Quad_Finder_Component component, Double area_minimum, Double *corners);
+extern void Quad_Finder__components_label(Quad_Finder quad_finder);
+extern Quad_Finder Quad_Finder__create(void);
+extern Unsigned Quad_Finder__duplicates_remove(Quad_Finder quad_finder);
+extern Unsigned Quad_Finder__find(Quad_Finder quad_finder,
+  CV_Image edge_image, Double area_minimum, Unsigned band_count);
+extern void Quad_Finder__free(Quad_Finder quad_finder);
+extern void Quad_Finder__quad_append(Quad_Finder quad_finder, Double *corners);
+extern Double Quad_Finder__quad_measure(
+  Double *quad, Double *center_x, Double *center_y);
+extern Unsigned Quad_Finder__rectangle_find(Quad_Finder quad_finder,
+  CV_Image edge_image, Double area_minimum, Integer left, Integer top,
+  Integer width, Integer height, Unsigned band_count);
+extern Unsigned Quad_Finder__root_find(
+  Quad_Finder quad_finder, Unsigned run_index);
+extern Unsigned Quad_Finder__run_merge(Quad_Finder quad_finder,
+  Unsigned run_index, Unsigned previous_index, Unsigned previous_end);
+extern void Quad_Finder__runs_append(
+  Quad_Finder quad_finder, Quad_Finder band_finder);
+extern void Quad_Finder__runs_banded_find(Quad_Finder quad_finder,
+  CV_Image image, Integer left, Integer top, Integer width, Integer height,
+  Unsigned band_count);
+extern void Quad_Finder__runs_find(Quad_Finder quad_finder, CV_Image image,
+  Integer left, Integer top, Integer width, Integer height);
+
+// *Quad_Finder_Band* routines:
+
+extern void *Quad_Finder_Band__process(void *band_pointer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined(QUAD_FINDER_H_INCLUDED)
@@ -88,6 +88,9 @@ struct Tag__Struct {
     /// @brief Parent *Map* object.
     Map map;
 
+    /// @brief Spanning tree *Arc* to the parent *Tag* (null for the origin).
+    Arc parent_arc;
+
     /// @brief The twist from the floor X axis to the tag bottom edge.
     Double twist;
 
@@ -141,7 +144,7 @@ extern void Tag__sort(Tag tag);
 extern Tag Tag__read(File in_file, Map map);
 extern void Tag__svg_write(Tag tag, SVG svg);
 extern void Tag__write(Tag tag, File out_file);
-extern void Tag__update_via_arc(
+extern Logical Tag__update_via_arc(
   Tag tag, Arc arc, CV_Image image, Unsigned sequence_number);
 
 // *Tag_Height* routines:
@@ -0,0 +1,81 @@
+// Copyright (c) 2013-2014 by Wayne C. Gramlich.  All rights reserved.
+
+#if !defined(TAG_DICTIONARY_H_INCLUDED)
+#define TAG_DICTIONARY_H_INCLUDED 1
+
+/// @brief *Tag_Dictionary* is a pointer to a *Tag_Dictionary__Struct* object.
+typedef struct Tag_Dictionary__Struct *Tag_Dictionary;
+
+/// @brief Marks an empty *Tag_Dictionary* slot.
+#define TAG_DICTIONARY_EMPTY 0xffffffff
+
+/// @brief Number of bits in a *Tag_Dictionary* slot index.
+#define TAG_DICTIONARY_SLOTS_BITS 19
+
+/// @brief Number of bits in a *Tag_Dictionary* filter bit index.
+#define TAG_DICTIONARY_FILTER_BITS (TAG_DICTIONARY_SLOTS_BITS + 1)
+
+#include <stdint.h>
+
+#include "FEC.h"
+#include "Logical.h"
+#include "Unsigned.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/// @brief *Tag_Dictionary* maps each of the 64-bit sampled bit patterns of
+/// every tag id in each of its 4 directions back to the tag id and
+/// direction.  It is an open addressed hash table with linear probing.
+///
+/// Bit *i* of a sampled bit pattern is the bit that was sampled at
+/// sample point *i* (see *Fiducials__tag_points_compute*()).
+struct Tag_Dictionary__Struct {
+    /// @brief The sampled bit pattern for each slot.
+    uint64_t *codewords;
+
+    /// @brief Tag id | (direction << 16) for each slot, or
+    /// *TAG_DICTIONARY_EMPTY*.
+    Unsigned *entries;
+
+    /// @brief The Reed-Solomon decoder used for noisy bit patterns.
+    FEC fec;
+
+    /// @brief A bit map (indexed by *Tag_Dictionary__filter_bit*()) with
+    /// a bit set for every sampled bit pattern in *codewords*.  It is
+    /// small enough to stay in cache, so most bit patterns that are not
+    /// present are rejected without probing *codewords* and *entries*.
+    uint64_t *filter;
+
+    /// @brief Number of slots in *codewords* and *entries* minus 1.
+    Unsigned slots_mask;
+};
+
+// *Tag_Dictionary* routines:
+
+extern uint64_t Tag_Dictionary__bit_swap(uint64_t word);
+extern uint64_t Tag_Dictionary__byte_swap(uint64_t word);
+extern uint64_t Tag_Dictionary__codeword(
+  Tag_Dictionary tag_dictionary, Unsigned tag_id);
+extern Tag_Dictionary Tag_Dictionary__create(FEC fec);
+extern Logical Tag_Dictionary__decode(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction);
+extern Logical Tag_Dictionary__fec_decode(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction);
+extern Unsigned Tag_Dictionary__filter_bit(uint64_t bits);
+extern void Tag_Dictionary__free(Tag_Dictionary tag_dictionary);
+extern Unsigned Tag_Dictionary__hash(uint64_t bits);
+extern void Tag_Dictionary__insert(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned tag_id, Unsigned direction);
+extern Logical Tag_Dictionary__lookup(Tag_Dictionary tag_dictionary,
+  uint64_t bits, Unsigned *tag_id, Unsigned *direction);
+extern uint64_t Tag_Dictionary__orient(uint64_t bits, Unsigned direction);
+extern uint64_t Tag_Dictionary__tag_bits(
+  Tag_Dictionary tag_dictionary, Unsigned tag_id, Unsigned direction);
+extern uint64_t Tag_Dictionary__transpose(uint64_t word);
+extern uint64_t Tag_Dictionary__unorient(uint64_t word, Unsigned direction);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined(TAG_DICTIONARY_H_INCLUDED)